@@ -0,0 +1,487 @@
+#include "base_station_core.h"
+#include "signal_processing.h"
+#include "combined_uplink.h"
+#include "instrument.h"
+#include <algorithm>
+
+BaseStation::BaseStation(const FrameLayout& layout)
+    : layout(layout), bins(layout.bins, layout.headerBins()),
+      // Every grant holds at least one bin, so the grants fit in the allocatable bins
+      grantNodes(std::make_shared<NodeArena>(NODE_ARENA_BLOCK, 2 * (layout.bins - layout.headerBins()) + 2)),
+      allocation(std::less<int>(), AllocationMap::allocator_type(grantNodes.get())),
+      modulation(std::less<int>(), ModulationMap::allocator_type(grantNodes.get())),
+      grantMod(MOD_QPSK), maxMessage(SEGMENT_MAX_MESSAGE), fec(FEC_NONE), combined(false),
+      uplinkSegment(layout.maxUsers(), 0), uplinkDest(layout.maxUsers(), 0), uplinkQuiet(layout.maxUsers(), 0),
+      publishedGrants(new std::atomic<uint64_t>[layout.maxUsers()]), collisions(0), log(nullptr), events(nullptr)
+{
+    for (int u = 0; u < layout.maxUsers(); u++)
+        publishedGrants[u].store(0, std::memory_order_relaxed);
+    // Every grant holds at least one bin
+    decodeScratch.segments.reserve(layout.bins - layout.headerBins());
+}
+
+const UplinkSegment* DecodedUplink::find(int userId) const
+{
+    std::vector<UplinkSegment>::const_iterator it = std::lower_bound(segments.begin(), segments.end(), userId,
+        [](const UplinkSegment& seg, int id) { return seg.userId < id; });
+    return it != segments.end() && it->userId == userId ? &*it : nullptr;
+}
+
+Modulation BaseStation::userModulation(int userId) const
+{
+    ModulationMap::const_iterator it = modulation.find(userId);
+    return it != modulation.end() ? it->second : MOD_QPSK;
+}
+
+Modulation BaseStation::linkModulation(int userId) const
+{
+    std::map<int, Modulation>::const_iterator it = linkMod.find(userId);
+    return it != linkMod.end() ? it->second : grantMod;
+}
+
+// To the event log if there is one, else as a line of the text log. The text
+// log flushes after failures and grants, as it always has.
+void BaseStation::note(LogEvent event, int userId, int peerId, int start, int count, uint32_t value, int modulation)
+{
+    if (events)
+	{
+        events->record(event, userId, peerId, start, count, value, modulation);
+        return;
+    }
+    if (!log) return;
+    EventRecord rec = EventRecord();
+    rec.event = (uint16_t)event;
+    rec.modulation = (uint8_t)modulation;
+    rec.userId = userId;
+    rec.peerId = peerId;
+    rec.start = start;
+    rec.count = count;
+    rec.value = value;
+    formatEvent(*log, rec);
+    if (event == EVENT_GRANT || event == EVENT_ALLOC_FAILURE || event == EVENT_UNKNOWN_CTRL || event == EVENT_UNEXPECTED_HEADER)
+        *log << std::endl;
+    else
+        *log << "\n";
+}
+
+void BaseStation::setScheduler(SchedulerPolicy policy, int grantTtis, int idleTtis)
+{
+    // Grants made so far belong to the old regime
+    while (!allocation.empty())
+        deallocateBins(allocation.begin()->first);
+    if (policy == SCHED_NONE)
+        scheduler.reset();
+    else
+        scheduler.reset(new MacScheduler(policy, layout.maxUsers(), grantTtis, idleTtis));
+}
+
+std::pair<int,int> BaseStation::allocateBins(int requested)
+{
+    INSTRUMENT_SCOPE(STAGE_ALLOC);
+    if (requested < 1) requested = 1;
+    if (requested > layout.maxGrant()) requested = layout.maxGrant();
+
+	// Falls back to fewer bins if no run of requested bins is free
+    BinExtent ext = bins.allocate(requested);
+    return std::make_pair(ext.start, ext.count);
+}
+
+void BaseStation::deallocateBins(int userId)
+{
+    AllocationMap::iterator it = allocation.find(userId);
+    if (scheduler)
+        scheduler->withdraw(userId, bins);   // also returns the bins
+    else if (it != allocation.end())
+        bins.release(it->second.first, it->second.second);
+    if (it != allocation.end())
+	{
+        allocation.erase(it);
+        modulation.erase(userId);
+        publishGrant(userId);
+    }
+    // A message in progress was segmented for the old allocation
+    std::map<int, ReassemblyBuffer>::iterator rit = rx.find(userId);
+    if (rit != rx.end()) rit->second.rx.reset();
+    if (userId >= 0 && userId < (int)uplinkSegment.size()) uplinkSegment[userId] = 0;
+}
+
+// For decodeUplink, which other threads may be running
+void BaseStation::publishGrant(int userId)
+{
+    if (userId < 0 || userId >= layout.maxUsers()) return;
+    AllocationMap::const_iterator it = allocation.find(userId);
+    uint64_t grant = 0;
+    if (it != allocation.end())
+        grant = (uint64_t)it->second.first << 32 | (uint64_t)it->second.second << 8 | (uint64_t)userModulation(userId);
+    publishedGrants[userId].store(grant, std::memory_order_release);
+}
+
+// Reads userId's payload from the bins of the grant seg holds
+void BaseStation::readSegment(const std::complex<double>* active, int userId, UplinkSegment& seg) const
+{
+    seg.userId = userId;
+    seg.empty = combined && binsEmpty(active, seg.start, seg.count, seg.modulation);
+    if (fec != FEC_NONE)
+        decodePayloadSoft(active, seg.start, seg.count, seg.modulation, seg.soft);
+    else
+        seg.payload = decodePayload(active, seg.start, seg.count, seg.modulation);
+}
+
+void BaseStation::decodeUplink(const std::complex<double>* active, DecodedUplink& decoded) const
+{
+    INSTRUMENT_START(t0);
+    decoded.segments.clear();
+    // A combined symbol has a header per control slot and a segment from
+    // anyone granted; otherwise it is one user's header and segment
+    decoded.headers = combined ? combinedControlSlots(layout) : 1;
+    for (int s = 0; s < decoded.headers; s++)
+	{
+        int first = s * layout.headerBins();
+        decoded.occupancy[s] = combined ? controlOccupancy(layout, active, first) : CONTROL_ONE;
+        decoded.msgs[s] = decoded.occupancy[s] == CONTROL_ONE ? decodeHeader(layout, active, first) : ControlMessage();
+    }
+    int firstUser = 0, endUser = layout.maxUsers();
+    if (!combined)
+	{
+        const ControlMessage& msg = decoded.msgs[0];
+        firstUser = msg.ctrl == CTRL_DATA_TX && msg.srcId >= 0 ? msg.srcId : endUser;
+        endUser = std::min(firstUser + 1, endUser);
+    }
+    for (int u = firstUser; u < endUser; u++)
+	{
+        uint64_t grant = publishedGrants[u].load(std::memory_order_acquire);
+        if (grant == 0) continue;
+        UplinkSegment seg;
+        seg.start = (int)(grant >> 32);
+        seg.count = (int)(grant >> 8 & 0xffffff);
+        seg.modulation = static_cast<Modulation>(grant & 0xff);
+        readSegment(active, u, seg);
+        decoded.segments.push_back(seg);
+    }
+    INSTRUMENT_STOP(STAGE_DECODE, t0);
+}
+
+// The segment a sender put in its current grant: the one decodeUplink read, or
+// read again if the grant changed since
+const UplinkSegment& BaseStation::segmentOf(AllocationMap::const_iterator grant, const std::complex<double>* active,
+                                            const DecodedUplink& decoded)
+{
+    int userId = grant->first;
+    Modulation mod = userModulation(userId);
+    const UplinkSegment* seg = decoded.find(userId);
+    if (seg && seg->start == grant->second.first && seg->count == grant->second.second && seg->modulation == mod)
+        return *seg;
+    reread.start = grant->second.first;
+    reread.count = grant->second.second;
+    reread.modulation = mod;
+    readSegment(active, userId, reread);
+    return reread;
+}
+
+void BaseStation::handleUplink(const std::complex<double>* active, std::vector<Downlink>& out)
+{
+    decodeUplink(active, decodeScratch);
+    handleUplink(active, decodeScratch, out);
+}
+
+void BaseStation::handleUplink(const std::complex<double>* active, const DecodedUplink& decoded, std::vector<Downlink>& out)
+{
+    if (combined)
+	{
+        handleCombinedUplink(active, decoded, out);
+        return;
+    }
+    const ControlMessage& msg = decoded.msgs[0];
+    if (msg.ctrl == CTRL_ACCESS_REQUEST)
+        handleAccessRequest(msg, out);
+    else if (msg.ctrl == CTRL_DATA_TX)
+        acceptSegment(msg.srcId, msg.userId, msg.seq, active, decoded, out);
+    else if (msg.ctrl == CTRL_DEALLOCATE)
+        handleDeallocate(msg, out);
+    else
+	{
+        INSTRUMENT_COUNT(COUNT_UNKNOWN_CTRL);
+        note(EVENT_UNKNOWN_CTRL, -1, -1, -1, 0, (uint32_t)msg.ctrl);
+    }
+}
+
+void BaseStation::handleAccessRequest(const ControlMessage& req, std::vector<Downlink>& out)
+{
+    int userId = req.userId;
+    INSTRUMENT_COUNT(COUNT_REQUESTS);
+    note(EVENT_ACCESS_REQUEST, userId, -1, -1, req.count);
+
+    if (scheduler)
+	{
+        // Demand only; the grant comes from runTti. A user that already holds one
+        // gets it again, in case the response was lost.
+        int requested = std::max(1, std::min((int)req.count, layout.maxGrant()));
+        scheduler->request(userId, requested, modulationBits(linkModulation(userId)));
+        AllocationMap::const_iterator it = allocation.find(userId);
+        if (it != allocation.end())
+            respond(userId, it->second.first, it->second.second, userModulation(userId), out);
+        return;
+    }
+
+    // A repeated request replaces the user's previous allocation
+    deallocateBins(userId);
+
+    // Allocation of bins
+    std::pair<int,int> allocRes = allocateBins(req.count);
+    int start = allocRes.first;
+    int count = allocRes.second;
+    Modulation mod = linkModulation(userId);
+
+    if (start < 0 || count == 0)
+	{
+        INSTRUMENT_COUNT(COUNT_ALLOC_FAILURES);
+        note(EVENT_ALLOC_FAILURE, userId);
+    }
+	else
+	{
+        INSTRUMENT_COUNT(COUNT_GRANTS);
+        allocation[userId] = std::make_pair(start, count);
+        modulation[userId] = mod;
+        publishGrant(userId);
+        note(EVENT_GRANT, userId, -1, start, count, 0, mod);
+    }
+    respond(userId, start, count, mod, out);
+}
+
+// Response: user id, allocated count and start bin
+void BaseStation::respond(int userId, int start, int count, Modulation mod, std::vector<Downlink>& out)
+{
+    Downlink resp;
+    resp.userId = userId;
+    resp.msg = ControlMessage();
+    resp.msg.ctrl = CTRL_RESPONSE;
+    resp.msg.userId = userId;
+    resp.msg.count = count;
+    resp.msg.start = start;
+    resp.msg.modulation = mod;
+    out.push_back(resp);
+}
+
+void BaseStation::runTti(std::vector<Downlink>& out)
+{
+    if (!scheduler) return;
+    grants.clear();
+    scheduler->runTti(bins, grants);
+    for (size_t i = 0; i < grants.size(); i++)
+	{
+        const SchedulerGrant& g = grants[i];
+        // Either way a message in progress was segmented for the old grant
+        endStream(g.userId);
+        if (g.count == 0)
+		{
+            allocation.erase(g.userId);
+            modulation.erase(g.userId);
+            publishGrant(g.userId);
+            note(EVENT_REVOKED, g.userId);
+            respond(g.userId, -1, 0, MOD_QPSK, out);
+            continue;
+        }
+        INSTRUMENT_COUNT(COUNT_GRANTS);
+        Modulation mod = linkModulation(g.userId);
+        allocation[g.userId] = std::make_pair(g.start, g.count);
+        modulation[g.userId] = mod;
+        publishGrant(g.userId);
+        note(EVENT_SCHEDULED, g.userId, -1, g.start, g.count);
+        respond(g.userId, g.start, g.count, mod, out);
+    }
+}
+
+void BaseStation::setUplinkCombine(bool on)
+{
+    if (on == combined) return;
+    while (!allocation.empty())
+        deallocateBins(allocation.begin()->first);
+    // The header slots past the first are held like any grant
+    int extra = combinedControlBins(layout) - layout.headerBins();
+    if (extra > 0)
+	{
+        if (on)
+            bins.allocateAt(layout.headerBins(), extra);
+        else
+            bins.release(layout.headerBins(), extra);
+    }
+    combined = on;
+}
+
+// Combined uplink: the streaming users' segments first, then the header in
+// each control slot, any of which may open a new stream
+void BaseStation::handleCombinedUplink(const std::complex<double>* active, const DecodedUplink& decoded,
+                                       std::vector<Downlink>& out)
+{
+    const int slots = decoded.headers;
+    const ControlOccupancy* occupancy = decoded.occupancy;
+    const ControlMessage* msgs = decoded.msgs;
+    for (int s = 0; s < slots; s++)
+	{
+        if (occupancy[s] != CONTROL_COLLISION) continue;
+        collisions++;
+        INSTRUMENT_COUNT(COUNT_COLLISIONS);
+        note(EVENT_COLLISION, -1);
+    }
+
+    // Follow-on segments carry no header: their number is the stream's position.
+    // Granted bins left empty carry nothing; a few TTIs of that in a row mean
+    // the sender stopped, so its message is lost.
+    for (AllocationMap::const_iterator it = allocation.begin(); it != allocation.end(); ++it)
+	{
+        int uid = it->first;
+        if (uplinkSegment[uid] == 0) continue;
+        bool opening = false;
+        for (int s = 0; s < slots; s++)
+            opening = opening || (occupancy[s] == CONTROL_ONE && msgs[s].ctrl == CTRL_DATA_TX && msgs[s].srcId == uid);
+        if (opening) continue;
+        if (segmentOf(it, active, decoded).empty)
+		{
+            if (++uplinkQuiet[uid] < COMBINED_QUIET_TTIS) continue;
+            endStream(uid);
+            INSTRUMENT_COUNT(COUNT_DROPPED_MESSAGES);
+            note(EVENT_SEGMENT_LOST, uid, uplinkDest[uid]);
+            continue;
+        }
+        uplinkQuiet[uid] = 0;
+        int seq = segmentSeq(uplinkSegment[uid], (1 << layout.seqBits()) - 1);
+        SegmentStatus status = acceptSegment(uid, uplinkDest[uid], seq, active, decoded, out);
+        uplinkSegment[uid] = status == SEGMENT_PARTIAL ? uplinkSegment[uid] + 1 : 0;
+    }
+
+    for (int s = 0; s < slots; s++)
+	{
+        if (occupancy[s] != CONTROL_ONE) continue;
+        const ControlMessage& msg = msgs[s];
+        // A header outside its sender's slots is one the noise garbled
+        if (!headerInSlot(msg, s * layout.headerBins()))
+		{
+            INSTRUMENT_COUNT(COUNT_UNKNOWN_CTRL);
+            note(EVENT_UNEXPECTED_HEADER, -1, -1, -1, 0, (uint32_t)msg.ctrl);
+        }
+        else if (msg.ctrl == CTRL_ACCESS_REQUEST)
+            handleAccessRequest(msg, out);
+        else if (msg.ctrl == CTRL_DEALLOCATE)
+            handleDeallocate(msg, out);
+        else
+		{
+            uplinkDest[msg.srcId] = msg.userId;
+            uplinkQuiet[msg.srcId] = 0;
+            SegmentStatus status = acceptSegment(msg.srcId, msg.userId, 0, active, decoded, out);
+            uplinkSegment[msg.srcId] = status == SEGMENT_PARTIAL ? 1 : 0;
+        }
+    }
+}
+
+// Access requests come in the contention slot at bin 0; deallocations and
+// first segments from a granted user, in a slot its grant owns. Only a
+// message's first segment has a header.
+bool BaseStation::headerInSlot(const ControlMessage& msg, int first) const
+{
+    if (msg.ctrl == CTRL_ACCESS_REQUEST) return first == 0;
+    if (msg.ctrl == CTRL_DATA_TX && msg.seq != 0) return false;
+    if (msg.ctrl != CTRL_DATA_TX && msg.ctrl != CTRL_DEALLOCATE) return false;
+    AllocationMap::const_iterator it = allocation.find(msg.ctrl == CTRL_DATA_TX ? msg.srcId : msg.userId);
+    return it != allocation.end() && combinedOwnsSlot(layout, it->second.first, it->second.second, first);
+}
+
+// Drops the message userId was sending
+void BaseStation::endStream(int userId)
+{
+    uplinkSegment[userId] = 0;
+    std::map<int, ReassemblyBuffer>::iterator rit = rx.find(userId);
+    if (rit != rx.end()) rit->second.rx.reset();
+}
+
+// Adds srcId's segment to its message and relays the message to destId once it
+// is complete
+SegmentStatus BaseStation::acceptSegment(int srcId, int destId, int seq, const std::complex<double>* active,
+                                         const DecodedUplink& decoded, std::vector<Downlink>& out)
+{
+    // Find sender's allocation
+    auto itSrc = allocation.find(srcId);
+    if (itSrc == allocation.end())
+	{
+        INSTRUMENT_COUNT(COUNT_DROPPED_MESSAGES);
+        note(EVENT_NO_SENDER_ALLOCATION, srcId, destId);
+        return SEGMENT_LOST;
+    }
+    int stSrc = itSrc->second.first;   // Sender's start bin
+    int cntSrc = itSrc->second.second; // Sender's number of bins
+    Modulation modSrc = userModulation(srcId);
+
+    // The segment as read from the sender's allocated bins goes into the sender's message
+    const int segmentBits = cntSrc * modulationBits(modSrc);
+    INSTRUMENT_COUNT(COUNT_SEGMENTS);
+    if (scheduler) scheduler->served(srcId, segmentBits);
+    std::map<int, ReassemblyBuffer>::iterator itRx = rx.find(srcId);
+    if (itRx == rx.end())
+        itRx = rx.insert(std::make_pair(srcId, ReassemblyBuffer(maxMessage, layout.seqBits(), fec))).first;
+    Reassembler& msg = itRx->second.rx;
+    const UplinkSegment& in = segmentOf(itSrc, active, decoded);
+    SegmentStatus status = fec != FEC_NONE ? msg.acceptSoft(seq, in.soft, segmentBits)
+                                           : msg.accept(seq, in.payload, segmentBits);
+    if (status == SEGMENT_LOST)
+	{
+        INSTRUMENT_COUNT(COUNT_DROPPED_MESSAGES);
+        note(EVENT_SEGMENT_LOST, srcId, destId);
+        return status;
+    }
+    if (status == SEGMENT_TOO_LONG)
+	{
+        INSTRUMENT_COUNT(COUNT_DROPPED_MESSAGES);
+        note(EVENT_MESSAGE_TOO_LONG, srcId, destId, -1, 0, (uint32_t)maxMessage);
+        return status;
+    }
+    if (status != SEGMENT_COMPLETE) return status;
+    note(EVENT_DATA, srcId, destId, stSrc, cntSrc, (uint32_t)msg.length());
+
+    // Find receiver's allocation
+    auto itDst = allocation.find(destId);
+    if (itDst == allocation.end())
+	{
+        INSTRUMENT_COUNT(COUNT_DROPPED_MESSAGES);
+        note(EVENT_NO_RECEIVER_ALLOCATION, destId, srcId);
+        return status;
+    }
+    int stDst = itDst->second.first;   // Receiver's start bin
+    int cntDst = itDst->second.second; // Receiver's number of bins
+    Modulation modDst = userModulation(destId);
+
+    // Re-segment for the receiver's allocated bins
+    INSTRUMENT_COUNT(COUNT_RELAYS);
+    Segmenter seg;
+    seg.start(msg.data(), msg.length(), cntDst * modulationBits(modDst), layout.seqBits(), fec);
+    while (!seg.done())
+	{
+        Downlink relay;
+        relay.userId = destId;
+        relay.msg = ControlMessage();
+        relay.msg.ctrl = CTRL_DATA_TX;
+        relay.msg.userId = destId;
+        relay.msg.srcId = srcId;
+        relay.msg.start = stDst;
+        relay.msg.count = cntDst;
+        relay.msg.modulation = modDst;
+        seg.next(relay.msg.seq, relay.msg.payload);
+        out.push_back(relay);
+    }
+    return status;
+}
+
+void BaseStation::handleDeallocate(const ControlMessage& req, std::vector<Downlink>& out)
+{
+    int uid = req.userId;
+    INSTRUMENT_COUNT(COUNT_DEALLOCATIONS);
+    note(EVENT_DEALLOC_REQUEST, uid);
+    deallocateBins(uid);
+    note(EVENT_DEALLOCATED, uid);
+
+    // Response: user id only
+    Downlink resp;
+    resp.userId = uid;
+    resp.msg = ControlMessage();
+    resp.msg.ctrl = CTRL_RESPONSE;
+    resp.msg.userId = uid;
+    out.push_back(resp);
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "frame.h"
+#include "bin_allocator.h"
+#include "combined_uplink.h"
+#include "event_log.h"
+#include "mac_scheduler.h"
+#include "node_pool.h"
+#include "segment.h"
+#include <atomic>
+#include <iostream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+#include <utility>
+
+// A downlink symbol the base station wants delivered to userId
+struct Downlink
+{
+    int userId;
+    ControlMessage msg;
+};
+
+// A sender's payload bins, read with the grant it held when they were read
+struct UplinkSegment
+{
+    int userId;
+    int start;
+    int count;
+    Modulation modulation;
+    bool empty;         // combined uplink: nothing was sent in the grant
+    int payload;        // uncoded stream
+    int8_t soft[SEGMENT_MAX_BITS];  // coded stream, see conv_code.h
+};
+
+// An uplink symbol's headers and payloads (see BaseStation::decodeUplink)
+struct DecodedUplink
+{
+    int headers;        // header slots read: 1, or the combined control slots
+    ControlOccupancy occupancy[COMBINED_MAX_CONTROL_SLOTS];     // combined uplink only
+    ControlMessage msgs[COMBINED_MAX_CONTROL_SLOTS];
+    std::vector<UplinkSegment> segments;                        // by user id
+
+    // userId's segment, nullptr if none was read
+    const UplinkSegment* find(int userId) const;
+};
+
+// Base-station MAC: decodes uplink control symbols, owns the bin allocation and
+// produces the responses and relays. Shared by the base_station process and the
+// in-process simulator.
+class BaseStation
+{
+public:
+    // user -> (start_bin, allocated_bins)
+    typedef std::map<int, std::pair<int,int>, std::less<int>, PoolAllocator<std::pair<const int, std::pair<int,int>>>> AllocationMap;
+
+    explicit BaseStation(const FrameLayout& layout);
+
+    // Event log (e.g. &std::cout); nullptr silences it
+    void setLog(std::ostream* log) { this->log = log; }
+    // Records the events to a binary event log instead; nullptr goes back to setLog's
+    void setEventLog(EventLog* events) { this->events = events; }
+    void setAllocPolicy(AllocPolicy policy) { bins.setPolicy(policy); }
+    // Payload modulation granted with new allocations (default MOD_QPSK)
+    void setModulation(Modulation mod) { grantMod = mod; }
+    // Modulation of userId's grants, e.g. from its channel quality; overrides setModulation
+    void setLinkModulation(int userId, Modulation mod) { linkMod[userId] = mod; }
+    // Largest message relayed from each sender (default SEGMENT_MAX_MESSAGE)
+    void setMaxMessage(size_t bytes) { maxMessage = bytes; }
+    // Convolutional coding of message payloads, both received and relayed (see
+    // segment.h); every user must code the same way. Default FEC_NONE.
+    void setFec(FecRate rate) { fec = rate; }
+
+    // With a policy other than SCHED_NONE access requests only register demand,
+    // and bins are granted for grantTtis at a time by runTti; a user that
+    // sends nothing for idleTtis (default: one lease) loses its grant
+    void setScheduler(SchedulerPolicy policy, int grantTtis = DEFAULT_GRANT_TTIS, int idleTtis = 0);
+    const MacScheduler* macScheduler() const { return scheduler.get(); }
+    // Ends a TTI: grants the scheduler handed out or revoked become responses
+    void runTti(std::vector<Downlink>& out);
+
+    // Uplink symbols are combined TTI symbols (see combined_uplink.h): a header
+    // in each slot of the control region at most, and a segment from every user
+    // streaming a message. Access requests are read from the contention slot
+    // and other headers from the slots their sender's grant owns. The control
+    // region's bins are withheld from grants, so existing grants are dropped.
+    // Off by default.
+    void setUplinkCombine(bool on);
+    // Header slots of combined symbols with more than one header in them
+    uint64_t controlCollisions() const { return collisions; }
+
+    // Handles one uplink symbol given as its layout.bins active bins
+    void handleUplink(const std::complex<double>* active, std::vector<Downlink>& out);
+
+    // The two halves of handleUplink. decodeUplink reads the headers, and each
+    // sender's payload with the grant it held as of the last handleUplink to
+    // finish. It touches no MAC state, so other threads may call it while one
+    // runs the MAC. handleUplink then uses the symbol's decoded fields, and
+    // reads a payload again only if its sender's grant changed in between.
+    void decodeUplink(const std::complex<double>* active, DecodedUplink& decoded) const;
+    void handleUplink(const std::complex<double>* active, const DecodedUplink& decoded, std::vector<Downlink>& out);
+
+    std::pair<int,int> allocateBins(int requested);
+    void deallocateBins(int userId);
+
+    const FrameLayout& frameLayout() const { return layout; }
+    const AllocationMap& allocations() const { return allocation; }
+    const BinAllocator& binAllocator() const { return bins; }
+    // Modulation of the user's current grant
+    Modulation userModulation(int userId) const;
+
+private:
+    void handleAccessRequest(const ControlMessage& req, std::vector<Downlink>& out);
+    void handleCombinedUplink(const std::complex<double>* active, const DecodedUplink& decoded, std::vector<Downlink>& out);
+    bool headerInSlot(const ControlMessage& msg, int first) const;
+    void endStream(int userId);
+    void readSegment(const std::complex<double>* active, int userId, UplinkSegment& seg) const;
+    const UplinkSegment& segmentOf(AllocationMap::const_iterator grant, const std::complex<double>* active,
+                                   const DecodedUplink& decoded);
+    SegmentStatus acceptSegment(int srcId, int destId, int seq, const std::complex<double>* active,
+                                const DecodedUplink& decoded, std::vector<Downlink>& out);
+    void handleDeallocate(const ControlMessage& req, std::vector<Downlink>& out);
+    void respond(int userId, int start, int count, Modulation mod, std::vector<Downlink>& out);
+    void publishGrant(int userId);
+    Modulation linkModulation(int userId) const;
+    void note(LogEvent event, int userId, int peerId = -1, int start = -1, int count = 0,
+              uint32_t value = 0, int modulation = 0);
+
+    typedef std::map<int, Modulation, std::less<int>, PoolAllocator<std::pair<const int, Modulation>>> ModulationMap;
+
+    FrameLayout layout;
+    BinAllocator bins;              // header bins (CTRL code, DST ID, SRC ID) are reserved
+    std::shared_ptr<NodeArena> grantNodes;        // one node per grant in each map below
+    AllocationMap allocation;
+    ModulationMap modulation;                     // user -> granted modulation
+    Modulation grantMod;
+    std::map<int, Modulation> linkMod;            // per-user override of grantMod
+    std::unique_ptr<MacScheduler> scheduler;      // null: first come, first served
+    std::vector<SchedulerGrant> grants;           // runTti scratch
+    std::map<int, ReassemblyBuffer> rx;           // user -> message being received
+    size_t maxMessage;
+    FecRate fec;
+    bool combined;
+    std::vector<uint32_t> uplinkSegment;          // combined: next segment index per user, 0 if none is streaming
+    std::vector<int> uplinkDest;                  // combined: receiver of the message each user streams
+    std::vector<int> uplinkQuiet;                 // combined: empty TTIs in a row of each user's stream
+    // Each user's grant for decodeUplink, packed as start << 32 | count << 8 |
+    // modulation (0: none); written by the MAC only
+    std::unique_ptr<std::atomic<uint64_t>[]> publishedGrants;
+    DecodedUplink decodeScratch;                  // handleUplink scratch
+    UplinkSegment reread;                         // segmentOf scratch
+    uint64_t collisions;
+    std::ostream* log;
+    EventLog* events;
+};
@@ -0,0 +1,220 @@
+#define _USE_MATH_DEFINES
+#include "batch_dsp.h"
+#include "batch_dsp_kernels.h"
+#include "signal_processing.h"
+#include "noise.h"
+#include <atomic>
+#include <cstring>
+
+namespace
+{
+
+struct ScalarOps
+{
+    typedef double reg;
+    static const int W = 1;
+
+    static reg load(const double* p) { return *p; }
+    static void store(double* p, reg v) { *p = v; }
+    static reg set1(double v) { return v; }
+    static reg add(reg a, reg b) { return a + b; }
+    static reg sub(reg a, reg b) { return a - b; }
+    static reg mul(reg a, reg b) { return a * b; }
+    static reg min(reg a, reg b) { return b < a ? b : a; }
+    static reg fmadd(reg a, reg b, reg c) { return a * b + c; }
+    static reg fmsub(reg a, reg b, reg c) { return a * b - c; }
+
+    static void mapDibits(const uint8_t* d, double* re, double* im, double amp)
+    {
+        *re = (*d & 2) ? -amp : amp;
+        *im = (*d & 1) ? -amp : amp;
+    }
+
+    static void demapDibits(const double* re, const double* im, uint8_t* d)
+    {
+        *d = static_cast<uint8_t>(((*re < 0) ? 2 : 0) | ((*im < 0) ? 1 : 0));
+    }
+};
+
+}
+
+const BatchKernels* batchKernelsScalar()
+{
+    return kernelTable<ScalarOps>();
+}
+
+static_assert(BATCH_LANES == BATCH_BLOCK_LANES, "batch layout must match the kernel block size");
+
+static std::atomic<int> selectedIsa(-1);
+
+static const BatchKernels* kernelsFor(BatchIsa isa)
+{
+    switch (isa)
+	{
+        case BATCH_ISA_AVX512: return batchKernelsAvx512();
+        case BATCH_ISA_AVX2:   return batchKernelsAvx2();
+        default:               return batchKernelsScalar();
+    }
+}
+
+static bool cpuSupports(BatchIsa isa)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (isa == BATCH_ISA_AVX2) return avx2;
+    if (isa == BATCH_ISA_AVX512) return avx2 && __builtin_cpu_supports("avx512f");
+    return true;
+#else
+    return isa == BATCH_ISA_SCALAR;
+#endif
+}
+
+bool batchIsaSupported(BatchIsa isa)
+{
+    return kernelsFor(isa) != nullptr && cpuSupports(isa);
+}
+
+const char* batchIsaName(BatchIsa isa)
+{
+    switch (isa)
+	{
+        case BATCH_ISA_AVX512: return "avx512";
+        case BATCH_ISA_AVX2:   return "avx2";
+        default:               return "scalar";
+    }
+}
+
+static BatchIsa detectIsa()
+{
+    const char* env = std::getenv("OFDMA_BATCH_ISA");
+    if (env)
+	{
+        for (int i = BATCH_ISA_AVX512; i >= BATCH_ISA_SCALAR; i--)
+		{
+            BatchIsa isa = static_cast<BatchIsa>(i);
+            if (std::strcmp(env, batchIsaName(isa)) == 0)
+			{
+                if (batchIsaSupported(isa)) return isa;
+                std::cerr << "OFDMA_BATCH_ISA=" << env << " is not supported here, auto-selecting" << std::endl;
+                break;
+            }
+        }
+    }
+    if (batchIsaSupported(BATCH_ISA_AVX512)) return BATCH_ISA_AVX512;
+    if (batchIsaSupported(BATCH_ISA_AVX2)) return BATCH_ISA_AVX2;
+    return BATCH_ISA_SCALAR;
+}
+
+BatchIsa batchIsa()
+{
+    int isa = selectedIsa.load(std::memory_order_relaxed);
+    if (isa < 0)
+	{
+        isa = detectIsa();
+        selectedIsa.store(isa, std::memory_order_relaxed);
+    }
+    return static_cast<BatchIsa>(isa);
+}
+
+bool setBatchIsa(BatchIsa isa)
+{
+    if (!batchIsaSupported(isa)) return false;
+    selectedIsa.store(isa, std::memory_order_relaxed);
+    return true;
+}
+
+static const BatchKernels& kernels()
+{
+    return *kernelsFor(batchIsa());
+}
+
+void initBatch(SymbolBatch& batch, int symbols, int size)
+{
+    batch.symbols = symbols;
+    batch.size = size;
+    batch.blocks = (symbols + BATCH_LANES - 1) / BATCH_LANES;
+    batch.re.assign(batchSamples(batch), 0.0);
+    batch.im.assign(batchSamples(batch), 0.0);
+}
+
+void loadSymbol(SymbolBatch& batch, int symbol, const std::complex<double>* samples)
+{
+    for (int k = 0; k < batch.size; k++)
+	{
+        size_t i = batchIndex(batch, symbol, k);
+        batch.re[i] = samples[k].real();
+        batch.im[i] = samples[k].imag();
+    }
+}
+
+void storeSymbol(const SymbolBatch& batch, int symbol, std::complex<double>* samples)
+{
+    for (int k = 0; k < batch.size; k++)
+	{
+        size_t i = batchIndex(batch, symbol, k);
+        samples[k] = { batch.re[i], batch.im[i] };
+    }
+}
+
+static void batchTransform(SymbolBatch& batch, int inverse)
+{
+    if (batch.size <= 1) return;
+    const FftPlan& plan = fftPlan(batch.size);
+    kernels().transform(batch.re.data(), batch.im.data(), batch.blocks, plan.n, plan.bitrev.data(),
+                        reinterpret_cast<const double*>(plan.twiddle.data()), inverse);
+}
+
+void batchFft(SymbolBatch& batch)
+{
+    batchTransform(batch, 0);
+}
+
+void batchIfft(SymbolBatch& batch)
+{
+    batchTransform(batch, 1);
+}
+
+void batchQpskModulate(const uint8_t* dibits, SymbolBatch& batch)
+{
+    kernels().qpskMap(dibits, batch.re.data(), batch.im.data(), static_cast<int>(batchSamples(batch)), 1.0 / sqrt(2.0));
+}
+
+void batchQpskDemodulate(const SymbolBatch& batch, uint8_t* dibits)
+{
+    kernels().qpskDemap(batch.re.data(), batch.im.data(), dibits, static_cast<int>(batchSamples(batch)));
+}
+
+void batchAddAWGN(SymbolBatch& batch, double var, std::mt19937_64& gen)
+{
+    int count = static_cast<int>(batchSamples(batch));
+    batch.noise.resize(2 * static_cast<size_t>(count));
+    std::normal_distribution<double> dist(0.0, 1.0);
+    for (auto &n : batch.noise)
+        n = dist(gen);
+    kernels().addNoise(batch.re.data(), batch.im.data(), batch.noise.data(), sqrt(var), count);
+}
+
+void batchAddAWGN(SymbolBatch& batch, double var, uint64_t seed, uint32_t link, uint64_t firstSymbol)
+{
+    int count = static_cast<int>(batchSamples(batch));
+    batch.noise.assign(2 * static_cast<size_t>(count), 0.0);
+    for (int s = 0; s < batch.symbols; s++)
+	{
+        NoiseKey key = { seed, link, firstSymbol + s };
+        NoiseStream stream(key);
+        for (int k = 0; k < batch.size; k++)
+		{
+            size_t idx = batchIndex(batch, s, k);
+            batch.noise[idx] = stream.normal();
+            batch.noise[count + idx] = stream.normal();
+        }
+    }
+    kernels().addNoise(batch.re.data(), batch.im.data(), batch.noise.data(), sqrt(var), count);
+}
+
+void batchPamLLR(const double* y, int count, const double* levels, const uint8_t* labels, int m, int bits,
+                 double scale, double* llr)
+{
+    kernels().pamLlr(y, llr, count, levels, labels, m, bits, scale);
+}
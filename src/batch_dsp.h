@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include <complex>
+#include <random>
+#include <cstdint>
+
+// SIMD instruction sets the batch kernels can run on
+enum BatchIsa
+{
+    BATCH_ISA_SCALAR = 0,
+    BATCH_ISA_AVX2   = 1,
+    BATCH_ISA_AVX512 = 2
+};
+
+// Symbols per storage block, the widest SIMD lane count (doubles) of any kernel
+constexpr int BATCH_LANES = 8;
+
+// N OFDM symbols of `size` samples each in split real/imag (SoA) layout.
+// Symbols are grouped in blocks of BATCH_LANES and interleaved within a block:
+// sample k of symbol s lives at batchIndex(batch, s, k), so every SIMD lane works
+// on a different symbol with the same twiddle.
+struct SymbolBatch
+{
+    int symbols;
+    int size;
+    int blocks;     // symbols rounded up to whole blocks
+    std::vector<double> re;
+    std::vector<double> im;
+    std::vector<double> noise;  // scratch for batchAddAWGN
+};
+
+// Selected ISA; the first call picks the best one the CPU supports, unless the
+// OFDMA_BATCH_ISA environment variable (scalar, avx2, avx512) says otherwise.
+BatchIsa batchIsa();
+// Force an ISA; returns false if this build or CPU cannot run it
+bool setBatchIsa(BatchIsa isa);
+bool batchIsaSupported(BatchIsa isa);
+const char* batchIsaName(BatchIsa isa);
+
+inline size_t batchIndex(const SymbolBatch& batch, int symbol, int sample)
+{
+    return (static_cast<size_t>(symbol / BATCH_LANES) * batch.size + sample) * BATCH_LANES + symbol % BATCH_LANES;
+}
+
+// Stored samples including the padding lanes of the last block
+inline size_t batchSamples(const SymbolBatch& batch)
+{
+    return static_cast<size_t>(batch.blocks) * batch.size * BATCH_LANES;
+}
+
+void initBatch(SymbolBatch& batch, int symbols, int size);
+void loadSymbol(SymbolBatch& batch, int symbol, const std::complex<double>* samples);
+void storeSymbol(const SymbolBatch& batch, int symbol, std::complex<double>* samples);
+
+// In-place transforms of every symbol in the batch (size must be a power of two)
+void batchFft(SymbolBatch& batch);
+void batchIfft(SymbolBatch& batch);
+
+// QPSK map/demap. dibits uses the batch layout: dibits[batchIndex(b, s, k)] = (bit1 << 1) | bit2
+void batchQpskModulate(const uint8_t* dibits, SymbolBatch& batch);
+void batchQpskDemodulate(const SymbolBatch& batch, uint8_t* dibits);
+
+void batchAddAWGN(SymbolBatch& batch, double var, std::mt19937_64& gen);
+
+// Counter-based noise: symbol s gets the stream keyed (seed, link, firstSymbol + s),
+// so the result does not depend on how symbols are split into batches or threads
+void batchAddAWGN(SymbolBatch& batch, double var, uint64_t seed, uint32_t link, uint64_t firstSymbol);
+
+// Max-log LLRs of one Gray-coded PAM axis (see modulation.h): llr[j*count + i] for
+// label bit j of sample y[i], most significant first. count must be a multiple of
+// BATCH_LANES; bits is at most 4.
+void batchPamLLR(const double* y, int count, const double* levels, const uint8_t* labels, int m, int bits,
+                 double scale, double* llr);
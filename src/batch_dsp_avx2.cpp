@@ -0,0 +1,65 @@
+// Built with AVX2/FMA code generation; only reached after a runtime CPU check
+#include "batch_dsp_kernels.h"
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#include <cstring>
+
+namespace
+{
+
+struct Avx2Ops
+{
+    typedef __m256d reg;
+    static const int W = 4;
+
+    static reg load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, reg v) { _mm256_storeu_pd(p, v); }
+    static reg set1(double v) { return _mm256_set1_pd(v); }
+    static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+    static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+    static reg min(reg a, reg b) { return _mm256_min_pd(a, b); }
+    static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_pd(a, b, c); }
+    static reg fmsub(reg a, reg b, reg c) { return _mm256_fmsub_pd(a, b, c); }
+
+    static void mapDibits(const uint8_t* d, double* re, double* im, double amp)
+    {
+        int32_t packed;
+        std::memcpy(&packed, d, sizeof(packed));
+        __m128i v = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+        __m128i one = _mm_set1_epi32(1);
+        reg b1 = _mm256_cvtepi32_pd(_mm_and_si128(_mm_srli_epi32(v, 1), one));
+        reg b2 = _mm256_cvtepi32_pd(_mm_and_si128(v, one));
+        // bit = 0 -> +amp, bit = 1 -> -amp
+        reg a = set1(amp);
+        reg twoA = set1(-2.0 * amp);
+        store(re, fmadd(b1, twoA, a));
+        store(im, fmadd(b2, twoA, a));
+    }
+
+    static void demapDibits(const double* re, const double* im, uint8_t* d)
+    {
+        reg zero = _mm256_setzero_pd();
+        int mr = _mm256_movemask_pd(_mm256_cmp_pd(load(re), zero, _CMP_LT_OQ));
+        int mi = _mm256_movemask_pd(_mm256_cmp_pd(load(im), zero, _CMP_LT_OQ));
+        for (int l = 0; l < W; l++)
+            d[l] = static_cast<uint8_t>((((mr >> l) & 1) << 1) | ((mi >> l) & 1));
+    }
+};
+
+}
+
+const BatchKernels* batchKernelsAvx2()
+{
+    return kernelTable<Avx2Ops>();
+}
+
+#else
+
+const BatchKernels* batchKernelsAvx2()
+{
+    return nullptr;
+}
+
+#endif
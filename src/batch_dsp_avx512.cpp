@@ -0,0 +1,62 @@
+// Built with AVX-512F code generation; only reached after a runtime CPU check
+#include "batch_dsp_kernels.h"
+
+#if defined(__AVX512F__) && defined(__AVX2__)
+#include <immintrin.h>
+
+namespace
+{
+
+struct Avx512Ops
+{
+    typedef __m512d reg;
+    static const int W = 8;
+
+    static reg load(const double* p) { return _mm512_loadu_pd(p); }
+    static void store(double* p, reg v) { _mm512_storeu_pd(p, v); }
+    static reg set1(double v) { return _mm512_set1_pd(v); }
+    static reg add(reg a, reg b) { return _mm512_add_pd(a, b); }
+    static reg sub(reg a, reg b) { return _mm512_sub_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm512_mul_pd(a, b); }
+    static reg min(reg a, reg b) { return _mm512_maskz_min_pd(0xFF, a, b); }
+    static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_pd(a, b, c); }
+    static reg fmsub(reg a, reg b, reg c) { return _mm512_fmsub_pd(a, b, c); }
+
+    static void mapDibits(const uint8_t* d, double* re, double* im, double amp)
+    {
+        __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(d)));
+        __m256i one = _mm256_set1_epi32(1);
+        reg b1 = _mm512_maskz_cvtepi32_pd(0xFF, _mm256_and_si256(_mm256_srli_epi32(v, 1), one));
+        reg b2 = _mm512_maskz_cvtepi32_pd(0xFF, _mm256_and_si256(v, one));
+        // bit = 0 -> +amp, bit = 1 -> -amp
+        reg a = set1(amp);
+        reg twoA = set1(-2.0 * amp);
+        store(re, fmadd(b1, twoA, a));
+        store(im, fmadd(b2, twoA, a));
+    }
+
+    static void demapDibits(const double* re, const double* im, uint8_t* d)
+    {
+        reg zero = _mm512_setzero_pd();
+        unsigned mr = _mm512_cmp_pd_mask(load(re), zero, _CMP_LT_OQ);
+        unsigned mi = _mm512_cmp_pd_mask(load(im), zero, _CMP_LT_OQ);
+        for (int l = 0; l < W; l++)
+            d[l] = static_cast<uint8_t>((((mr >> l) & 1) << 1) | ((mi >> l) & 1));
+    }
+};
+
+}
+
+const BatchKernels* batchKernelsAvx512()
+{
+    return kernelTable<Avx512Ops>();
+}
+
+#else
+
+const BatchKernels* batchKernelsAvx512()
+{
+    return nullptr;
+}
+
+#endif
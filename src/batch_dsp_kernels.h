@@ -0,0 +1,199 @@
+#pragma once
+
+// Kernel bodies shared by the scalar, AVX2 and AVX-512 translation units. Each unit
+// instantiates them with its own lane type; the templates sit in an anonymous
+// namespace so no ISA-specific copy can leak into another unit at link time.
+// Only raw pointers cross this boundary for the same reason.
+
+#include <cstddef>
+#include <cstdint>
+
+struct BatchKernels
+{
+    void (*transform)(double* re, double* im, int blocks, int n, const int* bitrev,
+                      const double* twiddle, int inverse);
+    void (*qpskMap)(const uint8_t* dibits, double* re, double* im, int count, double amp);
+    void (*qpskDemap)(const double* re, const double* im, uint8_t* dibits, int count);
+    void (*addNoise)(double* re, double* im, const double* noise, double sigma, int count);
+    void (*pamLlr)(const double* y, double* llr, int count, const double* levels, const uint8_t* labels,
+                   int m, int bits, double scale);
+};
+
+// nullptr when the build has no code for that ISA
+const BatchKernels* batchKernelsScalar();
+const BatchKernels* batchKernelsAvx2();
+const BatchKernels* batchKernelsAvx512();
+
+// Lanes per storage block; a multiple of every kernel's SIMD width
+constexpr int BATCH_BLOCK_LANES = 8;
+
+// Most bits per PAM axis the LLR kernel handles (256-QAM)
+constexpr int PAM_MAX_BITS = 4;
+
+namespace
+{
+
+// V provides: reg, W (lanes), load, store, set1, add, sub, mul, min, fmadd (a*b+c),
+// fmsub (a*b-c), mapDibits and demapDibits.
+
+template<class V>
+void swapRows(double* a, double* b, int lanes)
+{
+    for (int s = 0; s < lanes; s += V::W)
+	{
+        typename V::reg x = V::load(a + s);
+        typename V::reg y = V::load(b + s);
+        V::store(a + s, y);
+        V::store(b + s, x);
+    }
+}
+
+// Radix-2 DIT over `n` rows of `lanes` columns spaced `stride` apart
+template<class V>
+void transformTile(double* re, double* im, int stride, int lanes, int n, const int* bitrev,
+                   const double* twiddle, int inverse)
+{
+    typedef typename V::reg reg;
+
+    for (int i = 0; i < n; i++)
+	{
+        int r = bitrev[i];
+        if (i < r)
+		{
+            swapRows<V>(re + i*stride, re + r*stride, lanes);
+            swapRows<V>(im + i*stride, im + r*stride, lanes);
+        }
+    }
+
+    for (int len = 2; len <= n; len <<= 1)
+	{
+        int half = len / 2;
+        int step = n / len;
+        for (int j = 0; j < half; j++)
+		{
+            reg wr = V::set1(twiddle[2*j*step]);
+            reg wi = V::set1(inverse ? -twiddle[2*j*step + 1] : twiddle[2*j*step + 1]);
+            for (int base = j; base < n; base += len)
+			{
+                double* ar = re + base*stride;
+                double* ai = im + base*stride;
+                double* br = re + (base + half)*stride;
+                double* bi = im + (base + half)*stride;
+                for (int s = 0; s < lanes; s += V::W)
+				{
+                    reg xr = V::load(br + s);
+                    reg xi = V::load(bi + s);
+                    reg tr = V::fmsub(xr, wr, V::mul(xi, wi));
+                    reg ti = V::fmadd(xr, wi, V::mul(xi, wr));
+                    reg yr = V::load(ar + s);
+                    reg yi = V::load(ai + s);
+                    V::store(ar + s, V::add(yr, tr));
+                    V::store(ai + s, V::add(yi, ti));
+                    V::store(br + s, V::sub(yr, tr));
+                    V::store(bi + s, V::sub(yi, ti));
+                }
+            }
+        }
+    }
+
+    if (inverse)
+	{
+        reg scale = V::set1(1.0 / n);
+        for (int i = 0; i < n; i++)
+		{
+            for (int s = 0; s < lanes; s += V::W)
+			{
+                V::store(re + i*stride + s, V::mul(V::load(re + i*stride + s), scale));
+                V::store(im + i*stride + s, V::mul(V::load(im + i*stride + s), scale));
+            }
+        }
+    }
+}
+
+// Symbols are stored in blocks of BATCH_BLOCK_LANES lanes, each block holding all
+// n rows back to back, so one block's transform stays within a few KB of cache
+template<class V>
+void transformKernel(double* re, double* im, int blocks, int n, const int* bitrev,
+                     const double* twiddle, int inverse)
+{
+    for (int b = 0; b < blocks; b++)
+	{
+        size_t offset = static_cast<size_t>(b) * n * BATCH_BLOCK_LANES;
+        transformTile<V>(re + offset, im + offset, BATCH_BLOCK_LANES, BATCH_BLOCK_LANES,
+                         n, bitrev, twiddle, inverse);
+    }
+}
+
+template<class V>
+void qpskMapKernel(const uint8_t* dibits, double* re, double* im, int count, double amp)
+{
+    for (int i = 0; i < count; i += V::W)
+        V::mapDibits(dibits + i, re + i, im + i, amp);
+}
+
+template<class V>
+void qpskDemapKernel(const double* re, const double* im, uint8_t* dibits, int count)
+{
+    for (int i = 0; i < count; i += V::W)
+        V::demapDibits(re + i, im + i, dibits + i);
+}
+
+// noise holds `count` real parts followed by `count` imaginary parts, unit variance
+template<class V>
+void addNoiseKernel(double* re, double* im, const double* noise, double sigma, int count)
+{
+    typename V::reg vs = V::set1(sigma);
+    for (int i = 0; i < count; i += V::W)
+	{
+        V::store(re + i, V::fmadd(vs, V::load(noise + i), V::load(re + i)));
+        V::store(im + i, V::fmadd(vs, V::load(noise + count + i), V::load(im + i)));
+    }
+}
+
+// Max-log LLRs of an m-level PAM axis: for every sample, the squared distance to
+// the nearest level labelled 1 minus the nearest labelled 0 in each of `bits`
+// label bits (most significant first), times scale. llr is bit-major:
+// llr[j*count + i].
+template<class V>
+void pamLlrKernel(const double* y, double* llr, int count, const double* levels, const uint8_t* labels,
+                  int m, int bits, double scale)
+{
+    typedef typename V::reg reg;
+    const reg vs = V::set1(scale);
+    for (int i = 0; i < count; i += V::W)
+	{
+        reg v = V::load(y + i);
+        reg d0[PAM_MAX_BITS], d1[PAM_MAX_BITS];
+        for (int j = 0; j < PAM_MAX_BITS; j++)
+            d0[j] = d1[j] = V::set1(1e300);
+        for (int p = 0; p < m; p++)
+		{
+            reg e = V::sub(v, V::set1(levels[p]));
+            reg d = V::mul(e, e);
+            for (int j = 0; j < bits; j++)
+			{
+                if ((labels[p] >> (bits - 1 - j)) & 1)
+                    d1[j] = V::min(d1[j], d);
+                else
+                    d0[j] = V::min(d0[j], d);
+            }
+        }
+        for (int j = 0; j < bits; j++)
+            V::store(llr + static_cast<size_t>(j) * count + i, V::mul(V::sub(d1[j], d0[j]), vs));
+    }
+}
+
+template<class V>
+const BatchKernels* kernelTable()
+{
+    static const BatchKernels kernels = {
+        transformKernel<V>,
+        qpskMapKernel<V>,
+        qpskDemapKernel<V>,
+        addNoiseKernel<V>,
+        pamLlrKernel<V>
+    };
+    return &kernels;
+}
+
+}
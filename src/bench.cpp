@@ -0,0 +1,1251 @@
+#define _USE_MATH_DEFINES
+#include "signal_processing.h"
+#include "waveform_file.h"
+#include "numerology.h"
+#include "modulation.h"
+#include "bin_allocator.h"
+#include "mac_scheduler.h"
+#include "base_station_core.h"
+#include "user_core.h"
+#include "downlink_frame.h"
+#include "combined_uplink.h"
+#include "bs_pipeline.h"
+#include "event_log.h"
+#include "batch_dsp.h"
+#include "conv_code.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <new>
+
+using namespace std;
+
+// Micro and macro benchmarks of the datapath. Each benchmark is calibrated to
+// run for --min-time per sample, then timed over --reps samples; the table and
+// the JSON report give the median ns/op with its spread, throughput in the
+// benchmark's unit, and heap allocations per op counted by the operator new
+// replacement below.
+
+// ---------------------------------------------------------------------------
+// Allocation counting
+
+static std::atomic<uint64_t> heapAllocs(0);
+
+void* operator new(size_t size)
+{
+    heapAllocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+// GCC pairs the new-expression with free() once these are inlined and warns,
+// though the memory did come from malloc above
+#if defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+#if defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+// ---------------------------------------------------------------------------
+// Harness
+
+// Keeps results alive so the optimizer cannot drop the work
+static volatile double sink;
+
+static void consume(const std::complex<double>& c) { sink = sink + c.real(); }
+
+// Runs `ops` operations; created per benchmark so setup stays out of the timing
+typedef std::function<void(long ops)> BenchRun;
+
+struct Benchmark
+{
+    std::string name;
+    const char* unit;       // what throughput counts
+    double itemsPerOp;
+    std::function<BenchRun()> setup;
+};
+
+struct BenchResult
+{
+    std::string name;
+    const char* unit;
+    long opsPerSample;
+    int samples;
+    double median, mean, stddev, min;   // ns/op
+    double throughput;                  // unit/s at the median
+    double allocsPerOp;
+};
+
+static double elapsedNs(const BenchRun& run, long ops)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    run(ops);
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static BenchResult runBenchmark(const Benchmark& b, int reps, double minTimeMs)
+{
+    BenchRun run = b.setup();
+
+    // Grow the op count until one sample takes minTimeMs; this also warms up
+    long ops = 1;
+    while (true)
+	{
+        double ns = elapsedNs(run, ops);
+        if (ns >= minTimeMs * 1e6 || ops >= (1L << 30)) break;
+        double scale = ns > 0 ? minTimeMs * 1e6 / ns : 100;
+        ops = (long)(ops * std::min(100.0, std::max(2.0, scale * 1.1)));
+    }
+
+    std::vector<double> perOp;
+    perOp.reserve(reps);
+    uint64_t allocs0 = heapAllocs.load();
+    for (int r = 0; r < reps; r++)
+        perOp.push_back(elapsedNs(run, ops) / ops);
+    uint64_t allocs = heapAllocs.load() - allocs0;
+
+    BenchResult res;
+    res.name = b.name;
+    res.unit = b.unit;
+    res.opsPerSample = ops;
+    res.samples = reps;
+    res.allocsPerOp = (double)allocs / ((double)ops * reps);
+    double sum = 0;
+    for (size_t i = 0; i < perOp.size(); i++) sum += perOp[i];
+    res.mean = sum / reps;
+    double var = 0;
+    for (size_t i = 0; i < perOp.size(); i++) var += (perOp[i] - res.mean) * (perOp[i] - res.mean);
+    res.stddev = reps > 1 ? sqrt(var / (reps - 1)) : 0;
+    std::sort(perOp.begin(), perOp.end());
+    res.min = perOp.front();
+    res.median = reps % 2 ? perOp[reps / 2] : 0.5 * (perOp[reps / 2 - 1] + perOp[reps / 2]);
+    res.throughput = b.itemsPerOp * 1e9 / res.median;
+    return res;
+}
+
+static void addBench(std::vector<Benchmark>& list, const std::string& name, const char* unit, double itemsPerOp,
+                     std::function<BenchRun()> setup)
+{
+    Benchmark b = { name, unit, itemsPerOp, setup };
+    list.push_back(b);
+}
+
+// Deterministic test signal
+static std::vector<std::complex<double>> testSignal(int n, uint32_t link)
+{
+    std::vector<std::complex<double>> x(n);
+    NoiseStream noise(noiseKey(link, 0));
+    for (int i = 0; i < n; i++)
+        x[i] = std::complex<double>(noise.normal(), noise.normal());
+    return x;
+}
+
+// ---------------------------------------------------------------------------
+// Transforms, modulation, noise, waveform files
+
+static void addDspBenchmarks(std::vector<Benchmark>& list)
+{
+    const int sizes[] = { 64, 256, 1024, 2048 };
+    for (int s = 0; s < 4; s++)
+	{
+        int n = sizes[s];
+        addBench(list, "fft/" + std::to_string(n), "samples", n, [n]() -> BenchRun {
+            auto x = std::make_shared<std::vector<std::complex<double>>>(testSignal(n, 1));
+            auto y = std::make_shared<std::vector<std::complex<double>>>(n);
+            const FftPlan& plan = fftPlan(n);
+            return [x, y, &plan](long ops) {
+                for (long i = 0; i < ops; i++) fft(plan, x->data(), y->data());
+                consume((*y)[0]);
+            };
+        });
+        addBench(list, "ifft/" + std::to_string(n), "samples", n, [n]() -> BenchRun {
+            auto x = std::make_shared<std::vector<std::complex<double>>>(testSignal(n, 1));
+            auto y = std::make_shared<std::vector<std::complex<double>>>(n);
+            const FftPlan& plan = fftPlan(n);
+            return [x, y, &plan](long ops) {
+                for (long i = 0; i < ops; i++) ifft(plan, x->data(), y->data());
+                consume((*y)[0]);
+            };
+        });
+    }
+    // The original vector API, which allocates its result
+    addBench(list, "fft-vector/64", "samples", 64, []() -> BenchRun {
+        auto x = std::make_shared<std::vector<std::complex<double>>>(testSignal(64, 1));
+        return [x](long ops) {
+            for (long i = 0; i < ops; i++) consume(fft(*x)[1]);
+        };
+    });
+
+    // Compiled numerologies: time samples <-> active bins
+    for (int i = 0; i < numerologyCount(); i++)
+	{
+        const NumerologyOps* num = &numerologyAt(i);
+        addBench(list, std::string("demux/") + num->name, "symbols", 1, [num]() -> BenchRun {
+            auto time = std::make_shared<std::vector<std::complex<double>>>(testSignal(num->fftSize, 2));
+            auto active = std::make_shared<std::vector<std::complex<double>>>(num->bins);
+            return [num, time, active](long ops) {
+                for (long i = 0; i < ops; i++) num->demux(time->data(), active->data());
+                consume((*active)[0]);
+            };
+        });
+        addBench(list, std::string("mux/") + num->name, "symbols", 1, [num]() -> BenchRun {
+            auto active = std::make_shared<std::vector<std::complex<double>>>(testSignal(num->bins, 2));
+            auto time = std::make_shared<std::vector<std::complex<double>>>(num->fftSize);
+            return [num, time, active](long ops) {
+                for (long i = 0; i < ops; i++) num->mux(active->data(), time->data());
+                consume((*time)[0]);
+            };
+        });
+
+        // The same in single precision and in Q15
+        addBench(list, std::string("demux-cf32/") + num->name, "symbols", 1, [num]() -> BenchRun {
+            std::vector<std::complex<double>> x = testSignal(num->fftSize, 2);
+            auto time = std::make_shared<std::vector<std::complex<float>>>(num->fftSize);
+            auto active = std::make_shared<std::vector<std::complex<float>>>(num->bins);
+            toCF32(x.data(), x.size(), time->data());
+            return [num, time, active](long ops) {
+                for (long i = 0; i < ops; i++) num->demuxF32(time->data(), active->data());
+                sink = sink + (*active)[0].real();
+            };
+        });
+        addBench(list, std::string("mux-cf32/") + num->name, "symbols", 1, [num]() -> BenchRun {
+            std::vector<std::complex<double>> x = testSignal(num->bins, 2);
+            auto active = std::make_shared<std::vector<std::complex<float>>>(num->bins);
+            auto time = std::make_shared<std::vector<std::complex<float>>>(num->fftSize);
+            toCF32(x.data(), x.size(), active->data());
+            return [num, time, active](long ops) {
+                for (long i = 0; i < ops; i++) num->muxF32(active->data(), time->data());
+                sink = sink + (*time)[0].real();
+            };
+        });
+        addBench(list, std::string("demux-cq15/") + num->name, "symbols", 1, [num]() -> BenchRun {
+            std::vector<std::complex<double>> x = testSignal(num->fftSize, 2);
+            auto time = std::make_shared<std::vector<cq15>>(num->fftSize);
+            auto active = std::make_shared<std::vector<cq15>>(num->bins);
+            int exp = blockExponent(x.data(), x.size());
+            toQ15(x.data(), x.size(), exp, time->data());
+            return [num, time, active, exp](long ops) {
+                for (long i = 0; i < ops; i++) sink = sink + num->demuxQ15(time->data(), exp, active->data());
+            };
+        });
+        addBench(list, std::string("mux-cq15/") + num->name, "symbols", 1, [num]() -> BenchRun {
+            std::vector<std::complex<double>> x = testSignal(num->bins, 2);
+            auto active = std::make_shared<std::vector<cq15>>(num->bins);
+            auto time = std::make_shared<std::vector<cq15>>(num->fftSize);
+            int exp = blockExponent(x.data(), x.size());
+            toQ15(x.data(), x.size(), exp, active->data());
+            return [num, time, active, exp](long ops) {
+                for (long i = 0; i < ops; i++) sink = sink + num->muxQ15(active->data(), exp, time->data());
+            };
+        });
+    }
+
+    addBench(list, "qpsk/modulate", "symbols", 1, []() -> BenchRun {
+        return [](long ops) {
+            std::complex<double> acc;
+            for (long i = 0; i < ops; i++) acc += qpskModulate((int)(i >> 1) & 1, (int)i & 1);
+            consume(acc);
+        };
+    });
+    addBench(list, "qpsk/demodulate", "symbols", 1, []() -> BenchRun {
+        auto x = std::make_shared<std::vector<std::complex<double>>>(testSignal(1024, 3));
+        return [x](long ops) {
+            int acc = 0;
+            for (long i = 0; i < ops; i++)
+			{
+                std::pair<int,int> b = qpskDemodulate((*x)[i & 1023]);
+                acc += b.first + b.second;
+            }
+            sink = sink + acc;
+        };
+    });
+
+    const Modulation mods[] = { MOD_16QAM, MOD_256QAM };
+    for (int m = 0; m < 2; m++)
+	{
+        Modulation mod = mods[m];
+        addBench(list, std::string("map-bytes/") + modulationName(mod), "bytes", 1024, [mod]() -> BenchRun {
+            auto bytes = std::make_shared<std::vector<uint8_t>>(1024);
+            for (size_t i = 0; i < bytes->size(); i++) (*bytes)[i] = (uint8_t)(i * 37);
+            auto out = std::make_shared<std::vector<std::complex<double>>>(modulationSymbols(mod, 8 * 1024));
+            return [mod, bytes, out](long ops) {
+                for (long i = 0; i < ops; i++) mapBytes(mod, bytes->data(), bytes->size(), out->data());
+                consume((*out)[0]);
+            };
+        });
+        addBench(list, std::string("demap-llr/") + modulationName(mod), "symbols", 1024, [mod]() -> BenchRun {
+            auto x = std::make_shared<std::vector<std::complex<double>>>(testSignal(1024, 4));
+            auto llr = std::make_shared<std::vector<double>>(1024 * modulationBits(mod));
+            return [mod, x, llr](long ops) {
+                for (long i = 0; i < ops; i++) demapLLR(mod, x->data(), x->size(), 0.01, llr->data());
+                sink = sink + (*llr)[0];
+            };
+        });
+    }
+
+    addBench(list, "noise/normal", "draws", 1, []() -> BenchRun {
+        auto noise = std::make_shared<NoiseStream>(noiseKey(5, 0));
+        return [noise](long ops) {
+            double acc = 0;
+            for (long i = 0; i < ops; i++) acc += noise->normal();
+            sink = sink + acc;
+        };
+    });
+    addBench(list, "noise/awgn-1024", "samples", 1024, []() -> BenchRun {
+        auto x = std::make_shared<std::vector<std::complex<double>>>(1024);
+        return [x](long ops) {
+            for (long i = 0; i < ops; i++) addAWGN(x->data(), x->size(), NOISE_VARIANCE, noiseKey(6, i));
+            consume((*x)[0]);
+        };
+    });
+    addBench(list, "noise/awgn-vector-64", "samples", 64, []() -> BenchRun {
+        auto x = std::make_shared<std::vector<std::complex<double>>>(64);
+        return [x](long ops) {
+            for (long i = 0; i < ops; i++) addAWGN(*x, NOISE_VARIANCE);
+            consume((*x)[0]);
+        };
+    });
+}
+
+// ---------------------------------------------------------------------------
+// Convolutional code
+
+// Information bits of a benchmark codeword: a 32-byte message
+constexpr int BENCH_FEC_BITS = 256;
+// Codewords per decodeBatch op
+constexpr int BENCH_FEC_BATCH = 16;
+
+// Soft values of `codewords` random rate-1/2 codewords at about 4 dB Es/N0
+static std::vector<int8_t> noisyCodewords(int codewords)
+{
+    const size_t coded = fecCodedBits(FEC_1_2, BENCH_FEC_BITS);
+    std::vector<int8_t> soft(codewords * coded);
+    std::vector<uint8_t> info(BENCH_FEC_BITS / 8), bits(coded);
+    NoiseStream noise(noiseKey(8, 0));
+    for (int c = 0; c < codewords; c++)
+	{
+        for (size_t i = 0; i < info.size(); i++) info[i] = (uint8_t)noise.next64();
+        convEncode(FEC_1_2, info.data(), BENCH_FEC_BITS, bits.data());
+        for (size_t i = 0; i < coded; i++)
+            soft[c * coded + i] = softBit((bits[i] ? -1.0 : 1.0) + 0.45 * noise.normal(), 32);
+    }
+    return soft;
+}
+
+static void addFecBenchmarks(std::vector<Benchmark>& list)
+{
+    addBench(list, "fec/encode", "bits", BENCH_FEC_BITS, []() -> BenchRun {
+        auto info = std::make_shared<std::vector<uint8_t>>(BENCH_FEC_BITS / 8, 0x5A);
+        auto coded = std::make_shared<std::vector<uint8_t>>(fecCodedBits(FEC_1_2, BENCH_FEC_BITS));
+        return [info, coded](long ops) {
+            for (long i = 0; i < ops; i++) convEncode(FEC_1_2, info->data(), BENCH_FEC_BITS, coded->data());
+            sink = sink + (*coded)[0];
+        };
+    });
+
+    // The scalar reference against the kernel batchIsa() selects, one codeword
+    // at a time and in lockstep batches
+    const BatchIsa isas[] = { BATCH_ISA_SCALAR, batchIsa() };
+    for (int k = 0; k < (isas[1] == BATCH_ISA_SCALAR ? 1 : 2); k++)
+	{
+        BatchIsa isa = isas[k];
+        addBench(list, std::string("viterbi/") + batchIsaName(isa), "bits", BENCH_FEC_BITS, [isa]() -> BenchRun {
+            auto soft = std::make_shared<std::vector<int8_t>>(noisyCodewords(1));
+            auto info = std::make_shared<std::vector<uint8_t>>(BENCH_FEC_BITS / 8);
+            auto decoder = std::make_shared<ViterbiDecoder>(isa);
+            return [soft, info, decoder](long ops) {
+                for (long i = 0; i < ops; i++) decoder->decode(FEC_1_2, soft->data(), BENCH_FEC_BITS, info->data());
+                sink = sink + (*info)[0];
+            };
+        });
+        addBench(list, std::string("viterbi-batch/") + batchIsaName(isa), "bits", BENCH_FEC_BITS * BENCH_FEC_BATCH, [isa]() -> BenchRun {
+            const size_t coded = fecCodedBits(FEC_1_2, BENCH_FEC_BITS);
+            auto soft = std::make_shared<std::vector<int8_t>>(noisyCodewords(BENCH_FEC_BATCH));
+            auto info = std::make_shared<std::vector<uint8_t>>(BENCH_FEC_BATCH * BENCH_FEC_BITS / 8);
+            auto in = std::make_shared<std::vector<const int8_t*>>(BENCH_FEC_BATCH);
+            auto out = std::make_shared<std::vector<uint8_t*>>(BENCH_FEC_BATCH);
+            for (int c = 0; c < BENCH_FEC_BATCH; c++)
+			{
+                (*in)[c] = &(*soft)[c * coded];
+                (*out)[c] = &(*info)[c * BENCH_FEC_BITS / 8];
+            }
+            auto decoder = std::make_shared<ViterbiDecoder>(isa);
+            return [soft, info, in, out, decoder](long ops) {
+                for (long i = 0; i < ops; i++)
+                    decoder->decodeBatch(FEC_1_2, in->data(), BENCH_FEC_BITS, out->data(), BENCH_FEC_BATCH);
+                sink = sink + (*info)[0];
+            };
+        });
+    }
+}
+
+static const char* const BENCH_TEXT_FILE = "bench_waveform.txt";
+static const char* const BENCH_BIN_FILE = "bench_waveform.bin";
+
+static void addWaveformBenchmarks(std::vector<Benchmark>& list)
+{
+    addBench(list, "waveform/write-text-64", "symbols", 1, []() -> BenchRun {
+        auto x = std::make_shared<std::vector<std::complex<double>>>(testSignal(FFT_SIZE, 7));
+        return [x](long ops) {
+            for (long i = 0; i < ops; i++) writeWaveform(BENCH_TEXT_FILE, *x);
+        };
+    });
+    addBench(list, "waveform/read-text-64", "symbols", 1, []() -> BenchRun {
+        writeWaveform(BENCH_TEXT_FILE, testSignal(FFT_SIZE, 7));
+        return [](long ops) {
+            for (long i = 0; i < ops; i++) consume(readWaveform(BENCH_TEXT_FILE)[0]);
+        };
+    });
+    addBench(list, "waveform/write-bin-64", "symbols", 1, []() -> BenchRun {
+        auto x = std::make_shared<std::vector<std::complex<double>>>(testSignal(FFT_SIZE, 7));
+        return [x](long ops) {
+            for (long i = 0; i < ops; i++) writeWaveformFile(BENCH_BIN_FILE, x->data(), x->size(), 1, i);
+        };
+    });
+    addBench(list, "waveform/map-bin-64", "symbols", 1, []() -> BenchRun {
+        std::vector<std::complex<double>> x = testSignal(FFT_SIZE, 7);
+        writeWaveformFile(BENCH_BIN_FILE, x.data(), x.size(), 1, 0);
+        return [](long ops) {
+            for (long i = 0; i < ops; i++)
+			{
+                MappedWaveform wave;
+                if (wave.open(BENCH_BIN_FILE)) consume(wave.samples()[0]);
+            }
+        };
+    });
+}
+
+// ---------------------------------------------------------------------------
+// Bin allocation under churn: random-sized requests against a pool of live
+// grants kept near 80% occupancy, with a random grant freed whenever the pool
+// is above it. One op is one allocate or one free.
+
+constexpr double CHURN_OCCUPANCY = 0.8;
+constexpr int CHURN_MAX_REQUEST = 16;
+
+// The original linear-scan allocator over bool usedBins[], kept as a baseline
+class LinearAllocator
+{
+public:
+    LinearAllocator(int bins, int reserved) : usedBins(bins, false)
+    {
+        for (int i = 0; i < reserved && i < bins; i++) usedBins[i] = true;
+    }
+
+    BinExtent allocate(int requested)
+    {
+        int nbins = (int)usedBins.size();
+        for (int r = requested; r >= 1; r--)
+		{
+            for (int i = 1; i < nbins; i++)
+			{
+                bool canAlloc = true;
+                for (int j = i; j < i + r; j++)
+				{
+                    if (j >= nbins || usedBins[j])
+					{
+                        canAlloc = false;
+                        break;
+                    }
+                }
+                if (canAlloc)
+				{
+                    for (int j = i; j < i + r; j++) usedBins[j] = true;
+                    BinExtent ext = { i, r };
+                    return ext;
+                }
+            }
+        }
+        BinExtent none = { -1, 0 };
+        return none;
+    }
+
+    void release(int start, int count)
+    {
+        for (int i = start; i < start + count; i++) usedBins[i] = false;
+    }
+
+private:
+    std::vector<bool> usedBins;
+};
+
+enum ChurnMode { CHURN_LINEAR, CHURN_FIRST_FIT, CHURN_BEST_FIT };
+
+static const char* churnModeName(ChurnMode mode)
+{
+    switch (mode)
+	{
+        case CHURN_LINEAR: return "linear";
+        case CHURN_FIRST_FIT: return "first-fit";
+        default: return "best-fit";
+    }
+}
+
+struct ChurnState
+{
+    ChurnState(ChurnMode mode, int bins)
+        : mode(mode), linear(bins, 1), alloc(bins, 1), rng(1),
+          size(1, std::min(CHURN_MAX_REQUEST, bins - 1)), target((int)(CHURN_OCCUPANCY * (bins - 1))), used(0)
+    {
+        alloc.setPolicy(mode == CHURN_BEST_FIT ? ALLOC_BEST_FIT : ALLOC_FIRST_FIT);
+        live.reserve(bins);
+    }
+
+    void step()
+    {
+        if (used < target || live.empty())
+		{
+            int req = size(rng);
+            BinExtent ext = mode == CHURN_LINEAR ? linear.allocate(req) : alloc.allocate(req);
+            if (ext.count > 0)
+			{
+                live.push_back(ext);
+                used += ext.count;
+            }
+        }
+		else
+		{
+            size_t victim = rng() % live.size();
+            BinExtent ext = live[victim];
+            live[victim] = live.back();
+            live.pop_back();
+            if (mode == CHURN_LINEAR)
+                linear.release(ext.start, ext.count);
+            else
+                alloc.release(ext.start, ext.count);
+            used -= ext.count;
+        }
+    }
+
+    ChurnMode mode;
+    LinearAllocator linear;
+    BinAllocator alloc;
+    std::mt19937 rng;
+    std::uniform_int_distribution<int> size;
+    std::vector<BinExtent> live;
+    int target;
+    int used;
+};
+
+static void addAllocBenchmarks(std::vector<Benchmark>& list)
+{
+    const int sizes[] = { 128, 1200, 4096 };
+    for (int s = 0; s < 3; s++)
+	{
+        for (int m = CHURN_LINEAR; m <= CHURN_BEST_FIT; m++)
+		{
+            int bins = sizes[s];
+            ChurnMode mode = (ChurnMode)m;
+            addBench(list, std::string("alloc/") + churnModeName(mode) + "/" + std::to_string(bins), "ops", 1,
+                     [mode, bins]() -> BenchRun {
+                auto state = std::make_shared<ChurnState>(mode, bins);
+                return [state](long ops) {
+                    for (long i = 0; i < ops; i++) state->step();
+                };
+            });
+        }
+    }
+
+    // The same churn through the MAC's grant path: access requests and
+    // deallocations as decoded uplink symbols, so BaseStation::allocateBins and
+    // deallocateBins run with the allocation map updates around them
+    addBench(list, "bs/allocate-deallocate", "ops", 1, []() -> BenchRun {
+        struct State
+        {
+            State() : layout(makeFrameLayout(1024, 128, 10)), bs(layout), rng(1), used(0)
+            {
+                std::vector<std::complex<double>> active(layout.bins);
+                for (int uid = 0; uid < layout.maxUsers(); uid++)
+				{
+                    ControlMessage msg = ControlMessage();
+                    msg.ctrl = CTRL_ACCESS_REQUEST;
+                    msg.userId = uid;
+                    msg.count = 1 + uid % CHURN_MAX_REQUEST;
+                    encodeControl(layout, msg, active.data());
+                    requests.push_back(active);
+                    msg.ctrl = CTRL_DEALLOCATE;
+                    encodeControl(layout, msg, active.data());
+                    releases.push_back(active);
+                    idle.push_back(uid);
+                }
+                live.reserve(layout.maxUsers());
+            }
+
+            void step()
+            {
+                downlinks.clear();
+                if (used < (int)(CHURN_OCCUPANCY * (layout.bins - layout.headerBins())) || live.empty())
+				{
+                    int uid = idle[rng() % idle.size()];
+                    bs.handleUplink(requests[uid].data(), downlinks);
+                    BaseStation::AllocationMap::const_iterator it = bs.allocations().find(uid);
+                    if (it == bs.allocations().end()) return;
+                    std::swap(*std::find(idle.begin(), idle.end(), uid), idle.back());
+                    idle.pop_back();
+                    live.push_back(uid);
+                    used += it->second.second;
+                }
+				else
+				{
+                    size_t victim = rng() % live.size();
+                    int uid = live[victim];
+                    used -= bs.allocations().find(uid)->second.second;
+                    bs.handleUplink(releases[uid].data(), downlinks);
+                    live[victim] = live.back();
+                    live.pop_back();
+                    idle.push_back(uid);
+                }
+            }
+
+            FrameLayout layout;
+            BaseStation bs;
+            std::mt19937 rng;
+            std::vector<std::vector<std::complex<double>>> requests, releases;    // by user id
+            std::vector<int> idle, live;
+            std::vector<Downlink> downlinks;
+            int used;
+        };
+        auto st = std::make_shared<State>();
+        return [st](long ops) {
+            for (long i = 0; i < ops; i++) st->step();
+        };
+    });
+}
+
+// ---------------------------------------------------------------------------
+// Scheduler: one op is one TTI with every user backlogged. Granted users are
+// credited a TTI's worth of their grant, so leases renew and proportional
+// fair's averages move; users ask for 1-16 bins on links of 2-8 bits per bin.
+
+static void addSchedulerBenchmarks(std::vector<Benchmark>& list)
+{
+    const SchedulerPolicy policies[] = { SCHED_ROUND_ROBIN, SCHED_MAX_THROUGHPUT, SCHED_PROPORTIONAL_FAIR };
+    const int userCounts[] = { 64, 1024, 4096 };
+    for (int p = 0; p < 3; p++)
+	{
+        for (int n = 0; n < 3; n++)
+		{
+            SchedulerPolicy policy = policies[p];
+            int users = userCounts[n];
+            addBench(list, std::string("sched/") + schedulerPolicyName(policy) + "/" + std::to_string(users), "ttis", 1,
+                     [policy, users]() -> BenchRun {
+                struct State
+                {
+                    State(SchedulerPolicy policy, int users)
+                        : layout(makeFrameLayout(1024, 128, 12)), bins(layout.bins, layout.headerBins()),
+                          sched(policy, users, 4), slot(users, -1)
+                    {
+                        for (int uid = 0; uid < users; uid++)
+                            sched.request(uid, 1 + uid % CHURN_MAX_REQUEST, 2 * (1 + uid % MODULATION_COUNT));
+                        holders.reserve(users);
+                        grants.reserve(2 * users);
+                    }
+
+                    void step()
+                    {
+                        for (size_t i = 0; i < holders.size(); i++)
+						{
+                            BinExtent ext = sched.grantOf(holders[i]);
+                            sched.served(holders[i], ext.count * 2 * (1 + holders[i] % MODULATION_COUNT));
+                        }
+                        grants.clear();
+                        sched.runTti(bins, grants);
+                        for (size_t i = 0; i < grants.size(); i++)
+						{
+                            int uid = grants[i].userId;
+                            if (grants[i].count > 0 && slot[uid] < 0)
+							{
+                                slot[uid] = (int)holders.size();
+                                holders.push_back(uid);
+                            }
+                            else if (grants[i].count == 0 && slot[uid] >= 0)
+							{
+                                holders[slot[uid]] = holders.back();
+                                slot[holders.back()] = slot[uid];
+                                holders.pop_back();
+                                slot[uid] = -1;
+                            }
+                        }
+                    }
+
+                    FrameLayout layout;
+                    BinAllocator bins;
+                    MacScheduler sched;
+                    std::vector<int> slot;      // user -> index in holders, -1 without a grant
+                    std::vector<int> holders;
+                    std::vector<SchedulerGrant> grants;
+                };
+                auto st = std::make_shared<State>(policy, users);
+                return [st](long ops) {
+                    for (long i = 0; i < ops; i++) st->step();
+                };
+            });
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Downlink transmit side for one TTI: a relay segment to each of `users` users
+// holding 3 bins each on the 1024/128 numerology, sent as a symbol per message
+// or packed into multiplexed frames. Either way each symbol is encoded and
+// transformed once; per-user noise and I/O are left out.
+
+static void addDownlinkBenchmarks(std::vector<Benchmark>& list)
+{
+    const int userCounts[] = { 8, 32 };
+    for (int n = 0; n < 2; n++)
+	{
+        for (int mux = 0; mux < 2; mux++)
+		{
+            int users = userCounts[n];
+            addBench(list, std::string("downlink/") + (mux ? "mux/" : "per-message/") + std::to_string(users), "messages", users,
+                     [users, mux]() -> BenchRun {
+                struct State
+                {
+                    explicit State(int users)
+                        : layout(makeFrameLayout(1024, 128, 6)), builder(layout), active(layout.bins), time(layout.fftSize)
+                    {
+                        for (int uid = 0; uid < users; uid++)
+						{
+                            ControlMessage m = ControlMessage();
+                            m.ctrl = CTRL_DATA_TX;
+                            m.userId = uid;
+                            m.srcId = (uid + 1) % users;
+                            m.start = layout.headerBins() + 3 * uid;
+                            m.count = 3;
+                            m.modulation = MOD_QPSK;
+                            m.payload = uid;
+                            tti.push_back(m);
+                        }
+                        frameUsers.reserve(users);
+                    }
+                    FrameLayout layout;
+                    DownlinkFrameBuilder builder;
+                    std::vector<ControlMessage> tti;
+                    std::vector<int> frameUsers;
+                    std::vector<std::complex<double>> active, time;
+                };
+                auto st = std::make_shared<State>(users);
+                if (mux)
+                    return [st](long ops) {
+                        for (long i = 0; i < ops; i++)
+						{
+                            for (size_t m = 0; m < st->tti.size(); m++)
+                                st->builder.add(st->tti[m]);
+                            while (!st->builder.empty())
+							{
+                                st->builder.build(st->active.data(), st->frameUsers);
+                                activeBinsToTime(st->active.data(), st->layout.bins, st->time.data(), st->layout.fftSize);
+                            }
+                        }
+                    };
+                return [st](long ops) {
+                    for (long i = 0; i < ops; i++)
+                        for (size_t m = 0; m < st->tti.size(); m++)
+						{
+                            encodeControl(st->layout, st->tti[m], st->active.data());
+                            activeBinsToTime(st->active.data(), st->layout.bins, st->time.data(), st->layout.fftSize);
+                        }
+                };
+            });
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Uplink receive side for one TTI: a segment from each of `users` users holding
+// 3 bins each, received as a symbol per user or as one combined symbol. The
+// per-symbol path transforms and decodes each user's symbol; the combined path
+// sums them in the time domain, as the pipeline's reader does, and reads every
+// allocation from a single transform.
+
+static void addUplinkBenchmarks(std::vector<Benchmark>& list)
+{
+    const int userCounts[] = { 8, 32 };
+    for (int n = 0; n < 2; n++)
+	{
+        for (int combine = 0; combine < 2; combine++)
+		{
+            int users = userCounts[n];
+            addBench(list, std::string("uplink/") + (combine ? "combined/" : "per-symbol/") + std::to_string(users), "segments", users,
+                     [users, combine]() -> BenchRun {
+                struct State
+                {
+                    State(int users, bool combine)
+                        : layout(makeFrameLayout(1024, 128, 6)), active(layout.bins), sum(layout.fftSize), payloads(0)
+                    {
+                        std::vector<std::complex<double>> bins(layout.bins);
+                        for (int uid = 0; uid < users; uid++)
+						{
+                            ControlMessage m = ControlMessage();
+                            m.ctrl = CTRL_DATA_TX;
+                            m.userId = (uid + 1) % users;
+                            m.srcId = uid;
+                            m.start = layout.headerBins() + 3 * uid;
+                            m.count = 3;
+                            m.modulation = MOD_QPSK;
+                            m.payload = uid;
+                            m.seq = 1;
+                            if (combine)
+							{
+                                std::fill(bins.begin(), bins.end(), std::complex<double>(0, 0));
+                                encodePayload(bins.data(), m.start, m.count, m.modulation, m.payload);
+                            }
+							else
+							{
+                                encodeControl(layout, m, bins.data());
+                            }
+                            tti.push_back(std::vector<std::complex<double>>(layout.fftSize));
+                            activeBinsToTime(bins.data(), layout.bins, tti.back().data(), layout.fftSize);
+                            starts.push_back(m.start);
+                        }
+                    }
+                    FrameLayout layout;
+                    std::vector<std::vector<std::complex<double>>> tti;     // each user's symbol
+                    std::vector<int> starts;
+                    std::vector<std::complex<double>> active, sum;
+                    long payloads;
+                };
+                auto st = std::make_shared<State>(users, combine != 0);
+                if (combine)
+                    return [st](long ops) {
+                        for (long i = 0; i < ops; i++)
+						{
+                            std::copy(st->tti[0].begin(), st->tti[0].end(), st->sum.begin());
+                            for (size_t u = 1; u < st->tti.size(); u++)
+                                for (int k = 0; k < st->layout.fftSize; k++)
+                                    st->sum[k] += st->tti[u][k];
+                            timeToActiveBins(st->sum.data(), st->layout.fftSize, st->active.data(), st->layout.bins);
+                            st->payloads += controlOccupancy(st->layout, st->active.data());
+                            for (size_t u = 0; u < st->starts.size(); u++)
+                                st->payloads += decodePayload(st->active.data(), st->starts[u], 3, MOD_QPSK);
+                        }
+                    };
+                return [st](long ops) {
+                    for (long i = 0; i < ops; i++)
+                        for (size_t u = 0; u < st->tti.size(); u++)
+						{
+                            timeToActiveBins(st->tti[u].data(), st->layout.fftSize, st->active.data(), st->layout.bins);
+                            ControlMessage m = decodeControl(st->layout, st->active.data());
+                            st->payloads += decodePayload(st->active.data(), st->starts[m.srcId], 3, MOD_QPSK);
+                        }
+                };
+            });
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// End to end: uplink symbols through the base station and back out as relayed
+// downlinks. The traffic is recorded once from UserTerminals: every user is
+// granted bins, then they all send messages round-robin to the next user.
+
+struct RelayTraffic
+{
+    FrameLayout layout;
+    std::vector<std::vector<std::complex<double>>> grants;  // access requests, replayed untimed
+    std::vector<std::vector<std::complex<double>>> data;    // whole messages, replayed in a loop
+};
+
+static std::shared_ptr<RelayTraffic> makeRelayTraffic(const FrameLayout& layout, int users, int bins, size_t messageBytes)
+{
+    auto traffic = std::make_shared<RelayTraffic>();
+    traffic->layout = layout;
+    BaseStation bs(layout);
+    std::vector<UserTerminal> terms;
+    std::vector<std::complex<double>> active(layout.bins), time(layout.fftSize);
+    std::vector<Downlink> downlinks;
+
+    for (int u = 0; u < users; u++)
+	{
+        terms.push_back(UserTerminal(layout, u));
+        terms[u].accessRequest(bins, active.data());
+        activeBinsToTime(active.data(), layout.bins, time.data(), layout.fftSize);
+        traffic->grants.push_back(time);
+        downlinks.clear();
+        bs.handleUplink(active.data(), downlinks);
+        for (size_t i = 0; i < downlinks.size(); i++)
+		{
+            encodeControl(layout, downlinks[i].msg, active.data());
+            terms[downlinks[i].userId].handleDownlink(active.data());
+        }
+    }
+
+    std::vector<uint8_t> message(messageBytes);
+    for (size_t i = 0; i < messageBytes; i++) message[i] = (uint8_t)('a' + i % 26);
+    for (int u = 0; u < users; u++)
+        terms[u].sendData((u + 1) % users, message.data(), message.size());
+    for (bool pending = true; pending; )
+	{
+        pending = false;
+        for (int u = 0; u < users; u++)
+		{
+            if (!terms[u].nextDataTx(active.data())) continue;
+            activeBinsToTime(active.data(), layout.bins, time.data(), layout.fftSize);
+            traffic->data.push_back(time);
+            pending = true;
+        }
+    }
+    return traffic;
+}
+
+// BaseStation with the recorded grants applied
+static void grantTraffic(BaseStation& bs, const RelayTraffic& traffic)
+{
+    std::vector<std::complex<double>> active(traffic.layout.bins);
+    std::vector<Downlink> downlinks;
+    for (size_t i = 0; i < traffic.grants.size(); i++)
+	{
+        timeToActiveBins(traffic.grants[i].data(), traffic.layout.fftSize, active.data(), traffic.layout.bins);
+        bs.handleUplink(active.data(), downlinks);
+    }
+}
+
+// Feeds a recorded uplink to the pipeline's reader, as many symbols as allowed,
+// and swallows the downlinks
+class ReplayTransport : public Transport
+{
+public:
+    explicit ReplayTransport(std::shared_ptr<RelayTraffic> traffic) : traffic(traffic), budget(0), next(0) {}
+
+    void allow(long symbols) { budget.fetch_add(symbols); }
+
+    bool send(int, const std::complex<double>* samples, int)
+    {
+        consume(samples[0]);
+        return true;
+    }
+
+    int receive(int, std::complex<double>* samples, int capacity, int)
+    {
+        if (budget.load() <= 0)
+		{
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+            return 0;
+        }
+        budget.fetch_sub(1);
+        const std::vector<std::complex<double>>& sym = traffic->data[next++ % traffic->data.size()];
+        int n = std::min<int>(capacity, (int)sym.size());
+        std::copy(sym.begin(), sym.begin() + n, samples);
+        return n;
+    }
+
+private:
+    std::shared_ptr<RelayTraffic> traffic;
+    std::atomic<long> budget;
+    size_t next;    // reader thread only
+};
+
+static void addRelayBenchmarks(std::vector<Benchmark>& list)
+{
+    struct RelayCase { const char* name; int fftSize, bins, idBits, users, grant; };
+    const RelayCase cases[] = {
+        { "64/8", FFT_SIZE, FREQ_BINS, 2, 4, 1 },
+        { "1024/128", 1024, 128, 12, 32, 3 },
+    };
+    for (int c = 0; c < 2; c++)
+	{
+        RelayCase rc = cases[c];
+        FrameLayout layout = rc.fftSize == FFT_SIZE ? legacyLayout() : makeFrameLayout(rc.fftSize, rc.bins, rc.idBits);
+
+        // One thread: demux, MAC, then encode, mux and noise for every downlink
+        addBench(list, std::string("relay/serial/") + rc.name, "symbols", 1, [rc, layout]() -> BenchRun {
+            struct State
+            {
+                explicit State(const FrameLayout& layout) : bs(layout), active(layout.bins), time(layout.fftSize), next(0) {}
+                std::shared_ptr<RelayTraffic> traffic;
+                BaseStation bs;
+                std::vector<std::complex<double>> active, time;
+                std::vector<Downlink> downlinks;
+                std::map<int, uint64_t> txSymbols;
+                size_t next;
+            };
+            auto st = std::make_shared<State>(layout);
+            st->traffic = makeRelayTraffic(layout, rc.users, rc.grant, 4);
+            grantTraffic(st->bs, *st->traffic);
+            return [st, layout](long ops) {
+                for (long i = 0; i < ops; i++)
+				{
+                    const std::vector<std::complex<double>>& sym = st->traffic->data[st->next++ % st->traffic->data.size()];
+                    timeToActiveBins(sym.data(), layout.fftSize, st->active.data(), layout.bins);
+                    st->downlinks.clear();
+                    st->bs.handleUplink(st->active.data(), st->downlinks);
+                    for (size_t d = 0; d < st->downlinks.size(); d++)
+					{
+                        int uid = st->downlinks[d].userId;
+                        encodeControl(layout, st->downlinks[d].msg, st->active.data());
+                        activeBinsToTime(st->active.data(), layout.bins, st->time.data(), layout.fftSize);
+                        addAWGN(st->time.data(), st->time.size(), NOISE_VARIANCE, noiseKey(downlinkNoise(uid), st->txSymbols[uid]++));
+                        consume(st->time[0]);
+                    }
+                }
+            };
+        });
+
+        // The base_station process's pipeline, fed from memory
+        addBench(list, std::string("relay/pipeline/") + rc.name, "symbols", 1, [rc, layout]() -> BenchRun {
+            struct State
+            {
+                State(std::shared_ptr<RelayTraffic> traffic)
+                    : traffic(traffic), bs(traffic->layout), link(traffic), target(0)
+                {
+                    grantTraffic(bs, *traffic);
+                    pipeline.reset(new BaseStationPipeline(bs, link, 0, 0, 64));
+                    pipeline->start();
+                }
+                ~State() { pipeline->stop(); }
+                std::shared_ptr<RelayTraffic> traffic;
+                BaseStation bs;
+                ReplayTransport link;
+                std::unique_ptr<BaseStationPipeline> pipeline;
+                uint64_t target;
+            };
+            auto st = std::make_shared<State>(makeRelayTraffic(layout, rc.users, rc.grant, 4));
+            return [st](long ops) {
+                st->target += ops;
+                st->link.allow(ops);
+                Backoff backoff;
+                while (st->pipeline->handledSymbols() < st->target)
+                    backoff.pause();
+            };
+        });
+    }
+}
+
+// The user process's loop with its allocation granted: decode a relayed downlink
+// symbol, then encode, transform and add noise to one uplink segment
+static void addUserBenchmarks(std::vector<Benchmark>& list)
+{
+    addBench(list, "user/rx-tx/64/8", "symbols", 2, []() -> BenchRun {
+        struct State
+        {
+            explicit State(const FrameLayout& layout)
+                : terminal(layout, 1), message(64, 'x'), rxActive(layout.bins), txActive(layout.bins), txWave(layout.fftSize), next(0), txSymbols(0) {}
+            UserTerminal terminal;
+            std::string message;
+            std::vector<std::vector<std::complex<double>>> downlinks;  // relayed to user 1
+            std::vector<std::complex<double>> rxActive, txActive, txWave;
+            size_t next;
+            uint64_t txSymbols;
+        };
+        FrameLayout layout = legacyLayout();
+        auto st = std::make_shared<State>(layout);
+        auto traffic = makeRelayTraffic(layout, 4, 1, 4);
+
+        // Replay the recorded uplink through a base station, granting user 1's
+        // terminal and keeping the downlinks addressed to it
+        BaseStation bs(layout);
+        std::vector<std::complex<double>> active(layout.bins), time(layout.fftSize);
+        std::vector<Downlink> out;
+        for (size_t i = 0; i < traffic->grants.size() + traffic->data.size(); i++)
+		{
+            bool grant = i < traffic->grants.size();
+            const std::vector<std::complex<double>>& sym = grant ? traffic->grants[i] : traffic->data[i - traffic->grants.size()];
+            timeToActiveBins(sym.data(), layout.fftSize, active.data(), layout.bins);
+            out.clear();
+            bs.handleUplink(active.data(), out);
+            for (size_t d = 0; d < out.size(); d++)
+			{
+                if (out[d].userId != 1) continue;
+                encodeControl(layout, out[d].msg, active.data());
+                if (grant)
+                    st->terminal.handleDownlink(active.data());
+                else
+				{
+                    activeBinsToTime(active.data(), layout.bins, time.data(), layout.fftSize);
+                    st->downlinks.push_back(time);
+                }
+            }
+        }
+        return [st](long ops) {
+            for (long i = 0; i < ops; i++)
+			{
+                demuxActiveBins(st->downlinks[st->next++ % st->downlinks.size()].data(), st->rxActive.data());
+                st->terminal.handleDownlink(st->rxActive.data());
+                if (st->terminal.completedMessage()) consume(st->rxActive[0]);
+
+                if (!st->terminal.dataPending())
+                    st->terminal.sendData(2, (const uint8_t*)st->message.data(), st->message.size());
+                st->terminal.nextDataTx(st->txActive.data());
+                muxActiveBins(st->txActive.data(), st->txWave.data());
+                addAWGN(st->txWave.data(), st->txWave.size(), NOISE_VARIANCE, noiseKey(uplinkNoise(1), st->txSymbols++));
+                consume(st->txWave[0]);
+            }
+        };
+    });
+}
+
+// ---------------------------------------------------------------------------
+// Event log: a binary record on the hot path against the text line it replaces
+
+static const char* const BENCH_EVENT_LOG_FILE = "bench_events.evt";
+
+// Formats like the text log, writes nowhere
+class DiscardBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) { return n; }
+};
+
+static void addLogBenchmarks(std::vector<Benchmark>& list)
+{
+    addBench(list, "log/record", "events", 1, []() -> BenchRun {
+        auto events = std::make_shared<EventLog>();
+        events->open(BENCH_EVENT_LOG_FILE);
+        events->record(EVENT_ACCESS_REQUEST, 0, -1, -1, 4);   // registers this thread's buffer
+        return [events](long ops) {
+            for (long i = 0; i < ops; i++)
+                events->record(EVENT_DATA, (int)i & 63, 1, 40, 8, 4);
+        };
+    });
+
+    addBench(list, "log/text", "events", 1, []() -> BenchRun {
+        struct State
+        {
+            State() : out(&discard) {}
+            DiscardBuffer discard;
+            std::ostream out;
+        };
+        auto st = std::make_shared<State>();
+        return [st](long ops) {
+            for (long i = 0; i < ops; i++)
+                st->out << "Data from user " << ((int)i & 63) << " to user " << 1 << " => " << 4 << " bytes\n";
+        };
+    });
+}
+
+// ---------------------------------------------------------------------------
+
+static bool optionValue(const std::string& arg, const char* name, std::string& value)
+{
+    size_t len = strlen(name);
+    if (arg.compare(0, len, name) != 0) return false;
+    value = arg.substr(len);
+    return true;
+}
+
+static void writeJson(std::ostream& out, const std::vector<BenchResult>& results, int reps, double minTimeMs)
+{
+    out << std::setprecision(6);
+    out << "{\n  \"batch_isa\": \"" << batchIsaName(batchIsa()) << "\",\n  \"reps\": " << reps
+        << ",\n  \"min_time_ms\": " << minTimeMs << ",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+	{
+        const BenchResult& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"unit\": \"" << r.unit << "\", \"ops_per_sample\": " << r.opsPerSample
+            << ", \"samples\": " << r.samples << ", \"ns_per_op\": {\"median\": " << r.median << ", \"mean\": " << r.mean
+            << ", \"min\": " << r.min << ", \"stddev\": " << r.stddev << "}, \"throughput_per_s\": " << r.throughput
+            << ", \"allocs_per_op\": " << r.allocsPerOp << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char* argv[])
+{
+    int reps = 10;
+    double minTimeMs = 20;
+    std::vector<std::string> filters;
+    std::string jsonFile;
+    bool listOnly = false;
+    double maxAllocs = -1;  // fail when a benchmark allocates more per op
+
+    for (int i = 1; i < argc; i++)
+	{
+        std::string arg = argv[i], value;
+        if (optionValue(arg, "--reps=", value)) reps = atoi(value.c_str());
+        else if (optionValue(arg, "--min-time=", value)) minTimeMs = atof(value.c_str());
+        else if (optionValue(arg, "--filter=", value)) filters.push_back(value);
+        else if (optionValue(arg, "--json=", value)) jsonFile = value;
+        else if (optionValue(arg, "--max-allocs=", value)) maxAllocs = atof(value.c_str());
+        else if (arg == "--list") listOnly = true;
+        else
+		{
+            cerr << "Usage: ofdma_bench [--filter=SUBSTRING]... [--reps=N] [--min-time=MS] [--json=FILE] [--max-allocs=N] [--list]" << endl;
+            return 1;
+        }
+    }
+    if (reps < 1 || minTimeMs <= 0)
+	{
+        cerr << "--reps and --min-time must be positive" << endl;
+        return 1;
+    }
+
+    std::vector<Benchmark> all;
+    addDspBenchmarks(all);
+    addFecBenchmarks(all);
+    addWaveformBenchmarks(all);
+    addAllocBenchmarks(all);
+    addSchedulerBenchmarks(all);
+    addDownlinkBenchmarks(all);
+    addUplinkBenchmarks(all);
+    addRelayBenchmarks(all);
+    addUserBenchmarks(all);
+    addLogBenchmarks(all);
+
+    std::vector<Benchmark> selected;
+    for (size_t i = 0; i < all.size(); i++)
+	{
+        bool match = filters.empty();
+        for (size_t f = 0; f < filters.size() && !match; f++)
+            match = all[i].name.find(filters[f]) != std::string::npos;
+        if (match) selected.push_back(all[i]);
+    }
+    if (listOnly)
+	{
+        for (size_t i = 0; i < selected.size(); i++) cout << selected[i].name << endl;
+        return 0;
+    }
+
+    cout << "batch ISA " << batchIsaName(batchIsa()) << ", " << reps << " samples of >= " << minTimeMs << " ms each" << endl;
+    cout << left << setw(28) << "benchmark" << right << setw(12) << "ns/op" << setw(9) << "+/-%"
+         << setw(16) << "throughput/s" << setw(10) << "unit" << setw(12) << "allocs/op" << endl;
+    std::vector<BenchResult> results;
+    for (size_t i = 0; i < selected.size(); i++)
+	{
+        BenchResult r = runBenchmark(selected[i], reps, minTimeMs);
+        cout << left << setw(28) << r.name << right << fixed << setprecision(1) << setw(12) << r.median
+             << setw(9) << (r.mean > 0 ? 100 * r.stddev / r.mean : 0.0) << defaultfloat << setprecision(4)
+             << setw(16) << r.throughput << setw(10) << r.unit << setw(12) << r.allocsPerOp << endl;
+        results.push_back(r);
+    }
+    std::remove(BENCH_TEXT_FILE);
+    std::remove(BENCH_BIN_FILE);
+    std::remove(BENCH_EVENT_LOG_FILE);
+
+    if (!jsonFile.empty())
+	{
+        std::ofstream ofs(jsonFile);
+        if (!ofs)
+		{
+            std::cerr << "Error writing to " << jsonFile << std::endl;
+            return 1;
+        }
+        writeJson(ofs, results, reps, minTimeMs);
+    }
+
+    // Allocation gate, e.g. --max-allocs=0 over the steady-state datapath
+    int over = 0;
+    for (size_t i = 0; maxAllocs >= 0 && i < results.size(); i++)
+	{
+        if (results[i].allocsPerOp <= maxAllocs) continue;
+        cerr << results[i].name << ": " << results[i].allocsPerOp << " allocs/op exceeds --max-allocs=" << maxAllocs << endl;
+        over++;
+    }
+    return over ? 1 : 0;
+}
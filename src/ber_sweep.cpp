@@ -0,0 +1,589 @@
+#define _USE_MATH_DEFINES
+#include "signal_processing.h"
+#include "numerology.h"
+#include "noise.h"
+#include "modulation.h"
+#include "frame.h"
+#include "conv_code.h"
+#include "work_stealing_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+
+using namespace std;
+
+// Monte-Carlo BER/SER sweep of QAM -> IFFT -> AWGN -> FFT -> demodulation over
+// a grid of SNR points and allocation sizes. Each point runs in fixed-size chunks
+// of symbols; chunk c of point p always sees the same data and noise (keyed by
+// seed, point and symbol index), and a point stops at the first chunk prefix that
+// reaches the error target. Chunks past that prefix may run but are discarded, so
+// the results do not depend on the number of threads. --sample-format runs the
+// mux and demux in float or Q15 instead of double; --accuracy reports how far
+// those paths stray from the double reference instead of sweeping. --fec=RATE
+// fills each chunk with convolutional codewords and soft-decodes them, adding the
+// decoded bit and block error rates; the error target then counts decoded errors.
+
+struct SweepConfig
+{
+    const NumerologyOps* numerology;
+    SampleFormat format;
+    Modulation modulation;
+    double snrStart, snrStop, snrStep;  // Es/N0 per active bin, dB
+    std::vector<int> allocs;            // active bins carrying data
+    FecRate fec;
+    long long targetErrors;             // bit errors per point
+    long long maxSymbols;               // per point
+    int chunkSymbols;
+    int window;                         // chunks in flight per point past its done prefix
+    uint64_t seed;
+};
+
+struct ChunkResult
+{
+    long long symbols;
+    long long bits;
+    long long bitErrors;
+    long long symbolErrors;     // QAM symbols (bins) with at least one bit wrong
+    // --fec: decoded information bits and codewords
+    long long infoBits;
+    long long infoErrors;
+    long long blocks;
+    long long blockErrors;
+};
+
+// Information bits per codeword in --fec sweeps: a 32-byte message
+constexpr int FEC_BLOCK_BITS = 256;
+
+// Errors the target counts
+static long long countedErrors(const SweepConfig& cfg, const ChunkResult& res)
+{
+    return cfg.fec != FEC_NONE ? res.infoErrors : res.bitErrors;
+}
+
+// Symbols in a chunk: cfg.chunkSymbols, except a last chunk cut short by cfg.maxSymbols
+static int chunkLength(const SweepConfig& cfg, int chunk)
+{
+    return (int)std::min<long long>(cfg.chunkSymbols, cfg.maxSymbols - (long long)chunk * cfg.chunkSymbols);
+}
+
+// Codewords that fit in symbols of an allocation; the bits past them are padding
+static int chunkBlocks(const SweepConfig& cfg, int symbols, int alloc)
+{
+    size_t slots = (size_t)symbols * alloc * modulationBits(cfg.modulation);
+    return (int)(slots / fecCodedBits(cfg.fec, FEC_BLOCK_BITS));
+}
+
+struct SweepPoint
+{
+    int index;
+    double snrDb;
+    int alloc;
+    double sigma2;              // time-domain noise variance per real dimension
+
+    std::mutex mtx;
+    std::vector<ChunkResult> chunks;
+    std::vector<bool> done;
+    int issued;
+    int prefix;                 // chunks [0, prefix) are all done
+    long long prefixErrors;
+    int stopChunks;             // chunks counted in the result, 0 until decided
+    ChunkResult total;
+};
+
+static ChunkResult runChunk(const SweepConfig& cfg, const SweepPoint& pt, int chunk)
+{
+    const NumerologyOps& num = *cfg.numerology;
+    SampleChain chain(num, cfg.format);
+    std::vector<std::complex<double>> active(num.bins), time(num.fftSize), rx(num.bins);
+    std::vector<int> sent(pt.alloc);
+    const Modulation mod = cfg.modulation;
+    const int bits = modulationBits(mod);
+    ChunkResult res = ChunkResult();
+    const int symbols = chunkLength(cfg, chunk);
+
+    // Coded: the chunk's bits are its codewords, encoded up front
+    const bool coded = cfg.fec != FEC_NONE;
+    const int blocks = coded ? chunkBlocks(cfg, symbols, pt.alloc) : 0;
+    const size_t blockBytes = FEC_BLOCK_BITS / 8;
+    const size_t blockCoded = fecCodedBits(cfg.fec, FEC_BLOCK_BITS);
+    std::vector<uint8_t> info(blocks * blockBytes), codedBits, decoded(blocks * blockBytes);
+    std::vector<int8_t> soft;
+    if (coded)
+	{
+        codedBits.assign((size_t)symbols * pt.alloc * bits, 0);
+        soft.resize(codedBits.size());
+        NoiseKey infoKey = { cfg.seed, 2u * pt.index, (uint64_t)chunk };
+        NoiseStream src(infoKey);
+        for (size_t i = 0; i < info.size(); i++)
+            info[i] = (uint8_t)src.next64();
+        for (int k = 0; k < blocks; k++)
+            convEncode(cfg.fec, &info[k * blockBytes], FEC_BLOCK_BITS, &codedBits[k * blockCoded]);
+    }
+
+    for (int i = 0; i < symbols; i++)
+	{
+        uint64_t symbol = (uint64_t)chunk * cfg.chunkSymbols + i;
+
+        // Data: one byte of random bits per allocated bin; unallocated bins stay empty
+        NoiseKey dataKey = { cfg.seed, 2u * pt.index, symbol };
+        NoiseStream data(dataKey);
+        uint64_t word = 0;
+        for (int b = 0; b < num.bins; b++)
+		{
+            if (b >= pt.alloc)
+			{
+                active[b] = 0;
+                continue;
+            }
+            if (coded)
+			{
+                const uint8_t* c = &codedBits[((size_t)i * pt.alloc + b) * bits];
+                sent[b] = 0;
+                for (int k = 0; k < bits; k++)
+                    sent[b] = (sent[b] << 1) | c[k];
+            }
+			else
+			{
+                if ((b & 7) == 0) word = data.next64();
+                sent[b] = (word >> (8 * (b & 7))) & ((1 << bits) - 1);
+            }
+            active[b] = mapSymbol(mod, sent[b]);
+        }
+
+        chain.mux(active.data());
+        NoiseKey noiseKey = { cfg.seed, 2u * pt.index + 1, symbol };
+        chain.addNoise(pt.sigma2, noiseKey);
+        chain.demux(rx.data());
+
+        for (int b = 0; b < pt.alloc; b++)
+		{
+            int errors = __builtin_popcount(demapSymbol(mod, rx[b]) ^ sent[b]);
+            res.bitErrors += errors;
+            res.symbolErrors += errors > 0;
+        }
+        if (coded) decodePayloadSoft(rx.data(), 0, pt.alloc, mod, &soft[(size_t)i * pt.alloc * bits]);
+        res.symbols++;
+        res.bits += bits * pt.alloc;
+    }
+
+    if (coded)
+	{
+        // All of the chunk's codewords in one batch, in lockstep groups
+        static thread_local ViterbiDecoder decoder;
+        std::vector<const int8_t*> in(blocks);
+        std::vector<uint8_t*> out(blocks);
+        for (int k = 0; k < blocks; k++)
+		{
+            in[k] = &soft[k * blockCoded];
+            out[k] = &decoded[k * blockBytes];
+        }
+        decoder.decodeBatch(cfg.fec, in.data(), FEC_BLOCK_BITS, out.data(), blocks);
+        for (int k = 0; k < blocks; k++)
+		{
+            int errors = 0;
+            for (size_t j = 0; j < blockBytes; j++)
+                errors += __builtin_popcount(info[k * blockBytes + j] ^ decoded[k * blockBytes + j]);
+            res.infoErrors += errors;
+            res.blockErrors += errors > 0;
+        }
+        res.infoBits = (long long)blocks * FEC_BLOCK_BITS;
+        res.blocks = blocks;
+    }
+    return res;
+}
+
+static void issueChunk(WorkStealingPool& pool, const SweepConfig& cfg, SweepPoint& pt, int chunk);
+
+static int maxChunks(const SweepConfig& cfg)
+{
+    return (int)((cfg.maxSymbols + cfg.chunkSymbols - 1) / cfg.chunkSymbols);
+}
+
+// Reserves the next chunks of an unfinished point, keeping at most cfg.window
+// past its done prefix so the chunk that decides the stop is never starved by
+// later ones. Caller holds pt.mtx.
+static void claimChunks(const SweepConfig& cfg, SweepPoint& pt, std::vector<int>& claimed)
+{
+    while (pt.stopChunks == 0 && pt.issued < maxChunks(cfg) && pt.issued - pt.prefix < cfg.window)
+	{
+        claimed.push_back(pt.issued++);
+        pt.chunks.push_back(ChunkResult());
+        pt.done.push_back(false);
+    }
+}
+
+static void chunkDone(WorkStealingPool& pool, const SweepConfig& cfg, SweepPoint& pt, int chunk, const ChunkResult& res)
+{
+    std::vector<int> next;
+    {
+        std::lock_guard<std::mutex> lock(pt.mtx);
+        pt.chunks[chunk] = res;
+        pt.done[chunk] = true;
+        while (pt.prefix < pt.issued && pt.done[pt.prefix])
+		{
+            pt.prefixErrors += countedErrors(cfg, pt.chunks[pt.prefix]);
+            pt.prefix++;
+            if (pt.stopChunks == 0 && (pt.prefixErrors >= cfg.targetErrors || pt.prefix == maxChunks(cfg)))
+                pt.stopChunks = pt.prefix;
+        }
+        claimChunks(cfg, pt, next);
+    }
+    for (size_t i = 0; i < next.size(); i++)
+        issueChunk(pool, cfg, pt, next[i]);
+}
+
+static void issueChunk(WorkStealingPool& pool, const SweepConfig& cfg, SweepPoint& pt, int chunk)
+{
+    SweepPoint* p = &pt;
+    const SweepConfig* c = &cfg;
+    WorkStealingPool* wp = &pool;
+    pool.submit([wp, c, p, chunk]
+	{
+        ChunkResult res = runChunk(*c, *p, chunk);
+        chunkDone(*wp, *c, *p, chunk, res);
+    });
+}
+
+// Gray-coded square M-QAM, nearest-neighbour approximation (exact for QPSK)
+static double theoryBer(Modulation mod, double esn0)
+{
+    int k = modulationBits(mod);
+    double m = (double)(1 << k);
+    double q = 0.5 * erfc(sqrt(3 * esn0 / (m - 1)) / sqrt(2.0));
+    return 4.0 / k * (1 - 1 / sqrt(m)) * q;
+}
+
+struct AccuracyResult
+{
+    double txSqnrDb;    // time samples after mux
+    double rxSqnrDb;    // active bins after mux and demux
+    double evmPercent;  // RMS error of the active bins relative to their RMS
+    double maxError;    // largest active-bin error magnitude
+};
+
+// Noise-free mux and demux in format, against the double reference, over
+// symbols of random data in every bin
+static AccuracyResult measureAccuracy(const NumerologyOps& num, SampleFormat format, Modulation mod, int symbols, uint64_t seed)
+{
+    SampleChain chain(num, format);
+    std::vector<std::complex<double>> active(num.bins), time(num.fftSize), ref(num.fftSize), rx(num.bins);
+    const int bits = modulationBits(mod);
+    double txSignal = 0, txError = 0, rxSignal = 0, rxError = 0;
+    AccuracyResult res = AccuracyResult();
+
+    for (int i = 0; i < symbols; i++)
+	{
+        NoiseKey key = { seed, 0xACC0u + (uint32_t)format, (uint64_t)i };
+        NoiseStream data(key);
+        for (int b = 0; b < num.bins; b++)
+            active[b] = mapSymbol(mod, (int)(data.next64() & ((1 << bits) - 1)));
+
+        num.mux(active.data(), ref.data());
+        chain.mux(active.data());
+        chain.timeSamples(time.data());
+        for (int n = 0; n < num.fftSize; n++)
+		{
+            txSignal += std::norm(ref[n]);
+            txError += std::norm(time[n] - ref[n]);
+        }
+
+        chain.demux(rx.data());
+        for (int b = 0; b < num.bins; b++)
+		{
+            double err = std::abs(rx[b] - active[b]);
+            rxSignal += std::norm(active[b]);
+            rxError += err * err;
+            res.maxError = std::max(res.maxError, err);
+        }
+    }
+    // An exact path reports infinity
+    res.txSqnrDb = 10 * log10(txSignal / txError);
+    res.rxSqnrDb = 10 * log10(rxSignal / rxError);
+    res.evmPercent = 100 * sqrt(rxError / rxSignal);
+    return res;
+}
+
+// Symbols per numerology and format in the --accuracy report
+constexpr int ACCURACY_SYMBOLS = 1000;
+
+static bool writeTextFile(const std::string& filename, const std::string& text)
+{
+    std::ofstream ofs(filename);
+    if (!ofs)
+	{
+        std::cerr << "Error writing to " << filename << std::endl;
+        return false;
+    }
+    ofs << text;
+    return true;
+}
+
+static bool optionValue(const std::string& arg, const char* name, std::string& value)
+{
+    size_t len = strlen(name);
+    if (arg.compare(0, len, name) != 0) return false;
+    value = arg.substr(len);
+    return true;
+}
+
+static void usage()
+{
+    cerr << "Usage: ber_sweep [--numerology=FFT/BINS] [--modulation=qpsk|16qam|64qam|256qam] [--snr=START:STOP:STEP] [--alloc=N,N,...]\n"
+         << "                 [--fec=1/2|2/3|3/4|5/6]\n"
+         << "                 [--target-errors=N] [--max-symbols=N] [--chunk=N] [--threads=N] [--seed=N]\n"
+         << "                 [--sample-format=cf64|cf32|cq15] [--accuracy] [--csv=FILE] [--json=FILE]" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    SweepConfig cfg;
+    cfg.numerology = findNumerology("64/8");
+    cfg.format = FORMAT_CF64;
+    parseSampleFormat(DEFAULT_SAMPLE_FORMAT, cfg.format);
+    cfg.modulation = MOD_QPSK;
+    cfg.fec = FEC_NONE;
+    cfg.snrStart = 0;
+    cfg.snrStop = 10;
+    cfg.snrStep = 1;
+    cfg.targetErrors = 200;
+    cfg.maxSymbols = 1000000;
+    cfg.chunkSymbols = 256;
+    cfg.seed = 1;
+    int threads = 0;
+    bool accuracy = false;
+    std::string csvFile, jsonFile;
+
+    for (int i = 1; i < argc; i++)
+	{
+        std::string arg = argv[i], value;
+        if (optionValue(arg, "--numerology=", value))
+		{
+            cfg.numerology = findNumerology(value);
+            if (!cfg.numerology)
+			{
+                cerr << "Unknown numerology " << value << " (available: " << numerologyNames() << ")" << endl;
+                return 1;
+            }
+        }
+        else if (optionValue(arg, "--sample-format=", value))
+		{
+            if (!parseSampleFormat(value, cfg.format))
+			{
+                cerr << "Unknown sample format " << value << " (cf64, cf32 or cq15)" << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--accuracy") accuracy = true;
+        else if (optionValue(arg, "--modulation=", value))
+		{
+            if (!parseModulation(value, cfg.modulation))
+			{
+                cerr << "Unknown modulation " << value << endl;
+                return 1;
+            }
+        }
+        else if (optionValue(arg, "--fec=", value))
+		{
+            if (!parseFecRate(value, cfg.fec))
+			{
+                cerr << "Unknown code rate " << value << " (none, 1/2, 2/3, 3/4 or 5/6)" << endl;
+                return 1;
+            }
+        }
+        else if (optionValue(arg, "--snr=", value))
+		{
+            if (sscanf(value.c_str(), "%lf:%lf:%lf", &cfg.snrStart, &cfg.snrStop, &cfg.snrStep) != 3 || cfg.snrStep <= 0)
+			{
+                usage();
+                return 1;
+            }
+        }
+        else if (optionValue(arg, "--alloc=", value))
+		{
+            std::istringstream iss(value);
+            std::string item;
+            while (std::getline(iss, item, ','))
+                cfg.allocs.push_back(atoi(item.c_str()));
+        }
+        else if (optionValue(arg, "--target-errors=", value)) cfg.targetErrors = atoll(value.c_str());
+        else if (optionValue(arg, "--max-symbols=", value)) cfg.maxSymbols = (long long)atof(value.c_str());
+        else if (optionValue(arg, "--chunk=", value)) cfg.chunkSymbols = atoi(value.c_str());
+        else if (optionValue(arg, "--threads=", value)) threads = atoi(value.c_str());
+        else if (optionValue(arg, "--seed=", value)) cfg.seed = strtoull(value.c_str(), nullptr, 10);
+        else if (optionValue(arg, "--csv=", value)) csvFile = value;
+        else if (optionValue(arg, "--json=", value)) jsonFile = value;
+        else
+		{
+            usage();
+            return 1;
+        }
+    }
+
+    if (accuracy)
+	{
+        std::ostringstream csv;
+        csv << "numerology,sample_format,modulation,symbols,tx_sqnr_db,rx_sqnr_db,evm_percent,max_error\n";
+        csv << std::setprecision(4);
+        for (int n = 0; n < numerologyCount(); n++)
+		{
+            for (int f = FORMAT_CF32; f <= FORMAT_CQ15; f++)
+			{
+                const NumerologyOps& num = numerologyAt(n);
+                AccuracyResult r = measureAccuracy(num, (SampleFormat)f, cfg.modulation, ACCURACY_SYMBOLS, cfg.seed);
+                csv << num.name << "," << sampleFormatName((SampleFormat)f) << "," << modulationName(cfg.modulation) << ","
+                    << ACCURACY_SYMBOLS << "," << r.txSqnrDb << "," << r.rxSqnrDb << "," << r.evmPercent << "," << r.maxError << "\n";
+            }
+        }
+        cout << csv.str();
+        return csvFile.empty() || writeTextFile(csvFile, csv.str()) ? 0 : 1;
+    }
+
+    const NumerologyOps& num = *cfg.numerology;
+    if (cfg.allocs.empty()) cfg.allocs.push_back(num.bins);
+    for (size_t a = 0; a < cfg.allocs.size(); a++)
+	{
+        if (cfg.allocs[a] < 1 || cfg.allocs[a] > num.bins)
+		{
+            cerr << "Allocations must be 1-" << num.bins << endl;
+            return 1;
+        }
+    }
+    if (cfg.chunkSymbols < 1 || cfg.maxSymbols < 1)
+	{
+        usage();
+        return 1;
+    }
+    for (size_t a = 0; a < cfg.allocs.size() && cfg.fec != FEC_NONE; a++)
+	{
+        if (chunkBlocks(cfg, chunkLength(cfg, 0), cfg.allocs[a]) < 1)
+		{
+            cerr << "A chunk of " << cfg.allocs[a] << " bins cannot hold a " << FEC_BLOCK_BITS << "-bit codeword; raise --chunk" << endl;
+            return 1;
+        }
+    }
+
+    // One point per (allocation, SNR)
+    std::vector<std::unique_ptr<SweepPoint>> points;
+    for (size_t a = 0; a < cfg.allocs.size(); a++)
+	{
+        for (double snr = cfg.snrStart; snr <= cfg.snrStop + 1e-9; snr += cfg.snrStep)
+		{
+            std::unique_ptr<SweepPoint> pt(new SweepPoint());
+            pt->index = (int)points.size();
+            pt->snrDb = snr;
+            pt->alloc = cfg.allocs[a];
+            // Active bins see fftSize times the time-domain variance
+            pt->sigma2 = 1.0 / (2.0 * num.fftSize * pow(10.0, snr / 10));
+            pt->issued = 0;
+            pt->prefix = 0;
+            pt->prefixErrors = 0;
+            pt->stopChunks = 0;
+            points.push_back(std::move(pt));
+        }
+    }
+
+    WorkStealingPool pool(threads);
+    cfg.window = pool.threads();
+    auto t0 = std::chrono::steady_clock::now();
+
+    // Start every point; finished chunks issue the next ones
+    for (size_t p = 0; p < points.size(); p++)
+	{
+        SweepPoint& pt = *points[p];
+        std::vector<int> first;
+        {
+            std::lock_guard<std::mutex> lock(pt.mtx);
+            claimChunks(cfg, pt, first);
+        }
+        for (size_t i = 0; i < first.size(); i++)
+            issueChunk(pool, cfg, pt, first[i]);
+    }
+    pool.wait();
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    long long totalSymbols = 0;
+    for (size_t p = 0; p < points.size(); p++)
+	{
+        SweepPoint& pt = *points[p];
+        pt.total = ChunkResult();
+        for (int c = 0; c < pt.stopChunks; c++)
+		{
+            pt.total.symbols += pt.chunks[c].symbols;
+            pt.total.bits += pt.chunks[c].bits;
+            pt.total.bitErrors += pt.chunks[c].bitErrors;
+            pt.total.symbolErrors += pt.chunks[c].symbolErrors;
+            pt.total.infoBits += pt.chunks[c].infoBits;
+            pt.total.infoErrors += pt.chunks[c].infoErrors;
+            pt.total.blocks += pt.chunks[c].blocks;
+            pt.total.blockErrors += pt.chunks[c].blockErrors;
+        }
+        totalSymbols += pt.total.symbols;
+    }
+
+    const int bits = modulationBits(cfg.modulation);
+    const bool coded = cfg.fec != FEC_NONE;
+    // Information bits per coded bit, padding aside
+    const double codeRate = (double)FEC_BLOCK_BITS / fecCodedBits(cfg.fec, FEC_BLOCK_BITS);
+    std::ostringstream csv;
+    csv << "numerology,sample_format,modulation,alloc,snr_db,ebn0_db,symbols,bits,bit_errors,ber,symbol_errors,ser,theory_ber";
+    if (coded) csv << ",fec,info_ebn0_db,info_bits,info_errors,info_ber,blocks,block_errors,bler";
+    csv << "\n";
+    csv << std::setprecision(6);
+    for (size_t p = 0; p < points.size(); p++)
+	{
+        const SweepPoint& pt = *points[p];
+        const ChunkResult& t = pt.total;
+        csv << num.name << "," << sampleFormatName(cfg.format) << "," << modulationName(cfg.modulation) << "," << pt.alloc << "," << pt.snrDb << ","
+            << pt.snrDb - 10 * log10((double)bits) << "," << t.symbols << "," << t.bits << "," << t.bitErrors << ","
+            << (double)t.bitErrors / t.bits << "," << t.symbolErrors << "," << (double)t.symbolErrors / (t.bits / bits) << ","
+            << theoryBer(cfg.modulation, pow(10.0, pt.snrDb / 10));
+        if (coded)
+            csv << "," << fecRateName(cfg.fec) << "," << pt.snrDb - 10 * log10(bits * codeRate) << "," << t.infoBits << ","
+                << t.infoErrors << "," << (double)t.infoErrors / t.infoBits << "," << t.blocks << "," << t.blockErrors << ","
+                << (double)t.blockErrors / t.blocks;
+        csv << "\n";
+    }
+    cout << csv.str();
+
+    if (!csvFile.empty() && !writeTextFile(csvFile, csv.str()))
+        return 1;
+
+    if (!jsonFile.empty())
+	{
+        std::ofstream ofs(jsonFile);
+        if (!ofs)
+		{
+            std::cerr << "Error writing to " << jsonFile << std::endl;
+            return 1;
+        }
+        ofs << std::setprecision(6);
+        ofs << "{\n  \"numerology\": \"" << num.name << "\",\n  \"sample_format\": \"" << sampleFormatName(cfg.format)
+            << "\",\n  \"modulation\": \"" << modulationName(cfg.modulation)
+            << "\",\n  \"fec\": \"" << fecRateName(cfg.fec)
+            << "\",\n  \"seed\": " << cfg.seed
+            << ",\n  \"target_errors\": " << cfg.targetErrors << ",\n  \"max_symbols\": " << cfg.maxSymbols
+            << ",\n  \"chunk_symbols\": " << cfg.chunkSymbols << ",\n  \"points\": [\n";
+        for (size_t p = 0; p < points.size(); p++)
+		{
+            const SweepPoint& pt = *points[p];
+            const ChunkResult& t = pt.total;
+            ofs << "    {\"alloc\": " << pt.alloc << ", \"snr_db\": " << pt.snrDb
+                << ", \"symbols\": " << t.symbols << ", \"bits\": " << t.bits
+                << ", \"bit_errors\": " << t.bitErrors << ", \"ber\": " << (double)t.bitErrors / t.bits
+                << ", \"symbol_errors\": " << t.symbolErrors << ", \"ser\": " << (double)t.symbolErrors / (t.bits / bits)
+                << ", \"theory_ber\": " << theoryBer(cfg.modulation, pow(10.0, pt.snrDb / 10));
+            if (coded)
+                ofs << ", \"info_bits\": " << t.infoBits << ", \"info_errors\": " << t.infoErrors
+                    << ", \"info_ber\": " << (double)t.infoErrors / t.infoBits << ", \"blocks\": " << t.blocks
+                    << ", \"block_errors\": " << t.blockErrors << ", \"bler\": " << (double)t.blockErrors / t.blocks;
+            ofs << "}" << (p + 1 < points.size() ? ",\n" : "\n");
+        }
+        ofs << "  ]\n}\n";
+    }
+
+    cerr << points.size() << " points, " << totalSymbols << " symbols in " << wall << " s on "
+         << pool.threads() << " threads (" << totalSymbols / wall << " symbols/s)" << endl;
+    return 0;
+}
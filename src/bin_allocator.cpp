@@ -0,0 +1,172 @@
+#include "bin_allocator.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+
+static int countTrailingZeros(uint64_t word)
+{
+    return __builtin_ctzll(word);
+}
+
+BinAllocator::BinAllocator(int bins, int reserved)
+    : nbins(bins), freeCount(0), policy(ALLOC_FIRST_FIT), words((bins + 63) / 64, 0),
+      // Free runs are separated by used bins, so there are at most (bins + 1) / 2
+      runNodes(std::make_shared<NodeArena>(NODE_ARENA_BLOCK, 2 * ((bins + 1) / 2) + 2)),
+      byStart(std::less<int>(), RunsByStart::allocator_type(runNodes.get())),
+      bySize(std::less<std::pair<int,int>>(), RunsBySize::allocator_type(runNodes.get()))
+{
+    if (reserved < 0) reserved = 0;
+    if (reserved < bins)
+        release(reserved, bins - reserved);
+}
+
+int BinAllocator::nextFree(int pos) const
+{
+    if (pos >= nbins) return nbins;
+    size_t w = pos >> 6;
+    uint64_t word = words[w] & (~0ULL << (pos & 63));
+    while (word == 0)
+	{
+        if (++w == words.size()) return nbins;
+        word = words[w];
+    }
+    return (int)(w * 64) + countTrailingZeros(word);
+}
+
+int BinAllocator::nextUsed(int pos) const
+{
+    if (pos >= nbins) return nbins;
+    size_t w = pos >> 6;
+    // Bits past nbins are never set, so they read as used
+    uint64_t word = ~words[w] & (~0ULL << (pos & 63));
+    while (word == 0)
+	{
+        if (++w == words.size()) return nbins;
+        word = ~words[w];
+    }
+    int bin = (int)(w * 64) + countTrailingZeros(word);
+    return bin < nbins ? bin : nbins;
+}
+
+void BinAllocator::setRange(int start, int count, bool free)
+{
+    int end = start + count;
+    while (start < end)
+	{
+        int bit = start & 63;
+        int span = std::min(64 - bit, end - start);
+        uint64_t mask = (span == 64 ? ~0ULL : ((1ULL << span) - 1)) << bit;
+        if (free)
+            words[start >> 6] |= mask;
+        else
+            words[start >> 6] &= ~mask;
+        start += span;
+    }
+}
+
+void BinAllocator::addRun(int start, int count)
+{
+    byStart[start] = count;
+    bySize.insert(std::make_pair(count, start));
+}
+
+void BinAllocator::removeRun(int start, int count)
+{
+    byStart.erase(start);
+    bySize.erase(std::make_pair(count, start));
+}
+
+// Carves [start, start + count) out of the free run beginning at runStart
+void BinAllocator::take(int runStart, int start, int count)
+{
+    int runCount = byStart[runStart];
+    removeRun(runStart, runCount);
+    if (start > runStart)
+        addRun(runStart, start - runStart);
+    int runEnd = runStart + runCount;
+    if (start + count < runEnd)
+        addRun(start + count, runEnd - start - count);
+    setRange(start, count, false);
+    freeCount -= count;
+}
+
+// Walks the bitset run by run: ctz finds where a free run starts and where it ends
+int BinAllocator::firstFit(int count) const
+{
+    int pos = nextFree(0);
+    while (pos < nbins)
+	{
+        int end = nextUsed(pos);
+        if (end - pos >= count) return pos;
+        pos = nextFree(end);
+    }
+    return -1;
+}
+
+int BinAllocator::bestFit(int count) const
+{
+    RunsBySize::const_iterator it = bySize.lower_bound(std::make_pair(count, INT_MIN));
+    return it == bySize.end() ? -1 : it->second;
+}
+
+BinExtent BinAllocator::allocate(int requested)
+{
+    BinExtent ext = { -1, 0 };
+    if (requested < 1 || freeCount == 0) return ext;
+
+	// If no run is long enough, grant the longest one available
+    int count = std::min(requested, largestFree());
+    int start = policy == ALLOC_BEST_FIT ? bestFit(count) : firstFit(count);
+    if (start < 0) return ext;
+
+    take(start, start, count);
+    ext.start = start;
+    ext.count = count;
+    return ext;
+}
+
+bool BinAllocator::allocateAt(int start, int count)
+{
+    if (count < 1 || start < 0 || start + count > nbins || nextUsed(start) < start + count) return false;
+
+    // The free run holding start is the last one beginning at or before it
+    RunsByStart::iterator run = byStart.upper_bound(start);
+    --run;
+    take(run->first, start, count);
+    return true;
+}
+
+void BinAllocator::release(int start, int count)
+{
+    if (count <= 0) return;
+    // Releasing a bin twice would add an overlapping run to the index
+    assert(start >= 0 && start + count <= nbins && nextFree(start) >= start + count &&
+           "BinAllocator::release of a bin that is already free");
+    setRange(start, count, true);
+    freeCount += count;
+
+    // Merge with the free run that follows
+    RunsByStart::iterator next = byStart.lower_bound(start);
+    if (next != byStart.end() && next->first == start + count)
+	{
+        int nextCount = next->second;
+        removeRun(start + count, nextCount);
+        count += nextCount;
+    }
+
+    // Merge with the free run that ends where this one starts
+    RunsByStart::iterator prev = byStart.lower_bound(start);
+    if (prev != byStart.begin())
+	{
+        --prev;
+        if (prev->first + prev->second == start)
+		{
+            int prevStart = prev->first;
+            int prevCount = prev->second;
+            removeRun(prevStart, prevCount);
+            start = prevStart;
+            count += prevCount;
+        }
+    }
+    addRun(start, count);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "node_pool.h"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <set>
+#include <vector>
+#include <utility>
+
+enum AllocPolicy
+{
+    ALLOC_FIRST_FIT,    // lowest-addressed free run that fits
+    ALLOC_BEST_FIT      // shortest free run that fits, lowest address on ties
+};
+
+struct BinExtent
+{
+    int start;
+    int count;
+};
+
+// Subcarrier allocator. Free bins are kept twice: as a bitset (bit set = free)
+// that first-fit walks a word at a time with count-trailing-zeros, and as an
+// index of maximal free runs by start and by length for best-fit and O(log n)
+// coalescing on release. The run index draws its nodes from a per-allocator
+// arena sized for the most runs the bins can hold, so allocate and release do
+// not touch the heap.
+class BinAllocator
+{
+public:
+    // Bins [0, reserved) are never handed out
+    BinAllocator(int bins, int reserved);
+
+    void setPolicy(AllocPolicy policy) { this->policy = policy; }
+    AllocPolicy allocPolicy() const { return policy; }
+
+    // Contiguous allocation of requested bins. If no free run is long enough the
+    // longest one is granted instead; count is 0 when nothing is free.
+    BinExtent allocate(int requested);
+
+    // Takes exactly [start, start + count); false unless every bin in it is free
+    bool allocateAt(int start, int count);
+
+    // Returns [start, start + count) and merges it with free neighbours; every bin
+    // in it must be allocated (asserted)
+    void release(int start, int count);
+
+    bool isFree(int bin) const { return (words[bin >> 6] >> (bin & 63)) & 1; }
+    int bins() const { return nbins; }
+    int freeBins() const { return freeCount; }
+    int largestFree() const { return bySize.empty() ? 0 : bySize.rbegin()->first; }
+    int freeRuns() const { return (int)byStart.size(); }
+
+private:
+    int nextFree(int pos) const;    // first free bin at or after pos, or nbins
+    int nextUsed(int pos) const;    // first used bin at or after pos, or nbins
+    int firstFit(int count) const;
+    int bestFit(int count) const;
+    void setRange(int start, int count, bool free);
+    void addRun(int start, int count);
+    void removeRun(int start, int count);
+    void take(int runStart, int start, int count);
+
+    typedef std::map<int, int, std::less<int>, PoolAllocator<std::pair<const int,int>>> RunsByStart;
+    typedef std::set<std::pair<int,int>, std::less<std::pair<int,int>>, PoolAllocator<std::pair<int,int>>> RunsBySize;
+
+    int nbins;
+    int freeCount;
+    AllocPolicy policy;
+    std::vector<uint64_t> words;
+    std::shared_ptr<NodeArena> runNodes;    // shared by copies, whose nodes come from it too
+    RunsByStart byStart;                    // run start -> length
+    RunsBySize bySize;                      // (length, start)
+};
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <type_traits>
+
+// Waits for a queue to change: spins briefly, then yields, then sleeps, so a
+// stalled stage does not burn a core
+class Backoff
+{
+public:
+    Backoff() : rounds(0) {}
+
+    void pause()
+    {
+        if (rounds >= 64)
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        else if (rounds >= 16)
+            std::this_thread::yield();
+        rounds++;
+    }
+    void reset() { rounds = 0; }
+
+private:
+    int rounds;
+};
+
+// Vyukov's bounded multi-producer multi-consumer ring, written once for both
+// BoundedQueue and the shared-memory transport rings, whose cells live in a
+// mapped region. Each cell's sequence number says whether it is free for the
+// producer or full for the consumer whose turn it is. sequenceAt(pos) returns
+// the sequence of the cell that holds position pos; fill(pos) and take(pos) run
+// on a claimed cell before it is handed over. capacity must be a power of two.
+template <typename Pos, typename SequenceAt, typename Fill>
+bool ringEnqueue(std::atomic<Pos>& enqueuePos, SequenceAt sequenceAt, Fill fill)
+{
+    typedef typename std::make_signed<Pos>::type Diff;
+    Pos pos = enqueuePos.load(std::memory_order_relaxed);
+    while (true)
+	{
+        std::atomic<Pos>& sequence = sequenceAt(pos);
+        Diff diff = (Diff)(sequence.load(std::memory_order_acquire) - pos);
+        if (diff == 0)
+		{
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+                fill(pos);
+                sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0)
+		{
+            return false;   // full
+        }
+        else
+		{
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename Pos, typename SequenceAt, typename Take>
+bool ringDequeue(std::atomic<Pos>& dequeuePos, Pos capacity, SequenceAt sequenceAt, Take take)
+{
+    typedef typename std::make_signed<Pos>::type Diff;
+    Pos pos = dequeuePos.load(std::memory_order_relaxed);
+    while (true)
+	{
+        std::atomic<Pos>& sequence = sequenceAt(pos);
+        Diff diff = (Diff)(sequence.load(std::memory_order_acquire) - (pos + 1));
+        if (diff == 0)
+		{
+            if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+                take(pos);
+                sequence.store(pos + capacity, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0)
+		{
+            return false;   // empty
+        }
+        else
+		{
+            pos = dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Bounded lock-free multi-producer multi-consumer queue on ringEnqueue and
+// ringDequeue. A full queue refuses tryPush, so callers decide between waiting
+// (backpressure) and dropping.
+template <typename T>
+class BoundedQueue
+{
+public:
+    // capacity is rounded up to a power of two
+    explicit BoundedQueue(size_t capacity)
+        : mask(roundCapacity(capacity) - 1), cells(new Cell[mask + 1]),
+          enqueuePos(0), dequeuePos(0), peak(0)
+    {
+        for (size_t i = 0; i <= mask; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    bool tryPush(const T& value)
+    {
+        size_t claimed = 0;
+        Cell* c = cells.get();
+        const size_t m = mask;
+        if (!ringEnqueue(enqueuePos,
+                         [c, m](size_t pos) -> std::atomic<size_t>& { return c[pos & m].sequence; },
+                         [c, m, &value, &claimed](size_t pos) { c[pos & m].value = value; claimed = pos; }))
+            return false;
+        notePeak(claimed + 1);
+        return true;
+    }
+
+    bool tryPop(T& value)
+    {
+        Cell* c = cells.get();
+        const size_t m = mask;
+        return ringDequeue(dequeuePos, m + 1,
+                           [c, m](size_t pos) -> std::atomic<size_t>& { return c[pos & m].sequence; },
+                           [c, m, &value](size_t pos) { value = c[pos & m].value; });
+    }
+
+    // Waits while the queue is full; false if `stop` was raised first
+    bool push(const T& value, const std::atomic<bool>& stop)
+    {
+        Backoff backoff;
+        while (!tryPush(value))
+		{
+            if (stop.load(std::memory_order_relaxed)) return false;
+            backoff.pause();
+        }
+        return true;
+    }
+
+    // Waits while the queue is empty; false if `stop` was raised first
+    bool pop(T& value, const std::atomic<bool>& stop)
+    {
+        Backoff backoff;
+        while (!tryPop(value))
+		{
+            if (stop.load(std::memory_order_relaxed)) return false;
+            backoff.pause();
+        }
+        return true;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    // Entries queued right now; approximate while producers and consumers run
+    size_t size() const
+    {
+        size_t tail = enqueuePos.load(std::memory_order_relaxed);
+        size_t head = dequeuePos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    // Deepest the queue has been, as seen by producers
+    size_t peakSize() const { return peak.load(std::memory_order_relaxed); }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t roundCapacity(size_t n)
+    {
+        size_t c = 2;
+        while (c < n) c <<= 1;
+        return c;
+    }
+
+    void notePeak(size_t tail)
+    {
+        size_t depth = tail - dequeuePos.load(std::memory_order_relaxed);
+        size_t seen = peak.load(std::memory_order_relaxed);
+        while (depth > seen && depth <= mask + 1 &&
+               !peak.compare_exchange_weak(seen, depth, std::memory_order_relaxed))
+            ;
+    }
+
+    // Producers and consumers each get a cache line for their position; padding
+    // rather than alignas, since C++11 new ignores extended alignment
+    const size_t mask;
+    std::unique_ptr<Cell[]> cells;
+    char pad0[64];
+    std::atomic<size_t> enqueuePos;
+    char pad1[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> dequeuePos;
+    char pad2[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> peak;
+};
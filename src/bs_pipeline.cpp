@@ -0,0 +1,328 @@
+#include "bs_pipeline.h"
+#include "signal_processing.h"
+#include "combined_uplink.h"
+#include "instrument.h"
+
+// Longest the reader blocks on the transport before checking for stop()
+constexpr int READER_TIMEOUT_MS = 100;
+
+static int defaultWorkers(int requested, int share)
+{
+    if (requested > 0) return requested;
+    int hw = (int)std::thread::hardware_concurrency();
+    return hw / share > 1 ? hw / share : 1;
+}
+
+BaseStationPipeline::BaseStationPipeline(BaseStation& bs, Transport& link, int rxWorkers, int txWorkers, int queueDepth)
+    : bs(bs), link(link), layout(bs.frameLayout()),
+      // Enough symbols to fill every RX queue, so the queues rather than the pool
+      // set the backpressure
+      freeSymbols(defaultWorkers(rxWorkers, 2) * (2 * queueDepth + 1) + 2),
+      ttiUs(0), multiplexed(false), combined(false), builder(layout),
+      // One frame queued per slot of TX worker 0, one it is sending and one being packed
+      freeFrames(queueDepth + 2),
+      stopping(false), received(0), combinedSymbols(0), demodulated(0), handled(0), sent(0), framesSent(0), dropped(0)
+{
+    rxWorkers = defaultWorkers(rxWorkers, 2);
+    txWorkers = defaultWorkers(txWorkers, 4);
+    for (int i = 0; i < rxWorkers; i++)
+	{
+        rxIn.push_back(std::unique_ptr<BoundedQueue<UplinkSymbol*>>(new BoundedQueue<UplinkSymbol*>(queueDepth)));
+        rxOut.push_back(std::unique_ptr<BoundedQueue<UplinkSymbol*>>(new BoundedQueue<UplinkSymbol*>(queueDepth)));
+    }
+    for (int i = 0; i < txWorkers; i++)
+        txIn.push_back(std::unique_ptr<BoundedQueue<TxItem>>(new BoundedQueue<TxItem>(queueDepth)));
+
+    symbols.resize(freeSymbols.capacity());
+    for (size_t i = 0; i < symbols.size(); i++)
+	{
+        symbols[i].time.resize(layout.fftSize);
+        symbols[i].active.resize(layout.bins);
+        // Every grant holds at least one bin
+        symbols[i].decoded.segments.reserve(layout.bins - layout.headerBins());
+        freeSymbols.tryPush(&symbols[i]);
+    }
+    frames.resize(freeFrames.capacity());
+    for (size_t i = 0; i < frames.size(); i++)
+	{
+        frames[i].active.resize(layout.bins);
+        frames[i].users.reserve(layout.maxUsers());
+        frames[i].noiseSymbols.reserve(layout.maxUsers());
+        freeFrames.tryPush(&frames[i]);
+    }
+}
+
+BaseStationPipeline::~BaseStationPipeline()
+{
+    stop();
+}
+
+void BaseStationPipeline::start()
+{
+    if (!threads.empty() || stopping.load()) return;
+    threads.push_back(std::thread(&BaseStationPipeline::readerLoop, this));
+    for (int i = 0; i < rxWorkers(); i++)
+        threads.push_back(std::thread(&BaseStationPipeline::rxLoop, this, i));
+    threads.push_back(std::thread(&BaseStationPipeline::macLoop, this));
+    for (int i = 0; i < txWorkers(); i++)
+        threads.push_back(std::thread(&BaseStationPipeline::txLoop, this, i));
+}
+
+void BaseStationPipeline::stop()
+{
+    stopping.store(true);
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    threads.clear();
+}
+
+void BaseStationPipeline::readerLoop()
+{
+    if (combined && ttiUs > 0)
+	{
+        combineLoop();
+        return;
+    }
+    uint64_t next = 0;
+    UplinkSymbol* sym = nullptr;
+    while (!stopping.load(std::memory_order_relaxed))
+	{
+        if (!sym && !freeSymbols.pop(sym, stopping)) break;
+        // RX_IO times only a read that found a symbol waiting, not the wait for one
+        INSTRUMENT_START(t0);
+        if (link.receive(BS_ENDPOINT, sym->time.data(), layout.fftSize, 0) == layout.fftSize)
+            INSTRUMENT_STOP(STAGE_RX_IO, t0);
+        else if (link.receive(BS_ENDPOINT, sym->time.data(), layout.fftSize, READER_TIMEOUT_MS) != layout.fftSize)
+            continue;
+        received.fetch_add(1, std::memory_order_relaxed);
+        if (!rxIn[next % rxIn.size()]->push(sym, stopping)) break;
+        sym = nullptr;
+        next++;
+    }
+}
+
+// Sums the symbols of each TTI in sym->time; the sum goes to the next RX worker
+// once the clock or a symbol from a later TTI shows the TTI is over
+void BaseStationPipeline::combineLoop()
+{
+    uint64_t next = 0;
+    UplinkSymbol* sym = nullptr;
+    std::vector<std::complex<double>> in(layout.fftSize);
+    uint64_t tti = 0;
+    int contributions = 0;
+    Backoff backoff;
+    while (!stopping.load(std::memory_order_relaxed))
+	{
+        if (!sym && !freeSymbols.pop(sym, stopping)) break;
+        bool closed = contributions > 0 && std::chrono::steady_clock::now() >= ttiStart(tti + 1, ttiUs);
+        int n = closed ? 0 : link.receive(BS_ENDPOINT, in.data(), layout.fftSize, contributions > 0 ? 0 : READER_TIMEOUT_MS);
+        uint64_t now = 0;
+        if (n == layout.fftSize)
+		{
+            received.fetch_add(1, std::memory_order_relaxed);
+            now = ttiIndex(std::chrono::steady_clock::now(), ttiUs);
+            closed = contributions > 0 && now != tti;
+        }
+        else if (!closed)
+		{
+            if (contributions > 0) backoff.pause();
+            continue;
+        }
+        backoff.reset();
+
+        if (closed)
+		{
+            INSTRUMENT_START(t0);
+            addAWGN(sym->time.data(), sym->time.size(), NOISE_VARIANCE, noiseKey(NOISE_LINK_COMBINED_UPLINK, tti));
+            INSTRUMENT_STOP(STAGE_NOISE, t0);
+            combinedSymbols.fetch_add(1, std::memory_order_relaxed);
+            if (!rxIn[next % rxIn.size()]->push(sym, stopping)) break;
+            sym = nullptr;
+            next++;
+            contributions = 0;
+            if (n != layout.fftSize) continue;
+            if (!freeSymbols.pop(sym, stopping)) break;
+        }
+        if (contributions++ == 0)
+		{
+            tti = now;
+            std::copy(in.begin(), in.end(), sym->time.begin());
+        }
+		else
+		{
+            for (int i = 0; i < layout.fftSize; i++)
+                sym->time[i] += in[i];
+        }
+    }
+}
+
+void BaseStationPipeline::rxLoop(int worker)
+{
+    BoundedQueue<UplinkSymbol*>& in = *rxIn[worker];
+    BoundedQueue<UplinkSymbol*>& out = *rxOut[worker];
+    UplinkSymbol* sym;
+    while (in.pop(sym, stopping))
+	{
+        INSTRUMENT_START(t0);
+        timeToActiveBins(sym->time.data(), layout.fftSize, sym->active.data(), layout.bins);
+        INSTRUMENT_STOP(STAGE_DEMUX, t0);
+        bs.decodeUplink(sym->active.data(), sym->decoded);
+        demodulated.fetch_add(1, std::memory_order_relaxed);
+        if (!out.push(sym, stopping)) break;
+    }
+}
+
+void BaseStationPipeline::macLoop()
+{
+    std::vector<Downlink> downlinks;
+    uint64_t next = 0;
+    UplinkSymbol* sym;
+    std::chrono::steady_clock::time_point nextTti = std::chrono::steady_clock::now() + std::chrono::microseconds(ttiUs);
+    Backoff backoff;
+    while (!stopping.load(std::memory_order_relaxed))
+	{
+        if (ttiUs > 0 && std::chrono::steady_clock::now() >= nextTti)
+		{
+            nextTti += std::chrono::microseconds(ttiUs);
+            downlinks.clear();
+            bs.runTti(downlinks);
+            if (!dispatch(downlinks) || !dispatchFrames()) return;
+        }
+        // Same round-robin order the reader dealt the symbols in
+        if (!rxOut[next % rxOut.size()]->tryPop(sym))
+		{
+            backoff.pause();
+            continue;
+        }
+        backoff.reset();
+        next++;
+        downlinks.clear();
+        INSTRUMENT_START(t0);
+        bs.handleUplink(sym->active.data(), sym->decoded, downlinks);
+        INSTRUMENT_STOP(STAGE_MAC, t0);
+        freeSymbols.tryPush(sym);   // never full: it has room for the whole pool
+        handled.fetch_add(1, std::memory_order_relaxed);
+        if (!dispatch(downlinks)) return;
+    }
+}
+
+// False if the pipeline stopped while a TX queue was full
+bool BaseStationPipeline::dispatch(const std::vector<Downlink>& downlinks)
+{
+    for (size_t i = 0; i < downlinks.size(); i++)
+	{
+        if (multiplexed)
+		{
+            builder.add(downlinks[i].msg);     // sent with the next TTI's frames
+            continue;
+        }
+        TxItem item;
+        item.downlink = downlinks[i];
+        item.noiseSymbol = txSymbols[downlinks[i].userId]++;
+        item.frame = nullptr;
+        if (!txIn[downlinks[i].userId % txIn.size()]->push(item, stopping)) return false;
+    }
+    return true;
+}
+
+// Packs everything the builder holds into frames for TX worker 0; false if the
+// pipeline stopped while waiting for a frame or the queue
+bool BaseStationPipeline::dispatchFrames()
+{
+    while (multiplexed && !builder.empty())
+	{
+        DownlinkFrame* frame;
+        if (!freeFrames.pop(frame, stopping)) return false;
+        INSTRUMENT_START(t0);
+        builder.build(frame->active.data(), frame->users);
+        INSTRUMENT_STOP(STAGE_ENCODE, t0);
+        frame->noiseSymbols.clear();
+        for (size_t i = 0; i < frame->users.size(); i++)
+            frame->noiseSymbols.push_back(txSymbols[frame->users[i]]++);
+        if (frame->users.empty())
+		{
+            freeFrames.tryPush(frame);
+            continue;
+        }
+        TxItem item;
+        item.downlink = Downlink();
+        item.noiseSymbol = 0;
+        item.frame = frame;
+        if (!txIn[0]->push(item, stopping)) return false;
+    }
+    return true;
+}
+
+void BaseStationPipeline::txLoop(int worker)
+{
+    BoundedQueue<TxItem>& in = *txIn[worker];
+    std::vector<std::complex<double>> active(layout.bins);
+    std::vector<std::complex<double>> time(layout.fftSize);
+    std::vector<std::complex<double>> noisy(layout.fftSize);
+    TxItem item;
+    while (in.pop(item, stopping))
+	{
+        if (item.frame)
+		{
+            sendFrame(*item.frame, time, noisy);
+            freeFrames.tryPush(item.frame);     // never full: it has room for the whole pool
+            continue;
+        }
+        int uid = item.downlink.userId;
+        INSTRUMENT_START(t0);
+        encodeControl(layout, item.downlink.msg, active.data());
+        INSTRUMENT_LAP(STAGE_ENCODE, t0);
+        activeBinsToTime(active.data(), layout.bins, time.data(), layout.fftSize);
+        INSTRUMENT_STOP(STAGE_MUX, t0);
+        bool ok = link.sendNoisy(uid, time.data(), layout.fftSize, NOISE_VARIANCE,
+                                 noiseKey(downlinkNoise(uid), item.noiseSymbol));
+        if (ok)
+            sent.fetch_add(1, std::memory_order_relaxed);
+        else
+            dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// One transform for the frame; each user gets a copy with its own link's noise
+void BaseStationPipeline::sendFrame(const DownlinkFrame& frame, std::vector<std::complex<double>>& time,
+                                    std::vector<std::complex<double>>& noisy)
+{
+    INSTRUMENT_START(t0);
+    activeBinsToTime(frame.active.data(), layout.bins, time.data(), layout.fftSize);
+    INSTRUMENT_STOP(STAGE_MUX, t0);
+    framesSent.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = 0; i < frame.users.size(); i++)
+	{
+        int uid = frame.users[i];
+        std::copy(time.begin(), time.end(), noisy.begin());
+        bool ok = link.sendNoisy(uid, noisy.data(), layout.fftSize, NOISE_VARIANCE,
+                                 noiseKey(downlinkNoise(uid), frame.noiseSymbols[i]));
+        if (ok)
+            sent.fetch_add(1, std::memory_order_relaxed);
+        else
+            dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+template <typename T>
+static void printQueues(std::ostream& out, const char* name, const std::vector<std::unique_ptr<BoundedQueue<T>>>& queues)
+{
+    out << " " << name;
+    for (size_t i = 0; i < queues.size(); i++)
+        out << " " << queues[i]->size() << "/" << queues[i]->peakSize();
+}
+
+void BaseStationPipeline::printStats(std::ostream& out) const
+{
+    out << "Pipeline: received " << received.load();
+    if (combined) out << " (combined into " << combinedSymbols.load() << " TTI symbols)";
+    out << ", demodulated " << demodulated.load()
+        << ", handled " << handled.load() << ", sent " << sent.load() << " (" << dropped.load() << " dropped";
+    if (multiplexed) out << ", in " << framesSent.load() << " frames";
+    out << ");"
+        << " queue depth/peak";
+    printQueues(out, "rx", rxIn);
+    printQueues(out, "mac", rxOut);
+    printQueues(out, "tx", txIn);
+    out << std::endl;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "base_station_core.h"
+#include "bounded_queue.h"
+#include "downlink_frame.h"
+#include "transport.h"
+#include <atomic>
+#include <complex>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Base station as a staged pipeline:
+//
+//   reader -> RX workers -> MAC -> TX workers -> transport
+//
+// The reader takes uplink symbols off the transport and deals them round-robin
+// to the RX workers, which move them to the frequency domain and decode their
+// headers and payloads (BaseStation::decodeUplink). The single MAC thread
+// collects them in the same round-robin order, so it sees symbols in arrival
+// order, and is the only thread that changes the BaseStation (allocation map,
+// bins, reassembly, scheduler). A payload an RX worker read with a grant the
+// MAC has changed since is read again by the MAC. Its downlinks go to TX worker userId % txWorkers, which
+// keeps each user's downlink in order, and the TX workers encode, transform, add
+// noise and send. Stages are joined by BoundedQueues; a full queue stalls the stage
+// feeding it, back to the transport.
+//
+// With a multiplexed downlink the MAC queues its downlinks in a DownlinkFrameBuilder
+// instead and packs them into frames at each TTI tick. Frames carry several users,
+// so they all go to TX worker 0 to stay in order; it transforms each frame once and
+// sends every user a copy with that user's downlink noise.
+//
+// With a combined uplink the reader adds up every symbol that arrives within a
+// TTI into one, as the air would, and passes the sum on when the TTI is over:
+// the RX workers transform each TTI once however many users sent in it. Users
+// then send without noise and the reader adds the receiver's.
+class BaseStationPipeline
+{
+public:
+    // rxWorkers/txWorkers <= 0 pick a count from the hardware threads
+    BaseStationPipeline(BaseStation& bs, Transport& link, int rxWorkers, int txWorkers, int queueDepth);
+    ~BaseStationPipeline();
+
+    // Runs the base station's scheduler every ttiUs microseconds on the MAC
+    // thread, between uplink symbols; call before start()
+    void setTti(int ttiUs) { this->ttiUs = ttiUs; }
+    // Sends each TTI's downlinks as multiplexed frames (see downlink_frame.h)
+    // rather than a symbol per message; needs setTti. Call before start().
+    void setDownlinkMux(bool on) { multiplexed = on; }
+    // Combines each TTI's uplink symbols into one (see combined_uplink.h); needs
+    // setTti and a BaseStation set up the same way. Call before start().
+    void setUplinkCombine(bool on) { combined = on; }
+
+    // Starts the stage threads; a stopped pipeline cannot be restarted
+    void start();
+    // Stops every stage; symbols still queued are dropped
+    void stop();
+
+    int rxWorkers() const { return (int)rxIn.size(); }
+    int txWorkers() const { return (int)txIn.size(); }
+
+    // Uplink symbols the MAC has finished with
+    uint64_t handledSymbols() const { return handled.load(); }
+
+    // Stage counters and queue depths (current/peak) on one line
+    void printStats(std::ostream& out) const;
+
+private:
+    // One uplink symbol on its way from the reader to the MAC
+    struct UplinkSymbol
+    {
+        std::vector<std::complex<double>> time;
+        std::vector<std::complex<double>> active;
+        DecodedUplink decoded;
+    };
+
+    // A multiplexed downlink symbol on its way from the MAC to TX worker 0
+    struct DownlinkFrame
+    {
+        std::vector<std::complex<double>> active;
+        std::vector<int> users;
+        std::vector<uint64_t> noiseSymbols;     // per user, as TxItem::noiseSymbol
+    };
+
+    struct TxItem
+    {
+        Downlink downlink;
+        uint64_t noiseSymbol;   // position in the user's downlink noise stream
+        DownlinkFrame* frame;   // if set, sent to each of its users instead of downlink
+    };
+
+    void readerLoop();
+    void combineLoop();
+    void rxLoop(int worker);
+    void macLoop();
+    bool dispatch(const std::vector<Downlink>& downlinks);
+    bool dispatchFrames();
+    void txLoop(int worker);
+    void sendFrame(const DownlinkFrame& frame, std::vector<std::complex<double>>& time,
+                   std::vector<std::complex<double>>& noisy);
+
+    BaseStation& bs;
+    Transport& link;
+    const FrameLayout layout;
+
+    std::vector<UplinkSymbol> symbols;              // fixed pool, recycled through freeSymbols
+    BoundedQueue<UplinkSymbol*> freeSymbols;
+    std::vector<std::unique_ptr<BoundedQueue<UplinkSymbol*>>> rxIn;   // reader -> RX worker
+    std::vector<std::unique_ptr<BoundedQueue<UplinkSymbol*>>> rxOut;  // RX worker -> MAC
+    std::vector<std::unique_ptr<BoundedQueue<TxItem>>> txIn;          // MAC -> TX worker
+
+    std::map<int, uint64_t> txSymbols;  // per-user downlink noise stream position, MAC only
+    int ttiUs;                          // 0: no scheduler ticks
+    bool multiplexed;
+    bool combined;
+    DownlinkFrameBuilder builder;       // MAC only
+    std::vector<DownlinkFrame> frames;  // fixed pool, recycled through freeFrames
+    BoundedQueue<DownlinkFrame*> freeFrames;
+
+    std::vector<std::thread> threads;
+    std::atomic<bool> stopping;
+    std::atomic<uint64_t> received;     // symbols taken off the transport
+    std::atomic<uint64_t> combinedSymbols;  // TTI sums passed on by the reader
+    std::atomic<uint64_t> demodulated;
+    std::atomic<uint64_t> handled;      // uplink symbols through the MAC
+    std::atomic<uint64_t> sent;
+    std::atomic<uint64_t> framesSent;   // multiplexed symbols, each sent to several users
+    std::atomic<uint64_t> dropped;      // downlinks the transport refused
+};
@@ -0,0 +1,126 @@
+#include "combined_uplink.h"
+#include "signal_processing.h"
+#include <algorithm>
+
+int combinedControlSlots(const FrameLayout& layout)
+{
+    return std::max(1, std::min(COMBINED_MAX_CONTROL_SLOTS, layout.bins / 4 / layout.headerBins()));
+}
+
+int combinedControlBins(const FrameLayout& layout)
+{
+    return combinedControlSlots(layout) * layout.headerBins();
+}
+
+// Positions in a cycle of scheduled slots: one per allocatable bin, rounded up
+// to a multiple of maxGrant
+static int schedulePositions(const FrameLayout& layout)
+{
+    const int grant = layout.maxGrant();
+    const int bins = layout.bins - combinedControlBins(layout);
+    return (bins + grant - 1) / grant * grant;
+}
+
+int combinedHeaderCycle(const FrameLayout& layout)
+{
+    const int slots = combinedControlSlots(layout);
+    const int positions = schedulePositions(layout);
+    return slots > 1 ? (positions + slots - 2) / (slots - 1) : 2 * positions;
+}
+
+// The TTI of the cycle and the slot in which allocatable bin `bin` owns a
+// header. Consecutive bins sit a maxGrant-th of the positions apart, so that
+// a grant's turns spread over the cycle.
+static void headerOpportunity(const FrameLayout& layout, int bin, int& phase, int& slot)
+{
+    const int slots = combinedControlSlots(layout);
+    const int grant = layout.maxGrant();
+    const int offset = bin - combinedControlBins(layout);
+    const int position = offset % grant * (schedulePositions(layout) / grant) + offset / grant;
+    if (slots > 1)
+	{
+        phase = position / (slots - 1);
+        slot = 1 + position % (slots - 1);
+    }
+	else
+	{
+        phase = 2 * position + 1;
+        slot = 0;
+    }
+}
+
+bool combinedAccessTti(const FrameLayout& layout, uint64_t tti)
+{
+    return combinedControlSlots(layout) > 1 || tti % 2 == 0;
+}
+
+int combinedScheduledSlot(const FrameLayout& layout, int start, int count, uint64_t tti)
+{
+    const int at = (int)(tti % combinedHeaderCycle(layout));
+    for (int b = start; b < start + count; b++)
+	{
+        int phase, slot;
+        headerOpportunity(layout, b, phase, slot);
+        if (phase == at) return slot * layout.headerBins();
+    }
+    return -1;
+}
+
+uint64_t combinedNextHeaderTti(const FrameLayout& layout, int start, int count, uint64_t tti)
+{
+    const int cycle = combinedHeaderCycle(layout);
+    const int at = (int)(tti % cycle);
+    int wait = cycle;
+    for (int b = start; b < start + count; b++)
+	{
+        int phase, slot;
+        headerOpportunity(layout, b, phase, slot);
+        wait = std::min(wait, (phase - at + cycle) % cycle);
+    }
+    return tti + (wait < cycle ? wait : 0);
+}
+
+bool combinedOwnsSlot(const FrameLayout& layout, int start, int count, int first)
+{
+    for (int b = start; b < start + count; b++)
+	{
+        int phase, slot;
+        headerOpportunity(layout, b, phase, slot);
+        if (slot * layout.headerBins() == first) return true;
+    }
+    return false;
+}
+
+ControlOccupancy controlOccupancy(const FrameLayout& layout, const std::complex<double>* active, int first)
+{
+    int len = std::min(controlHeaderBins(layout, readField(active, first, 1)), layout.headerBins());
+    double energy = 0, distance = 0;
+    for (int b = first; b < first + len; b++)
+	{
+        std::pair<int,int> bits = qpskDemodulate(active[b]);
+        energy += std::norm(active[b]);
+        distance += std::norm(active[b] - qpskModulate(bits.first, bits.second));
+    }
+    if (energy < COMBINED_EMPTY_ENERGY * len) return CONTROL_EMPTY;
+    return distance > COMBINED_COLLISION_DISTANCE * len ? CONTROL_COLLISION : CONTROL_ONE;
+}
+
+bool binsEmpty(const std::complex<double>* active, int start, int count, Modulation mod)
+{
+    double innermost = 3.0 / ((1 << modulationBits(mod)) - 1);
+    double energy = 0;
+    for (int b = start; b < start + count; b++)
+        energy += std::norm(active[b]);
+    return energy < COMBINED_EMPTY_ENERGY * innermost * count;
+}
+
+uint64_t ttiIndex(std::chrono::steady_clock::time_point t, int ttiUs)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count() / ttiUs;
+}
+
+std::chrono::steady_clock::time_point ttiStart(uint64_t tti, int ttiUs)
+{
+    return std::chrono::steady_clock::time_point(
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::microseconds(tti * ttiUs)));
+}
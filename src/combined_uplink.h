@@ -0,0 +1,82 @@
+#pragma once
+
+#include "frame.h"
+#include "modulation.h"
+#include <chrono>
+#include <complex>
+#include <cstdint>
+
+// Combined uplink: the users of a TTI transmit at once, as on the air, and the
+// base station receives the sum of their symbols, transforms it once and reads
+// every allocation from it. Each user's symbol carries only its own part and is
+// zero elsewhere:
+//   - a header in the control region when it has one to send. The region is a
+//     row of header slots, each headerBins long. Slot 0 takes access requests,
+//     which the users without a grant contend for: two in one TTI garble each
+//     other, and both users back off for a random number of TTIs. The other
+//     slots are scheduled over a cycle of TTIs (see combinedHeaderCycle): each
+//     allocatable bin owns one of them once a cycle, so a granted user sends
+//     its deallocation or the first segment of a message in a slot of its own.
+//   - a segment in its granted bins. The CTRL_DATA_TX header goes only with a
+//     message's first segment; the rest follow one per TTI with no header, and
+//     the base station numbers them itself. A TTI whose granted bins are empty
+//     carries no segment, and COMBINED_QUIET_TTIS of them in a row end the
+//     user's message there.
+// A TTI nobody transmits in produces no symbol at all, and the segment numbers
+// only advance with the symbols the base station receives.
+
+// Empty TTIs in a row after which a message in progress is given up
+constexpr int COMBINED_QUIET_TTIS = 4;
+
+// Mean energy per bin below which nothing was sent there, half a QPSK point's
+constexpr double COMBINED_EMPTY_ENERGY = 0.5;
+// Mean squared distance of the bins from the nearest QPSK point above which the
+// control region holds more than one header. A lone header's bins sit on the
+// constellation, up to the noise; where two overlap their points add up to 0,
+// to twice a point or to a point between two, each a distance of 1 from it.
+constexpr double COMBINED_COLLISION_DISTANCE = 0.5;
+
+enum ControlOccupancy
+{
+    CONTROL_EMPTY,
+    CONTROL_ONE,
+    CONTROL_COLLISION
+};
+
+// Most header slots a control region has
+constexpr int COMBINED_MAX_CONTROL_SLOTS = 8;
+
+// As many slots as fit in a quarter of the bins, within [1, COMBINED_MAX_CONTROL_SLOTS];
+// the 8-bin legacy layout has one
+int combinedControlSlots(const FrameLayout& layout);
+// Bins the control region takes, which are never granted
+int combinedControlBins(const FrameLayout& layout);
+
+// TTIs in a cycle of the header schedule. Slot 0 is left to access requests in
+// every TTI and the scheduled slots fill the rest, the bins of one grant about
+// a maxGrant-th of a cycle apart. On a layout with a single slot the two take
+// turns: access requests in even TTIs, scheduled headers in odd ones.
+int combinedHeaderCycle(const FrameLayout& layout);
+// Whether TTI tti has a slot for access requests, at bin 0
+bool combinedAccessTti(const FrameLayout& layout, uint64_t tti);
+// First bin of the slot the grant [start, start + count) owns in TTI tti, -1
+// if it owns none then
+int combinedScheduledSlot(const FrameLayout& layout, int start, int count, uint64_t tti);
+// First TTI from tti on in which the grant owns a slot
+uint64_t combinedNextHeaderTti(const FrameLayout& layout, int start, int count, uint64_t tti);
+// Whether the grant owns the slot starting at bin first in some TTI of the cycle
+bool combinedOwnsSlot(const FrameLayout& layout, int start, int count, int first);
+
+// Classifies the header slot starting at bin first of a combined symbol from
+// the bins of the header its control code calls for
+ControlOccupancy controlOccupancy(const FrameLayout& layout, const std::complex<double>* active, int first = 0);
+
+// Whether [start, start + count) was left empty by a sender using mod. Scaled
+// by the constellation's innermost point, 3/(M-1) of the mean, so that no run
+// of mod's points reads as empty; below the noise that can never hold.
+bool binsEmpty(const std::complex<double>* active, int start, int count, Modulation mod);
+
+// TTI boundaries every process on the host agrees on: multiples of ttiUs on
+// the steady clock
+uint64_t ttiIndex(std::chrono::steady_clock::time_point t, int ttiUs);
+std::chrono::steady_clock::time_point ttiStart(uint64_t tti, int ttiUs);
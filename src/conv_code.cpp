@@ -0,0 +1,234 @@
+#include "conv_code.h"
+#include "conv_code_kernels.h"
+#include <cstring>
+
+// Punctured codes keep these of each step's two coded bits, over a period of
+// steps; 1/2 keeps everything
+struct Puncture
+{
+    int period;
+    uint8_t keepA[5];
+    uint8_t keepB[5];
+};
+
+static const Puncture PUNCTURES[] =
+{
+    { 1, { 1 }, { 1 } },                            // FEC_NONE, unused
+    { 1, { 1 }, { 1 } },                            // 1/2
+    { 2, { 1, 1 }, { 1, 0 } },                      // 2/3
+    { 3, { 1, 1, 0 }, { 1, 0, 1 } },                // 3/4
+    { 5, { 1, 1, 0, 1, 0 }, { 1, 0, 1, 0, 1 } }     // 5/6
+};
+
+const char* fecRateName(FecRate rate)
+{
+    switch (rate)
+	{
+        case FEC_1_2: return "1/2";
+        case FEC_2_3: return "2/3";
+        case FEC_3_4: return "3/4";
+        case FEC_5_6: return "5/6";
+        default:      return "none";
+    }
+}
+
+bool parseFecRate(const std::string& name, FecRate& rate)
+{
+    for (int r = FEC_NONE; r <= FEC_5_6; r++)
+	{
+        if (name == fecRateName((FecRate)r))
+		{
+            rate = (FecRate)r;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t fecCodedBits(FecRate rate, size_t infoBits)
+{
+    if (rate == FEC_NONE) return infoBits;
+    const Puncture& p = PUNCTURES[rate];
+    size_t steps = infoBits + FEC_TAIL_BITS;
+    size_t perPeriod = 0, partial = 0;
+    for (int i = 0; i < p.period; i++)
+	{
+        perPeriod += p.keepA[i] + p.keepB[i];
+        if (i < (int)(steps % p.period)) partial += p.keepA[i] + p.keepB[i];
+    }
+    return steps / p.period * perPeriod + partial;
+}
+
+void ConvEncoder::reset(FecRate rate)
+{
+    this->rate = rate;
+    state = 0;
+    phase = 0;
+}
+
+int ConvEncoder::push(int bit, uint64_t& acc)
+{
+    const Puncture& p = PUNCTURES[rate];
+    int reg = (state << 1) | (bit & 1);
+    state = reg & (FEC_STATES - 1);
+    int n = 0;
+    if (p.keepA[phase])
+	{
+        acc = (acc << 1) | (uint64_t)__builtin_parity(reg & FEC_G0);
+        n++;
+    }
+    if (p.keepB[phase])
+	{
+        acc = (acc << 1) | (uint64_t)__builtin_parity(reg & FEC_G1);
+        n++;
+    }
+    if (++phase == p.period) phase = 0;
+    return n;
+}
+
+int ConvEncoder::finish(uint64_t& acc)
+{
+    int n = 0;
+    for (int i = 0; i < FEC_TAIL_BITS; i++)
+        n += push(0, acc);
+    reset(rate);
+    return n;
+}
+
+void convEncode(FecRate rate, const uint8_t* info, size_t infoBits, uint8_t* coded)
+{
+    ConvEncoder enc;
+    enc.reset(rate);
+    size_t out = 0;
+    for (size_t i = 0; i <= infoBits; i++)
+	{
+        uint64_t acc = 0;
+        int n = i < infoBits ? enc.push((info[i / 8] >> (7 - i % 8)) & 1, acc) : enc.finish(acc);
+        for (int k = n - 1; k >= 0; k--)
+            coded[out++] = (uint8_t)((acc >> k) & 1);
+    }
+}
+
+namespace
+{
+
+void forwardScalar(const int16_t* const* pairs, size_t steps, uint64_t* const* decisions, int count)
+{
+    int branch[FEC_STATES / 2];
+    for (int j = 0; j < FEC_STATES / 2; j++)
+        branch[j] = fecBranch(j);
+
+    for (int c = 0; c < count; c++)
+	{
+        int metric[FEC_STATES], next[FEC_STATES];
+        for (int s = 0; s < FEC_STATES; s++)
+            metric[s] = s == 0 ? 0 : -VITERBI_START_PENALTY;
+
+        for (size_t t = 0; t < steps; t++)
+		{
+            int s0 = pairs[c][2 * t], s1 = pairs[c][2 * t + 1];
+            uint64_t d = 0;
+            for (int j = 0; j < FEC_STATES / 2; j++)
+			{
+                int bm = ((branch[j] & 2) ? -s0 : s0) + ((branch[j] & 1) ? -s1 : s1);
+                int a = metric[j], b = metric[j + FEC_STATES / 2];
+                // Ties keep the path from j, as the vector compare does
+                int even0 = a + bm, even1 = b - bm;
+                int odd0 = a - bm, odd1 = b + bm;
+                next[2 * j] = even1 > even0 ? even1 : even0;
+                next[2 * j + 1] = odd1 > odd0 ? odd1 : odd0;
+                d |= (uint64_t)(even1 > even0) << j;
+                d |= (uint64_t)(odd1 > odd0) << (j + 32);
+            }
+            decisions[c][t] = d;
+            std::memcpy(metric, next, sizeof(metric));
+        }
+    }
+}
+
+}
+
+ViterbiForward viterbiForwardScalar()
+{
+    return forwardScalar;
+}
+
+static ViterbiForward forwardFor(BatchIsa isa)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    // The 16-bit lanes need AVX-512BW, which the batch kernels do not check for
+    __builtin_cpu_init();
+    if (isa == BATCH_ISA_AVX512 && viterbiForwardAvx512() && __builtin_cpu_supports("avx512bw"))
+        return viterbiForwardAvx512();
+#endif
+    if (isa != BATCH_ISA_SCALAR && viterbiForwardAvx2())
+        return viterbiForwardAvx2();
+    return viterbiForwardScalar();
+}
+
+ViterbiDecoder::ViterbiDecoder(BatchIsa isa) : forward(forwardFor(isa))
+{
+}
+
+void ViterbiDecoder::depuncture(FecRate rate, const int8_t* soft, size_t steps, int16_t* out) const
+{
+    const Puncture& p = PUNCTURES[rate];
+    int phase = 0;
+    for (size_t t = 0; t < steps; t++)
+	{
+        out[2 * t] = p.keepA[phase] ? *soft++ : 0;
+        out[2 * t + 1] = p.keepB[phase] ? *soft++ : 0;
+        if (++phase == p.period) phase = 0;
+    }
+}
+
+// Follows the survivors back from state 0, where the tail left the encoder
+void ViterbiDecoder::traceback(const uint64_t* dec, size_t infoBits, uint8_t* info) const
+{
+    std::memset(info, 0, (infoBits + 7) / 8);
+    int state = 0;
+    for (size_t t = infoBits + FEC_TAIL_BITS; t-- > 0; )
+	{
+        int j = state >> 1, bit = state & 1;
+        if (t < infoBits && bit) info[t / 8] |= (uint8_t)(0x80 >> (t % 8));
+        state = j + (int)((dec[t] >> (32 * bit + j)) & 1) * (FEC_STATES / 2);
+    }
+}
+
+void ViterbiDecoder::decode(FecRate rate, const int8_t* soft, size_t infoBits, uint8_t* info)
+{
+    decodeBatch(rate, &soft, infoBits, &info, 1);
+}
+
+void ViterbiDecoder::decodeBatch(FecRate rate, const int8_t* const* soft, size_t infoBits, uint8_t* const* info, int count)
+{
+    const size_t steps = infoBits + FEC_TAIL_BITS;
+    const size_t lanes = count < VITERBI_GROUP ? count : VITERBI_GROUP;
+    if (decisions.size() < lanes * steps)
+	{
+        pairs.resize(lanes * 2 * steps);
+        decisions.resize(lanes * steps);
+    }
+    for (int first = 0; first < count; first += VITERBI_GROUP)
+	{
+        int group = count - first < VITERBI_GROUP ? count - first : VITERBI_GROUP;
+        const int16_t* in[VITERBI_GROUP];
+        uint64_t* dec[VITERBI_GROUP];
+        for (int c = 0; c < group; c++)
+		{
+            int16_t* p = &pairs[c * 2 * steps];
+            depuncture(rate, soft[first + c], steps, p);
+            in[c] = p;
+            dec[c] = &decisions[c * steps];
+        }
+        forward(in, steps, dec, group);
+        for (int c = 0; c < group; c++)
+            traceback(dec[c], infoBits, info[first + c]);
+    }
+}
+
+void viterbiDecode(FecRate rate, const int8_t* soft, size_t infoBits, uint8_t* info)
+{
+    static thread_local ViterbiDecoder decoder;
+    decoder.decode(rate, soft, infoBits, info);
+}
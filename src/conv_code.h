@@ -0,0 +1,105 @@
+#pragma once
+
+#include "batch_dsp.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Forward error correction between the payload bits and the mapper: the
+// rate-1/2, constraint length 7 convolutional code of 802.11 (generators 133
+// and 171 octal), punctured to 2/3, 3/4 or 5/6. A codeword is the encoded
+// information bits followed by 6 zero tail bits, which return the encoder to
+// state 0, so the decoder knows where every path ends.
+//
+// Information bits are packed most significant first. Coded bits are one per
+// byte (0 or 1), in transmission order, ready for the mapper; the decoder takes
+// them as soft values, one int8_t per coded bit, positive for 0 with the
+// magnitude as the confidence (see softBit). A hard decision is +-FEC_SOFT_MAX.
+
+enum FecRate
+{
+    FEC_NONE,   // uncoded
+    FEC_1_2,
+    FEC_2_3,
+    FEC_3_4,
+    FEC_5_6
+};
+
+constexpr int FEC_CONSTRAINT = 7;
+constexpr int FEC_STATES = 1 << (FEC_CONSTRAINT - 1);
+constexpr int FEC_TAIL_BITS = FEC_CONSTRAINT - 1;
+constexpr int FEC_SOFT_MAX = 127;
+
+const char* fecRateName(FecRate rate);
+// Accepts none, 1/2, 2/3, 3/4, 5/6
+bool parseFecRate(const std::string& name, FecRate& rate);
+
+// Coded bits of a codeword carrying infoBits information bits, tail included
+size_t fecCodedBits(FecRate rate, size_t infoBits);
+
+// LLR (positive favours 0) scaled and saturated to a soft value
+inline int8_t softBit(double llr, double scale)
+{
+    double v = llr * scale;
+    if (v >= FEC_SOFT_MAX) return FEC_SOFT_MAX;
+    if (v <= -FEC_SOFT_MAX) return -FEC_SOFT_MAX;
+    return (int8_t)(v < 0 ? v - 0.5 : v + 0.5);
+}
+
+// Encodes one codeword into fecCodedBits(rate, infoBits) coded bits
+void convEncode(FecRate rate, const uint8_t* info, size_t infoBits, uint8_t* coded);
+
+// Bit-at-a-time encoder for streams that are never held whole, such as a
+// message cut into segments. Feed it a codeword's information bits, then
+// finish() for the tail.
+class ConvEncoder
+{
+public:
+    ConvEncoder() : rate(FEC_1_2), state(0), phase(0) {}
+
+    void reset(FecRate rate);
+    // Coded bits for one information bit (0, 1 or 2 of them after puncturing),
+    // appended to the low end of acc, oldest first; returns how many
+    int push(int bit, uint64_t& acc);
+    // Appends the tail bits and returns their count; the encoder is then reset
+    int finish(uint64_t& acc);
+
+private:
+    FecRate rate;
+    int state;
+    int phase;          // position in the puncturing period
+};
+
+// Forward pass of the decoder (see conv_code_kernels.h)
+typedef void (*ViterbiForward)(const int16_t* const* pairs, size_t steps, uint64_t* const* decisions, int count);
+
+// Viterbi decoder with a 64-state trellis. Add-compare-select runs on 16-bit
+// path metrics with one state per SIMD lane; decodeBatch runs several codewords
+// through the trellis in lockstep, so their independent recursions keep the
+// vector units busy. The kernel is AVX-512BW or AVX2, or a scalar reference
+// with the same output bit for bit. One decoder per thread: it keeps its scratch between
+// calls, so decoding allocates only when a codeword is longer than any before.
+class ViterbiDecoder
+{
+public:
+    // Kernel for isa, which must be supported; AVX-512 without BW gets AVX2
+    explicit ViterbiDecoder(BatchIsa isa = batchIsa());
+
+    // Decodes a codeword of fecCodedBits(rate, infoBits) soft values into
+    // infoBits packed bits
+    void decode(FecRate rate, const int8_t* soft, size_t infoBits, uint8_t* info);
+    // count codewords of the same length
+    void decodeBatch(FecRate rate, const int8_t* const* soft, size_t infoBits, uint8_t* const* info, int count);
+
+private:
+    void depuncture(FecRate rate, const int8_t* soft, size_t steps, int16_t* pairs) const;
+    void traceback(const uint64_t* decisions, size_t infoBits, uint8_t* info) const;
+
+    ViterbiForward forward;
+    std::vector<int16_t> pairs;         // two soft values per trellis step, erasures 0
+    std::vector<uint64_t> decisions;    // a survivor bit per state per step
+};
+
+// One codeword through a per-thread decoder
+void viterbiDecode(FecRate rate, const int8_t* soft, size_t infoBits, uint8_t* info);
@@ -0,0 +1,114 @@
+// Built with AVX2 code generation; only reached after a runtime CPU check
+#include "conv_code_kernels.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+namespace
+{
+
+// The 64 path metrics as 16-bit lanes: a[0] holds states 0-15, a[1] 16-31,
+// b[0] 32-47 and b[1] 48-63, so a and b are the two halves of each butterfly
+struct Metrics
+{
+    __m256i a[2];
+    __m256i b[2];
+};
+
+// Survivor bits of 32 butterflies, j in lane order
+inline uint32_t decisionMask(__m256i lo, __m256i hi)
+{
+    // packs interleaves the 128-bit halves; put j back in order
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xD8);
+    return (uint32_t)_mm256_movemask_epi8(packed);
+}
+
+// Even and odd successors of 16 butterflies, back in state order
+inline void interleave(__m256i even, __m256i odd, __m256i& lo, __m256i& hi)
+{
+    __m256i l = _mm256_unpacklo_epi16(even, odd);
+    __m256i h = _mm256_unpackhi_epi16(even, odd);
+    lo = _mm256_permute2x128_si256(l, h, 0x20);
+    hi = _mm256_permute2x128_si256(l, h, 0x31);
+}
+
+// One codeword at a time: the shuffles already keep the ports busy, so running
+// several in lockstep gains nothing here
+void forward(const int16_t* pairs, size_t steps, uint64_t* decisions)
+{
+    // Sign of each coded bit's term in butterfly j's branch metric
+    __m256i sign0[2], sign1[2];
+    for (int k = 0; k < 2; k++)
+	{
+        alignas(32) int16_t s0[16], s1[16];
+        for (int l = 0; l < 16; l++)
+		{
+            int label = fecBranch(16 * k + l);
+            s0[l] = (label & 2) ? -1 : 1;
+            s1[l] = (label & 1) ? -1 : 1;
+        }
+        sign0[k] = _mm256_load_si256((const __m256i*)s0);
+        sign1[k] = _mm256_load_si256((const __m256i*)s1);
+    }
+
+    Metrics m;
+    __m256i start = _mm256_set1_epi16(-VITERBI_START_PENALTY);
+    m.a[0] = _mm256_insert_epi16(start, 0, 0);
+    m.a[1] = m.b[0] = m.b[1] = start;
+
+    for (size_t t = 0; t < steps; t++)
+	{
+        __m256i s0 = _mm256_set1_epi16(pairs[2 * t]);
+        __m256i s1 = _mm256_set1_epi16(pairs[2 * t + 1]);
+        __m256i even[2], odd[2], evenFrom32[2], oddFrom32[2];
+        for (int k = 0; k < 2; k++)
+		{
+            __m256i bm = _mm256_add_epi16(_mm256_sign_epi16(s0, sign0[k]), _mm256_sign_epi16(s1, sign1[k]));
+            __m256i e0 = _mm256_adds_epi16(m.a[k], bm);
+            __m256i e1 = _mm256_subs_epi16(m.b[k], bm);
+            __m256i o0 = _mm256_subs_epi16(m.a[k], bm);
+            __m256i o1 = _mm256_adds_epi16(m.b[k], bm);
+            even[k] = _mm256_max_epi16(e0, e1);
+            odd[k] = _mm256_max_epi16(o0, o1);
+            evenFrom32[k] = _mm256_cmpgt_epi16(e1, e0);
+            oddFrom32[k] = _mm256_cmpgt_epi16(o1, o0);
+        }
+        decisions[t] = decisionMask(evenFrom32[0], evenFrom32[1]) |
+                       (uint64_t)decisionMask(oddFrom32[0], oddFrom32[1]) << 32;
+        interleave(even[0], odd[0], m.a[0], m.a[1]);
+        interleave(even[1], odd[1], m.b[0], m.b[1]);
+
+        if (t % VITERBI_RENORM_STEPS == VITERBI_RENORM_STEPS - 1)
+		{
+            // Relative to state 0; the spread stays far inside 16 bits
+            __m256i base = _mm256_broadcastw_epi16(_mm256_castsi256_si128(m.a[0]));
+            for (int k = 0; k < 2; k++)
+			{
+                m.a[k] = _mm256_sub_epi16(m.a[k], base);
+                m.b[k] = _mm256_sub_epi16(m.b[k], base);
+            }
+        }
+    }
+}
+
+void forwardAvx2(const int16_t* const* pairs, size_t steps, uint64_t* const* decisions, int count)
+{
+    for (int c = 0; c < count; c++)
+        forward(pairs[c], steps, decisions[c]);
+}
+
+}
+
+ViterbiForward viterbiForwardAvx2()
+{
+    return forwardAvx2;
+}
+
+#else
+
+ViterbiForward viterbiForwardAvx2()
+{
+    return nullptr;
+}
+
+#endif
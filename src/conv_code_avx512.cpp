@@ -0,0 +1,117 @@
+// Built with AVX-512BW code generation; only reached after a runtime CPU check
+#include "conv_code_kernels.h"
+#include <cstring>
+
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+#include <immintrin.h>
+
+namespace
+{
+
+// The 64 path metrics as 16-bit lanes: a holds states 0-31 and b 32-63, the
+// two halves of every butterfly. A step is a handful of instructions with a
+// short dependency chain through a and b, so a group of codewords in lockstep
+// fills the pipeline where one alone would leave it waiting.
+template<int N>
+void forward(const int16_t* const* pairs, size_t steps, uint64_t* const* decisions)
+{
+    // A step's pair goes to every lane as one 32-bit broadcast, a plain load,
+    // where two word broadcasts would compete with the permutes for the shuffle
+    // port. Word 2k then holds the first soft value and 2k + 1 the second; each
+    // lane negates its own value as its branch label says, and adds the other,
+    // negated likewise in a second copy and rotated in from the partner word.
+    __mmask32 own = 0, partner = 0;
+    alignas(64) int16_t lo[32], hi[32];
+    for (int j = 0; j < 32; j++)
+	{
+        int label = fecBranch(j);
+        int neg0 = (label >> 1) & 1, neg1 = label & 1;
+        if (j % 2 == 0)
+		{
+            own |= (__mmask32)neg0 << j;
+            partner |= (__mmask32)neg1 << (j + 1);
+        }
+		else
+		{
+            own |= (__mmask32)neg1 << j;
+            partner |= (__mmask32)neg0 << (j - 1);
+        }
+        // Successor state i takes the even (i even) or odd (i odd) result of butterfly i / 2
+        lo[j] = (int16_t)((j & 1) * 32 + j / 2);
+        hi[j] = (int16_t)((j & 1) * 32 + 16 + j / 2);
+    }
+    const __m512i interleaveLo = _mm512_load_si512(lo);
+    const __m512i interleaveHi = _mm512_load_si512(hi);
+    const __m512i zero = _mm512_setzero_si512();
+
+    __m512i a[N], b[N];
+    for (int c = 0; c < N; c++)
+	{
+        b[c] = _mm512_set1_epi16(-VITERBI_START_PENALTY);
+        a[c] = _mm512_mask_mov_epi16(b[c], 1, zero);
+    }
+
+    for (size_t t = 0; t < steps; t++)
+	{
+        // Unrolled so that the metrics stay in registers
+#pragma GCC unroll 4
+        for (int c = 0; c < N; c++)
+		{
+            int32_t pair;
+            std::memcpy(&pair, &pairs[c][2 * t], sizeof(pair));
+            __m512i s = _mm512_set1_epi32(pair);
+            // (The unmasked rotate leaves GCC warning about its unused source)
+            __m512i swapped = _mm512_maskz_rol_epi32(0xFFFF, _mm512_mask_sub_epi16(s, partner, zero, s), 16);
+            __m512i bm = _mm512_add_epi16(_mm512_mask_sub_epi16(s, own, zero, s), swapped);
+            __m512i e0 = _mm512_adds_epi16(a[c], bm);
+            __m512i e1 = _mm512_subs_epi16(b[c], bm);
+            __m512i o0 = _mm512_subs_epi16(a[c], bm);
+            __m512i o1 = _mm512_adds_epi16(b[c], bm);
+            __mmask32 evenFrom32 = _mm512_cmpgt_epi16_mask(e1, e0);
+            __mmask32 oddFrom32 = _mm512_cmpgt_epi16_mask(o1, o0);
+            decisions[c][t] = (uint64_t)evenFrom32 | (uint64_t)oddFrom32 << 32;
+            __m512i even = _mm512_mask_mov_epi16(e0, evenFrom32, e1);
+            __m512i odd = _mm512_mask_mov_epi16(o0, oddFrom32, o1);
+            a[c] = _mm512_permutex2var_epi16(even, interleaveLo, odd);
+            b[c] = _mm512_permutex2var_epi16(even, interleaveHi, odd);
+        }
+        if (t % VITERBI_RENORM_STEPS == VITERBI_RENORM_STEPS - 1)
+		{
+            // Relative to state 0; the spread stays far inside 16 bits
+#pragma GCC unroll 4
+            for (int c = 0; c < N; c++)
+			{
+                __m512i base = _mm512_permutexvar_epi16(zero, a[c]);
+                a[c] = _mm512_sub_epi16(a[c], base);
+                b[c] = _mm512_sub_epi16(b[c], base);
+            }
+        }
+    }
+}
+
+void forwardAvx512(const int16_t* const* pairs, size_t steps, uint64_t* const* decisions, int count)
+{
+    switch (count)
+	{
+        case 4:  forward<4>(pairs, steps, decisions); break;
+        case 3:  forward<3>(pairs, steps, decisions); break;
+        case 2:  forward<2>(pairs, steps, decisions); break;
+        default: forward<1>(pairs, steps, decisions); break;
+    }
+}
+
+}
+
+ViterbiForward viterbiForwardAvx512()
+{
+    return forwardAvx512;
+}
+
+#else
+
+ViterbiForward viterbiForwardAvx512()
+{
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+// Viterbi forward pass shared by the scalar, AVX2 and AVX-512 translation units
+// of conv_code. Only raw pointers cross this boundary, as with batch_dsp_kernels.h.
+
+#include "conv_code.h"
+
+// Generator taps with bit k on the input k steps back: 133 and 171 octal,
+// whose leading tap is the current bit
+constexpr int FEC_G0 = 0155;
+constexpr int FEC_G1 = 0117;
+
+// Codewords a kernel call runs in lockstep at most
+constexpr int VITERBI_GROUP = 4;
+
+// Path metric of every state but 0 at the start: far enough below that no path
+// from them can catch up within the constraint length
+constexpr int VITERBI_START_PENALTY = 4096;
+// Steps between renormalizations, short enough for 16-bit metrics
+constexpr int VITERBI_RENORM_STEPS = 32;
+
+// Trellis: state s holds the last 6 input bits, newest in bit 0. States j and
+// j + 32 lead to 2j (input 0) and 2j + 1 (input 1). Both generators tap the
+// newest and oldest bits, so one branch label per j covers the butterfly: from
+// j with input 0 and from j + 32 with input 1 it is fecBranch(j), and the
+// other two branches carry its complement.
+inline int fecBranch(int j)
+{
+    int reg = j << 1;
+    return (__builtin_parity(reg & FEC_G0) << 1) | __builtin_parity(reg & FEC_G1);
+}
+
+// A ViterbiForward runs count (1..VITERBI_GROUP) codewords of `steps` trellis
+// steps through the add-compare-select recursion. pairs[c] holds two soft
+// values per step, widened to the metrics' 16 bits; decisions[c][t] gets, in bit j, whether state 2j's survivor
+// at step t came from state j + 32 rather than j, and in bit 32 + j the same for
+// state 2j + 1. Metrics start at 0 for state 0; ties keep the path from j.
+
+// nullptr when the build has no code for that ISA
+ViterbiForward viterbiForwardScalar();
+ViterbiForward viterbiForwardAvx2();
+ViterbiForward viterbiForwardAvx512();    // AVX-512BW
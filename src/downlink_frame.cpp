@@ -0,0 +1,121 @@
+#include "downlink_frame.h"
+#include "signal_processing.h"
+#include <algorithm>
+
+DownlinkFrameBuilder::DownlinkFrameBuilder(const FrameLayout& layout)
+    : layout(layout), lastFrame(layout.maxUsers(), 0), payloadBins(layout.bins, 0),
+      controlEnd(0), payloadStart(layout.bins), frameCount(0), messageCount(0)
+{
+    candidates.reserve(layout.maxUsers());
+}
+
+void DownlinkFrameBuilder::add(const ControlMessage& msg)
+{
+    if (msg.userId < 0 || msg.userId >= (int)lastFrame.size()) return;
+    queue.push_back(msg);
+}
+
+// Room for the header at the end of the control region and, for a relay, its
+// payload past it in bins no other payload took
+bool DownlinkFrameBuilder::fits(const ControlMessage& msg) const
+{
+    int end = controlEnd + controlHeaderBins(layout, msg.ctrl);
+    if (end > payloadStart) return false;
+    if (msg.ctrl != CTRL_DATA_TX) return true;
+    if (msg.start < end || msg.count < 1 || msg.start + msg.count > layout.bins) return false;
+    for (int b = msg.start; b < msg.start + msg.count; b++)
+        if (payloadBins[b]) return false;
+    return true;
+}
+
+void DownlinkFrameBuilder::place(const ControlMessage& msg, std::complex<double>* active)
+{
+    encodeHeader(layout, msg, active, controlEnd);
+    controlEnd += controlHeaderBins(layout, msg.ctrl);
+    if (msg.ctrl != CTRL_DATA_TX) return;
+    encodePayload(active, msg.start, msg.count, msg.modulation, msg.payload);
+    std::fill(payloadBins.begin() + msg.start, payloadBins.begin() + msg.start + msg.count, 1);
+    payloadStart = std::min(payloadStart, msg.start);
+}
+
+void DownlinkFrameBuilder::build(std::complex<double>* active, std::vector<int>& users)
+{
+    users.clear();
+    std::fill(active, active + layout.bins, qpskModulate(0,0));
+    if (queue.empty()) return;
+    frameCount++;
+
+    // Each user's oldest message, oldest first
+    candidates.clear();
+    for (size_t i = 0; i < queue.size(); i++)
+	{
+        int uid = queue[i].userId;
+        if (lastFrame[uid] == frameCount) continue;
+        lastFrame[uid] = frameCount;
+        candidates.push_back((int)i);
+    }
+    const std::vector<ControlMessage>& q = queue;
+    std::sort(candidates.begin() + 1, candidates.end(), [&q](int a, int b) {
+        bool relayA = q[a].ctrl == CTRL_DATA_TX, relayB = q[b].ctrl == CTRL_DATA_TX;
+        if (relayA != relayB) return relayB;
+        if (relayA && q[a].start != q[b].start) return q[a].start > q[b].start;
+        return a < b;
+    });
+
+    controlEnd = 0;
+    payloadStart = layout.bins;
+    std::fill(payloadBins.begin(), payloadBins.end(), 0);
+    placed.assign(queue.size(), 0);
+    for (size_t c = 0; c < candidates.size(); c++)
+	{
+        const ControlMessage& msg = queue[candidates[c]];
+        if (fits(msg))
+		{
+            place(msg, active);
+            users.push_back(msg.userId);
+            placed[candidates[c]] = 1;
+        }
+        else if (c == 0)
+		{
+            placed[candidates[c]] = 1;     // does not fit an empty frame either: drop it
+        }
+    }
+    messageCount += users.size();
+
+    size_t keep = 0;
+    for (size_t i = 0; i < queue.size(); i++)
+        if (!placed[i]) queue[keep++] = queue[i];
+    queue.resize(keep);
+}
+
+bool frameCanMultiplex(const FrameLayout& layout)
+{
+    int longest = std::max(controlHeaderBins(layout, CTRL_RESPONSE), controlHeaderBins(layout, CTRL_DATA_TX));
+    return 2 * longest + 1 <= layout.bins;
+}
+
+ControlMessage findFrameHeader(const FrameLayout& layout, const std::complex<double>* active, int userId)
+{
+    ControlMessage first = ControlMessage();
+    int headers = 0;
+    int at = 0;
+    while (at < layout.bins)
+	{
+        // Only responses and relays go down; anything else is past the control region
+        int ctrl = readField(active, at, 1);
+        int len = controlHeaderBins(layout, ctrl);
+        if ((ctrl != CTRL_RESPONSE && ctrl != CTRL_DATA_TX) || at + len > layout.bins) break;
+        ControlMessage msg = decodeHeader(layout, active, at);
+        if (msg.userId == userId) return msg;
+        if (headers++ == 0) first = msg;
+        at += len;
+    }
+    // Frames only go to users they have a header for, so a lone header whose
+    // id the channel corrupted is still ours
+    if (headers == 1) return first;
+    ControlMessage none = ControlMessage();
+    none.ctrl = CTRL_NONE;
+    none.userId = userId;
+    none.start = -1;
+    return none;
+}
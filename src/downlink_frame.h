@@ -0,0 +1,60 @@
+#pragma once
+
+#include "frame.h"
+#include <cstdint>
+#include <vector>
+
+// Multiplexed downlink: what the base station sends during a TTI shares as few
+// symbols as it fits in, instead of taking a symbol per message. A frame's
+// control region is a run of headers packed from bin 0, each in the format
+// encodeControl puts at bin 0 of a single-message symbol; the payloads of its
+// CTRL_DATA_TX headers sit in their receivers' allocated bins, all past the
+// control region. Bins nothing uses carry QPSK 00. A frame is sent only to the
+// users it has a header for, and each reads headers until it finds its own,
+// then the payload from its own bins. A user gets at most one message per
+// frame, so its messages arrive in the order they were queued.
+class DownlinkFrameBuilder
+{
+public:
+    explicit DownlinkFrameBuilder(const FrameLayout& layout);
+
+    // Queues a downlink to msg.userId; ids outside the layout's range are dropped
+    void add(const ControlMessage& msg);
+    bool empty() const { return queue.empty(); }
+    size_t pending() const { return queue.size(); }
+
+    // Packs the next frame into layout.bins active bins and sets users to the
+    // users it carries a message for, who are the ones to send it to. The
+    // oldest queued message always goes in, so every user makes progress. The
+    // rest of the frame is filled greedily with each other user's oldest
+    // message: control messages first, then relays from the highest first bin
+    // down, which leaves the control region the most room to grow.
+    void build(std::complex<double>* active, std::vector<int>& users);
+
+    uint64_t frames() const { return frameCount; }
+    uint64_t messages() const { return messageCount; }
+
+private:
+    bool fits(const ControlMessage& msg) const;
+    void place(const ControlMessage& msg, std::complex<double>* active);
+
+    FrameLayout layout;
+    std::vector<ControlMessage> queue;  // arrival order
+    std::vector<uint64_t> lastFrame;    // per user: last frame that took up its oldest message
+    std::vector<int> candidates;        // build scratch: queue indexes
+    std::vector<char> placed;           // build scratch, per queue index
+    std::vector<char> payloadBins;      // bins a payload in the frame takes
+    int controlEnd;                     // first bin past the control region
+    int payloadStart;                   // lowest bin a payload in the frame takes
+    uint64_t frameCount;
+    uint64_t messageCount;
+};
+
+// Whether a frame can hold two messages: two of the longest headers and a
+// payload bin. The 8-bin legacy layout cannot, so multiplexing its downlink
+// would only delay it.
+bool frameCanMultiplex(const FrameLayout& layout);
+
+// userId's header in a multiplexed frame, or its only header; ctrl is
+// CTRL_NONE if neither is found
+ControlMessage findFrameHeader(const FrameLayout& layout, const std::complex<double>* active, int userId);
@@ -0,0 +1,246 @@
+#include "event_log.h"
+#include "modulation.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+// Buffers of one log never outlive it, but a thread's cached buffer can: each
+// open() gets a generation no other log will have
+static std::atomic<uint64_t> nextGeneration(1);
+
+// Recording threads a log tells apart (EventRecord::thread)
+constexpr int EVENT_LOG_MAX_THREADS = 256;
+
+// Timestamp of a record as the hot path takes it: the time stamp counter where
+// there is one, a few ns against tens for the steady clock. The writer turns
+// ticks into ns against the steady clock.
+static uint64_t eventTicks()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+EventLog::EventLog()
+    : startTicks(0), nsPerTick(1), clock(nullptr), generation(0), stopping(false), recording(false), writtenCount(0), droppedCount(0)
+{
+}
+
+EventLog::~EventLog()
+{
+    close();
+}
+
+bool EventLog::open(const std::string& filename, const long long* simClock)
+{
+    close();
+    clock = simClock;
+    out.open(filename, std::ofstream::binary | std::ofstream::trunc);
+    if (!out) return false;
+    EventLogHeader hdr = EventLogHeader();
+    hdr.magic = EVENT_LOG_MAGIC;
+    hdr.version = EVENT_LOG_VERSION;
+    hdr.recordSize = sizeof(EventRecord);
+    hdr.headerSize = sizeof(EventLogHeader);
+    hdr.timeBase = clock ? EVENT_TIME_SIMULATED : EVENT_TIME_SINCE_OPEN;
+    out.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    out.flush();
+
+    buffers.clear();
+    batch.reserve(EVENT_LOG_BUFFER);
+    started = std::chrono::steady_clock::now();
+    startTicks = eventTicks();
+    generation = nextGeneration.fetch_add(1);
+    stopping = false;
+    writtenCount.store(0);
+    droppedCount.store(0);
+    writer = std::thread(&EventLog::run, this);
+    recording.store(true);
+    return (bool)out;
+}
+
+void EventLog::close()
+{
+    if (!writer.joinable()) return;
+    recording.store(false);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+    out.close();
+}
+
+// The calling thread's buffer, registered on its first record; nullptr once
+// EVENT_LOG_MAX_THREADS threads have one
+EventLog::Buffer* EventLog::threadBuffer(int& thread)
+{
+    static thread_local uint64_t cachedGeneration = 0;
+    static thread_local Buffer* cached = nullptr;
+    static thread_local int cachedThread = 0;
+    if (cachedGeneration != generation)
+	{
+        std::lock_guard<std::mutex> guard(lock);
+        if (buffers.size() >= (size_t)EVENT_LOG_MAX_THREADS) return nullptr;
+        buffers.push_back(std::unique_ptr<Buffer>(new Buffer()));
+        cached = buffers.back().get();
+        cachedThread = (int)buffers.size() - 1;
+        cachedGeneration = generation;
+    }
+    thread = cachedThread;
+    return cached;
+}
+
+bool EventLog::record(LogEvent event, int userId, int peerId, int start, int count, uint32_t value, int modulation)
+{
+    if (!recording.load(std::memory_order_acquire)) return false;
+    int thread;
+    Buffer* buffer = threadBuffer(thread);
+    size_t head = buffer ? buffer->head.load(std::memory_order_relaxed) : 0;
+    if (buffer && head - buffer->cachedTail >= (size_t)EVENT_LOG_BUFFER)
+        buffer->cachedTail = buffer->tail.load(std::memory_order_acquire);
+    if (!buffer || head - buffer->cachedTail >= (size_t)EVENT_LOG_BUFFER)
+	{
+        droppedCount.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    EventRecord& rec = buffer->ring[head & (EVENT_LOG_BUFFER - 1)];
+    rec.timeNs = clock ? (uint64_t)*clock * 1000 : eventTicks();
+    rec.event = (uint16_t)event;
+    rec.modulation = (uint8_t)modulation;
+    rec.thread = (uint8_t)thread;
+    rec.userId = userId;
+    rec.peerId = peerId;
+    rec.start = start;
+    rec.count = count;
+    rec.value = value;
+    buffer->head.store(head + 1, std::memory_order_release);
+    // A burst gets the writer early: once past half full, until it has drained
+    if (head + 1 - buffer->cachedTail >= EVENT_LOG_BUFFER / 2)
+	{
+        buffer->cachedTail = buffer->tail.load(std::memory_order_acquire);
+        if (head + 1 - buffer->cachedTail >= EVENT_LOG_BUFFER / 2 && buffer->wokenAt != buffer->cachedTail)
+		{
+            buffer->wokenAt = buffer->cachedTail;
+            wake.notify_one();
+        }
+    }
+    return true;
+}
+
+void EventLog::run()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (!stopping)
+	{
+        wake.wait_for(guard, std::chrono::milliseconds(EVENT_LOG_DRAIN_MS));
+        drain();
+    }
+    drain();
+}
+
+// Writes out every buffer's records; the caller holds lock
+void EventLog::drain()
+{
+    // Ticks per ns over all the time since open(), the closest estimate yet
+    uint64_t ticks = eventTicks() - startTicks;
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+    if (ticks > 0 && ns > 0) nsPerTick = ns / ticks;
+    for (size_t b = 0; b < buffers.size(); b++)
+	{
+        Buffer& buffer = *buffers[b];
+        size_t tail = buffer.tail.load(std::memory_order_relaxed);
+        size_t head = buffer.head.load(std::memory_order_acquire);
+        if (head == tail) continue;
+        batch.clear();
+        for (size_t i = tail; i != head; i++)
+		{
+            EventRecord rec = buffer.ring[i & (EVENT_LOG_BUFFER - 1)];
+            if (!clock)
+                rec.timeNs = rec.timeNs > startTicks ? (uint64_t)((rec.timeNs - startTicks) * nsPerTick) : 0;
+            batch.push_back(rec);
+        }
+        buffer.tail.store(head, std::memory_order_release);
+        out.write(reinterpret_cast<const char*>(batch.data()), batch.size() * sizeof(EventRecord));
+        writtenCount.fetch_add(batch.size(), std::memory_order_relaxed);
+    }
+    out.flush();
+}
+
+void formatEvent(std::ostream& out, const EventRecord& rec)
+{
+    switch (rec.event)
+	{
+    case EVENT_ACCESS_REQUEST:
+        out << "Access request from user " << rec.userId << " requesting " << rec.count << " bins.";
+        break;
+    case EVENT_GRANT:
+        out << "Allocated " << rec.count << " bins to user " << rec.userId << " starting at active bin " << rec.start;
+        if (rec.modulation != MOD_QPSK && rec.modulation < MODULATION_COUNT)
+            out << " (" << modulationName((Modulation)rec.modulation) << ")";
+        break;
+    case EVENT_ALLOC_FAILURE:
+        out << "Could not allocate bins for user " << rec.userId;
+        break;
+    case EVENT_SCHEDULED:
+        out << "Scheduled " << rec.count << " bins to user " << rec.userId << " starting at active bin " << rec.start;
+        break;
+    case EVENT_REVOKED:
+        out << "Grant of user " << rec.userId << " revoked";
+        break;
+    case EVENT_DEALLOC_REQUEST:
+        out << "Deallocation request from user " << rec.userId;
+        break;
+    case EVENT_DEALLOCATED:
+        out << "Deallocated bins for user " << rec.userId;
+        break;
+    case EVENT_DATA:
+        out << "Data from user " << rec.userId << " to user " << rec.peerId << " => " << rec.value << " bytes";
+        break;
+    case EVENT_NO_SENDER_ALLOCATION:
+        out << "Sender " << rec.userId << " has no allocation";
+        break;
+    case EVENT_NO_RECEIVER_ALLOCATION:
+        out << "Receiver " << rec.userId << " has no allocation, Cannot re-encode data.";
+        break;
+    case EVENT_SEGMENT_LOST:
+        out << "Lost segment from user " << rec.userId << ", dropping message";
+        break;
+    case EVENT_MESSAGE_TOO_LONG:
+        out << "Message from user " << rec.userId << " exceeds " << rec.value << " bytes, dropping";
+        break;
+    case EVENT_UNKNOWN_CTRL:
+        out << "Unknown control code: " << (int32_t)rec.value;
+        break;
+    case EVENT_COLLISION:
+        out << "Headers collided in the control region";
+        break;
+    case EVENT_UNEXPECTED_HEADER:
+        out << "Unexpected header in the control region: " << (int32_t)rec.value;
+        break;
+    default:
+        out << "Unknown event " << rec.event;
+        break;
+    }
+}
+
+bool loadEventLog(const std::string& filename, std::vector<EventRecord>& records, EventTimeBase* timeBase)
+{
+    std::ifstream in(filename, std::ifstream::binary);
+    EventLogHeader hdr;
+    if (!in || !in.read(reinterpret_cast<char*>(&hdr), sizeof(hdr)) ||
+        hdr.magic != EVENT_LOG_MAGIC || hdr.version != EVENT_LOG_VERSION ||
+        hdr.recordSize != sizeof(EventRecord) || hdr.headerSize < sizeof(hdr))
+        return false;
+    in.seekg(hdr.headerSize);
+    if (timeBase) *timeBase = hdr.timeBase == EVENT_TIME_SIMULATED ? EVENT_TIME_SIMULATED : EVENT_TIME_SINCE_OPEN;
+
+    records.clear();
+    EventRecord rec;
+    while (in.read(reinterpret_cast<char*>(&rec), sizeof(rec)))
+        records.push_back(rec);
+    return true;
+}
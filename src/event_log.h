@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Binary event log: the base station's requests, grants, relays and
+// deallocations as fixed-size records instead of text. A recording thread
+// copies its record into a buffer of its own; a background thread drains the
+// buffers to the file, so the hot path never formats, locks or does I/O. The
+// file is a header followed by records, in drain order: each thread's records
+// are in order, and event_log_dump sorts them by time and renders them as the
+// text log would read. Grants, revocations and deallocations make it an audit
+// trail of the allocations.
+constexpr uint32_t EVENT_LOG_MAGIC = 0x4544464F;  // "OFDE"
+constexpr uint16_t EVENT_LOG_VERSION = 1;
+
+// Records each thread can hold before the writer drains them; a full buffer
+// drops the record and counts it. A buffer half full wakes the writer.
+constexpr int EVENT_LOG_BUFFER = 4096;     // a power of two
+// How often the writer drains otherwise
+constexpr int EVENT_LOG_DRAIN_MS = 10;
+
+enum LogEvent
+{
+    EVENT_ACCESS_REQUEST,       // userId asked for count bins
+    EVENT_GRANT,                // count bins from start granted to userId, in modulation
+    EVENT_ALLOC_FAILURE,        // nothing free for userId
+    EVENT_SCHEDULED,            // scheduler granted userId count bins from start
+    EVENT_REVOKED,              // scheduler took userId's grant back
+    EVENT_DEALLOC_REQUEST,
+    EVENT_DEALLOCATED,          // userId's bins returned
+    EVENT_DATA,                 // message of value bytes from userId to peerId complete
+    EVENT_NO_SENDER_ALLOCATION, // segment from userId, which holds no bins
+    EVENT_NO_RECEIVER_ALLOCATION,   // message for userId, which holds no bins
+    EVENT_SEGMENT_LOST,         // gap in userId's segments
+    EVENT_MESSAGE_TOO_LONG,     // userId's message over value bytes
+    EVENT_UNKNOWN_CTRL,         // control code value
+    EVENT_COLLISION,            // headers collided in a combined uplink's control region
+    EVENT_UNEXPECTED_HEADER,    // combined uplink header with control code value
+    EVENT_COUNT
+};
+
+// What EventRecord::timeNs counts
+enum EventTimeBase
+{
+    EVENT_TIME_SINCE_OPEN,      // wall-clock time since the log was opened
+    EVENT_TIME_SIMULATED        // a simulator's clock
+};
+
+struct EventLogHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t headerSize;    // offset of the first record
+    uint32_t timeBase;      // EventTimeBase; 0 in logs from before it was recorded
+};
+
+struct EventRecord
+{
+    uint64_t timeNs;        // see EventLogHeader::timeBase
+    uint16_t event;         // LogEvent
+    uint8_t modulation;     // EVENT_GRANT
+    uint8_t thread;         // recording thread, in order of first record
+    int32_t userId;
+    int32_t peerId;         // the other end of a relay, else -1
+    int32_t start;          // first bin, or -1
+    int32_t count;          // bins
+    uint32_t value;         // bytes or control code, by event
+};
+
+static_assert(sizeof(EventLogHeader) == 16, "event log header layout changed");
+static_assert(sizeof(EventRecord) == 32, "event record layout changed");
+
+class EventLog
+{
+public:
+    EventLog();
+    ~EventLog();
+
+    // Truncates filename and starts the writer; false if it cannot be created.
+    // Records are stamped with *simClock, a simulator's clock in us that only
+    // the recording thread advances, or without one the time since open().
+    bool open(const std::string& filename, const long long* simClock = nullptr);
+    // Drains what is left and stops the writer
+    void close();
+    bool isOpen() const { return recording.load(std::memory_order_relaxed); }
+
+    // Hot path: copies the record into the calling thread's buffer. False if
+    // the log is closed or the buffer is full, in which case the record is
+    // dropped and counted.
+    bool record(LogEvent event, int userId, int peerId = -1, int start = -1, int count = 0,
+                uint32_t value = 0, int modulation = 0);
+
+    uint64_t written() const { return writtenCount.load(); }
+    uint64_t dropped() const { return droppedCount.load(); }
+
+private:
+    EventLog(const EventLog&);
+    EventLog& operator=(const EventLog&);
+
+    // One recording thread's records: a single-producer single-consumer ring,
+    // so a record costs a copy and a release store, with no read-modify-write.
+    // head and tail are free-running; each side has its own cache line.
+    struct Buffer
+    {
+        Buffer() : ring(EVENT_LOG_BUFFER), head(0), cachedTail(0), wokenAt(SIZE_MAX), tail(0) {}
+        std::vector<EventRecord> ring;
+        char pad0[64];
+        std::atomic<size_t> head;       // producer
+        size_t cachedTail;              // producer's last look at tail
+        size_t wokenAt;                 // tail when the producer last woke the writer
+        char pad1[64 - sizeof(std::atomic<size_t>) - 2 * sizeof(size_t)];
+        std::atomic<size_t> tail;       // writer
+        char pad2[64 - sizeof(std::atomic<size_t>)];
+    };
+
+    Buffer* threadBuffer(int& thread);
+    void run();
+    void drain();
+
+    std::mutex lock;                // buffers, and the writer's wakeups
+    std::condition_variable wake;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    std::vector<EventRecord> batch;     // writer scratch
+    std::ofstream out;
+    std::chrono::steady_clock::time_point started;
+    uint64_t startTicks;            // eventTicks() at open()
+    double nsPerTick;               // writer's latest estimate
+    const long long* clock;         // simulated time, or null
+    uint64_t generation;            // tells this open() apart in the threads' cached buffers
+    bool stopping;
+    std::thread writer;
+    std::atomic<bool> recording;
+    std::atomic<uint64_t> writtenCount;
+    std::atomic<uint64_t> droppedCount;
+};
+
+// The line the text log writes for rec, without the newline
+void formatEvent(std::ostream& out, const EventRecord& rec);
+
+// Records of an event log in file order, and what their times count if timeBase
+// is given; false if it is missing or not an event log. A record cut short by a
+// crash ends the log without failing.
+bool loadEventLog(const std::string& filename, std::vector<EventRecord>& records, EventTimeBase* timeBase = nullptr);
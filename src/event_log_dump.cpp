@@ -0,0 +1,91 @@
+#include "event_log.h"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+// Renders a binary event log (base_station or ofdma_sim --event-log=FILE) as the
+// text log, one line per record in time order, each prefixed with the seconds
+// since the log was opened, or the simulated time for an ofdma_sim log (the
+// header says which). --allocations keeps the grants, revocations and
+// deallocations only: the audit trail of who held which bins when.
+
+static bool optionValue(const std::string& arg, const char* name, std::string& value)
+{
+    size_t len = strlen(name);
+    if (arg.compare(0, len, name) != 0) return false;
+    value = arg.substr(len);
+    return true;
+}
+
+static bool allocationEvent(uint16_t event)
+{
+    return event == EVENT_GRANT || event == EVENT_ALLOC_FAILURE || event == EVENT_SCHEDULED ||
+           event == EVENT_REVOKED || event == EVENT_DEALLOCATED;
+}
+
+static bool earlier(const EventRecord& a, const EventRecord& b)
+{
+    return a.timeNs < b.timeNs;
+}
+
+int main(int argc, char* argv[])
+{
+    string logFile;
+    int user = -1;
+    bool times = true;
+    bool allocations = false;
+
+    for (int i = 1; i < argc; i++)
+	{
+        string arg = argv[i], value;
+        bool ok = true;
+        if (optionValue(arg, "--user=", value)) ok = (user = atoi(value.c_str())) >= 0;
+        else if (arg == "--no-time") times = false;
+        else if (arg == "--allocations") allocations = true;
+        else if (arg.compare(0, 2, "--") != 0 && logFile.empty()) logFile = arg;
+        else ok = false;
+        if (!ok)
+		{
+            logFile.clear();
+            break;
+        }
+    }
+    if (logFile.empty())
+	{
+        cerr << "Usage: event_log_dump <events.evt> [--user=N] [--allocations] [--no-time]" << endl;
+        return 1;
+    }
+
+    vector<EventRecord> records;
+    EventTimeBase timeBase;
+    if (!loadEventLog(logFile, records, &timeBase))
+	{
+        cerr << logFile << " is not an event log" << endl;
+        return 1;
+    }
+    // Each thread's records are in order already; merge them keeping that order
+    stable_sort(records.begin(), records.end(), earlier);
+
+    int threads = 0;
+    size_t shown = 0;
+    cout << fixed << setprecision(6);
+    for (size_t i = 0; i < records.size(); i++)
+	{
+        const EventRecord& rec = records[i];
+        threads = max(threads, rec.thread + 1);
+        if (user >= 0 && rec.userId != user && rec.peerId != user) continue;
+        if (allocations && !allocationEvent(rec.event)) continue;
+        if (times) cout << setw(12) << rec.timeNs * 1e-9 << "  ";
+        formatEvent(cout, rec);
+        cout << "\n";
+        shown++;
+    }
+    double span = records.empty() ? 0 : records.back().timeNs * 1e-9;
+    cerr << logFile << ": " << shown << " of " << records.size() << " records from " << threads
+         << " threads over " << span << (timeBase == EVENT_TIME_SIMULATED ? " s of simulated time" : " s since the log was opened")
+         << endl;
+    return 0;
+}
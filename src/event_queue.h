@@ -0,0 +1,54 @@
+#pragma once
+
+#include <queue>
+#include <vector>
+
+// Pending events ordered by time. Events scheduled for the same time come out
+// in the order they were scheduled, so a run is reproducible for a given seed.
+template <typename T>
+class EventQueue
+{
+public:
+    EventQueue() : nextSeq(0) {}
+
+    void schedule(long long time, const T& event)
+    {
+        Entry e;
+        e.time = time;
+        e.seq = nextSeq++;
+        e.event = event;
+        heap.push(e);
+    }
+
+    bool empty() const { return heap.empty(); }
+    size_t size() const { return heap.size(); }
+    long long nextTime() const { return heap.top().time; }
+
+    // Removes the earliest event and returns its time
+    long long pop(T& event)
+    {
+        long long time = heap.top().time;
+        event = heap.top().event;
+        heap.pop();
+        return time;
+    }
+
+private:
+    struct Entry
+    {
+        long long time;
+        unsigned long long seq;
+        T event;
+    };
+    struct Later
+    {
+        bool operator()(const Entry& a, const Entry& b) const
+        {
+            if (a.time != b.time) return a.time > b.time;
+            return a.seq > b.seq;
+        }
+    };
+
+    std::priority_queue<Entry, std::vector<Entry>, Later> heap;
+    unsigned long long nextSeq;
+};
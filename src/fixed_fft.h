@@ -0,0 +1,200 @@
+#pragma once
+
+#include "numerology.h"
+#include "sample_format.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+
+// Q15 fixed-point transforms with block floating point. Before each radix-2
+// stage the block is halved if a component could overflow in it, and the number
+// of halvings is returned so the caller can carry the block exponent along.
+// Butterfly sums also saturate, as a backstop.
+
+// Largest component a radix-2 stage takes without overflow: |a + w*b| per
+// component is at most (1 + sqrt(2)) times the largest input component
+constexpr int Q15_STAGE_HEADROOM = 13572;
+
+inline int16_t saturateQ15(int32_t v)
+{
+    return (int16_t)(v > 32767 ? 32767 : (v < -32768 ? -32768 : v));
+}
+
+// Arithmetic right shift by s >= 1, rounding to nearest
+inline int32_t roundShift(int32_t v, int s)
+{
+    return (v + (1 << (s - 1))) >> s;
+}
+
+template<int N>
+struct FixedFft
+{
+    static const std::array<cq15, N/2>& twiddle()
+    {
+        static const std::array<cq15, N/2> table = makeTwiddle();
+        return table;
+    }
+
+    // Transforms data already in StaticFft<N>::bitrev() order. The inverse is
+    // unscaled (no 1/N). Both return the right shifts applied to the block.
+    static int fftBitReversed(cq15* x) { return run<false>(x); }
+    static int ifftBitReversed(cq15* x) { return run<true>(x); }
+
+private:
+    static std::array<cq15, N/2> makeTwiddle()
+    {
+        // Clamped to +-32767 so the inverse can negate the imaginary part
+        std::array<cq15, N/2> table;
+        for (int k = 0; k < N/2; k++)
+		{
+            std::complex<double> w = std::polar(1.0, -2 * M_PI * k / N);
+            table[k].re = (int16_t)std::lround(w.real() * 32767);
+            table[k].im = (int16_t)std::lround(w.imag() * 32767);
+        }
+        return table;
+    }
+
+    static int peak(const cq15* x)
+    {
+        int m = 0;
+        for (int i = 0; i < N; i++)
+		{
+            int re = std::abs((int)x[i].re);
+            int im = std::abs((int)x[i].im);
+            if (re > m) m = re;
+            if (im > m) m = im;
+        }
+        return m;
+    }
+
+    template<bool Inverse>
+    static int run(cq15* x)
+    {
+        const cq15* tw = twiddle().data();
+        int shifts = 0;
+        for (int h = 1; h < N; h *= 2)
+		{
+            if (peak(x) > Q15_STAGE_HEADROOM)
+			{
+                for (int i = 0; i < N; i++)
+				{
+                    x[i].re = (int16_t)roundShift(x[i].re, 1);
+                    x[i].im = (int16_t)roundShift(x[i].im, 1);
+                }
+                shifts++;
+            }
+            const int step = N / (2*h);
+            for (int base = 0; base < N; base += 2*h)
+			{
+                for (int j = 0; j < h; j++)
+				{
+                    cq15 w = tw[j*step];
+                    if (Inverse) w.im = (int16_t)-w.im;
+                    cq15& a = x[base + j];
+                    cq15& b = x[base + j + h];
+                    int32_t tr = roundShift((int32_t)b.re * w.re - (int32_t)b.im * w.im, 15);
+                    int32_t ti = roundShift((int32_t)b.re * w.im + (int32_t)b.im * w.re, 15);
+                    int32_t ar = a.re, ai = a.im;
+                    a.re = saturateQ15(ar + tr);
+                    a.im = saturateQ15(ai + ti);
+                    b.re = saturateQ15(ar - tr);
+                    b.im = saturateQ15(ai - ti);
+                }
+            }
+        }
+        return shifts;
+    }
+};
+
+// Numerology<FFT, BINS> in Q15. Exponents are those of the blocks (see cq15);
+// each call takes its input's and returns its output's.
+template<int FFT, int BINS>
+struct FixedNumerology
+{
+    typedef Numerology<FFT, BINS> Layout;
+
+    static int demux(const cq15* time, int timeExp, cq15* active)
+    {
+        return Transform<Layout::strided>::demux(time, timeExp, active);
+    }
+
+    static int mux(const cq15* active, int activeExp, cq15* time)
+    {
+        return Transform<Layout::strided>::mux(active, activeExp, time);
+    }
+
+private:
+    static constexpr int LOG2_FFT = StaticFft<FFT>::log2n();
+
+    template<bool Strided, int Dummy = 0>
+    struct Transform
+    {
+        // Fold in 32 bits, then shift the folded block back into 16
+        static int demux(const cq15* time, int timeExp, cq15* active)
+        {
+            const std::array<int, BINS>& rev = StaticFft<BINS>::bitrev();
+            std::array<int32_t, 2*BINS> acc;
+            int32_t peak = 0;
+            for (int m = 0; m < BINS; m++)
+			{
+                int32_t re = 0, im = 0;
+                for (int i = m; i < FFT; i += BINS)
+				{
+                    re += time[i].re;
+                    im += time[i].im;
+                }
+                acc[2*m] = re;
+                acc[2*m + 1] = im;
+                peak = std::max(peak, std::max(std::abs(re), std::abs(im)));
+            }
+            int s = 0;
+            while ((peak >> s) > 32767) s++;
+            for (int m = 0; m < BINS; m++)
+			{
+                active[rev[m]].re = s ? saturateQ15(roundShift(acc[2*m], s)) : (int16_t)acc[2*m];
+                active[rev[m]].im = s ? saturateQ15(roundShift(acc[2*m + 1], s)) : (int16_t)acc[2*m + 1];
+            }
+            return timeExp + s + FixedFft<BINS>::fftBitReversed(active);
+        }
+
+        // x[n] = (1 / FFT) * sum_k A_k W^-(n*k), periodic with period BINS
+        static int mux(const cq15* active, int activeExp, cq15* time)
+        {
+            const std::array<int, BINS>& rev = StaticFft<BINS>::bitrev();
+            for (int m = 0; m < BINS; m++)
+                time[rev[m]] = active[m];
+            int shifts = FixedFft<BINS>::ifftBitReversed(time);
+            for (int i = BINS; i < FFT; i++)
+                time[i] = time[i - BINS];
+            return activeExp + shifts - LOG2_FFT;
+        }
+    };
+
+    template<int Dummy>
+    struct Transform<false, Dummy>
+    {
+        static int demux(const cq15* time, int timeExp, cq15* active)
+        {
+            const std::array<int, FFT>& rev = StaticFft<FFT>::bitrev();
+            std::array<cq15, FFT> freq;
+            for (int i = 0; i < FFT; i++)
+                freq[rev[i]] = time[i];
+            int shifts = FixedFft<FFT>::fftBitReversed(freq.data());
+            for (int i = 0; i < BINS; i++)
+                active[i] = freq[Layout::subcarrier(i)];
+            return timeExp + shifts;
+        }
+
+        static int mux(const cq15* active, int activeExp, cq15* time)
+        {
+            const std::array<int, FFT>& rev = StaticFft<FFT>::bitrev();
+            const cq15 zero = { 0, 0 };
+            for (int i = 0; i < FFT; i++)
+                time[i] = zero;
+            for (int i = 0; i < BINS; i++)
+                time[rev[Layout::subcarrier(i)]] = active[i];
+            return activeExp + FixedFft<FFT>::ifftBitReversed(time) - LOG2_FFT;
+        }
+    };
+};
@@ -0,0 +1,168 @@
+#include "frame.h"
+#include "conv_code.h"
+#include "signal_processing.h"
+#include <algorithm>
+#include <vector>
+
+static int symbolsFor(int bits)
+{
+    return (bits + 1) / 2;
+}
+
+FrameLayout makeFrameLayout(int fftSize, int bins, int idBits)
+{
+    int binBits = 0;
+    while ((1 << binBits) < bins) binBits++;
+
+    FrameLayout layout;
+    layout.fftSize = fftSize;
+    layout.bins = bins;
+    layout.idSymbols = symbolsFor(idBits);
+    layout.countSymbols = 1;
+    layout.startSymbols = symbolsFor(binBits);
+    // 2-bit sequence numbers are all the 8-bin layout has room for, and they
+    // take one of its allocatable bins (see frame.h)
+    layout.seqSymbols = bins >= 32 ? 4 : 1;
+    return layout;
+}
+
+FrameLayout legacyLayout()
+{
+    return makeFrameLayout(FFT_SIZE, FREQ_BINS, 2);
+}
+
+int readField(const std::complex<double>* active, int firstBin, int symbols)
+{
+    int value = 0;
+    for (int i = firstBin; i < firstBin + symbols; i++)
+	{
+        std::pair<int,int> bits = qpskDemodulate(active[i]);
+        value = (value << 2) | (bits.first * 2 + bits.second);
+    }
+    return value;
+}
+
+void writeField(std::complex<double>* active, int firstBin, int symbols, int value)
+{
+    for (int i = 0; i < symbols; i++)
+	{
+        int shift = 2 * (symbols - 1 - i);
+        int sym = (value >> shift) & 0x3;
+        active[firstBin + i] = qpskModulate((sym >> 1) & 1, sym & 1);
+    }
+}
+
+int controlHeaderBins(const FrameLayout& layout, int ctrl)
+{
+    const int id = layout.idSymbols;
+    switch (ctrl)
+	{
+        case CTRL_ACCESS_REQUEST: return 1 + id + layout.countSymbols;
+        case CTRL_RESPONSE:       return 1 + id + layout.countSymbols + layout.startSymbols + 1;
+        case CTRL_DATA_TX:        return layout.headerBins();
+        default:                  return 1 + id;
+    }
+}
+
+void encodeHeader(const FrameLayout& layout, const ControlMessage& msg, std::complex<double>* active, int first)
+{
+    const int id = layout.idSymbols;
+
+    writeField(active, first, 1, msg.ctrl);
+    writeField(active, first + 1, id, msg.userId);
+
+    switch (msg.ctrl)
+	{
+        case CTRL_ACCESS_REQUEST:
+            writeField(active, first + 1 + id, layout.countSymbols, msg.count);
+            break;
+        case CTRL_RESPONSE:
+            writeField(active, first + 1 + id, layout.countSymbols, msg.count);
+            writeField(active, first + 1 + id + layout.countSymbols, layout.startSymbols, msg.start);
+            writeField(active, first + 1 + id + layout.countSymbols + layout.startSymbols, 1, msg.modulation);
+            break;
+        case CTRL_DATA_TX:
+            writeField(active, first + 1 + id, id, msg.srcId);
+            writeField(active, first + 1 + 2 * id, layout.seqSymbols, msg.seq);
+            break;
+        default:
+            break;
+    }
+}
+
+ControlMessage decodeHeader(const FrameLayout& layout, const std::complex<double>* active, int first)
+{
+    const int id = layout.idSymbols;
+
+    ControlMessage msg = ControlMessage();
+    msg.start = -1;
+    msg.ctrl = readField(active, first, 1);
+    msg.userId = readField(active, first + 1, id);
+
+    switch (msg.ctrl)
+	{
+        case CTRL_ACCESS_REQUEST:
+            msg.count = readField(active, first + 1 + id, layout.countSymbols);
+            break;
+        case CTRL_RESPONSE:
+            msg.count = readField(active, first + 1 + id, layout.countSymbols);
+            msg.start = readField(active, first + 1 + id + layout.countSymbols, layout.startSymbols);
+            msg.modulation = static_cast<Modulation>(readField(active, first + 1 + id + layout.countSymbols + layout.startSymbols, 1));
+            break;
+        case CTRL_DATA_TX:
+            msg.srcId = readField(active, first + 1 + id, id);
+            msg.seq = readField(active, first + 1 + 2 * id, layout.seqSymbols);
+            break;
+        default:
+            break;
+    }
+    return msg;
+}
+
+void encodeControl(const FrameLayout& layout, const ControlMessage& msg, std::complex<double>* active)
+{
+    // No data in unused bins
+    std::fill(active, active + layout.bins, qpskModulate(0,0));
+
+    encodeHeader(layout, msg, active, 0);
+    if (msg.ctrl == CTRL_DATA_TX && msg.count > 0 && msg.start >= 0 && msg.start + msg.count <= layout.bins)
+        encodePayload(active, msg.start, msg.count, msg.modulation, msg.payload);
+}
+
+ControlMessage decodeControl(const FrameLayout& layout, const std::complex<double>* active)
+{
+    return decodeHeader(layout, active, 0);
+}
+
+void encodePayload(std::complex<double>* active, int start, int count, Modulation mod, int payload)
+{
+    const int bits = modulationBits(mod);
+    for (int i = 0; i < count; i++)
+	{
+        int shift = bits * (count - 1 - i);
+        active[start + i] = mapSymbol(mod, (payload >> shift) & ((1 << bits) - 1));
+    }
+}
+
+int decodePayload(const std::complex<double>* active, int start, int count, Modulation mod)
+{
+    const int bits = modulationBits(mod);
+    int value = 0;
+    for (int i = start; i < start + count; i++)
+        value = (value << bits) | demapSymbol(mod, active[i]);
+    return value;
+}
+
+void decodePayloadSoft(const std::complex<double>* active, int start, int count, Modulation mod, int8_t* soft)
+{
+    const int bits = modulationBits(mod);
+    static thread_local std::vector<double> llr;
+    llr.resize((size_t)count * bits);
+    // With noiseVar 0.5 an LLR is d1^2 - d0^2, so a point received exactly has
+    // the squared minimum distance (6 / (M - 1) at unit energy); scale that to a
+    // quarter of full confidence, leaving room for points beyond it
+    demapLLR(mod, active + start, count, 0.5, llr.data());
+    const double scale = (FEC_SOFT_MAX + 1) / 4 * ((1 << bits) - 1) / 6.0;
+    for (int i = 0; i < count * bits; i++)
+        soft[i] = softBit(llr[i], scale);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <complex>
+#include "modulation.h"
+
+// Where the fields of a control header sit among a symbol's active bins. Every
+// field is a run of QPSK symbols carrying 2 bits each, most significant first:
+//
+//   bin 0                         control code
+//   [1, 1+id)                     user id (destination for CTRL_DATA_TX)
+//   [1+id, 1+2*id)                source id (CTRL_DATA_TX)
+//   [1+2*id, 1+2*id+seq)          segment sequence number (CTRL_DATA_TX, see segment.h)
+//   [1+id, 1+id+count)            requested / allocated bin count
+//   [1+id+count, ...+start)       first allocated bin (CTRL_RESPONSE)
+//   1+id+count+start              payload modulation (CTRL_RESPONSE)
+//
+// With one-symbol ids this is the original 8-bin layout: ctrl, id, src|count, start hi, start lo,
+// followed by the modulation; CTRL_DATA_TX adds a one-symbol sequence number after the
+// source id. CTRL_DATA_TX payloads use the allocation's modulation.
+//
+// The uplink header is reserved in every symbol, so the sequence number costs
+// the 8-bin layout an allocatable bin: grants there come from bins 4..7, where
+// they came from 3..7 before segmentation. No spare room carries it instead:
+// the control code uses all four of its values, and a grant may cover every
+// bin past the header.
+struct FrameLayout
+{
+    int fftSize;
+    int bins;
+    int idSymbols;
+    int countSymbols;
+    int startSymbols;
+    int seqSymbols;
+
+    int maxUsers() const { return 1 << (2 * idSymbols); }
+    int maxGrant() const { return (1 << (2 * countSymbols)) - 1; }
+    int seqBits() const { return 2 * seqSymbols; }
+    // Bins every uplink symbol uses for its header; never allocated to users
+    int headerBins() const { return 1 + 2 * idSymbols + seqSymbols; }
+    // Room for every header field and at least one allocatable bin
+    bool fits() const { return headerBins() < bins && 1 + idSymbols + countSymbols + startSymbols + 1 <= bins; }
+};
+
+// Layout for an fftSize/bins numerology with user ids of at least idBits bits
+FrameLayout makeFrameLayout(int fftSize, int bins, int idBits);
+
+// FFT_SIZE/FREQ_BINS with 2-bit user ids, as used by the base_station and user processes
+FrameLayout legacyLayout();
+
+struct ControlMessage
+{
+    int ctrl;
+    int userId;     // requester, addressee, or destination for CTRL_DATA_TX
+    int srcId;      // CTRL_DATA_TX sender
+    int count;      // requested (CTRL_ACCESS_REQUEST) or allocated (CTRL_RESPONSE) bins
+    int start;      // CTRL_RESPONSE first bin; CTRL_DATA_TX payload bins start here
+    int seq;        // CTRL_DATA_TX segment sequence number
+    int payload;    // CTRL_DATA_TX segment, modulationBits(modulation) per bin in [start, start + count)
+    Modulation modulation;  // CTRL_RESPONSE grant; CTRL_DATA_TX payload
+};
+
+int readField(const std::complex<double>* active, int firstBin, int symbols);
+void writeField(std::complex<double>* active, int firstBin, int symbols, int value);
+
+// Bins the header fields of a ctrl message take
+int controlHeaderBins(const FrameLayout& layout, int ctrl);
+
+// Header fields alone, starting at active bin first: what encodeControl and
+// decodeControl put at bin 0, and a multiplexed downlink frame (see
+// downlink_frame.h) packs one after another
+void encodeHeader(const FrameLayout& layout, const ControlMessage& msg, std::complex<double>* active, int first);
+ControlMessage decodeHeader(const FrameLayout& layout, const std::complex<double>* active, int first);
+
+// Fills all layout.bins active bins; unused bins carry QPSK 00
+void encodeControl(const FrameLayout& layout, const ControlMessage& msg, std::complex<double>* active);
+
+// Decodes the header fields for msg.ctrl. CTRL_DATA_TX payloads live in the
+// sender's or receiver's allocation, which only the caller knows: see decodePayload.
+ControlMessage decodeControl(const FrameLayout& layout, const std::complex<double>* active);
+
+// Payload bits in [start, start + count), most significant first
+void encodePayload(std::complex<double>* active, int start, int count, Modulation mod, int payload);
+int decodePayload(const std::complex<double>* active, int start, int count, Modulation mod);
+// The same bits as soft values for a coded payload (see conv_code.h), one per bit
+void decodePayloadSoft(const std::complex<double>* active, int start, int count, Modulation mod, int8_t* soft);
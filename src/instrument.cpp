@@ -0,0 +1,275 @@
+#include "instrument.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static const char* const STAGE_NAMES[STAGE_COUNT] =
+{
+    "rx_io", "demux", "decode", "mac", "alloc", "encode", "mux", "noise", "tx_io"
+};
+
+static const char* const COUNTER_NAMES[COUNTER_COUNT] =
+{
+    "requests", "grants", "alloc_failures", "deallocations", "segments", "relays", "dropped_messages", "unknown_ctrl",
+    "collisions"
+};
+
+const char* instrumentStageName(InstrumentStage stage)
+{
+    return STAGE_NAMES[stage];
+}
+
+const char* instrumentCounterName(InstrumentCounter counter)
+{
+    return COUNTER_NAMES[counter];
+}
+
+void writeInstrumentSnapshot(std::ostream& out, const InstrumentSnapshot& snap)
+{
+    out << "{\"uptime_s\": " << snap.uptimeSeconds << ", \"counters\": {";
+    for (int c = 0; c < COUNTER_COUNT; c++)
+        out << (c ? ", " : "") << "\"" << COUNTER_NAMES[c] << "\": " << snap.counters[c];
+    out << "}, \"stages\": {";
+    bool first = true;
+    for (int s = 0; s < STAGE_COUNT; s++)
+	{
+        const StageSnapshot& st = snap.stages[s];
+        if (st.count == 0) continue;
+        out << (first ? "" : ", ") << "\"" << STAGE_NAMES[s] << "\": {\"count\": " << st.count
+            << ", \"mean_ns\": " << st.totalNs / st.count << ", \"p50_ns\": " << st.p50Ns << ", \"p90_ns\": " << st.p90Ns
+            << ", \"p99_ns\": " << st.p99Ns << ", \"p999_ns\": " << st.p999Ns << ", \"max_ns\": " << st.maxNs << "}";
+        first = false;
+    }
+    out << "}}" << std::endl;
+}
+
+#ifdef OFDMA_INSTRUMENT
+
+// Log-linear (HDR-style) buckets: values below 2^SUB_BITS get a bucket each,
+// then every power of two is split into 2^SUB_BITS equal buckets, so a bucket's
+// width is at most 1/16 of its values
+constexpr int SUB_BITS = 4;
+constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+constexpr int HIST_BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+static int bucketOf(uint64_t v)
+{
+    if (v < (uint64_t)SUB_BUCKETS) return (int)v;
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - SUB_BITS;
+    return (shift + 1) * SUB_BUCKETS + (int)(v >> shift) - SUB_BUCKETS;
+}
+
+// Largest value that lands in bucket b
+static uint64_t bucketHigh(int b)
+{
+    if (b < SUB_BUCKETS) return (uint64_t)b;
+    int shift = b / SUB_BUCKETS - 1;
+    uint64_t sub = (uint64_t)(b % SUB_BUCKETS + SUB_BUCKETS);
+    return ((sub + 1) << shift) - 1;
+}
+
+// One thread's data. Only the owner writes, so increments are a relaxed load
+// and store; snapshot readers see each value whole.
+struct ThreadStats
+{
+    std::atomic<uint64_t> hist[STAGE_COUNT][HIST_BUCKETS];
+    std::atomic<uint64_t> total[STAGE_COUNT];
+    std::atomic<uint64_t> max[STAGE_COUNT];
+    std::atomic<uint64_t> counters[COUNTER_COUNT];
+
+    ThreadStats()
+    {
+        for (int s = 0; s < STAGE_COUNT; s++)
+		{
+            for (int b = 0; b < HIST_BUCKETS; b++) hist[s][b].store(0, std::memory_order_relaxed);
+            total[s].store(0, std::memory_order_relaxed);
+            max[s].store(0, std::memory_order_relaxed);
+        }
+        for (int c = 0; c < COUNTER_COUNT; c++) counters[c].store(0, std::memory_order_relaxed);
+    }
+};
+
+static inline void bump(std::atomic<uint64_t>& v, uint64_t by)
+{
+    v.store(v.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+// Every thread that ever recorded; kept after the thread exits so its samples
+// stay in the totals
+struct StatsRegistry
+{
+    std::mutex mtx;
+    std::vector<std::unique_ptr<ThreadStats>> threads;
+    std::chrono::steady_clock::time_point started;
+
+    StatsRegistry() : started(std::chrono::steady_clock::now()) {}
+};
+
+static StatsRegistry& registry()
+{
+    static StatsRegistry* reg = new StatsRegistry();     // never destroyed: threads may record during exit
+    return *reg;
+}
+
+static ThreadStats& localStats()
+{
+    static thread_local ThreadStats* local = nullptr;
+    if (!local)
+	{
+        StatsRegistry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mtx);
+        reg.threads.push_back(std::unique_ptr<ThreadStats>(new ThreadStats()));
+        local = reg.threads.back().get();
+    }
+    return *local;
+}
+
+uint64_t instrumentNow()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void instrumentRecord(InstrumentStage stage, uint64_t ns)
+{
+    ThreadStats& ts = localStats();
+    bump(ts.hist[stage][bucketOf(ns)], 1);
+    bump(ts.total[stage], ns);
+    if (ns > ts.max[stage].load(std::memory_order_relaxed))
+        ts.max[stage].store(ns, std::memory_order_relaxed);
+}
+
+void instrumentCount(InstrumentCounter counter)
+{
+    bump(localStats().counters[counter], 1);
+}
+
+void instrumentSnapshot(InstrumentSnapshot& snap)
+{
+    StatsRegistry& reg = registry();
+    std::vector<uint64_t> merged(HIST_BUCKETS);
+    std::lock_guard<std::mutex> lock(reg.mtx);
+
+    snap.uptimeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - reg.started).count();
+    for (int c = 0; c < COUNTER_COUNT; c++)
+	{
+        snap.counters[c] = 0;
+        for (size_t t = 0; t < reg.threads.size(); t++)
+            snap.counters[c] += reg.threads[t]->counters[c].load(std::memory_order_relaxed);
+    }
+
+    for (int s = 0; s < STAGE_COUNT; s++)
+	{
+        StageSnapshot& st = snap.stages[s];
+        st = StageSnapshot();
+        std::fill(merged.begin(), merged.end(), 0);
+        for (size_t t = 0; t < reg.threads.size(); t++)
+		{
+            const ThreadStats& ts = *reg.threads[t];
+            for (int b = 0; b < HIST_BUCKETS; b++)
+			{
+                uint64_t n = ts.hist[s][b].load(std::memory_order_relaxed);
+                merged[b] += n;
+                st.count += n;
+            }
+            st.totalNs += ts.total[s].load(std::memory_order_relaxed);
+            uint64_t m = ts.max[s].load(std::memory_order_relaxed);
+            if (m > st.maxNs) st.maxNs = m;
+        }
+
+        // Percentiles from the merged buckets
+        const double quantiles[4] = { 0.5, 0.9, 0.99, 0.999 };
+        uint64_t* out[4] = { &st.p50Ns, &st.p90Ns, &st.p99Ns, &st.p999Ns };
+        uint64_t seen = 0;
+        int q = 0;
+        for (int b = 0; b < HIST_BUCKETS && q < 4; b++)
+		{
+            seen += merged[b];
+            while (q < 4 && st.count > 0 && seen >= (uint64_t)(quantiles[q] * st.count + 0.5) && seen > 0)
+			{
+                *out[q] = std::min(bucketHigh(b), st.maxNs);
+                q++;
+            }
+        }
+    }
+}
+
+// Background thread appending snapshots to a file
+class InstrumentReporter
+{
+public:
+    InstrumentReporter(const std::string& path, int intervalSeconds)
+        : out(path.c_str(), std::ios::app), interval(intervalSeconds), stopping(false)
+    {
+        if (out) thread = std::thread(&InstrumentReporter::run, this);
+    }
+
+    ~InstrumentReporter()
+    {
+        if (!thread.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_one();
+        thread.join();
+        report();
+    }
+
+    bool ok() const { return thread.joinable(); }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (!cv.wait_for(lock, std::chrono::seconds(interval), [this] { return stopping; }))
+            report();
+    }
+
+    void report()
+    {
+        InstrumentSnapshot snap;
+        instrumentSnapshot(snap);
+        writeInstrumentSnapshot(out, snap);
+    }
+
+    std::ofstream out;
+    int interval;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopping;
+    std::thread thread;
+};
+
+bool startInstrumentReporter(const std::string& path, int intervalSeconds)
+{
+    static std::unique_ptr<InstrumentReporter> reporter;
+    if (reporter || intervalSeconds < 1) return false;
+    reporter.reset(new InstrumentReporter(path, intervalSeconds));
+    return reporter->ok();
+}
+
+#else
+
+uint64_t instrumentNow() { return 0; }
+void instrumentRecord(InstrumentStage, uint64_t) {}
+void instrumentCount(InstrumentCounter) {}
+
+void instrumentSnapshot(InstrumentSnapshot& snap)
+{
+    snap = InstrumentSnapshot();
+}
+
+bool startInstrumentReporter(const std::string&, int)
+{
+    return false;
+}
+
+#endif
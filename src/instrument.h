@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Hot-path instrumentation: per-stage latency histograms and event counters.
+// Every thread records into its own copy, so recording takes no locks and
+// shares no cache lines; snapshots merge the copies. Build with
+// -DOFDMA_INSTRUMENT (make build INSTRUMENT=1) to enable it. Otherwise the
+// INSTRUMENT_* macros expand to nothing and startInstrumentReporter fails.
+
+enum InstrumentStage
+{
+    STAGE_RX_IO,        // transport receive of a symbol that was already waiting
+    STAGE_DEMUX,        // time samples -> active bins
+    STAGE_DECODE,       // control header decode
+    STAGE_MAC,          // whole uplink symbol through the base-station MAC
+    STAGE_ALLOC,        // bin allocation
+    STAGE_ENCODE,       // control/payload encode of a downlink or uplink symbol
+    STAGE_MUX,          // active bins -> time samples
+    STAGE_NOISE,        // AWGN
+    STAGE_TX_IO,        // transport send
+    STAGE_COUNT
+};
+
+enum InstrumentCounter
+{
+    COUNT_REQUESTS,         // access requests received
+    COUNT_GRANTS,
+    COUNT_ALLOC_FAILURES,
+    COUNT_DEALLOCATIONS,
+    COUNT_SEGMENTS,         // data segments received
+    COUNT_RELAYS,           // messages relayed to their receiver
+    COUNT_DROPPED_MESSAGES, // lost segment, too long, or no allocation at either end
+    COUNT_UNKNOWN_CTRL,
+    COUNT_COLLISIONS,       // combined uplink symbols with more than one header
+    COUNTER_COUNT
+};
+
+const char* instrumentStageName(InstrumentStage stage);
+const char* instrumentCounterName(InstrumentCounter counter);
+
+#ifdef OFDMA_INSTRUMENT
+constexpr bool INSTRUMENT_ENABLED = true;
+#else
+constexpr bool INSTRUMENT_ENABLED = false;
+#endif
+
+// Monotonic nanoseconds (steady_clock)
+uint64_t instrumentNow();
+void instrumentRecord(InstrumentStage stage, uint64_t ns);
+void instrumentCount(InstrumentCounter counter);
+
+// Records the time since `since` and returns the current time, so back-to-back
+// stages need one clock read each
+inline uint64_t instrumentLap(InstrumentStage stage, uint64_t since)
+{
+    uint64_t now = instrumentNow();
+    instrumentRecord(stage, now - since);
+    return now;
+}
+
+// Times the rest of the enclosing scope
+class ScopedStageTimer
+{
+public:
+    explicit ScopedStageTimer(InstrumentStage stage) : stage(stage), start(instrumentNow()) {}
+    ~ScopedStageTimer() { instrumentRecord(stage, instrumentNow() - start); }
+
+private:
+    InstrumentStage stage;
+    uint64_t start;
+};
+
+#ifdef OFDMA_INSTRUMENT
+#define INSTRUMENT_CONCAT2(a, b) a##b
+#define INSTRUMENT_CONCAT(a, b) INSTRUMENT_CONCAT2(a, b)
+#define INSTRUMENT_SCOPE(stage) ScopedStageTimer INSTRUMENT_CONCAT(stageTimer, __LINE__)(stage)
+#define INSTRUMENT_COUNT(counter) instrumentCount(counter)
+#define INSTRUMENT_START(var) uint64_t var = instrumentNow()
+#define INSTRUMENT_RESTART(var) (var = instrumentNow())
+#define INSTRUMENT_LAP(stage, var) (var = instrumentLap(stage, var))
+#define INSTRUMENT_STOP(stage, var) instrumentRecord(stage, instrumentNow() - (var))
+#else
+#define INSTRUMENT_SCOPE(stage) ((void)0)
+#define INSTRUMENT_COUNT(counter) ((void)0)
+#define INSTRUMENT_START(var) ((void)0)
+#define INSTRUMENT_RESTART(var) ((void)0)
+#define INSTRUMENT_LAP(stage, var) ((void)0)
+#define INSTRUMENT_STOP(stage, var) ((void)0)
+#endif
+
+struct StageSnapshot
+{
+    uint64_t count;
+    uint64_t totalNs;
+    uint64_t maxNs;
+    uint64_t p50Ns, p90Ns, p99Ns, p999Ns;   // bucket upper bounds, within ~6%
+};
+
+struct InstrumentSnapshot
+{
+    double uptimeSeconds;
+    uint64_t counters[COUNTER_COUNT];
+    StageSnapshot stages[STAGE_COUNT];
+};
+
+// Merges every thread's histograms and counters recorded so far
+void instrumentSnapshot(InstrumentSnapshot& snap);
+
+// One JSON object on one line; stages with no samples are left out
+void writeInstrumentSnapshot(std::ostream& out, const InstrumentSnapshot& snap);
+
+// Appends a snapshot line to `path` every intervalSeconds, and a last one at
+// exit. The path may be a named pipe for a live reader. False if instrumentation
+// is compiled out or the file cannot be opened.
+bool startInstrumentReporter(const std::string& path, int intervalSeconds);
@@ -0,0 +1,544 @@
+#define _USE_MATH_DEFINES
+#include "load_generator.h"
+#include "signal_processing.h"
+#include "user_core.h"
+#include "combined_uplink.h"
+#include "event_queue.h"
+#include "bounded_queue.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <random>
+#include <thread>
+
+// A header that got no reply by then is sent again
+constexpr long long LOAD_REPLY_TIMEOUT_US = 200000;
+// Combined uplink: access requests that collided wait up to 2^N TTIs more, N
+// the retries so far up to this, so that they do not collide again
+constexpr int LOAD_MAX_BACKOFF = 6;
+// First access requests are spread over this long, so they do not all collide
+constexpr long long LOAD_START_SPREAD_US = 100000;
+// Messages a user holds for sending; arrivals beyond that are dropped as overflow
+constexpr size_t LOAD_MAX_QUEUE = 1024;
+// Once the offered traffic stops, time for messages in flight to arrive
+constexpr long long LOAD_DRAIN_US = 1000000;
+constexpr long long LOAD_REPORT_US = 1000000;
+
+enum LoadEventType { LOAD_ARRIVAL, LOAD_TIMEOUT, LOAD_SESSION_START, LOAD_SESSION_END };
+
+struct LoadEvent
+{
+    int type;
+    int user;       // index into the driven users
+    int timer;      // LOAD_TIMEOUT: stale unless it matches the user's timer; LOAD_SESSION_END: its session
+};
+
+enum LoadUserState { LOAD_IDLE, LOAD_WAIT_GRANT, LOAD_ACTIVE, LOAD_RELEASING };
+
+struct LoadUser
+{
+    LoadUser(const FrameLayout& layout, int id)
+        : terminal(layout, id), state(LOAD_IDLE), timer(0), session(0), header(CTRL_NONE),
+          sessionOver(false), retries(0), started(false), dest(0), txSymbols(0) {}
+
+    UserTerminal terminal;
+    LoadUserState state;
+    int timer;
+    int session;                    // grants so far
+    int header;                     // CTRL_ACCESS_REQUEST or CTRL_DEALLOCATE to send, or CTRL_NONE
+    bool sessionOver;               // release the grant once the queue is empty
+    int retries;                    // access requests in a row that got no reply
+    std::deque<int> queue;          // lengths of the messages waiting, oldest first
+    bool started;                   // the oldest is being sent, from message
+    std::vector<uint8_t> message;
+    int dest;
+    std::vector<long long> sentUs;  // per sequence number: when its first segment went out
+    std::vector<char> delivered;    // per sequence number
+    uint64_t txSymbols;             // uplink noise stream position
+};
+
+struct LoadStats
+{
+    long long offered;
+    long long overflowed;
+    long long sent;                 // messages, all segments out
+    long long sentDriven;           // of those, to a driven user
+    long long segments;
+    long long restarted;            // a new grant abandoned them partway
+    long long delivered;
+    long long corrupt;              // decoded, but not a message that was sent
+    long long external;             // from users this process does not drive
+    long long sendFailures;         // symbols the transport dropped
+    long long requests;
+    long long grants;
+    long long blocked;
+    long long revoked;
+    long long timeouts;
+    long long sessions;             // grants given back
+};
+
+LoadProfile defaultLoadProfile()
+{
+    LoadProfile p;
+    p.arrival = ARRIVAL_POISSON;
+    p.rate = 20;
+    p.burstMean = 8;
+    p.minBytes = 4;
+    p.maxBytes = 16;
+    p.dest = LOAD_DEST_OTHERS;
+    p.bins = 2;
+    p.sessionMean = 0;
+    p.idleMean = 0.5;
+    p.duration = 10;
+    p.seed = 1;
+    p.multiplexed = false;
+    p.combined = false;
+    p.ttiUs = 1000;
+    p.fec = FEC_NONE;
+    return p;
+}
+
+bool parseLoadArrival(const std::string& name, LoadArrival& arrival)
+{
+    if (name == "poisson") arrival = ARRIVAL_POISSON;
+    else if (name == "bursty") arrival = ARRIVAL_BURSTY;
+    else return false;
+    return true;
+}
+
+// Sorted latencies in us -> the one at fraction q, in ms
+static double percentileMs(const std::vector<long long>& sorted, double q)
+{
+    if (sorted.empty()) return 0;
+    size_t i = std::min(sorted.size() - 1, (size_t)(q * sorted.size()));
+    return sorted[i] * 1e-3;
+}
+
+class LoadGenerator
+{
+public:
+    LoadGenerator(Transport& link, const std::vector<int>& ids, const LoadProfile& profile, std::ostream& out)
+        : link(link), profile(profile), out(out), layout(legacyLayout()), rng(profile.seed),
+          rxWave(FFT_SIZE), rxActive(FREQ_BINS), txWave(FFT_SIZE), txActive(FREQ_BINS),
+          indexOf(layout.maxUsers(), -1), nextUser(0), lastTti(0), now(0)
+    {
+        stats = LoadStats();
+        for (size_t i = 0; i < ids.size(); i++)
+		{
+            users.push_back(std::unique_ptr<LoadUser>(new LoadUser(layout, ids[i])));
+            users.back()->terminal.setDownlinkMux(profile.multiplexed);
+            users.back()->terminal.setUplinkCombine(profile.combined);
+            users.back()->terminal.setFec(profile.fec);
+            indexOf[ids[i]] = (int)i;
+        }
+    }
+
+    int run()
+    {
+        started = std::chrono::steady_clock::now();
+        std::uniform_int_distribution<long long> spread(0, LOAD_START_SPREAD_US);
+        for (size_t u = 0; u < users.size(); u++)
+		{
+            schedule(LOAD_SESSION_START, (int)u, 0, spread(rng));
+            scheduleArrival((int)u);
+        }
+        long long endUs = (long long)(profile.duration * 1e6);
+        long long nextReport = LOAD_REPORT_US;
+        size_t reported = 0;
+        long long reportedSent = 0;
+        Backoff backoff;
+        while (true)
+		{
+            now = elapsedUs();
+            if (now >= endUs + LOAD_DRAIN_US) break;
+            bool busy = receive();
+            LoadEvent ev;
+            while (!events.empty() && events.nextTime() <= now)
+			{
+                events.pop(ev);
+                handleEvent(ev, endUs);
+                busy = true;
+            }
+            if (transmitDue()) busy = transmit() || busy;
+            if (now >= nextReport)
+			{
+                // Progress over the last second
+                std::vector<long long> window(latencies.begin() + reported, latencies.end());
+                std::sort(window.begin(), window.end());
+                out << "[" << nextReport / LOAD_REPORT_US << " s] sent " << stats.sent - reportedSent
+                    << " messages, delivered " << window.size() << ", latency p50 " << percentileMs(window, 0.5)
+                    << " ms, p99 " << percentileMs(window, 0.99) << " ms" << std::endl;
+                reported = latencies.size();
+                reportedSent = stats.sent;
+                nextReport += LOAD_REPORT_US;
+            }
+            if (busy)
+                backoff.reset();
+            else
+                backoff.pause();
+        }
+        release();
+        return summary();
+    }
+
+private:
+    long long elapsedUs() const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+    }
+
+    void schedule(int type, int user, int timer, long long delayUs)
+    {
+        LoadEvent ev = { type, user, timer };
+        events.schedule(now + delayUs, ev);
+    }
+
+    long long expUs(double meanSeconds)
+    {
+        std::exponential_distribution<double> dist(1.0 / meanSeconds);
+        return 1 + (long long)(dist(rng) * 1e6);
+    }
+
+    void scheduleArrival(int u)
+    {
+        double gap = profile.arrival == ARRIVAL_BURSTY ? profile.burstMean / profile.rate : 1.0 / profile.rate;
+        schedule(LOAD_ARRIVAL, u, 0, expUs(gap));
+    }
+
+    void handleEvent(const LoadEvent& ev, long long endUs)
+    {
+        LoadUser& lu = *users[ev.user];
+        if (ev.type == LOAD_ARRIVAL)
+		{
+            if (now >= endUs) return;
+            int count = 1;
+            if (profile.arrival == ARRIVAL_BURSTY)
+			{
+                std::geometric_distribution<int> burst(1.0 / profile.burstMean);
+                count += burst(rng);
+            }
+            std::uniform_int_distribution<int> length(profile.minBytes, profile.maxBytes);
+            for (int i = 0; i < count; i++)
+			{
+                stats.offered++;
+                if (lu.queue.size() < LOAD_MAX_QUEUE)
+                    lu.queue.push_back(length(rng));
+                else
+                    stats.overflowed++;
+            }
+            scheduleArrival(ev.user);
+        }
+        else if (ev.type == LOAD_TIMEOUT && ev.timer == lu.timer)
+		{
+            // Unanswered, or blocked or revoked and due to ask again
+            if (lu.state == LOAD_WAIT_GRANT) lu.header = CTRL_ACCESS_REQUEST;
+            else if (lu.state == LOAD_RELEASING) lu.header = CTRL_DEALLOCATE;
+            stats.timeouts++;
+        }
+        else if (ev.type == LOAD_SESSION_START && lu.state == LOAD_IDLE)
+		{
+            lu.header = CTRL_ACCESS_REQUEST;
+        }
+        else if (ev.type == LOAD_SESSION_END && ev.timer == lu.session && lu.state == LOAD_ACTIVE)
+		{
+            lu.sessionOver = true;
+        }
+    }
+
+    // Decodes every downlink symbol that has arrived for the driven users
+    bool receive()
+    {
+        bool any = false;
+        for (size_t u = 0; u < users.size(); u++)
+		{
+            LoadUser& lu = *users[u];
+            while (link.receive(lu.terminal.id(), rxWave.data(), FFT_SIZE, 0) == FFT_SIZE)
+			{
+                any = true;
+                demuxActiveBins(rxWave.data(), rxActive.data());
+                ControlMessage msg = lu.terminal.handleDownlink(rxActive.data());
+                if (msg.ctrl == CTRL_RESPONSE)
+                    response((int)u, msg);
+                else if (msg.ctrl == CTRL_DATA_TX && lu.terminal.completedMessage())
+                    delivered(*lu.terminal.completedMessage());
+            }
+        }
+        return any;
+    }
+
+    void response(int u, const ControlMessage& msg)
+    {
+        LoadUser& lu = *users[u];
+        lu.retries = 0;
+        if (msg.count > 0 && lu.state == LOAD_WAIT_GRANT)
+		{
+            stats.grants++;
+            lu.state = LOAD_ACTIVE;
+            lu.timer++;
+            lu.session++;
+            if (profile.sessionMean > 0)
+                schedule(LOAD_SESSION_END, u, lu.session, expUs(profile.sessionMean));
+        }
+        else if (msg.count == 0 && lu.state == LOAD_WAIT_GRANT)
+		{
+            stats.blocked++;
+            schedule(LOAD_TIMEOUT, u, ++lu.timer, LOAD_REPLY_TIMEOUT_US);
+        }
+        else if (msg.count == 0 && lu.state == LOAD_RELEASING)
+		{
+            // The deallocation's acknowledgement
+            stats.sessions++;
+            lu.state = LOAD_IDLE;
+            lu.timer++;
+            schedule(LOAD_SESSION_START, u, 0, expUs(profile.idleMean));
+        }
+        else if (msg.count == 0 && lu.state == LOAD_ACTIVE)
+		{
+            stats.revoked++;
+            lu.state = LOAD_WAIT_GRANT;
+            schedule(LOAD_TIMEOUT, u, ++lu.timer, LOAD_REPLY_TIMEOUT_US);
+        }
+        // A grant the scheduler moved needs nothing: the message in progress starts over
+    }
+
+    // Checks a reassembled message against what its sender sent
+    void delivered(const RxMessage& rx)
+    {
+        int src = rx.srcId >= 0 && rx.srcId < (int)indexOf.size() ? indexOf[rx.srcId] : -1;
+        if (src < 0)
+		{
+            stats.external++;
+            return;
+        }
+        LoadUser& sender = *users[src];
+        uint32_t seq = 0;
+        bool ok = rx.length >= 4;
+        if (ok)
+		{
+            seq = rx.data[0] | rx.data[1] << 8 | rx.data[2] << 16 | (uint32_t)rx.data[3] << 24;
+            ok = seq < sender.sentUs.size() && !sender.delivered[seq];
+        }
+        for (size_t i = 4; ok && i < rx.length; i++)
+            ok = rx.data[i] == filler(sender.terminal.id(), seq, i);
+        if (!ok)
+		{
+            stats.corrupt++;
+            return;
+        }
+        sender.delivered[seq] = 1;
+        stats.delivered++;
+        latencies.push_back(now - sender.sentUs[seq]);
+    }
+
+    static uint8_t filler(int src, uint32_t seq, size_t i)
+    {
+        return (uint8_t)(seq * 31 + i * 7 + src);
+    }
+
+    // Legacy uplinks go out as soon as they are built; combined ones a quarter
+    // into each TTI, one per user, like the user process's
+    bool transmitDue()
+    {
+        if (!profile.combined) return true;
+        std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+        uint64_t tti = ttiIndex(t, profile.ttiUs);
+        if (tti == lastTti || t < ttiStart(tti, profile.ttiUs) + std::chrono::microseconds(profile.ttiUs / 4))
+            return false;
+        lastTti = tti;
+        return true;
+    }
+
+    // Whether the user may send its symbol for ctrl in this TTI; on a combined
+    // uplink a header waits for a slot it may use
+    bool turn(LoadUser& lu, int ctrl)
+    {
+        if (!profile.combined) return true;
+        if (lu.terminal.headerTti(ctrl, lastTti) != lastTti) return false;
+        lu.terminal.setUplinkTti(lastTti);
+        return true;
+    }
+
+    // Extra wait before an access request is sent again: on a combined uplink
+    // requests that collided time out together, so each waits a random number
+    // of TTIs from a window that doubles with every retry
+    long long backoff(LoadUser& lu)
+    {
+        if (!profile.combined) return 0;
+        std::uniform_int_distribution<int> ttis(0, (1 << std::min(lu.retries++, LOAD_MAX_BACKOFF)) - 1);
+        return (long long)ttis(rng) * profile.ttiUs;
+    }
+
+    // Each user sends at most one symbol, starting from a different user each time
+    bool transmit()
+    {
+        bool any = false;
+        for (size_t k = 0; k < users.size(); k++)
+            any = transmitOne((int)((nextUser + k) % users.size())) || any;
+        nextUser = (nextUser + 1) % users.size();
+        return any;
+    }
+
+    bool transmitOne(int u)
+    {
+        LoadUser& lu = *users[u];
+        if (lu.header != CTRL_NONE)
+		{
+            if (!turn(lu, lu.header)) return false;
+            long long timeout = LOAD_REPLY_TIMEOUT_US;
+            if (lu.header == CTRL_ACCESS_REQUEST)
+			{
+                timeout += backoff(lu);
+                lu.terminal.accessRequest(std::max(1, std::min(profile.bins, layout.maxGrant())), txActive.data());
+                lu.state = LOAD_WAIT_GRANT;
+                stats.requests++;
+            }
+			else
+			{
+                lu.terminal.deallocate(txActive.data());
+                lu.state = LOAD_RELEASING;
+            }
+            lu.header = CTRL_NONE;
+            schedule(LOAD_TIMEOUT, u, ++lu.timer, timeout);
+            send(lu);
+            return true;
+        }
+        if (lu.state != LOAD_ACTIVE || !lu.terminal.hasAllocation()) return false;
+        if (lu.queue.empty())
+		{
+            if (lu.sessionOver)
+			{
+                lu.sessionOver = false;
+                lu.header = CTRL_DEALLOCATE;
+            }
+            return false;
+        }
+
+        if (!turn(lu, CTRL_DATA_TX)) return false;
+        if (!lu.started)
+		{
+            startMessage(lu);
+            lu.terminal.sendData(lu.dest, lu.message.data(), lu.message.size());
+        }
+        else if (!lu.terminal.dataPending())
+		{
+            stats.restarted++;
+            lu.terminal.sendData(lu.dest, lu.message.data(), lu.message.size());
+        }
+        lu.terminal.nextDataTx(txActive.data());
+        stats.segments++;
+        send(lu);
+        if (!lu.terminal.dataPending())
+		{
+            stats.sent++;
+            if (lu.dest >= 0 && lu.dest < (int)indexOf.size() && indexOf[lu.dest] >= 0) stats.sentDriven++;
+            lu.queue.pop_front();
+            lu.started = false;
+        }
+        return true;
+    }
+
+    // The oldest queued message: its sequence number, then bytes the receiver can check
+    void startMessage(LoadUser& lu)
+    {
+        uint32_t seq = (uint32_t)lu.sentUs.size();
+        lu.sentUs.push_back(now);
+        lu.delivered.push_back(0);
+        lu.message.resize(lu.queue.front());
+        for (size_t i = 0; i < lu.message.size(); i++)
+            lu.message[i] = i < 4 ? (uint8_t)(seq >> (8 * i)) : filler(lu.terminal.id(), seq, i);
+        lu.dest = pickDest(lu.terminal.id());
+        lu.started = true;
+    }
+
+    int pickDest(int self)
+    {
+        if (profile.dest >= 0) return profile.dest;
+        int n = (int)users.size();
+        if (profile.dest == LOAD_DEST_OTHERS && n > 1)
+		{
+            std::uniform_int_distribution<int> other(0, n - 2);
+            int i = other(rng);
+            if (i >= indexOf[self]) i++;
+            return users[i]->terminal.id();
+        }
+        std::uniform_int_distribution<int> any(0, n - 1);
+        return users[any(rng)]->terminal.id();
+    }
+
+    void send(LoadUser& lu)
+    {
+        muxActiveBins(txActive.data(), txWave.data());
+        if (!profile.combined)   // the base station adds a combined symbol's
+            addAWGN(txWave.data(), FFT_SIZE, NOISE_VARIANCE, noiseKey(uplinkNoise(lu.terminal.id()), lu.txSymbols++));
+        if (!link.send(BS_ENDPOINT, txWave.data(), FFT_SIZE)) stats.sendFailures++;
+    }
+
+    // Gives back the grants still held, without waiting for the replies. On a
+    // combined uplink each goes in a TTI its grant has a slot in, over a cycle.
+    void release()
+    {
+        std::vector<char> released(users.size(), 0);
+        const int ttis = profile.combined ? combinedHeaderCycle(layout) : 1;
+        for (int t = 0; t < ttis; t++)
+		{
+            if (profile.combined)
+			{
+                lastTti = ttiIndex(std::chrono::steady_clock::now(), profile.ttiUs) + 1;
+                std::this_thread::sleep_until(ttiStart(lastTti, profile.ttiUs) + std::chrono::microseconds(profile.ttiUs / 4));
+            }
+            for (size_t u = 0; u < users.size(); u++)
+			{
+                if (released[u] || !users[u]->terminal.hasAllocation() || !turn(*users[u], CTRL_DEALLOCATE)) continue;
+                users[u]->terminal.deallocate(txActive.data());
+                send(*users[u]);
+                released[u] = 1;
+            }
+        }
+    }
+
+    int summary()
+    {
+        std::sort(latencies.begin(), latencies.end());
+        double mean = 0;
+        for (size_t i = 0; i < latencies.size(); i++)
+            mean += latencies[i];
+        mean = latencies.empty() ? 0 : mean / latencies.size() * 1e-3;
+        const LoadStats& s = stats;
+        out << "Load: " << users.size() << " users, " << (profile.arrival == ARRIVAL_BURSTY ? "bursty" : "poisson")
+            << " arrivals at " << profile.rate << " messages/s each, " << profile.minBytes << "-" << profile.maxBytes
+            << " bytes, " << profile.duration << " s\n";
+        out << "Messages: offered " << s.offered << " (overflowed " << s.overflowed << "), sent " << s.sent << " in "
+            << s.segments << " segments (restarted " << s.restarted << "), delivered " << s.delivered << " => "
+            << s.delivered / profile.duration << " messages/s, lost " << s.sentDriven - s.delivered << ", corrupt "
+            << s.corrupt << ", from other users " << s.external << ", symbols the transport dropped " << s.sendFailures << "\n";
+        out << "Latency from first segment to decode: mean " << mean << " ms, p50 " << percentileMs(latencies, 0.5)
+            << " ms, p90 " << percentileMs(latencies, 0.9) << " ms, p99 " << percentileMs(latencies, 0.99)
+            << " ms, max " << percentileMs(latencies, 1.0) << " ms\n";
+        out << "Access: " << s.requests << " requests, " << s.grants << " grants, " << s.blocked << " blocked, "
+            << s.revoked << " revoked, " << s.timeouts << " timeouts, " << s.sessions << " sessions ended" << std::endl;
+        return s.delivered > 0 || s.sent == 0 ? 0 : 1;
+    }
+
+    Transport& link;
+    LoadProfile profile;
+    std::ostream& out;
+    FrameLayout layout;
+    std::mt19937_64 rng;
+    std::vector<std::unique_ptr<LoadUser>> users;   // a terminal is not copyable
+    EventQueue<LoadEvent> events;
+    std::vector<std::complex<double>> rxWave, rxActive, txWave, txActive;
+    std::vector<int> indexOf;           // user id -> index into users, or -1
+    std::vector<long long> latencies;   // us, one per delivered message
+    size_t nextUser;
+    uint64_t lastTti;
+    std::chrono::steady_clock::time_point started;
+    long long now;                      // us since started
+    LoadStats stats;
+};
+
+int runLoadGenerator(Transport& link, const std::vector<int>& users, const LoadProfile& profile, std::ostream& out)
+{
+    LoadGenerator gen(link, users, profile, out);
+    return gen.run();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "conv_code.h"
+#include "transport.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Load generator: several user terminals driven from one process, against a
+// running base station, instead of the interactive menu. One thread runs an
+// event loop over them: it decodes whatever downlinks have arrived, fires the
+// traffic profile's due events, then lets each terminal send at most one
+// symbol. Messages carry a sequence number, so the receiving terminal, driven
+// by the same loop, can tell when each one was sent and how long it took to get
+// through the base station.
+
+// How messages arrive at each user
+enum LoadArrival
+{
+    ARRIVAL_POISSON,    // one at a time, exponential gaps
+    ARRIVAL_BURSTY      // geometric bursts of burstMean on average, exponential gaps between bursts
+};
+
+// Destinations other than a user id
+constexpr int LOAD_DEST_OTHERS = -1;    // any other driven user
+constexpr int LOAD_DEST_ANY = -2;       // any driven user, itself included
+
+struct LoadProfile
+{
+    LoadArrival arrival;
+    double rate;            // messages per second per user
+    int burstMean;
+    int minBytes;           // message lengths, uniform; at least 4 for the sequence number
+    int maxBytes;
+    int dest;               // LOAD_DEST_OTHERS, LOAD_DEST_ANY or a user id
+    int bins;               // asked for with each access request
+    double sessionMean;     // seconds a user keeps its grant before releasing it; 0 keeps it
+    double idleMean;        // seconds between a user's sessions
+    double duration;        // seconds of offered traffic; the loop then drains for a second
+    uint64_t seed;
+    bool multiplexed;       // as the base station runs
+    bool combined;
+    int ttiUs;
+    FecRate fec;
+};
+
+LoadProfile defaultLoadProfile();
+
+// Parses "poisson" or "bursty"
+bool parseLoadArrival(const std::string& name, LoadArrival& arrival);
+
+// Runs the profile for the given user ids, printing a progress line a second
+// and the totals to out. Returns 0, or 1 if nothing was delivered.
+int runLoadGenerator(Transport& link, const std::vector<int>& users, const LoadProfile& profile, std::ostream& out);
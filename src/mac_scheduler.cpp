@@ -0,0 +1,236 @@
+#include "mac_scheduler.h"
+#include <cmath>
+
+// Below this the stored averages are folded back into real ones before they overflow
+constexpr double MIN_DECAY = 1e-150;
+
+const char* schedulerPolicyName(SchedulerPolicy policy)
+{
+    switch (policy)
+	{
+        case SCHED_ROUND_ROBIN:       return "rr";
+        case SCHED_MAX_THROUGHPUT:    return "max-rate";
+        case SCHED_PROPORTIONAL_FAIR: return "pf";
+        default:                      return "fcfs";
+    }
+}
+
+bool parseSchedulerPolicy(const std::string& name, SchedulerPolicy& policy)
+{
+    if (name == "fcfs") policy = SCHED_NONE;
+    else if (name == "rr") policy = SCHED_ROUND_ROBIN;
+    else if (name == "max-rate") policy = SCHED_MAX_THROUGHPUT;
+    else if (name == "pf") policy = SCHED_PROPORTIONAL_FAIR;
+    else return false;
+    return true;
+}
+
+MacScheduler::MacScheduler(SchedulerPolicy policy, int maxUsers, int grantTtis, int idleTtis)
+    : policy(policy), grantTtis(grantTtis > 0 ? grantTtis : 1),
+      idleTtis(idleTtis > 0 ? idleTtis : this->grantTtis), users(maxUsers, UserState()),
+      nodes(std::make_shared<NodeArena>(NODE_ARENA_BLOCK, 2 * (size_t)maxUsers + 2)),
+      waiting(std::less<WaitKey>(), WaitSet::allocator_type(nodes.get())),
+      leases(std::less<std::pair<uint64_t,int>>(), LeaseSet::allocator_type(nodes.get())),
+      tti(0), nextOrder(0),
+      // Includes the current TTI's factor, so served() can credit bits right away
+      decay(1 - 1 / PF_WINDOW_TTIS),
+      totalBits(0), grantCount(0), preemptCount(0), idleCount(0)
+{
+    renewals.reserve(maxUsers);
+}
+
+// Smaller is served first
+double MacScheduler::metric(const UserState& u) const
+{
+    double rate = (double)u.demand * u.bitsPerBin;
+    if (policy == SCHED_MAX_THROUGHPUT)
+        return -rate;
+    if (policy == SCHED_PROPORTIONAL_FAIR)
+        return u.avgScaled > 0 ? -rate / u.avgScaled : -HUGE_VAL;
+    return (double)u.lastServed;
+}
+
+void MacScheduler::enqueue(int userId)
+{
+    UserState& u = users[userId];
+    u.key = metric(u);
+    u.order = nextOrder++;
+    u.queued = true;
+    WaitKey k = { u.key, u.order, userId };
+    waiting.insert(k);
+}
+
+void MacScheduler::dequeue(int userId)
+{
+    UserState& u = users[userId];
+    WaitKey k = { u.key, u.order, userId };
+    waiting.erase(k);
+    u.queued = false;
+}
+
+void MacScheduler::grant(int userId, BinExtent ext)
+{
+    UserState& u = users[userId];
+    u.ext = ext;
+    u.expires = tti + grantTtis;
+    u.lastServed = tti + 1;     // 0 stays "never served"
+    leases.insert(std::make_pair(u.expires, userId));
+}
+
+void MacScheduler::request(int userId, int bins, int bitsPerBin)
+{
+    if (userId < 0 || userId >= (int)users.size() || bins < 1) return;
+    UserState& u = users[userId];
+    u.seen = true;
+    u.backlogged = true;
+    u.demand = bins;
+    u.bitsPerBin = bitsPerBin;
+    if (u.queued)
+	{
+        // Re-key in place, keeping its turn among equal keys
+        uint64_t order = u.order;
+        dequeue(userId);
+        u.key = metric(u);
+        u.order = order;
+        u.queued = true;
+        WaitKey k = { u.key, u.order, userId };
+        waiting.insert(k);
+    }
+    else if (u.ext.count == 0)
+        enqueue(userId);
+}
+
+void MacScheduler::withdraw(int userId, BinAllocator& bins)
+{
+    if (userId < 0 || userId >= (int)users.size()) return;
+    UserState& u = users[userId];
+    u.backlogged = false;
+    if (u.queued) dequeue(userId);
+    if (u.ext.count > 0)
+	{
+        bins.release(u.ext.start, u.ext.count);
+        leases.erase(std::make_pair(u.expires, userId));
+        u.ext.count = 0;
+    }
+}
+
+void MacScheduler::served(int userId, int bits)
+{
+    if (userId < 0 || userId >= (int)users.size() || bits <= 0) return;
+    UserState& u = users[userId];
+    u.bits += bits;
+    u.lastActive = tti;
+    u.avgScaled += bits / (PF_WINDOW_TTIS * decay);
+    totalBits += bits;
+}
+
+BinExtent MacScheduler::grantOf(int userId) const
+{
+    BinExtent none = { -1, 0 };
+    if (userId < 0 || userId >= (int)users.size() || users[userId].ext.count == 0) return none;
+    return users[userId].ext;
+}
+
+// Frees an expired lease's bins. A user that sent nothing for idleTtis loses
+// its demand; the rest compete again, remembering the extent they held.
+void MacScheduler::endLease(int userId, BinAllocator& bins)
+{
+    UserState& u = users[userId];
+    bins.release(u.ext.start, u.ext.count);
+    if (tti - u.lastActive >= (uint64_t)idleTtis)
+	{
+        u.backlogged = false;
+        u.ext.count = 0;
+        idleCount++;
+        return;
+    }
+    u.renewing = true;
+    renewals.push_back(userId);
+    enqueue(userId);
+}
+
+void MacScheduler::runTti(BinAllocator& bins, std::vector<SchedulerGrant>& out)
+{
+    renewals.clear();
+    while (!leases.empty() && leases.begin()->first <= tti)
+	{
+        int uid = leases.begin()->second;
+        leases.erase(leases.begin());
+        endLease(uid, bins);
+        if (users[uid].ext.count == 0)
+		{
+            SchedulerGrant revoke = { uid, -1, 0 };
+            out.push_back(revoke);
+        }
+    }
+
+    while (!waiting.empty() && bins.freeBins() > 0)
+	{
+        int uid = waiting.begin()->userId;
+        UserState& u = users[uid];
+        dequeue(uid);
+        if (u.renewing && bins.allocateAt(u.ext.start, u.ext.count))
+		{
+            u.renewing = false;
+            grant(uid, u.ext);
+            continue;
+        }
+        // Never empty while bins are free: allocate falls back to the longest run
+        BinExtent ext = bins.allocate(u.demand);
+        if (!u.renewing) u.lastActive = tti;
+        u.renewing = false;
+        grant(uid, ext);
+        grantCount++;
+        SchedulerGrant g = { uid, ext.start, ext.count };
+        out.push_back(g);
+    }
+
+    // Renewals the free bins ran out before stay queued without their grant
+    for (size_t i = 0; i < renewals.size(); i++)
+	{
+        UserState& u = users[renewals[i]];
+        if (!u.renewing) continue;
+        u.renewing = false;
+        u.ext.count = 0;
+        preemptCount++;
+        SchedulerGrant revoke = { renewals[i], -1, 0 };
+        out.push_back(revoke);
+    }
+
+    tti++;
+    decay *= 1 - 1 / PF_WINDOW_TTIS;
+    if (decay < MIN_DECAY) renormalize();
+}
+
+// Folds the accumulated decay into the stored averages; the waiting users'
+// order does not change, only their keys' scale
+void MacScheduler::renormalize()
+{
+    for (size_t i = 0; i < users.size(); i++)
+        users[i].avgScaled *= decay;
+    decay = 1;
+    waiting.clear();
+    for (size_t i = 0; i < users.size(); i++)
+	{
+        UserState& u = users[i];
+        if (!u.queued) continue;
+        u.key = metric(u);
+        WaitKey k = { u.key, u.order, (int)i };
+        waiting.insert(k);
+    }
+}
+
+double MacScheduler::fairness() const
+{
+    double sum = 0, sumSq = 0;
+    int n = 0;
+    for (size_t i = 0; i < users.size(); i++)
+	{
+        if (!users[i].seen) continue;
+        double x = (double)users[i].bits;
+        sum += x;
+        sumSq += x * x;
+        n++;
+    }
+    return sumSq > 0 ? sum * sum / (n * sumSq) : 1.0;
+}
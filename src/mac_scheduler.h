@@ -0,0 +1,141 @@
+#pragma once
+
+#include "bin_allocator.h"
+#include "node_pool.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include <utility>
+
+enum SchedulerPolicy
+{
+    SCHED_NONE,                 // grant on request, held until released (first come, first served)
+    SCHED_ROUND_ROBIN,          // least recently served first
+    SCHED_MAX_THROUGHPUT,       // highest rate first
+    SCHED_PROPORTIONAL_FAIR     // highest rate relative to the user's average throughput first
+};
+
+// "fcfs", "rr", "max-rate" or "pf"
+const char* schedulerPolicyName(SchedulerPolicy policy);
+bool parseSchedulerPolicy(const std::string& name, SchedulerPolicy& policy);
+
+constexpr int DEFAULT_GRANT_TTIS = 8;
+// Time constant, in TTIs, of the average throughput proportional fair divides by
+constexpr double PF_WINDOW_TTIS = 100;
+
+// A grant the scheduler handed out or took back (count 0) in a TTI
+struct SchedulerGrant
+{
+    int userId;
+    int start;
+    int count;
+};
+
+// Per-TTI MAC scheduler. Users with demand wait in a set ordered by the
+// policy's metric, so picking the next user and re-keying one are O(log n);
+// grants are leases of grantTtis TTIs, kept in a second set by expiry. At the
+// end of each TTI expired leases go back into the waiting set if their user
+// sent anything in the last idleTtis TTIs and are dropped otherwise (idleTtis
+// defaults to one lease; an interactive user needs longer), then the free bins
+// go to the waiting users in metric order. A renewed user keeps its old extent
+// when it is still free, so only users that lose their bins see a new grant.
+//
+// Proportional fair's averages all decay by the same factor each TTI, which
+// leaves the waiting users' order unchanged; they are stored divided by the
+// accumulated decay, so only users that were served are re-keyed.
+class MacScheduler
+{
+public:
+    // Users are ids [0, maxUsers); idleTtis < 1 means grantTtis
+    MacScheduler(SchedulerPolicy policy, int maxUsers, int grantTtis, int idleTtis = 0);
+
+    SchedulerPolicy schedulerPolicy() const { return policy; }
+    int leaseTtis() const { return grantTtis; }
+    int idleTimeoutTtis() const { return idleTtis; }
+
+    // Adds or updates a user's demand: bins wanted per TTI and the payload bits
+    // each bin carries on its link. A user holding a grant keeps it.
+    void request(int userId, int bins, int bitsPerBin);
+    // Drops the user's demand and returns its grant's bins, if any
+    void withdraw(int userId, BinAllocator& bins);
+    // Payload bits received from the user during the current TTI
+    void served(int userId, int bits);
+
+    // Ends the current TTI. Grants that changed, new or revoked, are appended
+    // to out; renewals in place are not.
+    void runTti(BinAllocator& bins, std::vector<SchedulerGrant>& out);
+
+    // The user's current grant; count 0 if it has none
+    BinExtent grantOf(int userId) const;
+
+    uint64_t ttis() const { return tti; }
+    uint64_t servedBits() const { return totalBits; }
+    uint64_t grants() const { return grantCount; }
+    uint64_t preemptions() const { return preemptCount; }   // renewals refused for lack of bins
+    uint64_t idleRevocations() const { return idleCount; }  // leases unused for idleTtis
+    int waitingUsers() const { return (int)waiting.size(); }
+    // Jain's index of the bits served to each user that ever asked for bins:
+    // 1 when all got the same, 1/n when one got everything
+    double fairness() const;
+
+private:
+    struct UserState
+    {
+        bool seen;          // asked for bins at least once
+        bool backlogged;    // has demand
+        bool queued;        // in waiting
+        bool renewing;      // lease just expired; ext is the extent it held
+        int demand;
+        int bitsPerBin;
+        BinExtent ext;      // current grant, count 0 if none
+        uint64_t expires;
+        uint64_t lastActive;    // TTI the user last sent in, or was newly granted
+        double avgScaled;   // average bits per TTI divided by decay
+        uint64_t lastServed;
+        double key;
+        uint64_t order;
+        uint64_t bits;
+    };
+
+    // Waiting set entry: smaller key first, then first queued
+    struct WaitKey
+    {
+        double key;
+        uint64_t order;
+        int userId;
+        bool operator<(const WaitKey& o) const
+        {
+            if (key != o.key) return key < o.key;
+            return order < o.order;
+        }
+    };
+
+    typedef std::set<WaitKey, std::less<WaitKey>, PoolAllocator<WaitKey>> WaitSet;
+    typedef std::set<std::pair<uint64_t,int>, std::less<std::pair<uint64_t,int>>, PoolAllocator<std::pair<uint64_t,int>>> LeaseSet;
+
+    double metric(const UserState& u) const;
+    void enqueue(int userId);
+    void dequeue(int userId);
+    void grant(int userId, BinExtent ext);
+    void endLease(int userId, BinAllocator& bins);
+    void renormalize();
+
+    SchedulerPolicy policy;
+    int grantTtis;
+    int idleTtis;
+    std::vector<UserState> users;
+    std::shared_ptr<NodeArena> nodes;   // one node per user in each set
+    WaitSet waiting;
+    LeaseSet leases;                    // (expiry TTI, user)
+    std::vector<int> renewals;          // scratch for runTti
+    uint64_t tti;
+    uint64_t nextOrder;
+    double decay;                       // product of the per-TTI decay factors so far
+    uint64_t totalBits;
+    uint64_t grantCount;
+    uint64_t preemptCount;
+    uint64_t idleCount;
+};
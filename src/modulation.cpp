@@ -0,0 +1,167 @@
+#include "modulation.h"
+#include "batch_dsp.h"
+#include <cmath>
+#include <vector>
+
+static const char* const MODULATION_NAMES[MODULATION_COUNT] = { "qpsk", "16qam", "64qam", "256qam" };
+
+const char* modulationName(Modulation mod)
+{
+    return MODULATION_NAMES[mod];
+}
+
+bool parseModulation(const std::string& name, Modulation& mod)
+{
+    for (int i = 0; i < MODULATION_COUNT; i++)
+	{
+        if (name == MODULATION_NAMES[i])
+		{
+            mod = static_cast<Modulation>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Lookup tables for one modulation, built once
+struct QamTables
+{
+    int bits;                       // per symbol
+    int axisBits;
+    int levels;                     // per axis
+    double scale;                   // amplitude of the innermost level
+    double level[1 << (MODULATION_MAX_BITS / 2)];       // by position, most positive first
+    uint8_t label[1 << (MODULATION_MAX_BITS / 2)];      // Gray label of each position
+    double labelLevel[1 << (MODULATION_MAX_BITS / 2)];  // level of each label
+    std::complex<double> points[1 << MODULATION_MAX_BITS];
+
+    explicit QamTables(Modulation mod)
+    {
+        bits = modulationBits(mod);
+        axisBits = bits / 2;
+        levels = 1 << axisBits;
+        // Levels at +-1, +-3, ... have mean energy 2 * (M^2 - 1) / 3 per symbol
+        scale = 1.0 / sqrt(2.0 * (levels * levels - 1) / 3.0);
+        for (int p = 0; p < levels; p++)
+		{
+            level[p] = (levels - 1 - 2 * p) * scale;
+            label[p] = static_cast<uint8_t>(p ^ (p >> 1));
+            labelLevel[label[p]] = level[p];
+        }
+        for (int b = 0; b < (1 << bits); b++)
+            points[b] = std::complex<double>(labelLevel[b >> axisBits], labelLevel[b & (levels - 1)]);
+    }
+
+    // Gray label of the level nearest to y
+    int slice(double y) const
+    {
+        int p = static_cast<int>(floor(((levels - 1) - y / scale) * 0.5 + 0.5));
+        if (p < 0) p = 0;
+        if (p > levels - 1) p = levels - 1;
+        return label[p];
+    }
+};
+
+static const QamTables& qamTables(Modulation mod)
+{
+    static const QamTables tables[MODULATION_COUNT] = {
+        QamTables(MOD_QPSK), QamTables(MOD_16QAM), QamTables(MOD_64QAM), QamTables(MOD_256QAM)
+    };
+    return tables[mod];
+}
+
+const std::complex<double>* constellation(Modulation mod)
+{
+    return qamTables(mod).points;
+}
+
+int demapSymbol(Modulation mod, const std::complex<double>& sym)
+{
+    const QamTables& t = qamTables(mod);
+    return (t.slice(sym.real()) << t.axisBits) | t.slice(sym.imag());
+}
+
+size_t mapBytes(Modulation mod, const uint8_t* bytes, size_t count, std::complex<double>* out)
+{
+    const QamTables& t = qamTables(mod);
+    const unsigned mask = (1u << t.bits) - 1;
+    size_t n = 0;
+
+    // 256-QAM is one symbol per byte
+    if (t.bits == 8)
+	{
+        for (size_t i = 0; i < count; i++)
+            out[n++] = t.points[bytes[i]];
+        return n;
+    }
+
+    unsigned acc = 0;
+    int have = 0;
+    for (size_t i = 0; i < count; i++)
+	{
+        acc = (acc << 8) | bytes[i];
+        have += 8;
+        while (have >= t.bits)
+		{
+            have -= t.bits;
+            out[n++] = t.points[(acc >> have) & mask];
+        }
+    }
+    if (have > 0)
+        out[n++] = t.points[(acc << (t.bits - have)) & mask];
+    return n;
+}
+
+void demapBytes(Modulation mod, const std::complex<double>* in, size_t count, uint8_t* bytes)
+{
+    const int bits = modulationBits(mod);
+    unsigned acc = 0;
+    int have = 0;
+    size_t n = 0;
+    for (size_t i = 0; n < count; i++)
+	{
+        acc = (acc << bits) | demapSymbol(mod, in[i]);
+        have += bits;
+        while (have >= 8 && n < count)
+		{
+            have -= 8;
+            bytes[n++] = static_cast<uint8_t>(acc >> have);
+        }
+    }
+}
+
+void demapLLR(Modulation mod, const std::complex<double>* in, size_t count, double noiseVar, double* llr)
+{
+    const QamTables& t = qamTables(mod);
+    const int padded = static_cast<int>((count + BATCH_LANES - 1) / BATCH_LANES * BATCH_LANES);
+
+    // Split I and Q, run the per-axis kernel, then interleave I bits before Q bits
+    static thread_local std::vector<double> axis, axisLlr;
+    axis.resize(2 * static_cast<size_t>(padded));
+    axisLlr.resize(2 * static_cast<size_t>(padded) * t.axisBits);
+    double* re = axis.data();
+    double* im = re + padded;
+    for (size_t i = 0; i < count; i++)
+	{
+        re[i] = in[i].real();
+        im[i] = in[i].imag();
+    }
+    for (int i = static_cast<int>(count); i < padded; i++)
+        re[i] = im[i] = 0;
+
+    double* llrRe = axisLlr.data();
+    double* llrIm = llrRe + static_cast<size_t>(padded) * t.axisBits;
+    const double scale = 1.0 / (2.0 * noiseVar);
+    batchPamLLR(re, padded, t.level, t.label, t.levels, t.axisBits, scale, llrRe);
+    batchPamLLR(im, padded, t.level, t.label, t.levels, t.axisBits, scale, llrIm);
+
+    for (size_t i = 0; i < count; i++)
+	{
+        double* out = llr + i * t.bits;
+        for (int j = 0; j < t.axisBits; j++)
+		{
+            out[j] = llrRe[static_cast<size_t>(j) * padded + i];
+            out[t.axisBits + j] = llrIm[static_cast<size_t>(j) * padded + i];
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Square Gray-coded QAM. The value is the 2-bit code carried in a CTRL_RESPONSE
+// grant; a symbol carries 2 * (code + 1) bits.
+enum Modulation
+{
+    MOD_QPSK   = 0,
+    MOD_16QAM  = 1,
+    MOD_64QAM  = 2,
+    MOD_256QAM = 3
+};
+
+constexpr int MODULATION_COUNT = 4;
+constexpr int MODULATION_MAX_BITS = 8;
+
+inline int modulationBits(Modulation mod) { return 2 * (mod + 1); }
+
+const char* modulationName(Modulation mod);
+// Accepts qpsk, 16qam, 64qam, 256qam
+bool parseModulation(const std::string& name, Modulation& mod);
+
+// Symbols needed for `bits` bits
+inline size_t modulationSymbols(Modulation mod, size_t bits)
+{
+    return (bits + modulationBits(mod) - 1) / modulationBits(mod);
+}
+
+// Unit average energy constellation indexed by the symbol's bits. The upper half
+// of the bits picks the in-phase level and the lower half the quadrature level,
+// each Gray coded with a leading 0 on the positive side, so MOD_QPSK is exactly
+// qpskModulate.
+const std::complex<double>* constellation(Modulation mod);
+
+inline std::complex<double> mapSymbol(Modulation mod, int bits) { return constellation(mod)[bits]; }
+
+// Hard decision: nearest constellation point's bits
+int demapSymbol(Modulation mod, const std::complex<double>& sym);
+
+// Maps bytes most significant bit first, zero-padding the last symbol. Returns
+// modulationSymbols(mod, 8 * count), the number of symbols written.
+size_t mapBytes(Modulation mod, const uint8_t* bytes, size_t count, std::complex<double>* out);
+
+// Hard-decision inverse of mapBytes for `count` bytes
+void demapBytes(Modulation mod, const std::complex<double>* in, size_t count, uint8_t* bytes);
+
+// Max-log LLRs, modulationBits(mod) per symbol in mapping order:
+// llr[i * bits + j] = (d1^2 - d0^2) / (2 * noiseVar), where dX is the distance to
+// the nearest point whose bit j is X, so positive values favour 0. noiseVar is
+// the noise variance per real dimension.
+void demapLLR(Modulation mod, const std::complex<double>* in, size_t count, double noiseVar, double* llr);
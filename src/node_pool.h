@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+
+// Fixed-size blocks carved from one slab and recycled through a free list, so a
+// node-based container (std::map, std::set) stops calling the heap once the
+// slab is sized for its largest population. Not thread-safe: the containers
+// sharing an arena must be used from one thread at a time.
+class NodeArena
+{
+public:
+    NodeArena(size_t blockSize, size_t blocks)
+        : blockSize(roundBlock(blockSize)), blocks(blocks), slab(new char[this->blockSize * blocks]), freeList(nullptr)
+    {
+        for (size_t i = blocks; i-- > 0; )
+            give(slab.get() + i * this->blockSize);
+    }
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    // nullptr if the arena is exhausted or bytes does not fit a block
+    void* take(size_t bytes)
+    {
+        if (bytes > blockSize || !freeList) return nullptr;
+        FreeBlock* b = freeList;
+        freeList = b->next;
+        return b;
+    }
+
+    // False if p did not come from this arena
+    bool give(void* p)
+    {
+        char* c = static_cast<char*>(p);
+        if (c < slab.get() || c >= slab.get() + blockSize * blocks) return false;
+        FreeBlock* b = reinterpret_cast<FreeBlock*>(c);
+        b->next = freeList;
+        freeList = b;
+        return true;
+    }
+
+private:
+    struct FreeBlock { FreeBlock* next; };
+
+    static size_t roundBlock(size_t n)
+    {
+        const size_t align = alignof(std::max_align_t);
+        if (n < sizeof(FreeBlock)) n = sizeof(FreeBlock);
+        return (n + align - 1) / align * align;
+    }
+
+    const size_t blockSize;
+    const size_t blocks;
+    std::unique_ptr<char[]> slab;
+    FreeBlock* freeList;
+};
+
+// Allocator drawing single nodes from a NodeArena; anything else, or anything
+// past the arena's capacity, falls back to the heap
+template <typename T>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+
+    explicit PoolAllocator(NodeArena* arena) : arena(arena) {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n)
+    {
+        void* p = n == 1 && arena ? arena->take(sizeof(T)) : nullptr;
+        return static_cast<T*>(p ? p : ::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t)
+    {
+        if (!arena || !arena->give(p)) ::operator delete(p);
+    }
+
+    template <typename U> bool operator==(const PoolAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U> bool operator!=(const PoolAllocator<U>& other) const { return arena != other.arena; }
+
+private:
+    template <typename U> friend class PoolAllocator;
+    NodeArena* arena;
+};
+
+// Blocks big enough for the nodes of a std::map or std::set of small values
+constexpr size_t NODE_ARENA_BLOCK = 64;
@@ -0,0 +1,177 @@
+#include "noise.h"
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+
+static std::atomic<uint64_t> runSeed(0);
+static std::atomic<bool> runSeedSet(false);
+
+uint64_t noiseSeed()
+{
+    if (!runSeedSet.load(std::memory_order_acquire))
+	{
+        const char* env = getenv("OFDMA_NOISE_SEED");
+        setNoiseSeed(env ? strtoull(env, nullptr, 10) : 1);
+    }
+    return runSeed.load(std::memory_order_relaxed);
+}
+
+void setNoiseSeed(uint64_t seed)
+{
+    runSeed.store(seed, std::memory_order_relaxed);
+    runSeedSet.store(true, std::memory_order_release);
+}
+
+static const uint32_t PHILOX_M0 = 0xD2511F53;
+static const uint32_t PHILOX_M1 = 0xCD9E8D57;
+static const uint32_t PHILOX_W0 = 0x9E3779B9;
+static const uint32_t PHILOX_W1 = 0xBB67AE85;
+static const int PHILOX_ROUNDS = 10;
+
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4])
+{
+    uint32_t x0 = counter[0], x1 = counter[1], x2 = counter[2], x3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int r = 0; r < PHILOX_ROUNDS; r++)
+	{
+        uint64_t p0 = (uint64_t)PHILOX_M0 * x0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * x2;
+        x0 = (uint32_t)(p1 >> 32) ^ x1 ^ k0;
+        x1 = (uint32_t)p1;
+        x2 = (uint32_t)(p0 >> 32) ^ x3 ^ k1;
+        x3 = (uint32_t)p0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    out[0] = x0; out[1] = x1; out[2] = x2; out[3] = x3;
+}
+
+NoiseStream::NoiseStream(const NoiseKey& k)
+    : pos(NOISE_STREAM_WORDS)
+{
+    key[0] = (uint32_t)k.seed;
+    key[1] = (uint32_t)(k.seed >> 32);
+    counter[0] = 0;                         // block within the symbol
+    counter[1] = (uint32_t)k.symbol;
+    counter[2] = (uint32_t)(k.symbol >> 32);
+    counter[3] = k.link;
+}
+
+// The blocks are independent, so the rounds run lane-parallel across them
+void NoiseStream::refill()
+{
+    uint32_t x0[NOISE_STREAM_BLOCKS], x1[NOISE_STREAM_BLOCKS], x2[NOISE_STREAM_BLOCKS], x3[NOISE_STREAM_BLOCKS];
+    for (int b = 0; b < NOISE_STREAM_BLOCKS; b++)
+	{
+        x0[b] = counter[0] + b;
+        x1[b] = counter[1];
+        x2[b] = counter[2];
+        x3[b] = counter[3];
+    }
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int r = 0; r < PHILOX_ROUNDS; r++)
+	{
+        for (int b = 0; b < NOISE_STREAM_BLOCKS; b++)
+		{
+            uint64_t p0 = (uint64_t)PHILOX_M0 * x0[b];
+            uint64_t p1 = (uint64_t)PHILOX_M1 * x2[b];
+            x0[b] = (uint32_t)(p1 >> 32) ^ x1[b] ^ k0;
+            x1[b] = (uint32_t)p1;
+            x2[b] = (uint32_t)(p0 >> 32) ^ x3[b] ^ k1;
+            x3[b] = (uint32_t)p0;
+        }
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    for (int b = 0; b < NOISE_STREAM_BLOCKS; b++)
+	{
+        buffer[2*b]     = x0[b] | (uint64_t)x1[b] << 32;
+        buffer[2*b + 1] = x2[b] | (uint64_t)x3[b] << 32;
+    }
+    counter[0] += NOISE_STREAM_BLOCKS;
+    pos = 0;
+}
+
+// Ziggurat tables after Marsaglia & Tsang, with Doornik's layer layout
+static const int ZIG_LAYERS = 128;
+static const double ZIG_R = 3.442619855899;
+static const double ZIG_V = 9.91256303526217e-3;
+
+struct ZigguratTables
+{
+    double x[ZIG_LAYERS + 1];
+    double ratio[ZIG_LAYERS];   // x[i+1] / x[i]: |u| below this is inside layer i's core
+
+    ZigguratTables()
+    {
+        double f = exp(-0.5 * ZIG_R * ZIG_R);
+        x[0] = ZIG_V / f;
+        x[1] = ZIG_R;
+        x[ZIG_LAYERS] = 0;
+        for (int i = 2; i < ZIG_LAYERS; i++)
+		{
+            x[i] = sqrt(-2 * log(ZIG_V / x[i - 1] + f));
+            f = exp(-0.5 * x[i] * x[i]);
+        }
+        for (int i = 0; i < ZIG_LAYERS; i++)
+            ratio[i] = x[i + 1] / x[i];
+    }
+};
+
+static const ZigguratTables& zigguratTables()
+{
+    static const ZigguratTables tables;
+    return tables;
+}
+
+double NoiseStream::normalTail(bool negative)
+{
+    double x, y;
+    do
+	{
+        x = log(uniform()) / ZIG_R;
+        y = log(uniform());
+    } while (-2 * y < x * x);
+    return negative ? x - ZIG_R : ZIG_R - x;
+}
+
+double NoiseStream::normal()
+{
+    const ZigguratTables& zig = zigguratTables();
+    for (;;)
+	{
+        // Low 7 bits pick the layer, the top 53 the signed position in it
+        uint64_t w = next64();
+        int i = (int)(w & (ZIG_LAYERS - 1));
+        double u = 2.0 * ((w >> 11) * (1.0 / 9007199254740992.0)) - 1.0;
+
+        if (fabs(u) < zig.ratio[i])
+            return u * zig.x[i];
+        if (i == 0)
+            return normalTail(u < 0);
+
+        double x = u * zig.x[i];
+        double f0 = exp(-0.5 * (zig.x[i] * zig.x[i] - x * x));
+        double f1 = exp(-0.5 * (zig.x[i + 1] * zig.x[i + 1] - x * x));
+        if (f1 + uniform() * (f0 - f1) < 1.0)
+            return x;
+    }
+}
+
+void NoiseStream::fillNormal(double* out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = normal();
+}
+
+void addAWGN(std::complex<double>* sig, size_t count, double var, const NoiseKey& key)
+{
+    NoiseStream stream(key);
+    const double sigma = sqrt(var);
+    for (size_t i = 0; i < count; i++)
+	{
+        double re = stream.normal();
+        double im = stream.normal();
+        sig[i] += std::complex<double>(sigma * re, sigma * im);
+    }
+}
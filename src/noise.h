@@ -0,0 +1,71 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+
+// Counter-based Gaussian noise. Philox4x32-10 is keyed by the run seed and its
+// counter holds (block, symbol, link), so the noise of any symbol on any link is
+// a pure function of those three values: threads need no shared generator state
+// and a run is bit-reproducible for its seed however the work is split.
+
+struct NoiseKey
+{
+    uint64_t seed;
+    uint32_t link;      // see uplinkNoise / downlinkNoise
+    uint64_t symbol;    // per-link symbol index
+};
+
+// Stream ids for the two directions of each user's link
+inline uint32_t uplinkNoise(int user) { return 2u * user; }
+inline uint32_t downlinkNoise(int user) { return 2u * user + 1; }
+
+// Run seed: OFDMA_NOISE_SEED if set, otherwise 1, unless setNoiseSeed was called
+uint64_t noiseSeed();
+void setNoiseSeed(uint64_t seed);
+
+// Key for symbol `symbol` of `link` under the run seed
+inline NoiseKey noiseKey(uint32_t link, uint64_t symbol)
+{
+    NoiseKey key = { noiseSeed(), link, symbol };
+    return key;
+}
+
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]);
+
+// Random words and standard normals for one key, generated a batch of Philox
+// blocks at a time
+class NoiseStream
+{
+public:
+    explicit NoiseStream(const NoiseKey& key);
+
+    uint64_t next64()
+    {
+        if (pos == NOISE_STREAM_WORDS) refill();
+        return buffer[pos++];
+    }
+
+    // Uniform in (0, 1)
+    double uniform() { return ((next64() >> 11) + 0.5) * (1.0 / 9007199254740992.0); }
+
+    // Standard normal (Ziggurat, 128 layers)
+    double normal();
+
+    void fillNormal(double* out, size_t count);
+
+private:
+    static constexpr int NOISE_STREAM_BLOCKS = 16;
+    static constexpr int NOISE_STREAM_WORDS = 2 * NOISE_STREAM_BLOCKS;
+
+    void refill();
+    double normalTail(bool negative);
+
+    uint32_t key[2];
+    uint32_t counter[4];
+    uint64_t buffer[NOISE_STREAM_WORDS];
+    int pos;
+};
+
+// Adds complex Gaussian noise with variance var per real dimension
+void addAWGN(std::complex<double>* sig, size_t count, double var, const NoiseKey& key);
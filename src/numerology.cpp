@@ -0,0 +1,203 @@
+#define _USE_MATH_DEFINES
+#include "signal_processing.h"
+#include "numerology.h"
+#include "fixed_fft.h"
+#include <cstdlib>
+
+template<int FFT, int BINS>
+static NumerologyOps numerologyOps(const char* name)
+{
+    NumerologyOps ops;
+    ops.name = name;
+    ops.fftSize = FFT;
+    ops.bins = BINS;
+    ops.strided = Numerology<FFT, BINS>::strided;
+    ops.demux = &Numerology<FFT, BINS>::demux;
+    ops.mux = &Numerology<FFT, BINS>::mux;
+    ops.demuxF32 = &Numerology<FFT, BINS, float>::demux;
+    ops.muxF32 = &Numerology<FFT, BINS, float>::mux;
+    ops.demuxQ15 = &FixedNumerology<FFT, BINS>::demux;
+    ops.muxQ15 = &FixedNumerology<FFT, BINS>::mux;
+    return ops;
+}
+
+static const NumerologyOps NUMEROLOGIES[] =
+{
+    numerologyOps<64, 8>("64/8"),
+    numerologyOps<256, 32>("256/32"),
+    numerologyOps<1024, 128>("1024/128"),
+    numerologyOps<2048, 1200>("2048/1200"),
+};
+
+int numerologyCount()
+{
+    return sizeof(NUMEROLOGIES) / sizeof(NUMEROLOGIES[0]);
+}
+
+const NumerologyOps& numerologyAt(int index)
+{
+    return NUMEROLOGIES[index];
+}
+
+const NumerologyOps* findNumerology(const std::string& name)
+{
+    for (int i = 0; i < numerologyCount(); i++)
+        if (name == NUMEROLOGIES[i].name) return &NUMEROLOGIES[i];
+    return nullptr;
+}
+
+std::string numerologyNames()
+{
+    std::string names;
+    for (int i = 0; i < numerologyCount(); i++)
+	{
+        if (i) names += ", ";
+        names += NUMEROLOGIES[i].name;
+    }
+    return names;
+}
+
+SampleChain::SampleChain(const NumerologyOps& num, SampleFormat format)
+    : num(num), fmt(format), scratch64(num.fftSize), timeExp(0)
+{
+    if (fmt == FORMAT_CF32)
+	{
+        activeF32.resize(num.bins);
+        timeF32.resize(num.fftSize);
+        scratchF32.resize(num.fftSize);
+    }
+    else if (fmt == FORMAT_CQ15)
+	{
+        activeQ15.resize(num.bins);
+        timeQ15.resize(num.fftSize);
+        scratchQ15.resize(num.fftSize);
+        wide.resize(2 * num.fftSize);
+    }
+	else
+	{
+        time64.resize(num.fftSize);
+    }
+}
+
+void SampleChain::mux(const std::complex<double>* active)
+{
+    if (fmt == FORMAT_CF32)
+	{
+        toCF32(active, num.bins, activeF32.data());
+        num.muxF32(activeF32.data(), timeF32.data());
+    }
+    else if (fmt == FORMAT_CQ15)
+	{
+        int exp = blockExponent(active, num.bins);
+        toQ15(active, num.bins, exp, activeQ15.data());
+        timeExp = num.muxQ15(activeQ15.data(), exp, timeQ15.data());
+    }
+	else
+	{
+        num.mux(active, time64.data());
+    }
+}
+
+void SampleChain::muxAdd(const std::complex<double>* active)
+{
+    if (fmt == FORMAT_CF32)
+	{
+        toCF32(active, num.bins, activeF32.data());
+        num.muxF32(activeF32.data(), scratchF32.data());
+        for (int n = 0; n < num.fftSize; n++)
+            timeF32[n] += scratchF32[n];
+    }
+    else if (fmt == FORMAT_CQ15)
+	{
+        int exp = blockExponent(active, num.bins);
+        toQ15(active, num.bins, exp, activeQ15.data());
+        exp = num.muxQ15(activeQ15.data(), exp, scratchQ15.data());
+        addTime(scratchQ15.data(), exp);
+    }
+	else
+	{
+        num.mux(active, scratch64.data());
+        for (int n = 0; n < num.fftSize; n++)
+            time64[n] += scratch64[n];
+    }
+}
+
+void SampleChain::addNoise(double var, const NoiseKey& key)
+{
+    if (fmt == FORMAT_CF64)
+	{
+        addAWGN(time64.data(), time64.size(), var, key);
+        return;
+    }
+    std::fill(scratch64.begin(), scratch64.end(), std::complex<double>(0, 0));
+    addAWGN(scratch64.data(), scratch64.size(), var, key);
+    if (fmt == FORMAT_CF32)
+	{
+        for (int n = 0; n < num.fftSize; n++)
+            timeF32[n] += std::complex<float>(scratch64[n]);
+    }
+	else
+	{
+        // The noise is quantized at its own block exponent, as a second
+        // converter would, then summed like any other Q15 block
+        int exp = blockExponent(scratch64.data(), scratch64.size());
+        toQ15(scratch64.data(), scratch64.size(), exp, scratchQ15.data());
+        addTime(scratchQ15.data(), exp);
+    }
+}
+
+void SampleChain::demux(std::complex<double>* active)
+{
+    if (fmt == FORMAT_CF32)
+	{
+        num.demuxF32(timeF32.data(), activeF32.data());
+        fromCF32(activeF32.data(), num.bins, active);
+    }
+    else if (fmt == FORMAT_CQ15)
+	{
+        int exp = num.demuxQ15(timeQ15.data(), timeExp, activeQ15.data());
+        fromQ15(activeQ15.data(), num.bins, exp, active);
+    }
+	else
+	{
+        num.demux(time64.data(), active);
+    }
+}
+
+void SampleChain::timeSamples(std::complex<double>* time) const
+{
+    if (fmt == FORMAT_CF32)
+        fromCF32(timeF32.data(), num.fftSize, time);
+    else if (fmt == FORMAT_CQ15)
+        fromQ15(timeQ15.data(), num.fftSize, timeExp, time);
+    else
+        std::copy(time64.begin(), time64.end(), time);
+}
+
+// Q15 addition: both blocks are rounded to the larger exponent, summed in 32
+// bits, and the sum shifted down (raising the exponent) until its peak fits
+void SampleChain::addTime(const cq15* q, int exp)
+{
+    const int e = std::max(timeExp, exp);
+    const int sa = e - timeExp, sb = e - exp;
+    auto align = [](int32_t v, int s) { return s == 0 ? v : (s > 16 ? 0 : roundShift(v, s)); };
+    int32_t peak = 0;
+    for (int n = 0; n < num.fftSize; n++)
+	{
+        int32_t re = align(timeQ15[n].re, sa) + align(q[n].re, sb);
+        int32_t im = align(timeQ15[n].im, sa) + align(q[n].im, sb);
+        wide[2*n] = re;
+        wide[2*n + 1] = im;
+        peak = std::max(peak, std::max(std::abs(re), std::abs(im)));
+    }
+    int shift = 0;
+    while ((peak >> shift) > 32767)
+        shift++;
+    for (int n = 0; n < num.fftSize; n++)
+	{
+        int32_t re = wide[2*n], im = wide[2*n + 1];
+        timeQ15[n].re = saturateQ15(shift ? roundShift(re, shift) : re);
+        timeQ15[n].im = saturateQ15(shift ? roundShift(im, shift) : im);
+    }
+    timeExp = e + shift;
+}
@@ -0,0 +1,347 @@
+#pragma once
+
+#include "noise.h"
+#include "sample_format.h"
+#include <algorithm>
+#include <array>
+#include <complex>
+#include <cmath>
+#include <string>
+#include <vector>
+
+// Compile-time FFT sizes. Each StaticFft<N> has its own bit-reversal and
+// twiddle tables and a pass sequence unrolled by template recursion, so every
+// loop bound is a constant. The tables are filled on first use (std::polar is
+// not constexpr in C++11) and shared afterwards. R is the real type of the
+// samples: double for the reference path, float for the single-precision one.
+template<int N, typename R = double>
+struct StaticFft
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "StaticFft size must be a power of two");
+
+    typedef std::complex<R> Complex;
+
+    static constexpr int log2n() { return log2Of(N); }
+
+    static const std::array<int, N>& bitrev()
+    {
+        static const std::array<int, N> table = makeBitrev();
+        return table;
+    }
+
+    // Twiddles laid out pass by pass: for each radix-4 pass over sub-transforms
+    // of size q, the pairs (W_4q^j, W_2q^j) for j < q, so every pass reads its
+    // twiddles sequentially
+    static const std::array<Complex, N>& twiddle()
+    {
+        static const std::array<Complex, N> table = makeTwiddle();
+        return table;
+    }
+
+    static void fftInPlace(Complex* x)
+    {
+        bitReverse(x);
+        run<false>(x);
+    }
+
+    // Scaled by 1/N
+    static void ifftInPlace(Complex* x)
+    {
+        bitReverse(x);
+        run<true>(x);
+    }
+
+    // For callers that scatter their input straight to bitrev() positions,
+    // saving the separate permutation pass
+    static void fftBitReversed(Complex* x) { run<false>(x); }
+    static void ifftBitReversed(Complex* x) { run<true>(x); }
+
+private:
+    static constexpr int log2Of(int n) { return n <= 1 ? 0 : 1 + log2Of(n / 2); }
+
+    static std::array<int, N> makeBitrev()
+    {
+        std::array<int, N> table;
+        for (int i = 0; i < N; i++)
+		{
+            int r = 0;
+            for (int b = 0; b < log2n(); b++)
+                if (i & (1 << b)) r |= 1 << (log2n() - 1 - b);
+            table[i] = r;
+        }
+        return table;
+    }
+
+    static std::array<Complex, N> makeTwiddle()
+    {
+        std::array<Complex, N> table;
+        int k = 0;
+        for (int q = (log2n() & 1) ? 2 : 1; q < N; q *= 4)
+		{
+            for (int j = 0; j < q; j++)
+			{
+                table[k++] = Complex(std::polar(1.0, -2 * M_PI * j / (4*q)));
+                table[k++] = Complex(std::polar(1.0, -2 * M_PI * j / (2*q)));
+            }
+        }
+        for (; k < N; k++)
+            table[k] = 0;
+        return table;
+    }
+
+    static void bitReverse(Complex* x)
+    {
+        const std::array<int, N>& rev = bitrev();
+        for (int i = 0; i < N; i++)
+		{
+            int r = rev[i];
+            if (i < r) std::swap(x[i], x[r]);
+        }
+    }
+
+    static inline Complex cmul(const Complex& a, const Complex& b)
+    {
+        return { a.real()*b.real() - a.imag()*b.imag(), a.real()*b.imag() + a.imag()*b.real() };
+    }
+
+    // Radix-4 pass combining sub-transforms of size Q, then the next pass. The
+    // first pass of an even-log2 size has Q == 1 and needs no multiplies.
+    template<bool Inverse, int Q, bool Done = (Q >= N)>
+    struct Pass
+    {
+        static void run(Complex* x, const Complex* tw)
+        {
+            for (int base = 0; base < N; base += 4*Q)
+			{
+                for (int j = 0; j < Q; j++)
+				{
+                    Complex* p = x + base + j;
+                    Complex t1 = p[Q];
+                    Complex t3 = p[3*Q];
+                    Complex w1;
+                    if (Q > 1)
+					{
+                        w1 = tw[2*j];               // W_4Q^j
+                        Complex w2 = tw[2*j + 1];   // W_2Q^j
+                        if (Inverse)
+						{
+                            w1 = std::conj(w1);
+                            w2 = std::conj(w2);
+                        }
+                        t1 = cmul(w2, t1);
+                        t3 = cmul(w2, t3);
+                    }
+                    Complex b0 = p[0] + t1;
+                    Complex b1 = p[0] - t1;
+                    Complex b2 = p[2*Q] + t3;
+                    Complex b3 = p[2*Q] - t3;
+
+                    // W_4Q^(j+Q) = W_4Q^j * (-i), or * (+i) for the inverse
+                    Complex u2 = Q > 1 ? cmul(w1, b2) : b2;
+                    Complex v3 = Q > 1 ? cmul(w1, b3) : b3;
+                    Complex u3 = Inverse ? Complex(-v3.imag(), v3.real())
+                                         : Complex(v3.imag(), -v3.real());
+
+                    p[0]   = b0 + u2;
+                    p[2*Q] = b0 - u2;
+                    p[Q]   = b1 + u3;
+                    p[3*Q] = b1 - u3;
+                }
+            }
+            Pass<Inverse, Q*4>::run(x, tw + 2*Q);
+        }
+    };
+
+    template<bool Inverse, int Q>
+    struct Pass<Inverse, Q, true>
+    {
+        static void run(Complex*, const Complex*) {}
+    };
+
+    // Same pass order as the runtime engine: a radix-2 pass first when log2(N) is odd
+    template<bool Inverse>
+    static void run(Complex* x)
+    {
+        const Complex* tw = twiddle().data();
+        if (log2n() & 1)
+		{
+            for (int i = 0; i < N; i += 2)
+			{
+                Complex a = x[i];
+                Complex b = x[i + 1];
+                x[i] = a + b;
+                x[i + 1] = a - b;
+            }
+            Pass<Inverse, 2>::run(x, tw);
+        }
+		else
+		{
+            Pass<Inverse, 1>::run(x, tw);
+        }
+
+        if (Inverse)
+		{
+            const R scale = R(1) / N;
+            for (int i = 0; i < N; i++)
+                x[i] *= scale;
+        }
+    }
+};
+
+// One FFT size / active-bin count combination. When BINS is a power of two that
+// divides FFT the active bins sit on a stride of FFT/BINS and use the pruned
+// BINS-point transform. Otherwise (e.g. 2048/1200) they are a contiguous block
+// around DC, DC itself left empty, and go through the full FFT.
+template<int FFT, int BINS, typename R = double>
+struct Numerology
+{
+    static_assert(BINS >= 1 && BINS < FFT, "Numerology needs fewer active bins than FFT points");
+
+    static constexpr int fftSize = FFT;
+    static constexpr int bins = BINS;
+    static constexpr bool strided = FFT % BINS == 0 && (BINS & (BINS - 1)) == 0;
+    static constexpr int spacing = strided ? FFT / BINS : 1;
+
+    typedef std::complex<R> Complex;
+    typedef std::array<Complex, FFT> TimeSymbol;
+    typedef std::array<Complex, BINS> ActiveSymbol;
+
+    // FFT index carrying active bin i
+    static constexpr int subcarrier(int i)
+    {
+        return strided ? i * spacing : (i < BINS/2 ? FFT - BINS/2 + i : i - BINS/2 + 1);
+    }
+
+    // FFT time samples -> BINS active bins
+    static void demux(const Complex* time, Complex* active)
+    {
+        Transform<strided>::demux(time, active);
+    }
+
+    // BINS active bins -> FFT time samples
+    static void mux(const Complex* active, Complex* time)
+    {
+        Transform<strided>::mux(active, time);
+    }
+
+    static void demux(const TimeSymbol& time, ActiveSymbol& active) { demux(time.data(), active.data()); }
+    static void mux(const ActiveSymbol& active, TimeSymbol& time) { mux(active.data(), time.data()); }
+
+private:
+    template<bool Strided, int Dummy = 0>
+    struct Transform
+    {
+        // X[k*S] = sum_m (sum_p x[m + p*BINS]) * W_BINS^(m*k)
+        static void demux(const Complex* time, Complex* active)
+        {
+            const std::array<int, BINS>& rev = StaticFft<BINS, R>::bitrev();
+            for (int m = 0; m < BINS; m++)
+			{
+                Complex acc = time[m];
+                for (int i = m + BINS; i < FFT; i += BINS)
+                    acc += time[i];
+                active[rev[m]] = acc;
+            }
+            StaticFft<BINS, R>::fftBitReversed(active);
+        }
+
+        // x[n] = (BINS / FFT) * ifft_BINS(A)[n mod BINS]
+        static void mux(const Complex* active, Complex* time)
+        {
+            const std::array<int, BINS>& rev = StaticFft<BINS, R>::bitrev();
+            const R scale = static_cast<R>(BINS) / FFT;
+            for (int m = 0; m < BINS; m++)
+                time[rev[m]] = active[m] * scale;
+            StaticFft<BINS, R>::ifftBitReversed(time);
+            for (int i = BINS; i < FFT; i++)
+                time[i] = time[i - BINS];
+        }
+    };
+
+    template<int Dummy>
+    struct Transform<false, Dummy>
+    {
+        static void demux(const Complex* time, Complex* active)
+        {
+            const std::array<int, FFT>& rev = StaticFft<FFT, R>::bitrev();
+            TimeSymbol freq;
+            for (int i = 0; i < FFT; i++)
+                freq[rev[i]] = time[i];
+            StaticFft<FFT, R>::fftBitReversed(freq.data());
+            for (int i = 0; i < BINS; i++)
+                active[i] = freq[subcarrier(i)];
+        }
+
+        static void mux(const Complex* active, Complex* time)
+        {
+            const std::array<int, FFT>& rev = StaticFft<FFT, R>::bitrev();
+            for (int i = 0; i < FFT; i++)
+                time[i] = 0;
+            for (int i = 0; i < BINS; i++)
+                time[rev[subcarrier(i)]] = active[i];
+            StaticFft<FFT, R>::ifftBitReversed(time);
+        }
+    };
+};
+
+// The configurations compiled into this build, picked by name at startup
+struct NumerologyOps
+{
+    const char* name;       // "FFT/BINS"
+    int fftSize;
+    int bins;
+    bool strided;
+    void (*demux)(const std::complex<double>* time, std::complex<double>* active);
+    void (*mux)(const std::complex<double>* active, std::complex<double>* time);
+    void (*demuxF32)(const std::complex<float>* time, std::complex<float>* active);
+    void (*muxF32)(const std::complex<float>* active, std::complex<float>* time);
+    // Q15 blocks: each takes its input's exponent and returns its output's
+    int (*demuxQ15)(const cq15* time, int timeExp, cq15* active);
+    int (*muxQ15)(const cq15* active, int activeExp, cq15* time);
+};
+
+int numerologyCount();
+const NumerologyOps& numerologyAt(int index);
+
+// nullptr if name is not one of the compiled configurations
+const NumerologyOps* findNumerology(const std::string& name);
+
+// "64/8, 256/32, ..." for usage messages
+std::string numerologyNames();
+
+// One numerology's mux and demux carried out in a chosen sample format. Active
+// bins come in and go out as doubles, but the time-domain symbol between mux
+// and demux stays in the chain's format: superposed uplinks and channel noise
+// are added to it there, with Q15 sums rounded to a common block exponent and
+// rescaled when they outgrow it. Holds its own scratch, so calls do not
+// allocate; use one per thread.
+class SampleChain
+{
+public:
+    SampleChain(const NumerologyOps& num, SampleFormat format);
+
+    SampleFormat format() const { return fmt; }
+    const NumerologyOps& numerology() const { return num; }
+
+    // Replaces the held time symbol with the mux of active
+    void mux(const std::complex<double>* active);
+    // Adds the mux of active to the held time symbol
+    void muxAdd(const std::complex<double>* active);
+    // Adds AWGN of variance var per sample, drawn as addAWGN would draw it
+    void addNoise(double var, const NoiseKey& key);
+    void demux(std::complex<double>* active);
+
+    // The held time symbol as doubles, for inspection
+    void timeSamples(std::complex<double>* time) const;
+
+private:
+    void addTime(const cq15* q, int exp);
+
+    const NumerologyOps& num;
+    SampleFormat fmt;
+    std::vector<std::complex<double>> time64, scratch64;
+    std::vector<std::complex<float>> activeF32, timeF32, scratchF32;
+    std::vector<cq15> activeQ15, timeQ15, scratchQ15;
+    std::vector<int32_t> wide;
+    int timeExp;
+};
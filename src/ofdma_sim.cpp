@@ -0,0 +1,1279 @@
+#define _USE_MATH_DEFINES
+#include "signal_processing.h"
+#include "base_station_core.h"
+#include "user_core.h"
+#include "downlink_frame.h"
+#include "combined_uplink.h"
+#include "event_queue.h"
+#include "numerology.h"
+#include "event_log.h"
+#include "bounded_queue.h"
+#include <algorithm>
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <thread>
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#endif
+
+using namespace std;
+
+// Discrete-event simulation of one base station and many users in a single
+// process. Time is an integer number of microseconds; symbols travel through
+// the event queue instead of a transport. A user sends the segments of a
+// message one per TTI, at the TTI boundaries, as a scheduled user would.
+
+constexpr const char* SIM_NUMEROLOGY = "1024/128";
+constexpr int SIM_MAX_USERS = 4096;
+constexpr long long LINK_DELAY_US = 5;     // air + processing, each direction
+constexpr long long REPLY_TIMEOUT_US = 2000;
+// Largest combined-uplink contention backoff: 2^N TTIs
+constexpr int CONTENTION_MAX_BACKOFF = 10;
+// Multi-cell: a handover message's trip between two base stations. The cells
+// run in lockstep windows this long, so what one sends in a window reaches the
+// other in a later one.
+constexpr long long HANDOVER_DELAY_US = 1000;
+// A cell admits users handed over to it up to this many times its initial share
+constexpr int CELL_CAPACITY_FACTOR = 2;
+
+enum SimEventType { EV_USER_WAKE, EV_UPLINK, EV_DOWNLINK, EV_TTI, EV_HANDOVER, EV_HANDOVER_TIMEOUT, EV_CELL_MESSAGE };
+
+struct SimEvent
+{
+    int type;
+    int user;       // addressee (EV_USER_WAKE, EV_DOWNLINK, EV_HANDOVER) or sender (EV_UPLINK)
+    int symbol;     // SymbolPool slot carrying the active bins; EV_CELL_MESSAGE: inbox index
+    int timer;      // EV_USER_WAKE: stale unless it matches the user's timer; EV_HANDOVER: its stay;
+                    // EV_HANDOVER_TIMEOUT: the request it is for
+};
+
+enum UserState { USER_IDLE, USER_WAIT_GRANT, USER_ACTIVE, USER_RELEASING };
+
+struct SimUser
+{
+    UserState state;
+    int timer;
+    int burstLeft;
+    int dest;
+    bool resume;                    // message interrupted by a new or revoked grant
+    int retries;                    // headers in a row that went unanswered
+    std::vector<uint8_t> message;   // being sent, read in place by the terminal
+    bool leaving;                   // multi-cell: handover requested, not answered yet
+    int stay;                       // multi-cell: times the user joined this cell
+    int request;                    // multi-cell: handover requests made, so a stale timeout is ignored
+    long long arrives;              // multi-cell: when the source cell lets go of a user handed over here
+};
+
+// Multi-cell: the handover exchange between the source and target base stations
+enum HandoverType { HANDOVER_REQUEST, HANDOVER_ACCEPT, HANDOVER_REJECT };
+
+struct HandoverMessage
+{
+    long long time;     // of arrival
+    int type;           // HandoverType
+    int user;
+    int from;           // sending cell
+};
+
+static bool handoverOrder(const HandoverMessage& a, const HandoverMessage& b)
+{
+    if (a.time != b.time) return a.time < b.time;
+    if (a.from != b.from) return a.from < b.from;
+    return a.user < b.user;
+}
+
+// Lock-free queues between the cells, one inbox per cell. Cells post to any
+// inbox while they run; each collects its own between windows, taking what
+// arrives up to the end of the next window, in an order that does not depend
+// on thread timing. A user has at most one message in flight, so an inbox as
+// big as the population never fills.
+class CellMesh
+{
+public:
+    CellMesh(int cells, int users) : early(cells)
+    {
+        for (int c = 0; c < cells; c++)
+            inbox.push_back(std::unique_ptr<BoundedQueue<HandoverMessage>>(new BoundedQueue<HandoverMessage>(users)));
+    }
+
+    int cells() const { return (int)inbox.size(); }
+    bool post(int cell, const HandoverMessage& msg) { return inbox[cell]->tryPush(msg); }
+
+    void collect(int cell, long long until, std::vector<HandoverMessage>& out)
+    {
+        std::vector<HandoverMessage>& held = early[cell];
+        HandoverMessage msg;
+        while (inbox[cell]->tryPop(msg))
+            held.push_back(msg);
+        out.clear();
+        for (size_t i = 0; i < held.size(); )
+		{
+            if (held[i].time <= until)
+			{
+                out.push_back(held[i]);
+                held[i] = held.back();
+                held.pop_back();
+            }
+			else
+			{
+                i++;
+            }
+        }
+        std::sort(out.begin(), out.end(), handoverOrder);
+    }
+
+private:
+    std::vector<std::unique_ptr<BoundedQueue<HandoverMessage>>> inbox;
+    std::vector<std::vector<HandoverMessage>> early;    // per cell: popped before their window, owner only
+};
+
+// Active-bin symbols in flight, recycled through a free list
+class SymbolPool
+{
+public:
+    explicit SymbolPool(int bins) : bins(bins) {}
+
+    int acquire()
+    {
+        if (freeList.empty())
+		{
+            data.resize(data.size() + bins);
+            released.push_back(false);
+            return (int)(data.size() / bins) - 1;
+        }
+        int slot = freeList.back();
+        freeList.pop_back();
+        released[slot] = false;
+        return slot;
+    }
+    void release(int slot)
+    {
+        // A slot on the free list twice would be handed to two symbols at once
+        assert(slot >= 0 && slot < (int)released.size() && !released[slot] && "SymbolPool slot released twice");
+        released[slot] = true;
+        freeList.push_back(slot);
+    }
+    std::complex<double>* at(int slot) { return &data[(size_t)slot * bins]; }
+
+private:
+    int bins;
+    std::vector<std::complex<double>> data;
+    std::vector<int> freeList;
+    std::vector<bool> released;     // per slot: on the free list
+};
+
+struct SimStats
+{
+    long long events;
+    long long requests;
+    long long grants;
+    long long blocked;
+    long long dataSent;             // messages
+    long long dataDelivered;
+    long long segmentsSent;
+    long long segmentsDelivered;
+    long long deallocs;
+    long long timeouts;
+    long long misaddressed;
+    long long revoked;              // grants taken back while the user was active
+    long long resent;               // messages restarted after a grant changed
+    long long downlinkMessages;
+    long long downlinkSymbols;      // one transform each
+    long long uplinkTransmissions;
+    long long uplinkSymbols;        // the base station transformed
+    long long handoversIn;
+    long long handoversOut;
+    long long handoversRejected;    // of this cell's requests
+    long long handoversLost;        // requests or answers the target's inbox had no room for
+    long long strandedDownlinks;    // reached a user that had left the cell
+};
+
+class Simulator
+{
+public:
+    Simulator(const NumerologyOps& numerology, SampleFormat format, const FrameLayout& layout, int users,
+              unsigned long long seed, bool phy, double binNoise, int messageBytes, long long ttiUs)
+        : chain(numerology, format), layout(layout), bs(layout), pool(layout.bins), rng(seed), phy(phy),
+          seed(seed), binNoise(binNoise), messageBytes(messageBytes), linkSymbols(2 * users, 0),
+          noiseScale(users, 1.0), userBits(users, 0), ttiUs(ttiUs), ticking(false),
+          frames(layout), multiplexed(false), combined(false), fec(FEC_NONE), nextTti(0), combinedNoise(0),
+          uplinkSlot(users, -1), binScale(layout.bins),
+          mesh(nullptr), cell(0), dwellUs(0), capacity(users)
+    {
+        stats = SimStats();
+        bs.setMaxMessage(messageBytes);
+        for (int u = 0; u < users; u++)
+		{
+            terminals.push_back(UserTerminal(layout, u));
+            terminals.back().setReceiveCapacity(messageBytes);
+            SimUser su = SimUser();
+            su.state = USER_IDLE;
+            simUsers.push_back(su);
+            wake(u, expDelay(idleMeanUs));
+        }
+    }
+
+    void setLog(std::ostream* log) { bs.setLog(log); }
+    // Open the log with simClock() so that records carry the simulated time of their event
+    void setEventLog(EventLog* events) { bs.setEventLog(events); }
+    const long long* simClock() const { return &now; }
+    void setAllocPolicy(AllocPolicy policy) { bs.setAllocPolicy(policy); }
+    void setModulation(Modulation mod) { bs.setModulation(mod); }
+
+    // Scheduled grants, with the scheduler run every TTI
+    void setScheduler(SchedulerPolicy policy, int grantTtis)
+    {
+        bs.setScheduler(policy, grantTtis);
+        if (policy != SCHED_NONE) startTtis();
+    }
+
+    // Downlinks wait for the end of the TTI and go out as multiplexed frames
+    void setDownlinkMux()
+    {
+        multiplexed = true;
+        for (size_t u = 0; u < terminals.size(); u++)
+            terminals[u].setDownlinkMux(true);
+        startTtis();
+    }
+
+    // Uplinks wait for the end of the TTI and reach the base station as one
+    // combined symbol (see combined_uplink.h)
+    void setUplinkCombine()
+    {
+        combined = true;
+        bs.setUplinkCombine(true);
+        for (size_t u = 0; u < terminals.size(); u++)
+            terminals[u].setUplinkCombine(true);
+        startTtis();
+    }
+
+    // Convolutional coding of every message payload, up and down
+    void setFec(FecRate rate)
+    {
+        fec = rate;
+        bs.setFec(rate);
+        for (size_t u = 0; u < terminals.size(); u++)
+            terminals[u].setFec(rate);
+    }
+
+    // Makes this one cell of a mesh: the users with id % cells == cell start
+    // here, each stays for an exponential time of mean dwellUs and then asks a
+    // neighbouring cell to take it over. Ids are global, so a user keeps its id
+    // in every cell.
+    void joinMesh(CellMesh* mesh, int cell, long long dwellUs)
+    {
+        this->mesh = mesh;
+        this->cell = cell;
+        this->dwellUs = dwellUs;
+        int users = (int)terminals.size();
+        capacity = CELL_CAPACITY_FACTOR * ((users + mesh->cells() - 1) / mesh->cells());
+        memberIndex.assign(users, -1);
+        for (int u = 0; u < users; u++)
+		{
+            if (u % mesh->cells() == cell)
+			{
+                addMember(u);
+                scheduleDwell(u, expDelay(dwellUs));
+            }
+			else
+			{
+                ++simUsers[u].timer;    // not here: its first wake is stale
+            }
+        }
+    }
+
+    // Handover messages that arrive by the end of the next window
+    void deliver(const std::vector<HandoverMessage>& msgs)
+    {
+        inbox = msgs;
+        for (size_t i = 0; i < inbox.size(); i++)
+		{
+            SimEvent ev = { EV_CELL_MESSAGE, inbox[i].user, (int)i, 0 };
+            queue.schedule(inbox[i].time, ev);
+        }
+    }
+
+    // Spreads the users over the modulations as if they were at different
+    // distances: each step up gets a quarter of the noise, about the 6 dB the
+    // extra two bits need, and the base station grants it that modulation
+    void adaptLinks()
+    {
+        std::uniform_int_distribution<int> level(0, MODULATION_COUNT - 1);
+        for (size_t u = 0; u < terminals.size(); u++)
+		{
+            int k = level(rng);
+            noiseScale[u] = std::ldexp(1.0, -2 * k);
+            bs.setLinkModulation((int)u, (Modulation)k);
+        }
+    }
+
+    // Runs until simulated time reaches endUs
+    void run(long long endUs)
+    {
+        SimEvent ev;
+        while (!queue.empty() && queue.nextTime() <= endUs)
+		{
+            now = queue.pop(ev);
+            stats.events++;
+            if (ev.type == EV_USER_WAKE)
+                userWake(ev.user, ev.timer);
+            else if (ev.type == EV_UPLINK)
+                uplink(ev.symbol);
+            else if (ev.type == EV_TTI)
+                tti();
+            else if (ev.type == EV_HANDOVER)
+                handoverDue(ev.user, ev.timer);
+            else if (ev.type == EV_HANDOVER_TIMEOUT)
+                handoverTimeout(ev.user, ev.timer);
+            else if (ev.type == EV_CELL_MESSAGE)
+                cellMessage(inbox[ev.symbol]);
+            else
+                downlink(ev.user, ev.symbol);
+        }
+        now = endUs;
+    }
+
+    const SimStats& statistics() const { return stats; }
+    const MacScheduler* macScheduler() const { return bs.macScheduler(); }
+    bool downlinkMux() const { return multiplexed; }
+    bool uplinkCombine() const { return combined; }
+    uint64_t controlCollisions() const { return bs.controlCollisions(); }
+    int population() const { return mesh ? (int)members.size() : (int)terminals.size(); }
+    // The population less users handed over whose source still holds them,
+    // so a user in flight counts in one cell only
+    int residents() const
+    {
+        if (!mesh) return population();
+        int n = 0;
+        for (size_t i = 0; i < members.size(); i++)
+            n += simUsers[members[i]].arrives <= now;
+        return n;
+    }
+
+    // Bits of granted bins the users sent segments in, and Jain's index of how evenly
+    // they were shared among the users
+    uint64_t uplinkBits() const
+    {
+        uint64_t sum = 0;
+        for (size_t u = 0; u < userBits.size(); u++)
+            sum += userBits[u];
+        return sum;
+    }
+    double fairness() const
+    {
+        double sum = 0, sumSq = 0;
+        for (size_t u = 0; u < userBits.size(); u++)
+		{
+            sum += (double)userBits[u];
+            sumSq += (double)userBits[u] * userBits[u];
+        }
+        return sumSq > 0 ? sum * sum / (userBits.size() * sumSq) : 1.0;
+    }
+
+    long long idleMeanUs = 5000;    // between bursts
+    long long packetGapUs = 200;    // between packets of a burst
+    int burstMean = 8;              // packets per burst
+    bool fullBuffer = false;        // bursts never end and packets go back to back
+
+private:
+    long long expDelay(long long mean)
+    {
+        std::exponential_distribution<double> dist(1.0 / mean);
+        return 1 + (long long)dist(rng);
+    }
+
+    void startTtis()
+    {
+        if (ticking) return;
+        ticking = true;
+        nextTti = now + ttiUs;
+        SimEvent ev = { EV_TTI, -1, -1, 0 };
+        queue.schedule(nextTti, ev);
+    }
+
+    void wake(int user, long long delay)
+    {
+        SimEvent ev = { EV_USER_WAKE, user, -1, ++simUsers[user].timer };
+        queue.schedule(now + delay, ev);
+    }
+
+    // Puts the symbol through the channel: IFFT to fftSize samples, FFT back to
+    // the active bins (both in the chosen sample format), AWGN. White time-domain
+    // noise folds into each active bin with fftSize times its variance, so it is
+    // drawn per bin directly.
+    void channel(std::complex<double>* active, uint32_t link)
+    {
+        if (!phy) return;
+        chain.mux(active);
+        chain.demux(active);
+        addNoise(active, link);
+    }
+
+    void addNoise(std::complex<double>* active, uint32_t link)
+    {
+        NoiseKey key = { seed, link, linkSymbols[link]++ };
+        addAWGN(active, layout.bins, binNoise * noiseScale[link / 2], key);
+    }
+
+    void transmit(int user, int type, int symbol)
+    {
+        if (type == EV_UPLINK) stats.uplinkTransmissions++;
+        if (type == EV_UPLINK && combined)
+		{
+            uplinkSlot[user] = symbol;     // on the air with the rest of the TTI's
+            uplinkSenders.push_back(user);
+            return;
+        }
+        channel(pool.at(symbol), type == EV_UPLINK ? uplinkNoise(user) : downlinkNoise(user));
+        SimEvent ev = { type, user, symbol, 0 };
+        queue.schedule(now + LINK_DELAY_US, ev);
+    }
+
+    void userWake(int u, int timer)
+    {
+        SimUser& su = simUsers[u];
+        if (timer != su.timer) return;   // superseded
+        if (combined && uplinkSlot[u] >= 0)
+		{
+            wake(u, segmentGap());    // one symbol per TTI: try again in the next
+            return;
+        }
+        UserTerminal& term = terminals[u];
+        bool requesting = su.state == USER_IDLE || su.state == USER_WAIT_GRANT;
+        bool sending = su.state == USER_ACTIVE && term.hasAllocation() && (term.dataPending() || su.burstLeft > 0);
+        if (combined && !requesting && !sending && !term.hasAllocation())
+		{
+            // Nothing to give back, and no slot to say so in
+            su.state = USER_IDLE;
+            wake(u, expDelay(idleMeanUs));
+            return;
+        }
+        if (combined)
+		{
+            // A header waits for a TTI with a slot the user may send it in
+            uint64_t tti = currentTti();
+            uint64_t turn = term.headerTti(requesting ? CTRL_ACCESS_REQUEST : sending ? CTRL_DATA_TX : CTRL_DEALLOCATE, tti);
+            if (turn > tti)
+			{
+                wake(u, segmentGap() + (long long)(turn - tti - 1) * ttiUs);
+                return;
+            }
+            term.setUplinkTti(tti);
+        }
+
+        int symbol = pool.acquire();
+        if (requesting)
+		{
+            if (su.state == USER_WAIT_GRANT)
+			{
+                stats.timeouts++;
+                su.retries++;
+            }
+            std::uniform_int_distribution<int> bins(1, layout.maxGrant());
+            term.accessRequest(bins(rng), pool.at(symbol));
+            su.state = USER_WAIT_GRANT;
+            stats.requests++;
+            wake(u, replyTimeout(u, true));
+        }
+        else if (sending)
+		{
+            if (!term.dataPending())
+			{
+                // Next message of the burst
+                // Relays stay within the cell
+                std::uniform_int_distribution<int> dest(0, population() - 1);
+                std::uniform_int_distribution<int> length(1, messageBytes);
+                su.message.resize(length(rng));
+                for (size_t i = 0; i < su.message.size(); i++)
+                    su.message[i] = (uint8_t)rng();
+                su.dest = mesh ? members[dest(rng)] : dest(rng);
+                term.sendData(su.dest, su.message.data(), su.message.size());
+                if (!fullBuffer) su.burstLeft--;
+                stats.dataSent++;
+            }
+            term.nextDataTx(pool.at(symbol));
+            stats.segmentsSent++;
+            userBits[u] += term.allocBits();
+            wake(u, term.dataPending() || fullBuffer ? segmentGap() : expDelay(packetGapUs));
+        }
+        else
+		{
+            if (su.state == USER_RELEASING)
+			{
+                stats.timeouts++;
+                su.retries++;
+            }
+            term.deallocate(pool.at(symbol));
+            su.state = USER_RELEASING;
+            wake(u, replyTimeout(u, false));
+        }
+        transmit(u, EV_UPLINK, symbol);
+    }
+
+    // On a combined uplink the answer to a header comes just after the end of
+    // its TTI. An access request left unanswered collided with another, so
+    // its retry also waits a random number of TTIs from a window that doubles
+    // with each retry; other headers have slots of their own.
+    long long replyTimeout(int u, bool contended)
+    {
+        if (!combined) return REPLY_TIMEOUT_US;
+        if (!contended) return segmentGap();
+        int window = 1 << std::min(simUsers[u].retries + 1, CONTENTION_MAX_BACKOFF);
+        std::uniform_int_distribution<int> slots(0, window - 1);
+        return segmentGap() + slots(rng) * ttiUs;
+    }
+
+    // Segments follow one another in consecutive TTIs, from the next boundary;
+    // on a combined uplink from just after the answers to the TTI that closes
+    // this one arrive, so that a symbol goes with the grant they bring
+    long long segmentGap() const
+    {
+        return combined ? nextTti - now + LINK_DELAY_US + 1 : (now / ttiUs + 1) * ttiUs - now;
+    }
+
+    // The TTI a combined symbol sent now goes out in, numbered by its end
+    uint64_t currentTti() const
+    {
+        return (uint64_t)(nextTti / ttiUs);
+    }
+
+    void uplink(int symbol)
+    {
+        stats.uplinkSymbols++;
+        downlinks.clear();
+        bs.handleUplink(pool.at(symbol), downlinks);
+        pool.release(symbol);
+        sendDownlinks();
+    }
+
+    void tti()
+    {
+        combineUplinks();
+        downlinks.clear();
+        bs.runTti(downlinks);
+        sendDownlinks();
+        sendFrames();
+        nextTti = now + ttiUs;
+        SimEvent ev = { EV_TTI, -1, -1, 0 };
+        queue.schedule(nextTti, ev);
+    }
+
+    // The TTI's uplink symbols add up on the air, and the base station
+    // transforms the sum once
+    void combineUplinks()
+    {
+        if (uplinkSenders.empty()) return;
+        int sum = pool.acquire();
+        std::complex<double>* active = pool.at(sum);
+        std::fill(active, active + layout.bins, std::complex<double>(0, 0));
+        for (size_t i = 0; i < uplinkSenders.size(); i++)
+		{
+            int u = uplinkSenders[i];
+            const std::complex<double>* sent = pool.at(uplinkSlot[u]);
+            if (phy)
+			{
+                if (i == 0) chain.mux(sent);
+                else chain.muxAdd(sent);
+            }
+			else
+			{
+                for (int b = 0; b < layout.bins; b++)
+                    active[b] += sent[b];
+            }
+            pool.release(uplinkSlot[u]);
+            uplinkSlot[u] = -1;
+        }
+        uplinkSenders.clear();
+        if (phy)
+		{
+            chain.demux(active);
+            addCombinedNoise(active);
+        }
+        stats.uplinkSymbols++;
+        downlinks.clear();
+        bs.handleUplink(active, downlinks);
+        pool.release(sum);
+        sendDownlinks();
+    }
+
+    // Receiver noise of a combined symbol: granted bins at their user's link
+    // level, the control region and free bins at binNoise. Each run of equal
+    // level draws from its own part of the symbol's stream.
+    void addCombinedNoise(std::complex<double>* active)
+    {
+        std::fill(binScale.begin(), binScale.end(), 1.0);
+        const BaseStation::AllocationMap& grants = bs.allocations();
+        for (BaseStation::AllocationMap::const_iterator it = grants.begin(); it != grants.end(); ++it)
+            if (it->first < (int)noiseScale.size())
+                std::fill(binScale.begin() + it->second.first, binScale.begin() + it->second.first + it->second.second,
+                          noiseScale[it->first]);
+        uint64_t symbol = combinedNoise++;
+        for (int b = 0; b < layout.bins; )
+		{
+            int end = b + 1;
+            while (end < layout.bins && binScale[end] == binScale[b]) end++;
+            NoiseKey key = { seed, NOISE_LINK_COMBINED_UPLINK, symbol * layout.bins + b };
+            addAWGN(active + b, end - b, binNoise * binScale[b], key);
+            b = end;
+        }
+    }
+
+    void sendDownlinks()
+    {
+        for (size_t i = 0; i < downlinks.size(); i++)
+		{
+            int u = downlinks[i].userId;
+            if (u >= (int)terminals.size())
+			{
+                stats.misaddressed++;
+                continue;
+            }
+            stats.downlinkMessages++;
+            if (multiplexed)
+			{
+                frames.add(downlinks[i].msg);
+                continue;
+            }
+            stats.downlinkSymbols++;
+            int out = pool.acquire();
+            encodeControl(layout, downlinks[i].msg, pool.at(out));
+            transmit(u, EV_DOWNLINK, out);
+        }
+    }
+
+    // One transform per frame: every user it carries receives the same active
+    // bins, each with its own link's noise
+    void sendFrames()
+    {
+        if (frames.empty()) return;
+        int frame = pool.acquire();
+        while (!frames.empty())
+		{
+            frames.build(pool.at(frame), frameUsers);
+            if (frameUsers.empty()) continue;
+            stats.downlinkSymbols++;
+            if (phy)
+			{
+                chain.mux(pool.at(frame));
+                chain.demux(pool.at(frame));
+            }
+            for (size_t i = 0; i < frameUsers.size(); i++)
+			{
+                int u = frameUsers[i];
+                int out = pool.acquire();
+                std::copy(pool.at(frame), pool.at(frame) + layout.bins, pool.at(out));
+                if (phy) addNoise(pool.at(out), downlinkNoise(u));
+                SimEvent ev = { EV_DOWNLINK, u, out, 0 };
+                queue.schedule(now + LINK_DELAY_US, ev);
+            }
+        }
+        pool.release(frame);
+    }
+
+    void downlink(int u, int symbol)
+    {
+        if (mesh && memberIndex[u] < 0)
+		{
+            pool.release(symbol);
+            stats.strandedDownlinks++;
+            return;
+        }
+        SimUser& su = simUsers[u];
+        bool sending = terminals[u].dataPending();     // a new grant abandons the message
+        ControlMessage msg = terminals[u].handleDownlink(pool.at(symbol));
+        pool.release(symbol);
+        if (msg.ctrl == CTRL_RESPONSE) su.retries = 0;
+
+        if (msg.ctrl == CTRL_DATA_TX)
+		{
+            stats.segmentsDelivered++;
+            if (terminals[u].completedMessage()) stats.dataDelivered++;
+        }
+        else if (msg.ctrl == CTRL_RESPONSE && su.state == USER_ACTIVE && macScheduler())
+		{
+            // The scheduler moved or took back the grant; the message starts over
+            su.resume = su.resume || sending;
+            if (msg.count > 0)
+			{
+                resume(u);
+            }
+			else
+			{
+                stats.revoked++;
+                su.state = USER_WAIT_GRANT;
+                wake(u, REPLY_TIMEOUT_US);
+            }
+        }
+        else if (msg.ctrl == CTRL_RESPONSE && su.state == USER_WAIT_GRANT)
+		{
+            if (msg.count > 0 && (su.burstLeft > 0 || su.resume))
+			{
+                // Granted again after a revocation: carry on with the burst
+                stats.grants++;
+                su.state = USER_ACTIVE;
+                resume(u);
+            }
+            else if (msg.count > 0)
+			{
+                stats.grants++;
+                su.state = USER_ACTIVE;
+                std::geometric_distribution<int> burst(1.0 / burstMean);
+                su.burstLeft = 1 + burst(rng);
+                wake(u, expDelay(packetGapUs));
+            }
+			else
+			{
+                stats.blocked++;
+                su.state = USER_IDLE;
+                wake(u, expDelay(idleMeanUs));
+            }
+        }
+        else if (msg.ctrl == CTRL_RESPONSE && su.state == USER_RELEASING)
+		{
+            stats.deallocs++;
+            su.state = USER_IDLE;
+            su.burstLeft = 0;
+            wake(u, expDelay(idleMeanUs));
+        }
+    }
+
+    // Restarts an interrupted message in the new grant
+    void resume(int u)
+    {
+        SimUser& su = simUsers[u];
+        if (su.resume)
+		{
+            su.resume = false;
+            stats.resent++;
+            terminals[u].sendData(su.dest, su.message.data(), su.message.size());
+            wake(u, segmentGap());
+        }
+		else
+		{
+            wake(u, expDelay(packetGapUs));
+        }
+    }
+
+    void addMember(int u)
+    {
+        memberIndex[u] = (int)members.size();
+        members.push_back(u);
+    }
+
+    void removeMember(int u)
+    {
+        int last = members.back();
+        members[memberIndex[u]] = last;
+        memberIndex[last] = memberIndex[u];
+        members.pop_back();
+        memberIndex[u] = -1;
+    }
+
+    void scheduleDwell(int u, long long delay)
+    {
+        SimEvent ev = { EV_HANDOVER, u, -1, simUsers[u].stay };
+        queue.schedule(now + delay, ev);
+    }
+
+    bool postHandover(int to, int type, int user)
+    {
+        HandoverMessage msg = { now + HANDOVER_DELAY_US, type, user, cell };
+        if (mesh->post(to, msg)) return true;
+        stats.handoversLost++;
+        return false;
+    }
+
+    // The user's time in the cell is up: ask a neighbour on the ring of cells
+    void handoverDue(int u, int stay)
+    {
+        SimUser& su = simUsers[u];
+        if (memberIndex[u] < 0 || stay != su.stay || su.leaving) return;
+        std::uniform_int_distribution<int> side(0, 1);
+        int cells = mesh->cells();
+        int target = (cell + (side(rng) ? 1 : cells - 1)) % cells;
+        if (!postHandover(target, HANDOVER_REQUEST, u))
+		{
+            scheduleDwell(u, expDelay(dwellUs));
+            return;
+        }
+        su.leaving = true;
+        // The answer is back after two trips; none by then means it was lost
+        SimEvent ev = { EV_HANDOVER_TIMEOUT, u, -1, ++su.request };
+        queue.schedule(now + 2 * HANDOVER_DELAY_US + 1, ev);
+    }
+
+    void handoverTimeout(int u, int request)
+    {
+        SimUser& su = simUsers[u];
+        if (memberIndex[u] < 0 || !su.leaving || request != su.request) return;
+        su.leaving = false;
+        scheduleDwell(u, expDelay(dwellUs));
+    }
+
+    void cellMessage(const HandoverMessage& msg)
+    {
+        int u = msg.user;
+        SimUser& su = simUsers[u];
+        if (msg.type == HANDOVER_REQUEST)
+		{
+            bool admit = memberIndex[u] < 0 && (int)members.size() < capacity;
+            // Unanswered, the source times out and keeps the user
+            if (!postHandover(msg.from, admit ? HANDOVER_ACCEPT : HANDOVER_REJECT, u) || !admit) return;
+            // Arrives with nothing: no grant, no message in progress. It starts
+            // once the source has let it go.
+            stats.handoversIn++;
+            terminals[u] = UserTerminal(layout, u);
+            terminals[u].setReceiveCapacity(messageBytes);
+            terminals[u].setDownlinkMux(multiplexed);
+            terminals[u].setUplinkCombine(combined);
+            terminals[u].setFec(fec);
+            SimUser fresh = SimUser();
+            fresh.state = USER_IDLE;
+            fresh.timer = su.timer;
+            fresh.stay = su.stay + 1;
+            fresh.request = su.request;
+            fresh.arrives = now + HANDOVER_DELAY_US;
+            su = fresh;
+            addMember(u);
+            wake(u, HANDOVER_DELAY_US + expDelay(idleMeanUs));
+            scheduleDwell(u, HANDOVER_DELAY_US + expDelay(dwellUs));
+        }
+        else if (msg.type == HANDOVER_ACCEPT && memberIndex[u] >= 0)
+		{
+            // Gone: whatever it was sending is lost and its bins go back
+            stats.handoversOut++;
+            ++su.timer;
+            su.leaving = false;
+            su.state = USER_IDLE;
+            bs.deallocateBins(u);
+            removeMember(u);
+        }
+        else if (msg.type == HANDOVER_REJECT)
+		{
+            stats.handoversRejected++;
+            su.leaving = false;
+            scheduleDwell(u, expDelay(dwellUs));
+        }
+    }
+
+    SampleChain chain;
+    FrameLayout layout;
+    BaseStation bs;
+    std::vector<UserTerminal> terminals;
+    std::vector<SimUser> simUsers;
+    EventQueue<SimEvent> queue;
+    SymbolPool pool;
+    std::vector<Downlink> downlinks;
+    std::mt19937_64 rng;
+    bool phy;
+    uint64_t seed;
+    double binNoise;
+    int messageBytes;
+    std::vector<uint64_t> linkSymbols;  // next noise symbol index per link
+    std::vector<double> noiseScale;     // per user, of binNoise
+    std::vector<uint64_t> userBits;     // uplink segment bits sent
+    long long ttiUs;
+    bool ticking;                       // EV_TTI scheduled: a scheduler, multiplexing or combining needs them
+    DownlinkFrameBuilder frames;
+    std::vector<int> frameUsers;
+    bool multiplexed;
+    bool combined;
+    FecRate fec;
+    long long nextTti;                  // time of the next EV_TTI
+    uint64_t combinedNoise;             // combined uplink symbols drawn noise for
+    std::vector<int> uplinkSlot;        // per user: symbol waiting for the TTI's end, or -1
+    std::vector<int> uplinkSenders;     // users with a symbol waiting
+    std::vector<double> binScale;       // per bin, of binNoise
+    CellMesh* mesh;                     // null: a single cell
+    int cell;
+    long long dwellUs;                  // mean stay in a cell
+    int capacity;                       // users the cell admits
+    std::vector<int> members;           // users in the cell
+    std::vector<int> memberIndex;       // per user: position in members, or -1
+    std::vector<HandoverMessage> inbox; // this window's, by EV_CELL_MESSAGE
+    long long now = 0;
+    SimStats stats;
+};
+
+// ---------------------------------------------------------------------------
+// Multi-cell: one Simulator per cell, each on its own thread
+
+static bool pinThread(int core)
+{
+#ifdef _WIN32
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)core;
+    return false;
+#endif
+}
+
+// The cells' lockstep between windows. Windows take tens to hundreds of us, so
+// the threads spin (yielding, in case cells outnumber cores) rather than sleep.
+class SpinBarrier
+{
+public:
+    explicit SpinBarrier(int parties) : parties(parties), arrived(0), phase(0) {}
+
+    void wait()
+    {
+        int p = phase.load(std::memory_order_acquire);
+        if (arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == parties)
+		{
+            arrived.store(0, std::memory_order_relaxed);
+            phase.store(p + 1, std::memory_order_release);
+            return;
+        }
+        while (phase.load(std::memory_order_acquire) == p)
+            std::this_thread::yield();
+    }
+
+private:
+    const int parties;
+    std::atomic<int> arrived;
+    std::atomic<int> phase;
+};
+
+struct CellRun
+{
+    std::unique_ptr<Simulator> sim;
+    bool pinned;
+    double busy;        // wall seconds simulating
+    double waiting;     // wall seconds at the barrier
+};
+
+// Runs the cells for endUs of simulated time, window by window. Each thread pins
+// itself first and then builds its cell, so the cell's memory is first touched,
+// and placed, on its own core's NUMA node.
+static void runCells(std::vector<CellRun>& runs, CellMesh& mesh, const std::function<Simulator*(int)>& makeCell,
+                     long long dwellUs, long long endUs, bool pin)
+{
+    int cells = (int)runs.size();
+    int cores = std::max(1, (int)std::thread::hardware_concurrency());
+    SpinBarrier barrier(cells);
+    std::vector<std::thread> threads;
+    for (int c = 0; c < cells; c++)
+	{
+        threads.push_back(std::thread([&, c]() {
+            CellRun& run = runs[c];
+            run.pinned = pin && pinThread(c % cores);
+            run.sim.reset(makeCell(c));
+            run.sim->joinMesh(&mesh, c, dwellUs);
+            std::vector<HandoverMessage> arrivals;
+            barrier.wait();
+            for (long long t = 0; t < endUs; t += HANDOVER_DELAY_US)
+			{
+                long long end = std::min(t + HANDOVER_DELAY_US, endUs);
+                auto t0 = std::chrono::steady_clock::now();
+                mesh.collect(c, end, arrivals);
+                run.sim->deliver(arrivals);
+                run.sim->run(end);
+                auto t1 = std::chrono::steady_clock::now();
+                barrier.wait();
+                run.busy += std::chrono::duration<double>(t1 - t0).count();
+                run.waiting += std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+}
+
+static void addStats(SimStats& sum, const SimStats& s)
+{
+    sum.events += s.events;
+    sum.requests += s.requests;
+    sum.grants += s.grants;
+    sum.blocked += s.blocked;
+    sum.dataSent += s.dataSent;
+    sum.dataDelivered += s.dataDelivered;
+    sum.segmentsSent += s.segmentsSent;
+    sum.segmentsDelivered += s.segmentsDelivered;
+    sum.deallocs += s.deallocs;
+    sum.timeouts += s.timeouts;
+    sum.misaddressed += s.misaddressed;
+    sum.revoked += s.revoked;
+    sum.resent += s.resent;
+    sum.downlinkMessages += s.downlinkMessages;
+    sum.downlinkSymbols += s.downlinkSymbols;
+    sum.uplinkTransmissions += s.uplinkTransmissions;
+    sum.uplinkSymbols += s.uplinkSymbols;
+    sum.handoversIn += s.handoversIn;
+    sum.handoversOut += s.handoversOut;
+    sum.handoversRejected += s.handoversRejected;
+    sum.handoversLost += s.handoversLost;
+    sum.strandedDownlinks += s.strandedDownlinks;
+}
+
+static int runCluster(int cells, int users, const std::function<Simulator*(int)>& makeCell, long long dwellUs,
+                      long long endUs, bool pin, double duration, const FrameLayout& layout, bool phy,
+                      SampleFormat format, unsigned long long seed)
+{
+    CellMesh mesh(cells, users);
+    std::vector<CellRun> runs(cells);
+    auto t0 = std::chrono::steady_clock::now();
+    runCells(runs, mesh, makeCell, dwellUs, endUs, pin);
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    SimStats s = SimStats();
+    double busy = 0, waiting = 0;
+    int pinned = 0;
+    for (int c = 0; c < cells; c++)
+	{
+        addStats(s, runs[c].sim->statistics());
+        busy += runs[c].busy;
+        waiting += runs[c].waiting;
+        pinned += runs[c].pinned;
+    }
+    cout << "Simulated " << duration << " s, " << users << " users in " << cells << " cells, FFT " << layout.fftSize
+         << " / " << layout.bins << " bins, " << (phy ? std::string("PHY ") + sampleFormatName(format) : "no PHY")
+         << ", seed " << seed << "\n";
+    cout << "Cluster: " << cells << " threads, " << pinned << " pinned to a core, windows of " << HANDOVER_DELAY_US
+         << " us; barrier wait " << (busy + waiting > 0 ? 100 * waiting / (busy + waiting) : 0) << "% of thread time\n";
+    cout << "Events: " << s.events << " in " << wall << " s wall => "
+         << (wall > 0 ? s.events / wall : 0) << " events/s, sim/wall ratio "
+         << (wall > 0 ? duration / wall : 0) << "\n";
+    cout << "Requests: " << s.requests << ", grants: " << s.grants << ", blocked: " << s.blocked
+         << ", deallocs: " << s.deallocs << ", timeouts: " << s.timeouts << "\n";
+    cout << "Messages sent: " << s.dataSent << " (" << s.segmentsSent << " segments), delivered: "
+         << s.dataDelivered << " (" << s.segmentsDelivered << " segments), misaddressed: " << s.misaddressed << "\n";
+    cout << "Handovers: " << s.handoversIn << " completed, " << s.handoversRejected << " rejected, "
+         << s.handoversLost << " lost, " << s.strandedDownlinks << " downlinks reached a user that had left\n";
+    for (int c = 0; c < cells; c++)
+	{
+        const Simulator& sim = *runs[c].sim;
+        const SimStats& cs = sim.statistics();
+        cout << "Cell " << c << ": " << sim.residents() << " users, uplink " << sim.uplinkBits() / duration / 1e3
+             << " kbit/s, " << cs.dataDelivered / duration << " messages/s delivered, handovers in " << cs.handoversIn
+             << " / out " << cs.handoversOut << ", " << cs.events << " events in " << runs[c].busy << " s busy => "
+             << (runs[c].busy > 0 ? cs.events / runs[c].busy : 0) << " events/s\n";
+    }
+    cout.flush();
+    return 0;
+}
+
+static bool optionValue(const std::string& arg, const char* name, std::string& value)
+{
+    size_t len = strlen(name);
+    if (arg.compare(0, len, name) != 0) return false;
+    value = arg.substr(len);
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    int users = 1000;
+    double duration = 10.0;            // simulated seconds
+    unsigned long long seed = 1;
+    bool phy = true;
+    bool verbose = false;
+    AllocPolicy policy = ALLOC_FIRST_FIT;
+    std::string numerologyName = SIM_NUMEROLOGY;
+    double binNoise = NOISE_VARIANCE * FFT_SIZE;   // per active bin and dimension, as on the 64-point link
+    Modulation modulation = MOD_QPSK;
+    FecRate fec = FEC_NONE;
+    int messageBytes = 4;
+    SampleFormat format = FORMAT_CF64;
+    parseSampleFormat(DEFAULT_SAMPLE_FORMAT, format);
+    SchedulerPolicy scheduler = SCHED_NONE;
+    long long ttiUs = 1000;
+    int grantTtis = DEFAULT_GRANT_TTIS;
+    bool adaptLinks = false;
+    bool fullBuffer = false;
+    bool multiplexed = false;
+    bool combined = false;
+    std::string eventLogFile;
+    int cells = 1;
+    double dwell = 2.0;                 // mean simulated seconds a user stays in a cell
+    bool pin = true;
+
+    for (int i = 1; i < argc; i++)
+	{
+        std::string arg = argv[i], value;
+        if (optionValue(arg, "--users=", value)) users = atoi(value.c_str());
+        else if (optionValue(arg, "--duration=", value)) duration = atof(value.c_str());
+        else if (optionValue(arg, "--seed=", value)) seed = strtoull(value.c_str(), nullptr, 10);
+        else if (optionValue(arg, "--noise=", value)) binNoise = atof(value.c_str());
+        else if (optionValue(arg, "--message-bytes=", value)) messageBytes = atoi(value.c_str());
+        else if (optionValue(arg, "--numerology=", value)) numerologyName = value;
+        else if (optionValue(arg, "--tti-us=", value)) ttiUs = atoll(value.c_str());
+        else if (optionValue(arg, "--grant-ttis=", value)) grantTtis = atoi(value.c_str());
+        else if (optionValue(arg, "--event-log=", value)) eventLogFile = value;
+        else if (optionValue(arg, "--cells=", value)) cells = atoi(value.c_str());
+        else if (optionValue(arg, "--dwell=", value)) dwell = atof(value.c_str());
+        else if (optionValue(arg, "--scheduler=", value))
+		{
+            if (!parseSchedulerPolicy(value, scheduler))
+			{
+                cerr << "Unknown scheduler " << value << " (fcfs, rr, max-rate or pf)" << endl;
+                return 1;
+            }
+        }
+        else if (optionValue(arg, "--sample-format=", value))
+		{
+            if (!parseSampleFormat(value, format))
+			{
+                cerr << "Unknown sample format " << value << " (cf64, cf32 or cq15)" << endl;
+                return 1;
+            }
+        }
+        else if (optionValue(arg, "--modulation=", value))
+		{
+            if (!parseModulation(value, modulation))
+			{
+                cerr << "Unknown modulation " << value << endl;
+                return 1;
+            }
+        }
+        else if (optionValue(arg, "--fec=", value))
+		{
+            if (!parseFecRate(value, fec))
+			{
+                cerr << "Unknown code rate " << value << " (none, 1/2, 2/3, 3/4 or 5/6)" << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--alloc=first-fit") policy = ALLOC_FIRST_FIT;
+        else if (arg == "--alloc=best-fit") policy = ALLOC_BEST_FIT;
+        else if (arg == "--link-adaptation") adaptLinks = true;
+        else if (arg == "--full-buffer") fullBuffer = true;
+        else if (arg == "--dl-mux") multiplexed = true;
+        else if (arg == "--ul-combine") combined = true;
+        else if (arg == "--no-phy") phy = false;
+        else if (arg == "--verbose") verbose = true;
+        else if (arg == "--no-pin") pin = false;
+        else
+		{
+            cerr << "Usage: ofdma_sim [--users=N] [--duration=SECONDS] [--seed=N] [--numerology=FFT/BINS] [--noise=VAR] [--modulation=qpsk|16qam|64qam|256qam] [--fec=none|1/2|2/3|3/4|5/6] [--message-bytes=N] [--sample-format=cf64|cf32|cq15] [--alloc=first-fit|best-fit] [--scheduler=fcfs|rr|max-rate|pf] [--tti-us=N] [--grant-ttis=N] [--link-adaptation] [--full-buffer] [--dl-mux] [--ul-combine] [--no-phy] [--verbose] [--event-log=FILE] [--cells=N] [--dwell=SECONDS] [--no-pin]" << endl;
+            return 1;
+        }
+    }
+
+    const NumerologyOps* numerology = findNumerology(numerologyName);
+    if (!numerology)
+	{
+        cerr << "Unknown numerology " << numerologyName << " (available: " << numerologyNames() << ")" << endl;
+        return 1;
+    }
+    if (users < 1 || users > SIM_MAX_USERS)
+	{
+        cerr << "Users must be 1-" << SIM_MAX_USERS << endl;
+        return 1;
+    }
+    if (ttiUs < 1 || grantTtis < 1)
+	{
+        cerr << "TTI and grant length must be positive" << endl;
+        return 1;
+    }
+    if (messageBytes < 1 || messageBytes > (int)SEGMENT_MAX_MESSAGE)
+	{
+        cerr << "Message size must be 1-" << SEGMENT_MAX_MESSAGE << " bytes" << endl;
+        return 1;
+    }
+    if (cells < 1 || cells > users || dwell <= 0)
+	{
+        cerr << "Cells must be 1-" << users << " and the dwell time positive" << endl;
+        return 1;
+    }
+    if (cells > 1 && (verbose || !eventLogFile.empty()))
+	{
+        // Their lines carry no cell, and user ids repeat across cells' logs
+        cerr << "--verbose and --event-log need a single cell" << endl;
+        return 1;
+    }
+    // User id field just wide enough for the population
+    int idBits = 2;
+    while ((1 << idBits) < users) idBits++;
+    FrameLayout layout = makeFrameLayout(numerology->fftSize, numerology->bins, idBits);
+    if (!layout.fits())
+	{
+        cerr << "Numerology " << numerology->name << " has too few bins for " << users << " user ids" << endl;
+        return 1;
+    }
+    if (multiplexed && !frameCanMultiplex(layout))
+	{
+        cerr << "--dl-mux needs frames with room for two messages; " << numerology->name << " has one per symbol" << endl;
+        return 1;
+    }
+
+    // Cell 0 runs on the given seed; the others on seeds of their own
+    auto makeCell = [&](int cell) -> Simulator* {
+        unsigned long long cellSeed = seed ^ ((unsigned long long)cell << 32);
+        Simulator* sim = new Simulator(*numerology, format, layout, users, cellSeed, phy, binNoise, messageBytes, ttiUs);
+        sim->setAllocPolicy(policy);
+        sim->setModulation(modulation);
+        if (fec != FEC_NONE) sim->setFec(fec);
+        if (adaptLinks) sim->adaptLinks();
+        sim->fullBuffer = fullBuffer;
+        sim->setScheduler(scheduler, grantTtis);
+        if (multiplexed) sim->setDownlinkMux();
+        if (combined) sim->setUplinkCombine();
+        return sim;
+    };
+    long long endUs = (long long)(duration * 1e6);
+    if (cells > 1)
+        return runCluster(cells, users, makeCell, (long long)(dwell * 1e6), endUs, pin, duration, layout, phy, format, seed);
+
+    std::unique_ptr<Simulator> cell(makeCell(0));
+    Simulator& sim = *cell;
+    if (verbose) sim.setLog(&cout);
+    EventLog events;
+    if (!eventLogFile.empty())
+	{
+        if (!events.open(eventLogFile, sim.simClock()))
+		{
+            cerr << "Cannot write the event log to " << eventLogFile << endl;
+            return 1;
+        }
+        sim.setEventLog(&events);
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    sim.run(endUs);
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    const SimStats& s = sim.statistics();
+    cout << "Simulated " << duration << " s, " << users << " users, FFT " << layout.fftSize
+         << " / " << layout.bins << " bins, " << (phy ? std::string("PHY ") + sampleFormatName(format) : "no PHY")
+         << ", seed " << seed << (fec != FEC_NONE ? std::string(", rate ") + fecRateName(fec) + " coding" : "") << "\n";
+    cout << "Events: " << s.events << " in " << wall << " s wall => "
+         << (wall > 0 ? s.events / wall : 0) << " events/s, sim/wall ratio "
+         << (wall > 0 ? duration / wall : 0) << "\n";
+    cout << "Requests: " << s.requests << ", grants: " << s.grants << ", blocked: " << s.blocked
+         << ", deallocs: " << s.deallocs << ", timeouts: " << s.timeouts << "\n";
+    cout << "Messages sent: " << s.dataSent << " (" << s.segmentsSent << " segments), delivered: "
+         << s.dataDelivered << " (" << s.segmentsDelivered << " segments), misaddressed: " << s.misaddressed << "\n";
+    cout << "Downlink: " << s.downlinkMessages << " messages in " << s.downlinkSymbols << " symbols"
+         << (sim.downlinkMux() ? " (multiplexed, " : " (")
+         << (s.downlinkSymbols > 0 ? (double)s.downlinkMessages / s.downlinkSymbols : 0) << " per symbol)\n";
+    cout << "Uplink symbols: " << s.uplinkTransmissions << " transmissions in " << s.uplinkSymbols << " symbols"
+         << (sim.uplinkCombine() ? " (combined, " : " (")
+         << (s.uplinkSymbols > 0 ? (double)s.uplinkTransmissions / s.uplinkSymbols : 0) << " per symbol)";
+    if (sim.uplinkCombine()) cout << ", control collisions: " << sim.controlCollisions();
+    cout << "\n";
+    cout << "Uplink: " << sim.uplinkBits() / duration / 1e3 << " kbit/s cell throughput, fairness "
+         << sim.fairness() << " (Jain, " << users << " users)\n";
+    if (const MacScheduler* ms = sim.macScheduler())
+        cout << "Scheduler " << schedulerPolicyName(scheduler) << ": " << ms->ttis() << " TTIs of " << ttiUs
+             << " us, grants: " << ms->grants() << ", revoked: " << s.revoked << " (" << ms->preemptions()
+             << " preempted, " << ms->idleRevocations() << " idle), messages restarted: " << s.resent
+             << ", still waiting: " << ms->waitingUsers() << "\n";
+    if (events.isOpen())
+	{
+        events.close();
+        cout << "Event log: " << events.written() << " records written to " << eventLogFile << ", "
+             << events.dropped() << " dropped\n";
+    }
+    cout.flush();
+    return 0;
+}
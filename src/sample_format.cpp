@@ -0,0 +1,68 @@
+#include "sample_format.h"
+#include <algorithm>
+#include <cmath>
+
+const char* sampleFormatName(SampleFormat format)
+{
+    switch (format)
+	{
+        case FORMAT_CF32: return "cf32";
+        case FORMAT_CQ15: return "cq15";
+        default:          return "cf64";
+    }
+}
+
+bool parseSampleFormat(const std::string& name, SampleFormat& format)
+{
+    if (name == "cf64") format = FORMAT_CF64;
+    else if (name == "cf32") format = FORMAT_CF32;
+    else if (name == "cq15") format = FORMAT_CQ15;
+    else return false;
+    return true;
+}
+
+int blockExponent(const std::complex<double>* x, size_t n)
+{
+    double peak = 0;
+    for (size_t i = 0; i < n; i++)
+        peak = std::max(peak, std::max(std::fabs(x[i].real()), std::fabs(x[i].imag())));
+    if (peak == 0) return 0;
+    int e;
+    std::frexp(peak, &e);   // peak = f * 2^e with 0.5 <= f < 1
+    return e;
+}
+
+static inline int16_t saturate16(double v)
+{
+    long r = std::lround(v);
+    return (int16_t)std::min(32767L, std::max(-32768L, r));
+}
+
+void toQ15(const std::complex<double>* in, size_t n, int exponent, cq15* out)
+{
+    const double scale = std::ldexp(1.0, 15 - exponent);
+    for (size_t i = 0; i < n; i++)
+	{
+        out[i].re = saturate16(in[i].real() * scale);
+        out[i].im = saturate16(in[i].imag() * scale);
+    }
+}
+
+void fromQ15(const cq15* in, size_t n, int exponent, std::complex<double>* out)
+{
+    const double scale = std::ldexp(1.0, exponent - 15);
+    for (size_t i = 0; i < n; i++)
+        out[i] = std::complex<double>(in[i].re * scale, in[i].im * scale);
+}
+
+void toCF32(const std::complex<double>* in, size_t n, std::complex<float>* out)
+{
+    for (size_t i = 0; i < n; i++)
+        out[i] = std::complex<float>((float)in[i].real(), (float)in[i].imag());
+}
+
+void fromCF32(const std::complex<float>* in, size_t n, std::complex<double>* out)
+{
+    for (size_t i = 0; i < n; i++)
+        out[i] = std::complex<double>(in[i].real(), in[i].imag());
+}
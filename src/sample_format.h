@@ -0,0 +1,45 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Sample representations of the datapath. CF64 is the reference; CF32 halves
+// the memory traffic and doubles the SIMD width; CQ15 is 16-bit fixed point
+// whose blocks share one exponent (see fixed_fft.h).
+enum SampleFormat
+{
+    FORMAT_CF64,
+    FORMAT_CF32,
+    FORMAT_CQ15
+};
+
+// Default for the tools' --sample-format option; make build SAMPLE_FORMAT=cf32
+// changes it
+#ifndef OFDMA_SAMPLE_FORMAT
+#define OFDMA_SAMPLE_FORMAT "cf64"
+#endif
+constexpr const char* DEFAULT_SAMPLE_FORMAT = OFDMA_SAMPLE_FORMAT;
+
+const char* sampleFormatName(SampleFormat format);
+// "cf64", "cf32" or "cq15"; false for anything else
+bool parseSampleFormat(const std::string& name, SampleFormat& format);
+
+// Complex Q15 sample. A block of them carries an exponent e: each component
+// stands for q * 2^(e - 15), so e = 0 is the usual [-1, 1) range.
+struct cq15
+{
+    int16_t re;
+    int16_t im;
+};
+
+// Smallest e with every component of x below 2^e in magnitude (0 for all zeros)
+int blockExponent(const std::complex<double>* x, size_t n);
+
+// Rounds to the block exponent, saturating what does not fit
+void toQ15(const std::complex<double>* in, size_t n, int exponent, cq15* out);
+void fromQ15(const cq15* in, size_t n, int exponent, std::complex<double>* out);
+
+void toCF32(const std::complex<double>* in, size_t n, std::complex<float>* out);
+void fromCF32(const std::complex<float>* in, size_t n, std::complex<double>* out);
@@ -0,0 +1,226 @@
+#include "segment.h"
+
+int segmentSeq(size_t index, int seqMask)
+{
+    return index == 0 ? 0 : 1 + (int)((index - 1) % seqMask);
+}
+
+// A run of erasures costs the decoder the distance of the trellis steps it
+// spans; past these lengths a lost segment mostly decodes wrong
+int segmentErasableBits(FecRate fec)
+{
+    static const int ERASABLE[] = { 0, 12, 8, 8, 6 };
+    return ERASABLE[fec];
+}
+
+bool Segmenter::start(const uint8_t* data, size_t length, int segmentBits, int seqBits, FecRate fec)
+{
+    clear();
+    if (length > SEGMENT_MAX_MESSAGE || segmentBits < 1 || segmentBits > SEGMENT_MAX_BITS || seqBits < 1)
+        return false;
+    this->data = data;
+    this->length = length;
+    this->segmentBits = segmentBits;
+    this->seqMask = (1 << seqBits) - 1;
+    this->fec = fec;
+    if (fec != FEC_NONE) encoder.reset(fec);
+    infoPos = 0;
+    infoEnd = SEGMENT_LENGTH_BITS;
+    coded = 0;
+    codedBits = 0;
+    count = segmentCount(length, segmentBits, fec);
+    return true;
+}
+
+// Byte i of the length-prefixed stream, 0 past the end
+uint8_t Segmenter::byteAt(size_t i) const
+{
+    if (i == 0) return (uint8_t)(length >> 8);
+    if (i == 1) return (uint8_t)length;
+    return i - 2 < length ? data[i - 2] : 0;
+}
+
+// The next segmentBits coded bits, encoding as far ahead as they need
+int Segmenter::nextCoded()
+{
+    while (codedBits < segmentBits && infoEnd > 0)
+	{
+        if (infoPos < infoEnd)
+		{
+            codedBits += encoder.push((byteAt(infoPos / 8) >> (7 - infoPos % 8)) & 1, coded);
+            infoPos++;
+        }
+        else
+		{
+            codedBits += encoder.finish(coded);
+            // The bytes' codeword follows the length's, unless there are none
+            infoEnd = infoEnd == SEGMENT_LENGTH_BITS && length ? infoEnd + 8 * length : 0;
+        }
+    }
+    int take = codedBits < segmentBits ? codedBits : segmentBits;
+    uint32_t bits = (uint32_t)(coded >> (codedBits - take)) & ((1u << take) - 1);
+    codedBits -= take;
+    return (int)(bits << (segmentBits - take));
+}
+
+void Segmenter::next(int& seq, int& payload)
+{
+    seq = segmentSeq(index, seqMask);
+    if (fec != FEC_NONE)
+	{
+        payload = nextCoded();
+        index++;
+        return;
+    }
+
+    size_t pos = index * segmentBits;
+    size_t first = pos / 8;
+    size_t last = (pos + segmentBits - 1) / 8;
+
+    // At most 4 bytes hold a 24-bit segment
+    uint64_t acc = 0;
+    for (size_t b = first; b <= last; b++)
+        acc = (acc << 8) | byteAt(b);
+    int spare = (int)(8 * (last - first + 1) - pos % 8) - segmentBits;
+
+    payload = (int)((acc >> spare) & ((1u << segmentBits) - 1));
+    index++;
+}
+
+Reassembler::Reassembler(uint8_t* buffer, size_t capacity, int seqBits, FecRate fec)
+    : buffer(buffer), capacity(capacity), seqMask((1 << seqBits) - 1), fec(fec), completeLength(0)
+{
+    reset();
+}
+
+void Reassembler::reset()
+{
+    index = 0;
+    bitPos = 0;
+    messageLength = 0;
+    skipping = false;
+    soft.clear();
+}
+
+void Reassembler::writeBits(size_t pos, int bits, uint32_t value)
+{
+    const size_t prefixBytes = sizeof(prefix);
+    while (bits > 0)
+	{
+        size_t byte = pos / 8;
+        int offset = (int)(pos % 8);
+        int take = bits < 8 - offset ? bits : 8 - offset;
+        uint8_t chunk = (uint8_t)((value >> (bits - take)) & ((1u << take) - 1));
+
+        // Bytes past the buffer (padding, or an oversized message) are dropped
+        uint8_t* dst = nullptr;
+        if (byte < prefixBytes) dst = &prefix[byte];
+        else if (byte - prefixBytes < capacity) dst = &buffer[byte - prefixBytes];
+        if (dst)
+		{
+            if (offset == 0) *dst = 0;
+            *dst |= (uint8_t)(chunk << (8 - offset - take));
+        }
+        pos += take;
+        bits -= take;
+    }
+}
+
+// Checks a segment's place in the message; false (and the message dropped) if
+// it has none
+bool Reassembler::nextSegment(int seq, int segmentBits)
+{
+    if (seq == 0)
+        reset();                    // a new message, whatever happened to the last one
+    else if (index == 0 || seq != segmentSeq(index, seqMask))
+	{
+        reset();
+        return false;
+    }
+    if (segmentBits < 1 || segmentBits > SEGMENT_MAX_BITS)
+	{
+        reset();
+        return false;
+    }
+    return true;
+}
+
+SegmentStatus Reassembler::finishMessage()
+{
+    bool dropped = skipping;
+    size_t length = messageLength;
+    reset();
+    if (dropped) return SEGMENT_TOO_LONG;
+    completeLength = length;
+    return SEGMENT_COMPLETE;
+}
+
+SegmentStatus Reassembler::accept(int seq, int payload, int segmentBits)
+{
+    if (fec != FEC_NONE)
+	{
+        // A hard decision is a soft value at full confidence
+        int8_t values[SEGMENT_MAX_BITS];
+        for (int i = 0; i < segmentBits && i < SEGMENT_MAX_BITS; i++)
+            values[i] = (payload >> (segmentBits - 1 - i)) & 1 ? -FEC_SOFT_MAX : FEC_SOFT_MAX;
+        return acceptSoft(seq, values, segmentBits);
+    }
+    if (!nextSegment(seq, segmentBits))
+        return SEGMENT_LOST;
+
+    if (!skipping) writeBits(bitPos, segmentBits, (uint32_t)payload);
+    index++;
+    bitPos += segmentBits;
+
+    if (bitPos >= SEGMENT_LENGTH_BITS && bitPos - segmentBits < SEGMENT_LENGTH_BITS)
+	{
+        // This segment completed the length prefix
+        messageLength = ((size_t)prefix[0] << 8) | prefix[1];
+        skipping = messageLength > capacity;
+    }
+    if (bitPos < SEGMENT_LENGTH_BITS || bitPos < SEGMENT_LENGTH_BITS + 8 * messageLength)
+        return SEGMENT_PARTIAL;
+    return finishMessage();
+}
+
+SegmentStatus Reassembler::acceptSoft(int seq, const int8_t* values, int segmentBits)
+{
+    if (fec == FEC_NONE)
+	{
+        int payload = 0;
+        for (int i = 0; i < segmentBits && i < SEGMENT_MAX_BITS; i++)
+            payload = (payload << 1) | (values[i] < 0);
+        return accept(seq, payload, segmentBits);
+    }
+    // A segment whose header the noise garbled never reaches its stream; the
+    // code fills in one such segment as erasures, if they are few enough
+    const size_t before = bitPos;
+    if (index > 0 && seq == segmentSeq(index + 1, seqMask) && segmentBits <= segmentErasableBits(fec))
+	{
+        if (!skipping) soft.insert(soft.end(), segmentBits, 0);
+        index++;
+        bitPos += segmentBits;
+    }
+    if (!nextSegment(seq, segmentBits))
+        return SEGMENT_LOST;
+
+    if (!skipping) soft.insert(soft.end(), values, values + segmentBits);
+    index++;
+    bitPos += segmentBits;
+
+    const size_t prefixBits = fecCodedBits(fec, SEGMENT_LENGTH_BITS);
+    if (bitPos >= prefixBits && before < prefixBits)
+	{
+        // This segment completed the length's codeword
+        viterbiDecode(fec, &soft[0], SEGMENT_LENGTH_BITS, prefix);
+        messageLength = ((size_t)prefix[0] << 8) | prefix[1];
+        skipping = messageLength > capacity;
+        if (!skipping) soft.reserve(segmentStreamBits(messageLength, fec));
+    }
+    if (bitPos < prefixBits || bitPos < segmentStreamBits(messageLength, fec))
+        return SEGMENT_PARTIAL;
+
+    if (!skipping && messageLength)
+        viterbiDecode(fec, &soft[prefixBits], 8 * messageLength, buffer);
+    return finishMessage();
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "conv_code.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Byte messages carried over CTRL_DATA_TX symbols. A message goes on the link as
+// a 16-bit length followed by its bytes, most significant bit first, cut into
+// segments of the allocation's payload bits (count * modulationBits). The first
+// segment of a message is numbered 0 and the rest cycle through 1..2^seqBits-1,
+// so a receiver can spot both gaps and message starts. It knows the segment size
+// from its own allocation and writes each segment straight into its buffer at
+// the segment's bit offset.
+//
+// With a FecRate other than FEC_NONE the stream is coded instead: the length
+// and the bytes are two convolutional codewords (the second left out for an
+// empty message), and the segments carry their coded bits. The receiver then
+// collects soft values until a codeword is whole and decodes it. A coded
+// stream also survives a single missing segment, one the noise took the
+// header of: the next segment's sequence number shows the gap, and the
+// missing bits go to the decoder as erasures.
+
+constexpr int SEGMENT_LENGTH_BITS = 16;
+constexpr size_t SEGMENT_MAX_MESSAGE = (1 << SEGMENT_LENGTH_BITS) - 1;
+// Most payload bits one segment can carry (3 bins of 256-QAM)
+constexpr int SEGMENT_MAX_BITS = 24;
+
+// Stream bits of a message of `length` bytes
+inline size_t segmentStreamBits(size_t length, FecRate fec = FEC_NONE)
+{
+    if (fec == FEC_NONE) return SEGMENT_LENGTH_BITS + 8 * length;
+    return fecCodedBits(fec, SEGMENT_LENGTH_BITS) + (length ? fecCodedBits(fec, 8 * length) : 0);
+}
+
+// Segments a message of `length` bytes needs
+inline size_t segmentCount(size_t length, int segmentBits, FecRate fec = FEC_NONE)
+{
+    return (segmentStreamBits(length, fec) + segmentBits - 1) / segmentBits;
+}
+
+// Most coded bits of one lost segment a coded stream can decode through
+int segmentErasableBits(FecRate fec);
+
+// Sequence number of segment `index` of a message: 0 opens it, then
+// 1..seqMask repeat
+int segmentSeq(size_t index, int seqMask);
+
+// Cuts one message into segments, reading the caller's bytes in place
+class Segmenter
+{
+public:
+    Segmenter() : data(nullptr), length(0), segmentBits(0), seqMask(0), index(0), count(0),
+                  fec(FEC_NONE), infoPos(0), infoEnd(0), coded(0), codedBits(0) {}
+
+    // data must stay valid until done(); false if the message or segment size is out of range
+    bool start(const uint8_t* data, size_t length, int segmentBits, int seqBits, FecRate fec = FEC_NONE);
+    void clear() { index = count = 0; }
+
+    bool done() const { return index >= count; }
+    // Whether next() gives the message's first segment
+    bool atStart() const { return index == 0 && count > 0; }
+    size_t segments() const { return count; }
+
+    // Sequence number and segmentBits payload bits of the next segment; the
+    // last one is zero-padded
+    void next(int& seq, int& payload);
+
+private:
+    uint8_t byteAt(size_t i) const;
+    int nextCoded();
+
+    const uint8_t* data;
+    size_t length;
+    int segmentBits;
+    int seqMask;
+    size_t index;
+    size_t count;
+
+    // Coded streams are encoded as the segments go out
+    FecRate fec;
+    ConvEncoder encoder;
+    size_t infoPos;         // next information bit of the length-prefixed stream
+    size_t infoEnd;         // end of the codeword being encoded
+    uint64_t coded;         // coded bits not sent yet, in the low codedBits
+    int codedBits;
+};
+
+enum SegmentStatus
+{
+    SEGMENT_PARTIAL,    // accepted, message not complete yet
+    SEGMENT_COMPLETE,   // data()/length() hold the whole message
+    SEGMENT_LOST,       // sequence gap: the message in progress was dropped
+    SEGMENT_TOO_LONG    // last segment of a message that did not fit the buffer
+};
+
+// Rebuilds messages in a caller-provided buffer. Segments must arrive in order;
+// a gap drops the message in progress and everything up to the next segment 0,
+// unless a coded stream can decode through it (see segmentErasableBits).
+class Reassembler
+{
+public:
+    Reassembler() : buffer(nullptr), capacity(0), seqMask(0), fec(FEC_NONE), completeLength(0) { reset(); }
+    Reassembler(uint8_t* buffer, size_t capacity, int seqBits, FecRate fec = FEC_NONE);
+
+    void reset();
+    SegmentStatus accept(int seq, int payload, int segmentBits);
+    // segmentBits soft values (see conv_code.h), for a coded stream; an
+    // uncoded one takes their signs
+    SegmentStatus acceptSoft(int seq, const int8_t* values, int segmentBits);
+
+    const uint8_t* data() const { return buffer; }
+    // Bytes of the last completed message
+    size_t length() const { return completeLength; }
+
+private:
+    bool nextSegment(int seq, int segmentBits);
+    void writeBits(size_t pos, int bits, uint32_t value);
+    SegmentStatus finishMessage();
+
+    uint8_t* buffer;
+    size_t capacity;
+    int seqMask;
+    FecRate fec;
+    std::vector<int8_t> soft;   // coded stream of the message so far
+    size_t index;           // next expected segment
+    size_t bitPos;          // stream bits received
+    size_t messageLength;   // from the prefix, once received
+    bool skipping;          // in a dropped message
+    size_t completeLength;
+    uint8_t prefix[SEGMENT_LENGTH_BITS / 8];
+};
+
+// A Reassembler with a buffer of its own, for receivers that keep one per sender
+struct ReassemblyBuffer
+{
+    std::unique_ptr<uint8_t[]> bytes;
+    Reassembler rx;
+
+    ReassemblyBuffer(size_t capacity, int seqBits, FecRate fec = FEC_NONE)
+        : bytes(new uint8_t[capacity ? capacity : 1]), rx(bytes.get(), capacity, seqBits, fec) {}
+};
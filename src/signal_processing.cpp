@@ -1,13 +1,16 @@
 #define _USE_MATH_DEFINES
 #include "signal_processing.h"
+#include "numerology.h"
+#include "modulation.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <mutex>
 
 std::complex<double> qpskModulate(int bit1, int bit2)
 {
-    double invSqrt2 = 1.0 / sqrt(2.0);
-    if(bit1==0 && bit2==0) return {invSqrt2,  invSqrt2};
-    if(bit1==0 && bit2==1) return {invSqrt2, -invSqrt2};
-    if(bit1==1 && bit2==0) return {-invSqrt2, invSqrt2};
-    return {-invSqrt2, -invSqrt2};
+    return mapSymbol(MOD_QPSK, (bit1 << 1) | bit2);
 }
 
 std::pair<int,int> qpskDemodulate(const std::complex<double>& sym)
@@ -17,62 +20,314 @@ std::pair<int,int> qpskDemodulate(const std::complex<double>& sym)
     return {b1,b2};
 }
 
-std::vector<std::complex<double>> fft(const std::vector<std::complex<double>>& a)
+// Complex multiply without the NaN/Inf recovery path of operator*
+static inline std::complex<double> cmul(const std::complex<double>& a, const std::complex<double>& b)
 {
-    int n = a.size();
-    if (n <= 1) return a;
-    
-    // Divide: separate a into even and odd indexed elements.
-    std::vector<std::complex<double>> a_even(n/2), a_odd(n/2);
-    for (int i = 0; i < n/2; i++)
+    return { a.real()*b.real() - a.imag()*b.imag(), a.real()*b.imag() + a.imag()*b.real() };
+}
+
+static FftPlan makeFftPlan(int n)
+{
+    FftPlan plan;
+    plan.n = n;
+    plan.log2n = 0;
+    while ((1 << plan.log2n) < n) plan.log2n++;
+
+    plan.bitrev.resize(n);
+    for (int i = 0; i < n; i++)
 	{
-        a_even[i] = a[2*i];
-        a_odd[i] = a[2*i + 1];
+        int r = 0;
+        for (int b = 0; b < plan.log2n; b++)
+            if (i & (1 << b)) r |= 1 << (plan.log2n - 1 - b);
+        plan.bitrev[i] = r;
     }
-    
-    // Recursively compute FFT on even and odd parts.
-    std::vector<std::complex<double>> y_even = fft(a_even);
-    std::vector<std::complex<double>> y_odd  = fft(a_odd);
-    
-    // Combine
-    std::vector<std::complex<double>> y(n);
+
+    plan.twiddle.resize(n/2);
     for (int k = 0; k < n/2; k++)
 	{
-        std::complex<double> t = std::polar(1.0, -2 * M_PI * k / n) * y_odd[k];
-        y[k] = y_even[k] + t;
-        y[k + n/2] = y_even[k] - t;
+        plan.twiddle[k] = std::polar(1.0, -2 * M_PI * k / n);
+    }
+    return plan;
+}
+
+static bool isPowerOfTwo(int n)
+{
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+const FftPlan& fftPlan(int n)
+{
+    // One slot per log2(n); lookups after the first one for a size are lock-free
+    static std::atomic<const FftPlan*> plans[32];
+    static std::unique_ptr<FftPlan> owned[32];
+    static std::mutex mtx;
+
+    // A plan for the next power of two would transform the wrong length
+    assert(isPowerOfTwo(n) && "fftPlan size must be a power of two");
+    int log2n = 0;
+    while ((1 << log2n) < n) log2n++;
+
+    const FftPlan* plan = plans[log2n].load(std::memory_order_acquire);
+    if (plan) return *plan;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!owned[log2n])
+	{
+        owned[log2n].reset(new FftPlan(makeFftPlan(1 << log2n)));
+        plans[log2n].store(owned[log2n].get(), std::memory_order_release);
+    }
+    return *owned[log2n];
+}
+
+// Iterative decimation-in-time butterflies on bit-reversed data. Stages are fused
+// in pairs into radix-4 passes, with one leading radix-2 pass when log2(n) is odd.
+template<bool Inverse>
+static void butterflies(const FftPlan& plan, std::complex<double>* x)
+{
+    const int n = plan.n;
+    const std::complex<double>* tw = plan.twiddle.data();
+    int q = 1; // size of the sub-transforms already combined
+
+    if (plan.log2n & 1)
+	{
+        for (int i = 0; i < n; i += 2)
+		{
+            std::complex<double> a = x[i];
+            std::complex<double> b = x[i + 1];
+            x[i] = a + b;
+            x[i + 1] = a - b;
+        }
+        q = 2;
+    }
+
+    for (; q < n; q *= 4)
+	{
+        // Radix-4 pass: two radix-2 stages of size 2q and 4q in one sweep
+        int step = n / (4*q);
+        for (int base = 0; base < n; base += 4*q)
+		{
+            for (int j = 0; j < q; j++)
+			{
+                std::complex<double> w1 = tw[j*step];      // W_4q^j
+                std::complex<double> w2 = tw[2*j*step];    // W_2q^j
+                if (Inverse)
+				{
+                    w1 = std::conj(w1);
+                    w2 = std::conj(w2);
+                }
+                std::complex<double>* p = x + base + j;
+
+                std::complex<double> t1 = cmul(w2, p[q]);
+                std::complex<double> t3 = cmul(w2, p[3*q]);
+                std::complex<double> b0 = p[0] + t1;
+                std::complex<double> b1 = p[0] - t1;
+                std::complex<double> b2 = p[2*q] + t3;
+                std::complex<double> b3 = p[2*q] - t3;
+
+                // W_4q^(j+q) = W_4q^j * (-i), or * (+i) for the inverse
+                std::complex<double> u2 = cmul(w1, b2);
+                std::complex<double> v3 = cmul(w1, b3);
+                std::complex<double> u3 = Inverse ? std::complex<double>(-v3.imag(), v3.real())
+                                                  : std::complex<double>(v3.imag(), -v3.real());
+
+                p[0]   = b0 + u2;
+                p[2*q] = b0 - u2;
+                p[q]   = b1 + u3;
+                p[3*q] = b1 - u3;
+            }
+        }
+    }
+
+    if (Inverse)
+	{
+        const double scale = 1.0 / n;
+        for (int i = 0; i < n; i++)
+            x[i] *= scale;
+    }
+}
+
+static void bitReverseInPlace(const FftPlan& plan, std::complex<double>* x)
+{
+    for (int i = 0; i < plan.n; i++)
+	{
+        int r = plan.bitrev[i];
+        if (i < r) std::swap(x[i], x[r]);
+    }
+}
+
+static void bitReverseCopy(const FftPlan& plan, const std::complex<double>* in, std::complex<double>* out)
+{
+    for (int i = 0; i < plan.n; i++)
+        out[plan.bitrev[i]] = in[i];
+}
+
+void fftInPlace(const FftPlan& plan, std::complex<double>* data)
+{
+    bitReverseInPlace(plan, data);
+    butterflies<false>(plan, data);
+}
+
+void ifftInPlace(const FftPlan& plan, std::complex<double>* data)
+{
+    bitReverseInPlace(plan, data);
+    butterflies<true>(plan, data);
+}
+
+void fft(const FftPlan& plan, const std::complex<double>* in, std::complex<double>* out)
+{
+    if (in == out)
+	{
+        fftInPlace(plan, out);
+        return;
+    }
+    bitReverseCopy(plan, in, out);
+    butterflies<false>(plan, out);
+}
+
+void ifft(const FftPlan& plan, const std::complex<double>* in, std::complex<double>* out)
+{
+    if (in == out)
+	{
+        ifftInPlace(plan, out);
+        return;
+    }
+    bitReverseCopy(plan, in, out);
+    butterflies<true>(plan, out);
+}
+
+// Direct DFT for sizes the radix-2/4 engine cannot handle
+static std::vector<std::complex<double>> dft(const std::vector<std::complex<double>>& a, int sign)
+{
+    int n = a.size();
+    std::vector<std::complex<double>> y(n);
+    for (int k = 0; k < n; k++)
+	{
+        std::complex<double> acc = 0;
+        for (int i = 0; i < n; i++)
+            acc += a[i] * std::polar(1.0, sign * 2 * M_PI * (double)((long long)k * i % n) / n);
+        y[k] = acc;
     }
     return y;
 }
 
-// Inverse FFT: computes the inverse FFT of a vector of complex<double>
-// It works by conjugating the input, computing the FFT, then conjugating the result and dividing by n.
+std::vector<std::complex<double>> fft(const std::vector<std::complex<double>>& a)
+{
+    int n = a.size();
+    if (n <= 1) return a;
+    if (!isPowerOfTwo(n)) return dft(a, -1);
+
+    std::vector<std::complex<double>> y(n);
+    fft(fftPlan(n), a.data(), y.data());
+    return y;
+}
+
+// Inverse FFT, scaled by 1/n
 std::vector<std::complex<double>> ifft(const std::vector<std::complex<double>>& A)
 {
     int n = A.size();
-    std::vector<std::complex<double>> A_conj(n);
-    for (int i = 0; i < n; i++)
+    if (n <= 1) return A;
+    if (!isPowerOfTwo(n))
 	{
-        A_conj[i] = std::conj(A[i]);
-    }
-    // Compute FFT of conjugated vector.
-    std::vector<std::complex<double>> y = fft(A_conj);
-    // Conjugate the result and divide by n.
-    for (int i = 0; i < n; i++)
-	{
-        y[i] = std::conj(y[i]) / static_cast<double>(n);
+        std::vector<std::complex<double>> y = dft(A, 1);
+        for (auto &v : y) v /= static_cast<double>(n);
+        return y;
     }
+
+    std::vector<std::complex<double>> y(n);
+    ifft(fftPlan(n), A.data(), y.data());
     return y;
 }
 
-void addAWGN(std::vector<std::complex<double>>& sig, double var)
+void timeToActiveBins(const std::complex<double>* time, int fftSize, std::complex<double>* active, int bins)
 {
-    std::default_random_engine gen;
-    std::normal_distribution<double> dist(0.0, sqrt(var));
-    for(auto &s: sig)
+    // X[k*S] = sum_m (sum_p x[m + p*bins]) * W_bins^(m*k), with S = fftSize / bins
+    for (int m = 0; m < bins; m++)
 	{
-        s += std::complex<double>(dist(gen), dist(gen));
+        std::complex<double> acc = time[m];
+        for (int i = m + bins; i < fftSize; i += bins)
+            acc += time[i];
+        active[m] = acc;
     }
+    fftInPlace(fftPlan(bins), active);
+}
+
+void activeBinsToTime(const std::complex<double>* active, int bins, std::complex<double>* time, int fftSize)
+{
+    // x[n] = (bins / fftSize) * ifft_bins(A)[n mod bins]
+    ifft(fftPlan(bins), active, time);
+    const double scale = static_cast<double>(bins) / fftSize;
+    for (int m = 0; m < bins; m++)
+        time[m] *= scale;
+    for (int i = bins; i < fftSize; i++)
+        time[i] = time[i - bins];
+}
+
+// FFT_SIZE/FREQ_BINS with its transforms specialised at compile time
+typedef Numerology<FFT_SIZE, FREQ_BINS> LegacyNumerology;
+
+#ifdef FULL_FFT_VERIFY
+static void checkPruned(const char* what, const std::vector<std::complex<double>>& full,
+                        const std::vector<std::complex<double>>& pruned)
+{
+    double err = 0;
+    for (size_t i = 0; i < full.size(); i++)
+        err = std::max(err, std::abs(full[i] - pruned[i]));
+    if (err > 1e-9)
+        std::cerr << what << ": pruned transform differs from full FFT by " << err << std::endl;
+}
+#endif
+
+void demuxActiveBins(const std::complex<double>* time, std::complex<double>* active)
+{
+    LegacyNumerology::demux(time, active);
+#ifdef FULL_FFT_VERIFY
+    auto fullFreq = fft(std::vector<std::complex<double>>(time, time + FFT_SIZE));
+    std::vector<std::complex<double>> ref(FREQ_BINS);
+    for (int i = 0; i < FREQ_BINS; i++)
+        ref[i] = fullFreq[i * FREQ_BIN_SPACING];
+    checkPruned("demuxActiveBins", ref, std::vector<std::complex<double>>(active, active + FREQ_BINS));
+    std::copy(ref.begin(), ref.end(), active);
+#endif
+}
+
+void muxActiveBins(const std::complex<double>* active, std::complex<double>* time)
+{
+    LegacyNumerology::mux(active, time);
+#ifdef FULL_FFT_VERIFY
+    std::vector<std::complex<double>> fullFreq(FFT_SIZE, {0,0});
+    for (int i = 0; i < FREQ_BINS; i++)
+        fullFreq[i * FREQ_BIN_SPACING] = active[i];
+    auto ref = ifft(fullFreq);
+    checkPruned("muxActiveBins", ref, std::vector<std::complex<double>>(time, time + FFT_SIZE));
+    std::copy(ref.begin(), ref.end(), time);
+#endif
+}
+
+std::vector<std::complex<double>> demuxActiveBins(const std::complex<double>* time)
+{
+    std::vector<std::complex<double>> active(FREQ_BINS);
+    demuxActiveBins(time, active.data());
+    return active;
+}
+
+std::vector<std::complex<double>> demuxActiveBins(const std::vector<std::complex<double>>& time)
+{
+    return demuxActiveBins(time.data());
+}
+
+std::vector<std::complex<double>> muxActiveBins(const std::vector<std::complex<double>>& active)
+{
+    std::vector<std::complex<double>> time(FFT_SIZE);
+    muxActiveBins(active.data(), time.data());
+    return time;
+}
+
+void addAWGN(std::vector<std::complex<double>>& sig, double var)
+{
+    // Each call takes the next symbol of a process-wide noise stream
+    static std::atomic<uint64_t> symbol(0);
+    NoiseKey key = { noiseSeed(), NOISE_LINK_DEFAULT, symbol.fetch_add(1, std::memory_order_relaxed) };
+    addAWGN(sig.data(), sig.size(), var, key);
 }
 
 void writeWaveform(const std::string& filename, const std::vector<std::complex<double>>& wave)
@@ -83,6 +338,8 @@ void writeWaveform(const std::string& filename, const std::vector<std::complex<d
         std::cerr<<"Error writing to "<<filename<<std::endl;
         return;
     }
+    // Enough digits to read back the exact same doubles
+    ofs.precision(17);
     for(auto &sm : wave)
 	{
         ofs<<sm.real()<<" "<<sm.imag()<<"\n";
@@ -105,6 +362,11 @@ std::vector<std::complex<double>> readWaveform(const std::string& filename)
     return wave;
 }
 
+std::string userRxFile(int userId)
+{
+    return "rxbuffer_files/user" + std::to_string(userId) + "_rx_waveform.bin";
+}
+
 // Clear file
 void clearFile(const std::string& filename)
 {
@@ -10,6 +10,7 @@
 #include <random>
 #include <utility>
 #include <cmath>
+#include "noise.h"
 
 constexpr int FFT_SIZE = 64;
 constexpr int FREQ_BINS = 8;
@@ -20,18 +21,66 @@ constexpr int CTRL_ACCESS_REQUEST = 0; // 00
 constexpr int CTRL_DATA_TX        = 1; // 01
 constexpr int CTRL_RESPONSE       = 2; // 10
 constexpr int CTRL_DEALLOCATE     = 3; // 11
+// Not on the air: a multiplexed downlink frame with no header for the user
+constexpr int CTRL_NONE           = -1;
 
 constexpr double NOISE_VARIANCE = 0.001;
-constexpr const char* BS_RX_FILE = "rxbuffer_files/bs_rx_waveform.txt";
+constexpr const char* BS_RX_FILE = "rxbuffer_files/bs_rx_waveform.bin";
+
+// Per-user downlink waveform file
+std::string userRxFile(int userId);
 
 std::complex<double> qpskModulate(int bit1, int bit2);
 std::pair<int,int> qpskDemodulate(const std::complex<double>& sym);
 
+// Bit-reversal and twiddle tables for one power-of-two FFT size, built once and shared
+struct FftPlan
+{
+    int n;
+    int log2n;
+    std::vector<int> bitrev;
+    std::vector<std::complex<double>> twiddle; // exp(-2*pi*i*k/n) for k < n/2
+};
+
+// Cached plan for size n (n must be a power of two)
+const FftPlan& fftPlan(int n);
+
+// In-place transforms over plan.n samples
+void fftInPlace(const FftPlan& plan, std::complex<double>* data);
+void ifftInPlace(const FftPlan& plan, std::complex<double>* data);
+
+// Out-of-place transforms into a caller-provided buffer (in == out is allowed)
+void fft(const FftPlan& plan, const std::complex<double>* in, std::complex<double>* out);
+void ifft(const FftPlan& plan, const std::complex<double>* in, std::complex<double>* out);
+
 std::vector<std::complex<double>> fft(const std::vector<std::complex<double>>& a);
 std::vector<std::complex<double>> ifft(const std::vector<std::complex<double>>& A);
 
+// Pruned transforms for active bins sitting on a stride of fftSize/bins.
+// RX folds the time samples down to bins samples and runs a bins-point FFT;
+// TX runs a bins-point IFFT and extends it periodically to fftSize samples.
+void timeToActiveBins(const std::complex<double>* time, int fftSize, std::complex<double>* active, int bins);
+void activeBinsToTime(const std::complex<double>* active, int bins, std::complex<double>* time, int fftSize);
+
+// FFT_SIZE time samples <-> FREQ_BINS active bins. Building with FULL_FFT_VERIFY
+// runs the full FFT_SIZE transform instead and checks it against the pruned one
+// (and allocates). The pointer forms write into caller buffers of FREQ_BINS and
+// FFT_SIZE samples and do not allocate otherwise.
+void demuxActiveBins(const std::complex<double>* time, std::complex<double>* active);
+void muxActiveBins(const std::complex<double>* active, std::complex<double>* time);
+std::vector<std::complex<double>> demuxActiveBins(const std::complex<double>* time);
+std::vector<std::complex<double>> demuxActiveBins(const std::vector<std::complex<double>>& time);
+std::vector<std::complex<double>> muxActiveBins(const std::vector<std::complex<double>>& active);
+
+// Noise stream used by addAWGN calls without a key
+constexpr uint32_t NOISE_LINK_DEFAULT = 0xFFFFFFFF;
+// Receiver noise of the base station's combined uplink symbols (see combined_uplink.h)
+constexpr uint32_t NOISE_LINK_COMBINED_UPLINK = 0xFFFFFFFE;
+
+// Complex AWGN with variance var per real dimension; every call draws fresh noise
 void addAWGN(std::vector<std::complex<double>>& sig, double var);
 
+// Text waveform format, kept for import/export (see waveform_file.h for the binary one)
 void writeWaveform(const std::string& filename, const std::vector<std::complex<double>>& wave);
 std::vector<std::complex<double>> readWaveform(const std::string& filename);
 void clearFile(const std::string& filename);
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include "trace_file.h"
+#include "signal_processing.h"
+
+TraceWriter::TraceWriter() : format(TRACE_DEFAULT_FORMAT), written(0)
+{
+}
+
+bool TraceWriter::open(const std::string& filename, SampleFormat format, int modulation, int fec)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    out.open(filename, std::ofstream::binary | std::ofstream::trunc);
+    if (!out) return false;
+    this->format = format;
+    TraceHeader hdr = TraceHeader();
+    hdr.magic = TRACE_MAGIC;
+    hdr.version = TRACE_VERSION;
+    hdr.sampleType = sampleTypeOf(format);
+    hdr.headerSize = sizeof(TraceHeader);
+    hdr.modulation = modulation < 0 ? TRACE_UNKNOWN : (uint8_t)modulation;
+    hdr.fec = fec < 0 ? TRACE_UNKNOWN : (uint8_t)fec;
+    out.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    out.flush();
+    start = std::chrono::steady_clock::now();
+    sequence.clear();
+    written = 0;
+    return (bool)out;
+}
+
+void TraceWriter::close()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (out.is_open()) out.close();
+}
+
+uint64_t TraceWriter::records() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return written;
+}
+
+bool TraceWriter::write(TraceDirection direction, int endpoint, const std::complex<double>* samples, int count)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!out.is_open() || count <= 0) return false;
+
+    TraceRecord rec = TraceRecord();
+    rec.timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    rec.endpoint = endpoint;
+    rec.direction = (uint8_t)direction;
+    rec.sequence = sequence[std::make_pair((int)direction, endpoint)]++;
+    rec.sampleCount = count;
+
+    const char* data = reinterpret_cast<const char*>(samples);
+    if (format == FORMAT_CF32)
+	{
+        f32.resize(count);
+        toCF32(samples, count, f32.data());
+        data = reinterpret_cast<const char*>(f32.data());
+    }
+    else if (format == FORMAT_CQ15)
+	{
+        // Each symbol gets its own exponent, so quiet and loud symbols keep their precision
+        q15.resize(count);
+        rec.exponent = (int8_t)blockExponent(samples, count);
+        toQ15(samples, count, rec.exponent, q15.data());
+        data = reinterpret_cast<const char*>(q15.data());
+    }
+    out.write(reinterpret_cast<const char*>(&rec), sizeof(rec));
+    out.write(data, count * sampleSize(sampleTypeOf(format)));
+    out.flush();
+    written++;
+    return (bool)out;
+}
+
+bool loadTrace(const std::string& filename, LoadedTrace& trace)
+{
+    std::ifstream in(filename, std::ifstream::binary);
+    TraceHeader hdr;
+    if (!in || !in.read(reinterpret_cast<char*>(&hdr), sizeof(hdr)) ||
+        hdr.magic != TRACE_MAGIC || hdr.version < 1 || hdr.version > TRACE_VERSION || sampleSize(hdr.sampleType) == 0 ||
+        hdr.headerSize < sizeof(hdr))
+        return false;
+    in.seekg(hdr.headerSize);
+
+    trace.sampleType = hdr.sampleType;
+    // Version 1 left these fields zero whatever the settings were
+    trace.modulation = hdr.version >= 2 && hdr.modulation != TRACE_UNKNOWN ? hdr.modulation : -1;
+    trace.fec = hdr.version >= 2 && hdr.fec != TRACE_UNKNOWN ? hdr.fec : -1;
+    trace.records.clear();
+    trace.offsets.clear();
+    trace.samples.clear();
+    std::vector<char> raw;
+    TraceRecord rec;
+    while (in.read(reinterpret_cast<char*>(&rec), sizeof(rec)))
+	{
+        if (rec.sampleCount > TRACE_MAX_RECORD_SAMPLES) return false;
+        raw.resize(rec.sampleCount * sampleSize(hdr.sampleType));
+        if (!in.read(raw.data(), raw.size())) break;
+        size_t offset = trace.samples.size();
+        trace.samples.resize(offset + rec.sampleCount);
+        std::complex<double>* out = trace.samples.data() + offset;
+        if (hdr.sampleType == SAMPLE_CF32)
+            fromCF32(reinterpret_cast<const std::complex<float>*>(raw.data()), rec.sampleCount, out);
+        else if (hdr.sampleType == SAMPLE_CQ15)
+            fromQ15(reinterpret_cast<const cq15*>(raw.data()), rec.sampleCount, rec.exponent, out);
+        else
+            std::copy(reinterpret_cast<const std::complex<double>*>(raw.data()),
+                      reinterpret_cast<const std::complex<double>*>(raw.data()) + rec.sampleCount, out);
+        trace.records.push_back(rec);
+        trace.offsets.push_back(offset);
+    }
+    return true;
+}
+
+std::unique_ptr<Transport> captureTransport(std::unique_ptr<Transport> link, const std::string& filename,
+                                            SampleFormat format, int modulation, int fec)
+{
+    std::shared_ptr<TraceWriter> trace = std::make_shared<TraceWriter>();
+    if (!trace->open(filename, format, modulation, fec))
+	{
+        std::cerr << "Cannot write trace to " << filename << std::endl;
+        return std::unique_ptr<Transport>();
+    }
+    return std::unique_ptr<Transport>(new CaptureTransport(std::move(link), trace));
+}
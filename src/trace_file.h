@@ -0,0 +1,146 @@
+#pragma once
+
+#include "transport.h"
+#include "waveform_file.h"
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Capture trace: every symbol a process sent or received, in the order it did
+// so. A header is followed by records, each followed by its samples in the
+// header's sample type. Unlike the rxbuffer_files containers nothing is ever
+// cleared, so a session can be replayed offline (see trace_replay). Version 2
+// adds the link settings to the header; version 1 traces still load.
+constexpr uint32_t TRACE_MAGIC = 0x5444464F; // "OFDT"
+constexpr uint16_t TRACE_VERSION = 2;
+
+// Header value of a link setting the capturing process did not know
+constexpr uint8_t TRACE_UNKNOWN = 0xFF;
+
+// A record larger than this is taken for corruption rather than allocated
+constexpr uint32_t TRACE_MAX_RECORD_SAMPLES = 1u << 16;
+
+// Default for --capture-format: half the size of cf64 and decodes the same
+constexpr SampleFormat TRACE_DEFAULT_FORMAT = FORMAT_CF32;
+
+enum TraceDirection
+{
+    TRACE_TX = 0,   // sent by the capturing process
+    TRACE_RX = 1    // received by it
+};
+
+struct TraceHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t sampleType;    // WaveformSampleType
+    uint32_t headerSize;    // offset of the first record
+    uint8_t modulation;     // the base station's grant Modulation, or TRACE_UNKNOWN
+    uint8_t fec;            // FecRate of message payloads, or TRACE_UNKNOWN
+    uint16_t reserved;
+};
+
+struct TraceRecord
+{
+    uint64_t timeNs;        // since the capture started
+    int32_t endpoint;       // addressee: BS_ENDPOINT or a user id
+    uint8_t direction;      // TraceDirection
+    int8_t exponent;        // block exponent of SAMPLE_CQ15 samples, else 0
+    uint16_t reserved;
+    uint32_t sequence;      // per endpoint and direction, from 0
+    uint32_t sampleCount;
+};
+
+static_assert(sizeof(TraceHeader) == 16, "trace header layout changed");
+static_assert(sizeof(TraceRecord) == 24, "trace record layout changed");
+
+// Appends records to a trace. Thread-safe, so the base station's TX workers
+// can share one; each record is flushed so a killed process loses nothing.
+class TraceWriter
+{
+public:
+    TraceWriter();
+
+    // Truncates filename; false if it cannot be created. modulation and fec go
+    // into the header, -1 for a setting this process does not know.
+    bool open(const std::string& filename, SampleFormat format, int modulation, int fec);
+    void close();
+    bool isOpen() const { return out.is_open(); }
+
+    bool write(TraceDirection direction, int endpoint, const std::complex<double>* samples, int count);
+    uint64_t records() const;
+
+private:
+    TraceWriter(const TraceWriter&);
+    TraceWriter& operator=(const TraceWriter&);
+
+    mutable std::mutex lock;
+    std::ofstream out;
+    SampleFormat format;
+    std::chrono::steady_clock::time_point start;
+    std::map<std::pair<int,int>, uint32_t> sequence;   // (direction, endpoint) -> next
+    uint64_t written;
+    std::vector<std::complex<float>> f32;
+    std::vector<cq15> q15;
+};
+
+// A whole trace in memory, samples widened to double
+struct LoadedTrace
+{
+    uint16_t sampleType;
+    int modulation;     // Modulation, or -1 if the trace does not say
+    int fec;            // FecRate, or -1 if the trace does not say
+    std::vector<TraceRecord> records;
+    std::vector<size_t> offsets;                // first sample of each record in samples
+    std::vector<std::complex<double>> samples;
+
+    const std::complex<double>* samplesOf(size_t record) const { return samples.data() + offsets[record]; }
+};
+
+// False if the file is missing, not a trace or holds a record longer than
+// TRACE_MAX_RECORD_SAMPLES; a record cut short by a crash ends the trace
+// without failing the load
+bool loadTrace(const std::string& filename, LoadedTrace& trace);
+
+// Passes every symbol through to the wrapped transport and records it. A
+// symbol sent with channel noise is recorded without it, so a replay compares
+// against what the sender meant rather than one draw of the channel.
+class CaptureTransport : public Transport
+{
+public:
+    CaptureTransport(std::unique_ptr<Transport> inner, std::shared_ptr<TraceWriter> trace)
+        : inner(std::move(inner)), trace(trace) {}
+
+    bool send(int endpoint, const std::complex<double>* samples, int count)
+    {
+        trace->write(TRACE_TX, endpoint, samples, count);
+        return inner->send(endpoint, samples, count);
+    }
+
+    bool sendNoisy(int endpoint, std::complex<double>* samples, int count, double variance, const NoiseKey& key)
+    {
+        trace->write(TRACE_TX, endpoint, samples, count);
+        return inner->sendNoisy(endpoint, samples, count, variance, key);
+    }
+
+    int receive(int endpoint, std::complex<double>* samples, int capacity, int timeoutMs)
+    {
+        int n = inner->receive(endpoint, samples, capacity, timeoutMs);
+        if (n > 0) trace->write(TRACE_RX, endpoint, samples, n);
+        return n;
+    }
+
+private:
+    std::unique_ptr<Transport> inner;
+    std::shared_ptr<TraceWriter> trace;
+};
+
+// Wraps link in a CaptureTransport writing to filename, with the link settings
+// as TraceWriter::open takes them; on failure reports it and returns nullptr
+std::unique_ptr<Transport> captureTransport(std::unique_ptr<Transport> link, const std::string& filename,
+                                            SampleFormat format, int modulation, int fec);
@@ -0,0 +1,260 @@
+#define _USE_MATH_DEFINES
+#include "signal_processing.h"
+#include "base_station_core.h"
+#include "trace_file.h"
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <thread>
+
+using namespace std;
+
+// Offline replay of a capture trace through the base station's decode path.
+// Every symbol addressed to the base station (received in a base_station
+// capture, sent in a user capture) is demultiplexed and handed to a fresh
+// BaseStation, as fast as possible or at the recorded pace. The downlinks it
+// produces are hashed and checked, per user and in order, against the ones in
+// the trace (sent in a base_station capture, which records them before the
+// channel noise, or received in a user capture). The grant modulation and the
+// payload code come from the trace header unless given on the command line. A
+// capture made with --scheduler or --dl-mux depends on TTI timing and does not
+// replay exactly; first-come-first-served grants do. A --ul-combine capture
+// holds each user's symbol rather than the TTI sums and does not replay.
+
+static bool optionValue(const std::string& arg, const char* name, std::string& value)
+{
+    size_t len = strlen(name);
+    if (arg.compare(0, len, name) != 0) return false;
+    value = arg.substr(len);
+    return true;
+}
+
+// FNV-1a over the fields each control code puts on the air
+static uint64_t hashMessage(uint64_t h, const ControlMessage& m)
+{
+    const int fields[] = { m.ctrl, m.userId, m.srcId, m.count, m.start, m.seq, m.payload, (int)m.modulation };
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++)
+	{
+        uint32_t v = (uint32_t)fields[f];
+        for (int b = 0; b < 4; b++)
+		{
+            h ^= (v >> (8 * b)) & 0xFF;
+            h *= 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+static bool sameMessage(const ControlMessage& a, const ControlMessage& b)
+{
+    if (a.ctrl != b.ctrl || a.userId != b.userId) return false;
+    if (a.ctrl == CTRL_RESPONSE)
+        return a.count == b.count && (a.count == 0 || (a.start == b.start && a.modulation == b.modulation));
+    if (a.ctrl == CTRL_DATA_TX)
+        return a.srcId == b.srcId && a.seq == b.seq && a.payload == b.payload;
+    return true;
+}
+
+// A downlink a user captured carries the channel noise, which now and then
+// flips a decision. It still counts as the replayed message if every bin is
+// within 3/4 of its constellation's minimum distance of where that message puts it.
+static bool withinNoise(const FrameLayout& layout, const ControlMessage& msg, const complex<double>* captured)
+{
+    vector<complex<double>> ref(layout.bins);
+    encodeControl(layout, msg, ref.data());
+    for (int b = 0; b < layout.bins; b++)
+	{
+        bool payload = msg.ctrl == CTRL_DATA_TX && b >= msg.start && b < msg.start + msg.count;
+        int points = 1 << modulationBits(payload ? msg.modulation : MOD_QPSK);
+        double dmin = sqrt(6.0 / (points - 1));
+        if (abs(captured[b] - ref[b]) >= 0.75 * dmin) return false;
+    }
+    return true;
+}
+
+static void printMessage(ostream& out, const ControlMessage& m)
+{
+    out << "ctrl " << m.ctrl << " user " << m.userId;
+    if (m.ctrl == CTRL_RESPONSE) out << " count " << m.count << " start " << m.start << " " << modulationName(m.modulation);
+    if (m.ctrl == CTRL_DATA_TX) out << " src " << m.srcId << " seq " << m.seq << " payload " << m.payload;
+}
+
+struct ReplayRun
+{
+    double seconds;
+    uint64_t downlinks;
+    uint64_t digest;
+};
+
+// One pass over the uplink records with a fresh base station; the downlinks go
+// to produced if it is not null
+static ReplayRun replay(const FrameLayout& layout, Modulation modulation, FecRate fec, const LoadedTrace& trace,
+                        const vector<size_t>& uplinks, bool recordedPace, vector<Downlink>* produced)
+{
+    BaseStation bs(layout);
+    bs.setModulation(modulation);
+    bs.setFec(fec);
+    vector<complex<double>> active(layout.bins);
+    vector<Downlink> out;
+    ReplayRun run = { 0, 0, 14695981039346656037ULL };
+
+    auto t0 = chrono::steady_clock::now();
+    uint64_t firstNs = uplinks.empty() ? 0 : trace.records[uplinks[0]].timeNs;
+    for (size_t i = 0; i < uplinks.size(); i++)
+	{
+        if (recordedPace)
+            this_thread::sleep_until(t0 + chrono::nanoseconds(trace.records[uplinks[i]].timeNs - firstNs));
+        timeToActiveBins(trace.samplesOf(uplinks[i]), layout.fftSize, active.data(), layout.bins);
+        out.clear();
+        bs.handleUplink(active.data(), out);
+        for (size_t d = 0; d < out.size(); d++)
+            run.digest = hashMessage(run.digest, out[d].msg);
+        run.downlinks += out.size();
+        if (produced) produced->insert(produced->end(), out.begin(), out.end());
+    }
+    run.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    return run;
+}
+
+int main(int argc, char* argv[])
+{
+    string traceFile;
+    bool recordedPace = false;
+    int repeat = 1;
+    Modulation modulation = MOD_QPSK;
+    FecRate fec = FEC_NONE;
+    bool modulationGiven = false, fecGiven = false;
+    string expectDigest;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++)
+	{
+        string arg = argv[i], value;
+        bool ok = true;
+        if (arg == "--pace=max") recordedPace = false;
+        else if (arg == "--pace=recorded") recordedPace = true;
+        else if (optionValue(arg, "--repeat=", value)) ok = (repeat = atoi(value.c_str())) > 0;
+        else if (optionValue(arg, "--modulation=", value)) ok = modulationGiven = parseModulation(value, modulation);
+        else if (optionValue(arg, "--fec=", value)) ok = fecGiven = parseFecRate(value, fec);
+        else if (optionValue(arg, "--expect-digest=", value)) expectDigest = value;
+        else if (arg == "--verbose") verbose = true;
+        else if (arg.compare(0, 2, "--") != 0 && traceFile.empty()) traceFile = arg;
+        else ok = false;
+        if (!ok)
+		{
+            traceFile.clear();
+            break;
+        }
+    }
+    if (traceFile.empty())
+	{
+        cerr << "Usage: trace_replay <trace.bin> [--pace=max|recorded] [--repeat=N] [--modulation=qpsk|16qam|64qam|256qam]\n"
+             << "                    [--fec=none|1/2|2/3|3/4|5/6] [--expect-digest=HEX] [--verbose]" << endl;
+        return 1;
+    }
+
+    LoadedTrace trace;
+    if (!loadTrace(traceFile, trace))
+	{
+        cerr << traceFile << " is not a trace file" << endl;
+        return 1;
+    }
+    if (!modulationGiven && trace.modulation >= 0) modulation = (Modulation)trace.modulation;
+    if (!fecGiven && trace.fec >= 0) fec = (FecRate)trace.fec;
+    FrameLayout layout = legacyLayout();
+
+    // Uplinks in capture order; the downlinks each user was sent, in order
+    vector<size_t> uplinks;
+    map<int, deque<size_t>> expected;
+    for (size_t i = 0; i < trace.records.size(); i++)
+	{
+        const TraceRecord& rec = trace.records[i];
+        if ((int)rec.sampleCount != layout.fftSize)
+		{
+            cerr << "Record " << i << " has " << rec.sampleCount << " samples, not " << layout.fftSize << endl;
+            return 1;
+        }
+        if (rec.endpoint == BS_ENDPOINT)
+            uplinks.push_back(i);
+        else
+            expected[rec.endpoint].push_back(i);
+    }
+    double span = trace.records.empty() ? 0 : trace.records.back().timeNs * 1e-9;
+    cout << "Trace " << traceFile << ": " << sampleTypeName(trace.sampleType) << ", " << trace.records.size()
+         << " symbols (" << uplinks.size() << " uplink, " << trace.records.size() - uplinks.size()
+         << " downlink) over " << span << " s; replaying with " << modulationName(modulation) << " grants, FEC "
+         << fecRateName(fec) << endl;
+
+    // First pass checks the downlinks; the rest only time the decode path
+    vector<Downlink> produced;
+    ReplayRun first = replay(layout, modulation, fec, trace, uplinks, recordedPace, &produced);
+    double best = first.seconds;
+    for (int r = 1; r < repeat; r++)
+        best = min(best, replay(layout, modulation, fec, trace, uplinks, recordedPace, nullptr).seconds);
+    cout << "Replayed " << uplinks.size() << " uplink symbols at " << (recordedPace ? "recorded" : "max") << " pace in "
+         << best << " s => " << (best > 0 ? uplinks.size() / best : 0) << " symbols/s"
+         << (repeat > 1 ? " (best of " + to_string(repeat) + ")" : "") << endl;
+
+    long long matched = 0, noisy = 0, mismatched = 0, extra = 0, unchecked = 0, missing = 0;
+    vector<complex<double>> active(layout.bins);
+    for (size_t i = 0; i < produced.size(); i++)
+	{
+        const ControlMessage& got = produced[i].msg;
+        map<int, deque<size_t>>::iterator it = expected.find(produced[i].userId);
+        if (it == expected.end())
+		{
+            unchecked++;     // the trace saw nothing sent to this user
+            continue;
+        }
+        if (it->second.empty())
+		{
+            extra++;
+            if (verbose) { cout << "Extra downlink: "; printMessage(cout, got); cout << "\n"; }
+            continue;
+        }
+        size_t rec = it->second.front();
+        it->second.pop_front();
+        timeToActiveBins(trace.samplesOf(rec), layout.fftSize, active.data(), layout.bins);
+        ControlMessage want = decodeControl(layout, active.data());
+        if (want.ctrl == CTRL_DATA_TX && got.ctrl == CTRL_DATA_TX)
+            want.payload = decodePayload(active.data(), got.start, got.count, got.modulation);
+        if (sameMessage(got, want))
+		{
+            matched++;
+            continue;
+        }
+        if (withinNoise(layout, got, active.data()))
+		{
+            matched++;
+            noisy++;
+            continue;
+        }
+        mismatched++;
+        if (verbose)
+		{
+            cout << "Mismatch at record " << rec << ": replayed ";
+            printMessage(cout, got);
+            cout << ", captured ";
+            printMessage(cout, want);
+            cout << "\n";
+        }
+    }
+    for (map<int, deque<size_t>>::iterator it = expected.begin(); it != expected.end(); ++it)
+        missing += it->second.size();
+
+    ostringstream digest;
+    digest << hex << setw(16) << setfill('0') << first.digest;
+    cout << "Downlinks: " << first.downlinks << " replayed, digest " << digest.str() << "; against the trace "
+         << matched << " matched (" << noisy << " only within the channel noise), " << mismatched << " mismatched, " << extra << " extra, " << missing
+         << " missing, " << unchecked << " to users the trace has no downlinks for" << endl;
+
+    bool ok = mismatched == 0 && extra == 0 && missing == 0;
+    if (!expectDigest.empty() && expectDigest != digest.str())
+	{
+        cout << "Digest differs from the expected " << expectDigest << endl;
+        ok = false;
+    }
+    cout << (ok ? "MATCH" : "MISMATCH") << endl;
+    return ok ? 0 : 1;
+}
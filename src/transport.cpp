@@ -0,0 +1,486 @@
+#include "transport.h"
+#include "signal_processing.h"
+#include "waveform_file.h"
+#include "bounded_queue.h"
+#include "instrument.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <new>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "shared-memory rings need address-free lock-free atomics");
+
+// ---------------------------------------------------------------------------
+// File transport: one binary container per endpoint, appended by writers and
+// drained (then truncated) by the reader
+
+namespace
+{
+
+constexpr int FILE_POLL_MS = 10;
+
+class FileTransport : public Transport
+{
+public:
+    explicit FileTransport(int maxSamples) : maxSamples(maxSamples), txSequence(0) {}
+
+    bool send(int endpoint, const std::complex<double>* samples, int count)
+    {
+        return appendWaveformFile(fileFor(endpoint), samples, count, txSequence++);
+    }
+
+    int receive(int endpoint, std::complex<double>* samples, int capacity, int timeoutMs)
+    {
+        std::deque<std::vector<std::complex<double>>>& queue = pending[endpoint];
+        int waited = 0;
+        while (queue.empty())
+		{
+            drain(endpoint, queue);
+            if (!queue.empty()) break;
+            if (waited >= timeoutMs) return 0;
+            Sleep(FILE_POLL_MS);
+            waited += FILE_POLL_MS;
+        }
+        int n = std::min<int>(capacity, queue.front().size());
+        std::copy(queue.front().begin(), queue.front().begin() + n, samples);
+        queue.pop_front();
+        return n;
+    }
+
+private:
+    static std::string fileFor(int endpoint)
+    {
+        return endpoint == BS_ENDPOINT ? std::string(BS_RX_FILE) : userRxFile(endpoint);
+    }
+
+    // Moves every symbol in the endpoint's file into the local queue and clears the file
+    void drain(int endpoint, std::deque<std::vector<std::complex<double>>>& queue)
+    {
+        size_t perSymbol = 0;
+        // Any sample type is accepted and widened to double
+        if (!drainWaveformData(fileFor(endpoint), drained, perSymbol) || perSymbol == 0) return;
+        if (perSymbol > (size_t)maxSamples) return;
+        for (size_t first = 0; first + perSymbol <= drained.size(); first += perSymbol)
+            queue.push_back(std::vector<std::complex<double>>(drained.begin() + first, drained.begin() + first + perSymbol));
+    }
+
+    int maxSamples;
+    std::atomic<uint64_t> txSequence;     // shared by the base station's TX workers
+    std::map<int, std::deque<std::vector<std::complex<double>>>> pending;
+    std::vector<std::complex<double>> drained;
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// Shared-memory transport: one bounded MPSC ring per endpoint (ring 0 for the
+// base station, ring 1 + id for each user). Producers and consumers run the
+// ring protocol of bounded_queue.h on slots in the mapped region. Consumers sleep
+// on a per-ring wake counter instead of polling.
+
+namespace
+{
+
+constexpr uint32_t SHM_MAGIC = 0x4F46524E;  // "OFRN"
+constexpr uint32_t SHM_VERSION = 1;
+constexpr uint32_t SHM_SLOTS = SHM_RING_SLOTS;  // per ring, power of two
+constexpr int SHM_ATTACH_TIMEOUT_MS = 10000;
+constexpr int SHM_SEND_RETRY_MS = 100;
+constexpr const char* SHM_NAME = "ofdma_transport";   // OFDMA_SHM_NAME overrides it
+
+// Separate names let a second session (or a test) run beside the default one
+std::string shmName()
+{
+    const char* env = std::getenv("OFDMA_SHM_NAME");
+    return env && *env ? env : SHM_NAME;
+}
+
+struct ShmRegion
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t rings;
+    uint32_t slots;
+    uint32_t slotSamples;
+    uint32_t slotStride;    // bytes per slot
+    std::atomic<uint32_t> ready;
+};
+
+struct ShmRing
+{
+    alignas(64) std::atomic<uint64_t> enqueuePos;
+    alignas(64) std::atomic<uint64_t> dequeuePos;
+    alignas(64) std::atomic<uint32_t> wakeSeq;  // bumped after every enqueue, futex word
+    std::atomic<uint32_t> waiters;
+};
+
+struct ShmSlot
+{
+    std::atomic<uint64_t> sequence;
+    uint32_t sampleCount;
+    uint32_t reserved;
+    // followed by slotSamples complex<double>
+};
+
+constexpr size_t SHM_REGION_BYTES = 64;
+
+size_t roundUp(size_t n, size_t align)
+{
+    return (n + align - 1) / align * align;
+}
+
+class ShmTransport : public Transport
+{
+public:
+    ShmTransport() : region(nullptr), length(0), slotStride(0)
+    {
+#ifdef _WIN32
+        mapping = NULL;
+#endif
+    }
+
+    ~ShmTransport()
+    {
+#ifdef _WIN32
+        for (size_t i = 0; i < events.size(); i++)
+            CloseHandle(events[i]);
+        if (region) UnmapViewOfFile(region);
+        if (mapping) CloseHandle(mapping);
+#else
+        if (region) munmap(region, length);
+#endif
+    }
+
+    bool init(int maxSamples, bool owner)
+    {
+        uint32_t ringCount = 1 + SHM_MAX_USERS;
+        slotStride = roundUp(sizeof(ShmSlot) + maxSamples * sizeof(std::complex<double>), 64);
+        length = SHM_REGION_BYTES + ringCount * sizeof(ShmRing) + (size_t)ringCount * SHM_SLOTS * slotStride;
+
+        if (!(owner ? create() : attach())) return false;
+
+        if (owner)
+		{
+            for (uint32_t r = 0; r < ringCount; r++)
+			{
+                ShmRing* ring = new (ringAt(r)) ShmRing;
+                ring->enqueuePos.store(0, std::memory_order_relaxed);
+                ring->dequeuePos.store(0, std::memory_order_relaxed);
+                ring->wakeSeq.store(0, std::memory_order_relaxed);
+                ring->waiters.store(0, std::memory_order_relaxed);
+            }
+            region->magic = SHM_MAGIC;
+            region->version = SHM_VERSION;
+            region->rings = ringCount;
+            region->slots = SHM_SLOTS;
+            region->slotSamples = maxSamples;
+            region->slotStride = slotStride;
+            for (uint32_t r = 0; r < ringCount; r++)
+			{
+                for (uint32_t s = 0; s < SHM_SLOTS; s++)
+				{
+                    ShmSlot* slot = new (slotAt(r, s)) ShmSlot;
+                    slot->sequence.store(s, std::memory_order_relaxed);
+                }
+            }
+            region->ready.store(1, std::memory_order_release);
+        }
+        else
+		{
+            int waited = 0;
+            while (region->ready.load(std::memory_order_acquire) != 1)
+			{
+                if (waited >= SHM_ATTACH_TIMEOUT_MS) return false;
+                Sleep(10);
+                waited += 10;
+            }
+            if (region->magic != SHM_MAGIC || region->version != SHM_VERSION ||
+                region->slotSamples != (uint32_t)maxSamples || region->slotStride != slotStride ||
+                region->rings != ringCount)
+			{
+                std::cerr << "Shared-memory transport layout does not match this build" << std::endl;
+                return false;
+            }
+        }
+        return openEvents();
+    }
+
+    bool send(int endpoint, const std::complex<double>* samples, int count)
+    {
+        int r = ringIndex(endpoint);
+        if (r < 0 || count > (int)region->slotSamples) return false;
+        ShmRing* ring = ringAt(r);
+
+        for (int waited = 0; ; waited++)
+		{
+            if (enqueue(r, ring, samples, count))
+			{
+                // seq_cst pairs with the waiter registration in receive()
+                ring->wakeSeq.fetch_add(1);
+                if (ring->waiters.load() > 0)
+                    wake(r, ring);
+                return true;
+            }
+            // Ring full: give the consumer a moment before reporting a drop
+            if (waited >= SHM_SEND_RETRY_MS) return false;
+            Sleep(1);
+        }
+    }
+
+    int receive(int endpoint, std::complex<double>* samples, int capacity, int timeoutMs)
+    {
+        int r = ringIndex(endpoint);
+        if (r < 0) return 0;
+        ShmRing* ring = ringAt(r);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+        while (true)
+		{
+            int n = dequeue(r, ring, samples, capacity);
+            if (n >= 0) return n;
+
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0) return 0;
+
+            // Register as a waiter, then re-check so an enqueue between the first
+            // attempt and the wait cannot be missed
+            ring->waiters.fetch_add(1);
+            uint32_t seen = ring->wakeSeq.load();
+            n = dequeue(r, ring, samples, capacity);
+            if (n < 0) wait(r, ring, seen, static_cast<int>(left.count()));
+            ring->waiters.fetch_sub(1, std::memory_order_acq_rel);
+            if (n >= 0) return n;
+        }
+    }
+
+private:
+    int ringIndex(int endpoint) const
+    {
+        if (endpoint == BS_ENDPOINT) return 0;
+        if (endpoint < 0 || endpoint >= SHM_MAX_USERS) return -1;
+        return 1 + endpoint;
+    }
+
+    ShmRing* ringAt(uint32_t r) const
+    {
+        return reinterpret_cast<ShmRing*>(reinterpret_cast<char*>(region) + SHM_REGION_BYTES) + r;
+    }
+
+    ShmSlot* slotAt(uint32_t r, uint64_t s) const
+    {
+        char* first = reinterpret_cast<char*>(region) + SHM_REGION_BYTES + (1 + SHM_MAX_USERS) * sizeof(ShmRing);
+        return reinterpret_cast<ShmSlot*>(first + ((size_t)r * SHM_SLOTS + (s & (SHM_SLOTS - 1))) * slotStride);
+    }
+
+    static std::complex<double>* slotSamples(ShmSlot* slot)
+    {
+        return reinterpret_cast<std::complex<double>*>(slot + 1);
+    }
+
+    bool enqueue(int r, ShmRing* ring, const std::complex<double>* samples, int count)
+    {
+        return ringEnqueue(ring->enqueuePos,
+                           [this, r](uint64_t pos) -> std::atomic<uint64_t>& { return slotAt(r, pos)->sequence; },
+                           [this, r, samples, count](uint64_t pos)
+		{
+            ShmSlot* slot = slotAt(r, pos);
+            std::memcpy(slotSamples(slot), samples, count * sizeof(std::complex<double>));
+            slot->sampleCount = count;
+        });
+    }
+
+    // Samples copied, or -1 if the ring is empty
+    int dequeue(int r, ShmRing* ring, std::complex<double>* samples, int capacity)
+    {
+        int n = -1;
+        ringDequeue(ring->dequeuePos, (uint64_t)SHM_SLOTS,
+                    [this, r](uint64_t pos) -> std::atomic<uint64_t>& { return slotAt(r, pos)->sequence; },
+                    [this, r, samples, capacity, &n](uint64_t pos)
+		{
+            ShmSlot* slot = slotAt(r, pos);
+            n = std::min<int>(capacity, slot->sampleCount);
+            std::memcpy(samples, slotSamples(slot), n * sizeof(std::complex<double>));
+        });
+        return n;
+    }
+
+#ifdef _WIN32
+    bool create()
+    {
+        mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                     (DWORD)((uint64_t)length >> 32), (DWORD)length, mappingName().c_str());
+        if (!mapping) return false;
+        region = static_cast<ShmRegion*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, length));
+        if (!region) return false;
+        region->ready.store(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool attach()
+    {
+        for (int waited = 0; !mapping; waited += 10)
+		{
+            mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, mappingName().c_str());
+            if (mapping) break;
+            if (waited >= SHM_ATTACH_TIMEOUT_MS) return false;
+            Sleep(10);
+        }
+        region = static_cast<ShmRegion*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, length));
+        return region != nullptr;
+    }
+
+    static std::string mappingName()
+    {
+        return std::string("Local\\") + shmName();
+    }
+
+    bool openEvents()
+    {
+        for (uint32_t r = 0; r < region->rings; r++)
+		{
+            std::string name = mappingName() + "_ring" + std::to_string(r);
+            HANDLE ev = CreateEventA(NULL, FALSE, FALSE, name.c_str());
+            if (!ev) return false;
+            events.push_back(ev);
+        }
+        return true;
+    }
+
+    void wait(int r, ShmRing* ring, uint32_t seen, int timeoutMs)
+    {
+        if (ring->wakeSeq.load(std::memory_order_acquire) == seen)
+            WaitForSingleObject(events[r], timeoutMs);
+    }
+
+    void wake(int r, ShmRing*)
+    {
+        SetEvent(events[r]);
+    }
+
+    HANDLE mapping;
+    std::vector<HANDLE> events;
+#else
+    bool create()
+    {
+        std::string name = "/" + shmName();
+        shm_unlink(name.c_str());   // start from empty rings
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) return false;
+        bool ok = ftruncate(fd, length) == 0 && map(fd);
+        ::close(fd);
+        return ok;
+    }
+
+    bool attach()
+    {
+        std::string name = "/" + shmName();
+        for (int waited = 0; ; waited += 10)
+		{
+            int fd = shm_open(name.c_str(), O_RDWR, 0600);
+            if (fd >= 0)
+			{
+                struct stat st;
+                bool sized = fstat(fd, &st) == 0 && (size_t)st.st_size >= length;
+                bool ok = sized && map(fd);
+                ::close(fd);
+                if (ok) return true;
+            }
+            if (waited >= SHM_ATTACH_TIMEOUT_MS) return false;
+            Sleep(10);
+        }
+    }
+
+    bool map(int fd)
+    {
+        void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) return false;
+        region = static_cast<ShmRegion*>(p);
+        return true;
+    }
+
+    bool openEvents()
+    {
+        return true;
+    }
+
+#ifdef __linux__
+    // Shared (non-private) futex on the ring's wake counter works across processes
+    void wait(int, ShmRing* ring, uint32_t seen, int timeoutMs)
+    {
+        struct timespec ts;
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&ring->wakeSeq), FUTEX_WAIT, seen, &ts, nullptr, 0);
+    }
+
+    void wake(int, ShmRing* ring)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&ring->wakeSeq), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+#else
+    void wait(int, ShmRing* ring, uint32_t seen, int)
+    {
+        if (ring->wakeSeq.load(std::memory_order_acquire) == seen) Sleep(1);
+    }
+
+    void wake(int, ShmRing*)
+    {
+    }
+#endif
+#endif
+
+    ShmRegion* region;
+    size_t length;
+    size_t slotStride;
+};
+
+}
+
+bool Transport::sendNoisy(int endpoint, std::complex<double>* samples, int count, double variance, const NoiseKey& key)
+{
+    INSTRUMENT_START(t0);
+    addAWGN(samples, count, variance, key);
+    INSTRUMENT_LAP(STAGE_NOISE, t0);
+    bool ok = send(endpoint, samples, count);
+    INSTRUMENT_STOP(STAGE_TX_IO, t0);
+    return ok;
+}
+
+std::unique_ptr<Transport> createTransport(TransportKind kind, int maxSamples, bool owner)
+{
+    if (kind == TRANSPORT_FILE)
+        return std::unique_ptr<Transport>(new FileTransport(maxSamples));
+
+    std::unique_ptr<ShmTransport> shm(new ShmTransport());
+    if (!shm->init(maxSamples, owner))
+	{
+        std::cerr << (owner ? "Could not create" : "Could not attach to")
+                  << " the shared-memory transport" << std::endl;
+        return std::unique_ptr<Transport>();
+    }
+    return std::unique_ptr<Transport>(shm.release());
+}
+
+bool parseTransportKind(const std::string& name, TransportKind& kind)
+{
+    if (name == "file") kind = TRANSPORT_FILE;
+    else if (name == "shm") kind = TRANSPORT_SHM;
+    else return false;
+    return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "noise.h"
+#include <string>
+#include <complex>
+#include <memory>
+
+// Endpoint ids: the base station, or a user id >= 0
+constexpr int BS_ENDPOINT = -1;
+
+// Highest user id + 1 the shared-memory transport has rings for
+constexpr int SHM_MAX_USERS = 64;
+// Symbols each shared-memory ring holds; a send to a full ring retries for a
+// while, then fails
+constexpr int SHM_RING_SLOTS = 64;
+
+enum TransportKind
+{
+    TRANSPORT_FILE,     // rxbuffer_files/*.bin, polled
+    TRANSPORT_SHM       // lock-free rings in shared memory with blocking wakeups
+};
+
+// Moves whole OFDM symbols between the base station and users
+class Transport
+{
+public:
+    virtual ~Transport() {}
+
+    // Queue one symbol for `endpoint`; false if it could not be delivered
+    virtual bool send(int endpoint, const std::complex<double>* samples, int count) = 0;
+
+    // Take the next symbol addressed to `endpoint`, waiting up to timeoutMs for one.
+    // Returns the number of samples copied into `samples`, or 0 if none arrived.
+    virtual int receive(int endpoint, std::complex<double>* samples, int capacity, int timeoutMs) = 0;
+
+    // Adds the channel's AWGN to samples in place, then sends them. A capture
+    // records the symbol as it was before the noise.
+    virtual bool sendNoisy(int endpoint, std::complex<double>* samples, int count, double variance, const NoiseKey& key);
+};
+
+// maxSamples bounds the symbol size. The owner (the base station) creates the
+// shared-memory region; other processes wait for it to appear and attach.
+// Returns nullptr if the transport could not be set up.
+std::unique_ptr<Transport> createTransport(TransportKind kind, int maxSamples, bool owner);
+
+// Parses "file" or "shm"
+bool parseTransportKind(const std::string& name, TransportKind& kind);
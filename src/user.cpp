@@ -1,102 +1,213 @@
 #define _USE_MATH_DEFINES
 #include "signal_processing.h"
+#include "transport.h"
+#include "user_core.h"
+#include "user_link.h"
+#include "downlink_frame.h"
+#include "instrument.h"
+#include "trace_file.h"
+#include "load_generator.h"
+#include <algorithm>
+#include <cstdio>
 #include <queue>
 
 using namespace std;
 
-static int allocCount = 0;
-static int allocStart = -1;
+// A multiplexed downlink sends a relay's frames one by one as they are packed,
+// so after each symbol the user keeps listening this long for the next
+constexpr int MUX_FOLLOW_MS = 50;
 
 int main(int argc, char* argv[])
 {
+    TransportKind transportKind = TRANSPORT_SHM;
+    string instrumentFile;
+    string captureFile;
+    SampleFormat captureFormat = TRACE_DEFAULT_FORMAT;
+    bool multiplexed = false;
+    bool combined = false;
+    int ttiUs = 1000;
+    FecRate fec = FEC_NONE;
+    bool load = false;
+    LoadProfile profile = defaultLoadProfile();
+    for(int i=2; i<argc; i++)
+	{
+        string arg=argv[i];
+        if(arg.compare(0, 12, "--transport=")==0 && parseTransportKind(arg.substr(12), transportKind))
+            continue;
+        if(arg.compare(0, 13, "--instrument=")==0 && arg.size()>13)
+		{
+            instrumentFile=arg.substr(13);
+            continue;
+        }
+        if(arg.compare(0, 10, "--capture=")==0 && arg.size()>10)
+		{
+            captureFile=arg.substr(10);
+            continue;
+        }
+        if(arg=="--dl-mux")
+		{
+            multiplexed=true;
+            continue;
+        }
+        if(arg=="--ul-combine")
+		{
+            combined=true;
+            continue;
+        }
+        if(arg.compare(0, 9, "--tti-us=")==0 && (ttiUs=atoi(arg.c_str()+9))>0)
+            continue;
+        if(arg.compare(0, 17, "--capture-format=")==0 && parseSampleFormat(arg.substr(17), captureFormat))
+            continue;
+        if(arg.compare(0, 6, "--fec=")==0 && parseFecRate(arg.substr(6), fec))
+            continue;
+        // Load generator
+        if(arg=="--load")
+		{
+            load=true;
+            continue;
+        }
+        if(arg.compare(0, 10, "--arrival=")==0 && parseLoadArrival(arg.substr(10), profile.arrival))
+            continue;
+        if(arg.compare(0, 7, "--rate=")==0 && (profile.rate=atof(arg.c_str()+7))>0)
+            continue;
+        if(arg.compare(0, 8, "--burst=")==0 && (profile.burstMean=atoi(arg.c_str()+8))>0)
+            continue;
+        if(arg.compare(0, 8, "--bytes=")==0 && sscanf(arg.c_str()+8, "%d-%d", &profile.minBytes, &profile.maxBytes)==2
+           && profile.minBytes>=4 && profile.maxBytes>=profile.minBytes && profile.maxBytes<=(int)SEGMENT_MAX_MESSAGE)
+            continue;
+        if(arg=="--dest=others" || arg=="--dest=any")
+		{
+            profile.dest = arg=="--dest=any" ? LOAD_DEST_ANY : LOAD_DEST_OTHERS;
+            continue;
+        }
+        if(arg.compare(0, 7, "--dest=")==0 && (profile.dest=atoi(arg.c_str()+7))>=0 && profile.dest<=3)
+            continue;
+        if(arg.compare(0, 7, "--bins=")==0 && (profile.bins=atoi(arg.c_str()+7))>0)
+            continue;
+        if(arg.compare(0, 10, "--session=")==0 && (profile.sessionMean=atof(arg.c_str()+10))>=0)
+            continue;
+        if(arg.compare(0, 7, "--idle=")==0 && (profile.idleMean=atof(arg.c_str()+7))>0)
+            continue;
+        if(arg.compare(0, 11, "--duration=")==0 && (profile.duration=atof(arg.c_str()+11))>0)
+            continue;
+        if(arg.compare(0, 7, "--seed=")==0)
+		{
+            profile.seed=strtoull(arg.c_str()+7, nullptr, 10);
+            continue;
+        }
+        argc=0;
+    }
     if(argc<2)
 	{
-        cerr<<"Usage: user <user_id>"<<endl;
+        cerr<<"Usage: user <user_id> [--transport=shm|file] [--instrument=FILE] [--capture=FILE] [--capture-format=cf64|cf32|cq15] [--dl-mux]\n"
+            <<"            [--ul-combine] [--tti-us=N] [--fec=none|1/2|2/3|3/4|5/6]\n"
+            <<"       user <user_id>[,<user_id>...]|all --load [--arrival=poisson|bursty] [--rate=MSGS_PER_S] [--burst=N] [--bytes=MIN-MAX]\n"
+            <<"            [--dest=others|any|ID] [--bins=N] [--session=SECONDS] [--idle=SECONDS] [--duration=SECONDS] [--seed=N] [...]"<<endl;
         return 1;
     }
-    int userId=atoi(argv[1]);
-    if(userId<0 || userId>3)
+    if(!instrumentFile.empty() && !startInstrumentReporter(instrumentFile, 1))
+	{
+        cerr<<(INSTRUMENT_ENABLED ? "Cannot write instrumentation to "+instrumentFile
+                                  : string("Built without instrumentation; rebuild with make build INSTRUMENT=1"))<<endl;
+        return 1;
+    }
+    // The legacy frame has 2-bit user ids, so a load generator drives up to all four
+    vector<int> userIds;
+    string ids=argv[1];
+    if(load && ids=="all")
+        ids="0,1,2,3";
+    for(size_t pos=0; pos<=ids.size(); )
+	{
+        size_t comma=ids.find(',', pos);
+        if(comma==string::npos) comma=ids.size();
+        int id=atoi(ids.substr(pos, comma-pos).c_str());
+        if(comma==pos || id<0 || id>3 || find(userIds.begin(), userIds.end(), id)!=userIds.end() || (!load && !userIds.empty()))
+		{
+            cerr<<"User id must be 0-3"<<(load ? ", each at most once" : "")<<endl;
+            return 1;
+        }
+        userIds.push_back(id);
+        pos=comma+1;
+    }
+    int userId=userIds[0];
+    if(multiplexed && !frameCanMultiplex(legacyLayout()))
 	{
-        cerr<<"User id must be 0-3"<<endl;
+        cerr<<"--dl-mux needs frames with room for two messages; the "<<FFT_SIZE<<"/"<<FREQ_BINS<<" layout has one per symbol"<<endl;
         return 1;
     }
-    string rxFile="rxbuffer_files/user"+to_string(userId)+"_rx_waveform.txt";
+    unique_ptr<Transport> link=createTransport(transportKind, FFT_SIZE, false);
+    if(link && !captureFile.empty()) link=captureTransport(std::move(link), captureFile, captureFormat, -1, fec);
+    if(!link) return 1;
+    if(load)
+	{
+        profile.multiplexed=multiplexed;
+        profile.combined=combined;
+        profile.ttiUs=ttiUs;
+        profile.fec=fec;
+        cout<<"Load generator started for "<<userIds.size()<<" users"<<endl;
+        return runLoadGenerator(*link, userIds, profile, cout);
+    }
     cout<<"User simulation started. user id="<<userId<<"\n";
+    UserTerminal terminal(legacyLayout(), userId);
+    terminal.setDownlinkMux(multiplexed);
+    terminal.setUplinkCombine(combined);
+    terminal.setFec(fec);
+    int combineTtiUs = combined ? ttiUs : 0;	// the base station's TTI
 
 	// Message Buffer
     queue<string> msgQueue;
 
+    // Symbol buffers reused for every symbol
+    vector<complex<double>> rxWave(FFT_SIZE);
+    vector<complex<double>> rxActive(FREQ_BINS);	// N = 8 active bins of the N = 64 fft
+    vector<complex<double>> txWave(FFT_SIZE);
+    vector<complex<double>> activeVec(FREQ_BINS);
+    int rxWaitMs = 0;	// how long to wait for a reply to the last transmission
+    uint64_t txSymbols = 0;	// uplink noise stream position
     while(true)
 	{
-        auto rxWave = readWaveform(rxFile);
-        if(rxWave.size()==FFT_SIZE)
+        // Decode every downlink symbol that has arrived
+        ControlMessage msg;
+        while(receiveDownlink(*link, terminal, rxWave.data(), rxActive.data(), rxWaitMs, msg))
 		{
-            auto fullFreq = fft(rxWave);	// N = 64 fft
-            vector<std::complex<double>> active(FREQ_BINS);		// N = 8 bins
-			
-            for(int i=0; i<FREQ_BINS; i++)
-			{
-                active[i] = fullFreq[i*FREQ_BIN_SPACING];
-            }
-			
-			// Extract CTRL Code
-            std::pair<int,int> ctrlBits = qpskDemodulate(active[0]);
-            int ctrlVal = ctrlBits.first*2 + ctrlBits.second;
-			
-            ostringstream oss;
-			
-            if(ctrlVal == CTRL_RESPONSE)
-			{
-
-                auto cB = qpskDemodulate(active[2]);
-                int cnt = cB.first*2 + cB.second;
+            rxWaitMs = multiplexed ? MUX_FOLLOW_MS : 0;
 
-                auto hiPair = qpskDemodulate(active[3]);
-                int hiVal = hiPair.first*2 + hiPair.second;
-                auto loPair = qpskDemodulate(active[4]);
-                int loVal = loPair.first*2 + loPair.second;
-                int s = (hiVal<<2) | loVal;
-                
-                allocCount = cnt;
-                allocStart = s;
-                oss<<"Response: allocated "<<cnt<<" bins starting at active bin "<<s;
+            // Only symbols with something to report build a string
+            if(msg.ctrl == CTRL_NONE)
+                continue;	// a frame with nothing decodable for this user
+            if(msg.ctrl == CTRL_RESPONSE)
+			{
+                ostringstream oss;
+                oss<<"Response: allocated "<<msg.count<<" bins starting at active bin "<<msg.start;
+                if(msg.count>0 && msg.modulation!=MOD_QPSK)
+                    oss<<" ("<<modulationName(msg.modulation)<<")";
                 msgQueue.push(oss.str());
             }
-            else if(ctrlVal == CTRL_DATA_TX)
+            else if(msg.ctrl == CTRL_DATA_TX)
 			{
-				// decode data: active[1] => destination, active[2] => sender
-				// auto db = qpskDemodulate(active[1]);
-				// int destId = db.first * 2 + db.second;
-				auto sb = qpskDemodulate(active[2]);
-				int sndId = sb.first * 2 + sb.second;
-
-				// Now, decode the payload only from the receiver's allocated bins.
-				// allocStart and allocCount should have been updated from a previous response.
-				int payload = 0;
-				for (int i = allocStart; i < allocStart + allocCount; i++)
+				// Segments are decoded from the receiver's allocated bins; report whole messages
+				const RxMessage* done = terminal.completedMessage();
+				if(done)
 				{
-					auto bits = qpskDemodulate(active[i]);
-					int val = bits.first * 2 + bits.second;  // each symbol gives 2 bits
-					payload = (payload << 2) | val;
+					ostringstream oss;
+					oss << "Data from user " << done->srcId << ": " << string((const char*)done->data, done->length);
+					msgQueue.push(oss.str());
 				}
-				oss << "Data from user " << sndId << ", payload=" << payload;
-				msgQueue.push(oss.str());
 			}
-
-            else if(ctrlVal == CTRL_DEALLOCATE)
+            else if(msg.ctrl == CTRL_DEALLOCATE)
 			{
-                auto ub = qpskDemodulate(active[1]);
-                int uid = ub.first*2 + ub.second;
-                oss<<"Deallocation command for user "<<uid;
+                ostringstream oss;
+                oss<<"Deallocation command for user "<<msg.userId;
                 msgQueue.push(oss.str());
             }
             else
 			{
-                oss<<"Unknown control code: "<<ctrlVal;
+                ostringstream oss;
+                oss<<"Unknown control code: "<<msg.ctrl;
                 msgQueue.push(oss.str());
             }
-            clearFile(rxFile);
         }
+        rxWaitMs = 0;
 
         // menu
         cout<<"\nCommands: req, send, dealloc, read, exit: ";
@@ -113,94 +224,59 @@ int main(int argc, char* argv[])
 				n=1;
 			if(n>3)
 				n=3;
-            vector<complex<double>> fullFreq(FFT_SIZE, {0,0});
-            vector<complex<double>> activeVec(FREQ_BINS, {0,0});
-            // active[0] => 00 => Access Request
-            activeVec[0] = qpskModulate(0,0);
-            // active[1] => userId
-            activeVec[1] = qpskModulate((userId>>1)&1, userId&1);
-            // active[2] => requested
-            activeVec[2] = qpskModulate((n>>1)&1, n&1);
-            for(int i=3; i<FREQ_BINS; i++)
-			{
-                activeVec[i] = qpskModulate(0,0);
-            }
-            for(int i=0; i<FREQ_BINS; i++)
-			{
-                fullFreq[i*FREQ_BIN_SPACING] = activeVec[i];
-            }
-            auto timeSig = ifft(fullFreq);
-            addAWGN(timeSig, NOISE_VARIANCE);
-            writeWaveform(BS_RX_FILE, timeSig);
+            uint64_t tti = uplinkTti(terminal, CTRL_ACCESS_REQUEST, combineTtiUs);
+            terminal.accessRequest(n, activeVec.data());
+            sendUplink(*link, userId, activeVec.data(), txWave.data(), txSymbols, combineTtiUs, tti);
+            rxWaitMs = 500;
             cout<<"Access request sent.\n";
         }
         else if(cmd=="send")
 		{
-            if(allocCount<=0)
+            if(!terminal.hasAllocation())
 			{
                 cout<<"No bins allocated.\n";
                 continue;
             }
-            int maxBits = 2*allocCount;
-            int maxVal = (1<<maxBits)-1;
-            cout<<"You have "<< allocCount <<" bins => can send up to "<< maxBits <<" bits => max int="<<maxVal<<"\n";
-            int dst, pay;
+            cout<<"You have "<< terminal.allocCount() <<" bins => "<< terminal.allocBits() <<" bits per symbol\n";
+            int dst;
+            string text;
             cout << "Destination user(0-3)? ";
             cin >> dst;
-            cout << "Payload(0.."<<maxVal<<")? ";
-            cin>> pay;
-            if(pay<0) pay=0;
-            if(pay>maxVal) pay=maxVal;
-            
-            vector<complex<double>> fullFreq(FFT_SIZE, {0,0});
-            vector<complex<double>> activeVec(FREQ_BINS, {0,0});
-			
-			for(int i=0; i<FREQ_BINS; i++)
+            cout << "Message? ";
+            getline(cin >> ws, text);
+            if(!terminal.sendData(dst, (const uint8_t*)text.data(), text.size()))
 			{
-                activeVec[i] = qpskModulate(0,0);
+                cout<<"Message too long.\n";
+                continue;
             }
-			
-            // active[0] => 01 => Data Tx
-            activeVec[0] = qpskModulate(0,1);
-            // active[1] => dest
-            activeVec[1] = qpskModulate((dst>>1)&1, dst&1);
-            // active[2] => sender
-            activeVec[2] = qpskModulate((userId>>1)&1, userId&1);
-            // place payload in allocated bins
-            for(int i=0; i<allocCount; i++)
-			{
-                int shift = 2*(allocCount -1 - i);
-                int bits = (pay>>shift) & 0x3;
-                activeVec[allocStart + i] = qpskModulate((bits>>1)&1, bits&1);
-			}
-			
-            for(int i=0; i<FREQ_BINS; i++)
+
+            // One symbol per segment; the text is read in place until the last one is sent
+            int segments = 0;
+            while(terminal.dataPending())
 			{
-                fullFreq[i*FREQ_BIN_SPACING] = activeVec[i];
+                uint64_t tti = uplinkTti(terminal, CTRL_DATA_TX, combineTtiUs);
+                INSTRUMENT_START(t0);
+                terminal.nextDataTx(activeVec.data());
+                INSTRUMENT_STOP(STAGE_ENCODE, t0);
+                sendUplink(*link, userId, activeVec.data(), txWave.data(), txSymbols, combineTtiUs, tti);
+                segments++;
             }
-            auto timeSig = ifft(fullFreq);
-            addAWGN(timeSig, NOISE_VARIANCE);
-            writeWaveform(BS_RX_FILE, timeSig);
-            cout<<"Data transmission sent.\n";
+            rxWaitMs = 500;
+            cout<<"Data transmission sent in "<<segments<<" symbols.\n";
         }
         else if(cmd=="dealloc")
 		{
-            // send a deallocate command => 11
-            vector<complex<double>> fullFreq(FFT_SIZE, {0,0});
-            vector<complex<double>> activeVec(FREQ_BINS, {0,0});
-            activeVec[0] = qpskModulate(1,1); // 11 => Dealloc
-            activeVec[1] = qpskModulate((userId>>1)&1, userId&1);
-            for(int i=2; i<FREQ_BINS; i++)
+            // A combined uplink has no slot for a user without bins
+            if(combined && !terminal.hasAllocation())
 			{
-                activeVec[i] = qpskModulate(0,0);
-            }
-            for(int i=0; i<FREQ_BINS; i++)
-			{
-                fullFreq[i*FREQ_BIN_SPACING] = activeVec[i];
+                cout<<"No bins allocated.\n";
+                continue;
             }
-            auto timeSig = ifft(fullFreq);
-            addAWGN(timeSig, NOISE_VARIANCE);
-            writeWaveform(BS_RX_FILE, timeSig);
+            // send a deallocate command => 11
+            uint64_t tti = uplinkTti(terminal, CTRL_DEALLOCATE, combineTtiUs);
+            terminal.deallocate(activeVec.data());
+            sendUplink(*link, userId, activeVec.data(), txWave.data(), txSymbols, combineTtiUs, tti);
+            rxWaitMs = 500;
             cout<<"Deallocation command sent.\n";
         }
         else if(cmd=="read")
@@ -215,7 +291,6 @@ int main(int argc, char* argv[])
                 cout<<"No messages in queue.\n";
             }
         }
-        Sleep(500);
     }
     return 0;
 }
@@ -0,0 +1,127 @@
+#include "user_core.h"
+#include "combined_uplink.h"
+#include "downlink_frame.h"
+#include "signal_processing.h"
+#include <algorithm>
+
+UserTerminal::UserTerminal(const FrameLayout& layout, int userId)
+    : layout(layout), userId(userId), count(0), start(-1), modulation(MOD_QPSK),
+      multiplexed(false), combined(false), uplinkTti(0), fec(FEC_NONE), txDst(0), rxCapacity(SEGMENT_MAX_MESSAGE), rxDone(false)
+{
+}
+
+void UserTerminal::accessRequest(int bins, std::complex<double>* active) const
+{
+    ControlMessage msg = ControlMessage();
+    msg.ctrl = CTRL_ACCESS_REQUEST;
+    msg.userId = userId;
+    msg.count = bins;
+    encodeUplink(msg, true, active);
+}
+
+bool UserTerminal::sendData(int dst, const uint8_t* data, size_t length)
+{
+    if (!hasAllocation()) return false;
+    txDst = dst;
+    return tx.start(data, length, allocBits(), layout.seqBits(), fec);
+}
+
+bool UserTerminal::nextDataTx(std::complex<double>* active)
+{
+    if (tx.done()) return false;
+
+    // Segment goes in the allocated bins
+    ControlMessage msg = ControlMessage();
+    msg.ctrl = CTRL_DATA_TX;
+    msg.userId = txDst;
+    msg.srcId = userId;
+    msg.start = start;
+    msg.count = count;
+    msg.modulation = modulation;
+    tx.next(msg.seq, msg.payload);
+    encodeUplink(msg, msg.seq == 0, active);
+    return true;
+}
+
+void UserTerminal::deallocate(std::complex<double>* active) const
+{
+    ControlMessage msg = ControlMessage();
+    msg.ctrl = CTRL_DEALLOCATE;
+    msg.userId = userId;
+    encodeUplink(msg, true, active);
+}
+
+uint64_t UserTerminal::headerTti(int ctrl, uint64_t tti) const
+{
+    if (!combined) return tti;
+    if (ctrl == CTRL_ACCESS_REQUEST)
+        return combinedAccessTti(layout, tti) ? tti : tti + 1;
+    // Past its first segment a message goes on without headers
+    if (ctrl == CTRL_DATA_TX && !tx.done() && !tx.atStart()) return tti;
+    return hasAllocation() ? combinedNextHeaderTti(layout, start, count, tti) : tti;
+}
+
+// A combined uplink symbol is silent outside the header, when there is one, and
+// the payload
+void UserTerminal::encodeUplink(const ControlMessage& msg, bool header, std::complex<double>* active) const
+{
+    if (!combined)
+	{
+        encodeControl(layout, msg, active);
+        return;
+    }
+    std::fill(active, active + layout.bins, std::complex<double>(0, 0));
+    if (header)
+	{
+        // A header with no slot in this TTI is left out
+        int slot = msg.ctrl != CTRL_ACCESS_REQUEST ? combinedScheduledSlot(layout, start, count, uplinkTti)
+                                                   : combinedAccessTti(layout, uplinkTti) ? 0 : -1;
+        if (slot >= 0) encodeHeader(layout, msg, active, slot);
+    }
+    if (msg.ctrl == CTRL_DATA_TX) encodePayload(active, msg.start, msg.count, msg.modulation, msg.payload);
+}
+
+ControlMessage UserTerminal::handleDownlink(const std::complex<double>* active)
+{
+    ControlMessage msg = multiplexed ? findFrameHeader(layout, active, userId) : decodeControl(layout, active);
+    rxDone = false;
+    if (msg.ctrl == CTRL_RESPONSE)
+	{
+        count = msg.count;
+        start = msg.start;
+        modulation = msg.modulation;
+        tx.clear();     // segments were sized for the old allocation
+    }
+    else if (msg.ctrl == CTRL_DATA_TX)
+	{
+        // Only the receiver's allocated bins carry the payload
+        if (count > 0 && start >= 0 && start + count <= layout.bins)
+		{
+            msg.start = start;
+            msg.count = count;
+            msg.modulation = modulation;
+            msg.payload = decodePayload(active, start, count, modulation);
+
+            std::map<int, ReassemblyBuffer>::iterator it = rx.find(msg.srcId);
+            if (it == rx.end())
+                it = rx.insert(std::make_pair(msg.srcId, ReassemblyBuffer(rxCapacity, layout.seqBits(), fec))).first;
+            SegmentStatus status;
+            if (fec != FEC_NONE)
+			{
+                int8_t soft[SEGMENT_MAX_BITS];
+                decodePayloadSoft(active, start, count, modulation, soft);
+                status = it->second.rx.acceptSoft(msg.seq, soft, allocBits());
+            }
+            else
+                status = it->second.rx.accept(msg.seq, msg.payload, allocBits());
+            if (status == SEGMENT_COMPLETE)
+			{
+                rxMessage.srcId = msg.srcId;
+                rxMessage.data = it->second.rx.data();
+                rxMessage.length = it->second.rx.length();
+                rxDone = true;
+            }
+        }
+    }
+    return msg;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "frame.h"
+#include "segment.h"
+#include <map>
+
+// A message reassembled from CTRL_DATA_TX segments. data points into the
+// terminal's buffer for srcId and stays valid until srcId's next segment.
+struct RxMessage
+{
+    int srcId;
+    const uint8_t* data;
+    size_t length;
+};
+
+// User-side MAC: builds the uplink control symbols and tracks the allocation
+// granted by the base station. Shared by the user process and the simulator.
+class UserTerminal
+{
+public:
+    UserTerminal(const FrameLayout& layout, int userId);
+
+    int id() const { return userId; }
+    int allocCount() const { return count; }
+    int allocStart() const { return start; }
+    Modulation allocModulation() const { return modulation; }
+    // Payload bits the current allocation carries
+    int allocBits() const { return count * modulationBits(modulation); }
+    bool hasAllocation() const { return count > 0; }
+
+    // Each builder fills layout.bins active bins
+    void accessRequest(int bins, std::complex<double>* active) const;
+    void deallocate(std::complex<double>* active) const;
+
+    // Starts sending data[0, length) to dst, one segment per nextDataTx symbol.
+    // The bytes are read in place until dataPending() turns false. Fails without
+    // an allocation or if length exceeds SEGMENT_MAX_MESSAGE; a new grant
+    // abandons a message in progress.
+    bool sendData(int dst, const uint8_t* data, size_t length);
+    bool dataPending() const { return !tx.done(); }
+    // Builds the next segment's symbol; false if no segment is pending
+    bool nextDataTx(std::complex<double>* active);
+
+    // Largest message accepted from each sender (default SEGMENT_MAX_MESSAGE)
+    void setReceiveCapacity(size_t bytes) { rxCapacity = bytes; }
+
+    // Downlink symbols are multiplexed frames (see downlink_frame.h), as the
+    // base station must also be told; off by default
+    void setDownlinkMux(bool on) { multiplexed = on; }
+    // Uplink symbols carry only this user's part of a combined uplink (see
+    // combined_uplink.h), as the base station must also be told; off by default
+    void setUplinkCombine(bool on) { combined = on; }
+    // Combined uplink: the first TTI from tti on in which the symbol a builder
+    // makes for ctrl may go out. An access request needs a TTI with a
+    // contention slot; a deallocation or a message's first segment one in
+    // which the grant owns a slot. Other segments, and any symbol when not
+    // combined, may go in tti.
+    uint64_t headerTti(int ctrl, uint64_t tti) const;
+    // Combined uplink: the TTI the builders' symbols go out in, which picks
+    // their header's slot. In a TTI headerTti does not allow, the header is
+    // left out.
+    void setUplinkTti(uint64_t tti) { uplinkTti = tti; }
+    // Convolutional coding of message payloads sent and received (see
+    // segment.h), as the base station must also be told; default FEC_NONE
+    void setFec(FecRate rate) { fec = rate; }
+
+    // Decodes a downlink symbol. CTRL_RESPONSE updates the allocation and its
+    // modulation; CTRL_DATA_TX payloads are read from the current allocation.
+    // A multiplexed frame without a header for this user gives CTRL_NONE.
+    ControlMessage handleDownlink(const std::complex<double>* active);
+    // Message the last handleDownlink completed, or nullptr
+    const RxMessage* completedMessage() const { return rxDone ? &rxMessage : nullptr; }
+
+private:
+    void encodeUplink(const ControlMessage& msg, bool header, std::complex<double>* active) const;
+
+    FrameLayout layout;
+    int userId;
+    int count;
+    int start;
+    Modulation modulation;
+    bool multiplexed;
+    bool combined;
+    uint64_t uplinkTti;     // combined: TTI of the symbols being built
+    FecRate fec;
+
+    Segmenter tx;
+    int txDst;
+    std::map<int, ReassemblyBuffer> rx;     // by sender
+    size_t rxCapacity;
+    RxMessage rxMessage;
+    bool rxDone;
+};
@@ -0,0 +1,47 @@
+#include "user_link.h"
+#include "signal_processing.h"
+#include "combined_uplink.h"
+#include "instrument.h"
+#include <chrono>
+#include <thread>
+
+void sendUplink(Transport& link, int userId, const std::complex<double>* active, std::complex<double>* timeSig,
+                uint64_t& txSymbols, int combineTtiUs, uint64_t tti)
+{
+    if (combineTtiUs > 0)
+        std::this_thread::sleep_until(ttiStart(tti, combineTtiUs) + std::chrono::microseconds(combineTtiUs / 4));
+    INSTRUMENT_START(t0);
+    muxActiveBins(active, timeSig);
+    INSTRUMENT_LAP(STAGE_MUX, t0);
+    if (combineTtiUs == 0)
+        addAWGN(timeSig, FFT_SIZE, NOISE_VARIANCE, noiseKey(uplinkNoise(userId), txSymbols++));
+    INSTRUMENT_LAP(STAGE_NOISE, t0);
+    link.send(BS_ENDPOINT, timeSig, FFT_SIZE);
+    INSTRUMENT_STOP(STAGE_TX_IO, t0);
+}
+
+uint64_t uplinkTti(UserTerminal& terminal, int ctrl, int combineTtiUs)
+{
+    if (combineTtiUs == 0) return 0;
+    uint64_t tti = terminal.headerTti(ctrl, ttiIndex(std::chrono::steady_clock::now(), combineTtiUs) + 1);
+    terminal.setUplinkTti(tti);
+    return tti;
+}
+
+bool receiveDownlink(Transport& link, UserTerminal& terminal, std::complex<double>* rxWave,
+                     std::complex<double>* rxActive, int waitMs, ControlMessage& msg)
+{
+    // RX_IO times only a read that found a symbol waiting, not the wait for one
+    INSTRUMENT_START(t0);
+    if (link.receive(terminal.id(), rxWave, FFT_SIZE, 0) == FFT_SIZE)
+        INSTRUMENT_LAP(STAGE_RX_IO, t0);
+    else if (waitMs > 0 && link.receive(terminal.id(), rxWave, FFT_SIZE, waitMs) == FFT_SIZE)
+        INSTRUMENT_RESTART(t0);
+    else
+        return false;
+    demuxActiveBins(rxWave, rxActive);
+    INSTRUMENT_LAP(STAGE_DEMUX, t0);
+    msg = terminal.handleDownlink(rxActive);
+    INSTRUMENT_STOP(STAGE_DECODE, t0);
+    return true;
+}
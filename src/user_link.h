@@ -0,0 +1,29 @@
+#pragma once
+
+#include "user_core.h"
+#include "transport.h"
+#include <complex>
+#include <cstdint>
+
+// The user process's symbol I/O over a Transport on the legacy layout, shared
+// with the allocation test so it checks the same datapath the process runs.
+// Buffers are caller-owned scratch and nothing here touches the heap.
+
+// Active bins -> time samples with uplink noise, sent to the base station.
+// timeSig is FFT_SIZE samples. With combineTtiUs set the symbol goes a quarter
+// into TTI tti (see uplinkTti), so the base station sums it with the other
+// users' of that TTI, and adds the noise itself.
+void sendUplink(Transport& link, int userId, const std::complex<double>* active, std::complex<double>* timeSig,
+                uint64_t& txSymbols, int combineTtiUs, uint64_t tti = 0);
+
+// Combined uplink: the first TTI after the current one in which the terminal
+// may send its symbol for ctrl, set on the terminal for the builders. 0 when
+// combineTtiUs is 0.
+uint64_t uplinkTti(UserTerminal& terminal, int ctrl, int combineTtiUs);
+
+// Takes the terminal's next downlink symbol off the transport and decodes it into
+// msg. A symbol already waiting is taken at once; otherwise this waits up to
+// waitMs for one. rxWave is FFT_SIZE samples, rxActive FREQ_BINS. False if no
+// symbol arrived.
+bool receiveDownlink(Transport& link, UserTerminal& terminal, std::complex<double>* rxWave,
+                     std::complex<double>* rxActive, int waitMs, ControlMessage& msg);
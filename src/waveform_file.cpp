@@ -0,0 +1,463 @@
+#include "waveform_file.h"
+#include "signal_processing.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// Samples start on a 32-byte boundary so SIMD loads from the mapping stay aligned
+constexpr uint32_t WAVEFORM_HEADER_SIZE = 64;
+// Header bytes a version 1 file has, before the exponent
+constexpr uint32_t WAVEFORM_V1_HEADER_SIZE = 32;
+
+size_t sampleSize(uint16_t sampleType)
+{
+    switch (sampleType)
+	{
+        case SAMPLE_CF64: return sizeof(std::complex<double>);
+        case SAMPLE_CF32: return sizeof(std::complex<float>);
+        case SAMPLE_CQ15: return sizeof(cq15);
+        default:          return 0;
+    }
+}
+
+const char* sampleTypeName(uint16_t sampleType)
+{
+    switch (sampleType)
+	{
+        case SAMPLE_CF64: return "cf64";
+        case SAMPLE_CF32: return "cf32";
+        case SAMPLE_CQ15: return "cq15";
+        default:          return "unknown";
+    }
+}
+
+uint16_t sampleTypeOf(SampleFormat format)
+{
+    switch (format)
+	{
+        case FORMAT_CF32: return SAMPLE_CF32;
+        case FORMAT_CQ15: return SAMPLE_CQ15;
+        default:          return SAMPLE_CF64;
+    }
+}
+
+static void fillHeader(WaveformHeader& hdr, uint16_t sampleType, uint32_t symbolCount, uint64_t sampleCount,
+                       uint64_t sequence, int exponent)
+{
+    hdr.magic = WAVEFORM_MAGIC;
+    hdr.version = WAVEFORM_VERSION;
+    hdr.sampleType = sampleType;
+    hdr.headerSize = WAVEFORM_HEADER_SIZE;
+    hdr.symbolCount = symbolCount;
+    hdr.sampleCount = sampleCount;
+    hdr.sequence = sequence;
+    hdr.exponent = sampleType == SAMPLE_CQ15 ? exponent : 0;
+    hdr.reserved = 0;
+}
+
+bool writeWaveformData(const std::string& filename, uint16_t sampleType, const void* samples, size_t sampleCount,
+                       uint32_t symbolCount, uint64_t sequence, int exponent)
+{
+    // Written beside the target and renamed over it, so a reader that has the old
+    // file mapped keeps its pages instead of faulting on a truncated file
+    static std::atomic<unsigned> tempCount(0);
+#ifdef _WIN32
+    unsigned pid = (unsigned)GetCurrentProcessId();
+#else
+    unsigned pid = (unsigned)getpid();
+#endif
+    std::string temp = filename + ".tmp" + std::to_string(pid) + "." + std::to_string(tempCount++);
+    std::ofstream ofs(temp, std::ofstream::binary | std::ofstream::trunc);
+    if(!ofs)
+	{
+        std::cerr<<"Error writing to "<<filename<<std::endl;
+        return false;
+    }
+    WaveformHeader hdr;
+    fillHeader(hdr, sampleType, symbolCount, sampleCount, sequence, exponent);
+    char header[WAVEFORM_HEADER_SIZE] = {};
+    std::memcpy(header, &hdr, sizeof(hdr));
+    ofs.write(header, sizeof(header));
+    ofs.write(static_cast<const char*>(samples), sampleCount * sampleSize(sampleType));
+    ofs.close();
+#ifdef _WIN32
+    bool renamed = ofs && MoveFileExA(temp.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+    bool renamed = ofs && std::rename(temp.c_str(), filename.c_str()) == 0;
+#endif
+    if (!renamed)
+	{
+        std::remove(temp.c_str());
+        std::cerr<<"Error writing to "<<filename<<std::endl;
+        return false;
+    }
+    return true;
+}
+
+namespace
+{
+
+// A waveform file opened read-write under an exclusive advisory lock (flock or
+// LockFileEx), released on close. Appenders and the draining reader take it, so
+// each one sees the container as the previous holder left it.
+class LockedFile
+{
+public:
+    LockedFile() :
+#ifdef _WIN32
+        handle(INVALID_HANDLE_VALUE)
+#else
+        fd(-1)
+#endif
+    {
+    }
+    ~LockedFile() { close(); }
+
+    // False if the file cannot be opened, or is missing and create is false
+    bool open(const std::string& filename, bool create)
+    {
+#ifdef _WIN32
+        handle = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                             create ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (handle == INVALID_HANDLE_VALUE) return false;
+        OVERLAPPED whole = {};
+        if (!LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &whole))
+		{
+            close();
+            return false;
+        }
+        return true;
+#else
+        for (;;)
+		{
+            fd = ::open(filename.c_str(), O_RDWR | (create ? O_CREAT : 0), 0644);
+            if (fd < 0) return false;
+            int locked;
+            while ((locked = flock(fd, LOCK_EX)) != 0 && errno == EINTR) {}
+            if (locked != 0)
+			{
+                close();
+                return false;
+            }
+            // writeWaveformData may have renamed a new file over the one we locked
+            struct stat held, named;
+            if (fstat(fd, &held) == 0 && ::stat(filename.c_str(), &named) == 0 &&
+                held.st_dev == named.st_dev && held.st_ino == named.st_ino)
+                return true;
+            close();
+            if (!create && errno == ENOENT) return false;
+        }
+#endif
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
+        handle = INVALID_HANDLE_VALUE;
+#else
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+    }
+
+    uint64_t size() const
+    {
+#ifdef _WIN32
+        LARGE_INTEGER bytes;
+        return GetFileSizeEx(handle, &bytes) ? (uint64_t)bytes.QuadPart : 0;
+#else
+        struct stat st;
+        return fstat(fd, &st) == 0 ? (uint64_t)st.st_size : 0;
+#endif
+    }
+
+    bool readAt(uint64_t offset, void* buffer, size_t bytes) const
+    {
+#ifdef _WIN32
+        OVERLAPPED at = {};
+        at.Offset = (DWORD)offset;
+        at.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD done = 0;
+        return ReadFile(handle, buffer, (DWORD)bytes, &done, &at) && done == bytes;
+#else
+        return pread(fd, buffer, bytes, (off_t)offset) == (ssize_t)bytes;
+#endif
+    }
+
+    bool writeAt(uint64_t offset, const void* buffer, size_t bytes) const
+    {
+#ifdef _WIN32
+        OVERLAPPED at = {};
+        at.Offset = (DWORD)offset;
+        at.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD done = 0;
+        return WriteFile(handle, buffer, (DWORD)bytes, &done, &at) && done == bytes;
+#else
+        return pwrite(fd, buffer, bytes, (off_t)offset) == (ssize_t)bytes;
+#endif
+    }
+
+    bool truncate() const
+    {
+#ifdef _WIN32
+        LARGE_INTEGER zero = {};
+        return SetFilePointerEx(handle, zero, NULL, FILE_BEGIN) && SetEndOfFile(handle);
+#else
+        return ftruncate(fd, 0) == 0;
+#endif
+    }
+
+private:
+    LockedFile(const LockedFile&);
+    LockedFile& operator=(const LockedFile&);
+
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    int fd;
+#endif
+};
+
+bool validHeader(const WaveformHeader& hdr, uint64_t fileSize)
+{
+    size_t elem = sampleSize(hdr.sampleType);
+    uint32_t minHeader = hdr.version >= 2 ? sizeof(WaveformHeader) : WAVEFORM_V1_HEADER_SIZE;
+    return hdr.magic == WAVEFORM_MAGIC && (hdr.version == 1 || hdr.version == WAVEFORM_VERSION) && elem != 0 &&
+           hdr.headerSize >= minHeader && hdr.headerSize <= fileSize &&
+           hdr.sampleCount <= (fileSize - hdr.headerSize) / elem;
+}
+
+int headerExponent(const WaveformHeader& hdr)
+{
+    return hdr.version >= 2 ? hdr.exponent : 0;
+}
+
+bool convertSamples(uint16_t sampleType, const void* data, size_t count, int exponent, std::complex<double>* out)
+{
+    switch (sampleType)
+	{
+        case SAMPLE_CF64:
+            std::copy(static_cast<const std::complex<double>*>(data),
+                      static_cast<const std::complex<double>*>(data) + count, out);
+            return true;
+        case SAMPLE_CF32:
+            fromCF32(static_cast<const std::complex<float>*>(data), count, out);
+            return true;
+        case SAMPLE_CQ15:
+            fromQ15(static_cast<const cq15*>(data), count, exponent, out);
+            return true;
+        default:
+            return false;
+    }
+}
+
+}
+
+bool appendWaveformData(const std::string& filename, uint16_t sampleType, const void* samples, size_t sampleCount,
+                        uint64_t sequence, int exponent)
+{
+    LockedFile file;
+    if (!file.open(filename, true))
+	{
+        std::cerr<<"Error writing to "<<filename<<std::endl;
+        return false;
+    }
+    uint64_t fileSize = file.size();
+    size_t bytes = sampleCount * sampleSize(sampleType);
+    WaveformHeader hdr;
+    if (sampleType != SAMPLE_CQ15) exponent = 0;
+    if (fileSize < sizeof(hdr) || !file.readAt(0, &hdr, sizeof(hdr)) || !validHeader(hdr, fileSize))
+	{
+        // Empty, or not a container at all: start one in place, nothing is lost
+        fillHeader(hdr, sampleType, 0, 0, sequence, exponent);
+        if (fileSize > 0 && !file.truncate())
+		{
+            std::cerr<<"Error writing to "<<filename<<std::endl;
+            return false;
+        }
+    }
+    else if (hdr.sampleType != sampleType || hdr.symbolCount == 0 || headerExponent(hdr) != exponent ||
+             hdr.sampleCount != (uint64_t)hdr.symbolCount * sampleCount)
+	{
+        // Symbols already queued in another shape stay for the reader
+        std::cerr<<filename<<" holds "<<sampleTypeName(hdr.sampleType)<<" symbols of "
+                 <<(hdr.symbolCount ? hdr.sampleCount / hdr.symbolCount : 0)<<" samples at exponent "
+                 <<headerExponent(hdr)<<", not "<<sampleTypeName(sampleType)<<" symbols of "<<sampleCount
+                 <<" at exponent "<<exponent<<std::endl;
+        return false;
+    }
+
+    // Samples first, header last, so a reader never sees a count it cannot map
+    bool written = file.writeAt(hdr.headerSize + hdr.sampleCount * sampleSize(sampleType), samples, bytes);
+    hdr.symbolCount++;
+    hdr.sampleCount += sampleCount;
+    // A version 1 header ends where the exponent would start
+    size_t headerBytes = hdr.version >= 2 ? sizeof(hdr) : WAVEFORM_V1_HEADER_SIZE;
+    if (!written || !file.writeAt(0, &hdr, headerBytes))
+	{
+        std::cerr<<"Error writing to "<<filename<<std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool drainWaveformData(const std::string& filename, std::vector<std::complex<double>>& samples, size_t& perSymbol)
+{
+    samples.clear();
+    perSymbol = 0;
+    LockedFile file;
+    if (!file.open(filename, false)) return true;
+    uint64_t fileSize = file.size();
+    WaveformHeader hdr;
+    if (fileSize < sizeof(hdr)) return true;
+    if (!file.readAt(0, &hdr, sizeof(hdr)) || !validHeader(hdr, fileSize))
+	{
+        std::cerr<<"Error reading "<<filename<<std::endl;
+        return false;
+    }
+    if (hdr.symbolCount > 0)
+	{
+        std::vector<char> raw(hdr.sampleCount * sampleSize(hdr.sampleType));
+        samples.resize(hdr.sampleCount);
+        if (!file.readAt(hdr.headerSize, raw.data(), raw.size()) ||
+            !convertSamples(hdr.sampleType, raw.data(), samples.size(), headerExponent(hdr), samples.data()))
+		{
+            std::cerr<<"Error reading "<<filename<<std::endl;
+            samples.clear();
+            return false;
+        }
+        perSymbol = hdr.sampleCount / hdr.symbolCount;
+    }
+    // Emptied while still locked, so no appender can slip a symbol in between
+    return file.truncate();
+}
+
+bool writeWaveformAs(const std::string& filename, SampleFormat format, const std::complex<double>* samples,
+                     size_t sampleCount, uint32_t symbolCount, uint64_t sequence)
+{
+    if (format == FORMAT_CF32)
+	{
+        std::vector<std::complex<float>> converted(sampleCount);
+        toCF32(samples, sampleCount, converted.data());
+        return writeWaveformFile(filename, converted.data(), sampleCount, symbolCount, sequence);
+    }
+    if (format == FORMAT_CQ15)
+	{
+        std::vector<cq15> converted(sampleCount);
+        int exponent = blockExponent(samples, sampleCount);
+        toQ15(samples, sampleCount, exponent, converted.data());
+        return writeWaveformData(filename, SAMPLE_CQ15, converted.data(), sampleCount, symbolCount, sequence, exponent);
+    }
+    return writeWaveformFile(filename, samples, sampleCount, symbolCount, sequence);
+}
+
+MappedWaveform::MappedWaveform() : base(nullptr), length(0)
+{
+}
+
+MappedWaveform::~MappedWaveform()
+{
+    close();
+}
+
+bool MappedWaveform::open(const std::string& filename)
+{
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)sizeof(WaveformHeader))
+	{
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) return false;
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);   // the view keeps the mapping alive
+    if (!view) return false;
+    base = view;
+    length = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(WaveformHeader))
+	{
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) return false;
+    base = view;
+    length = static_cast<size_t>(st.st_size);
+#endif
+
+    // Reject anything that is not a complete container, e.g. a file caught mid-write
+    if (!validHeader(header(), length))
+	{
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedWaveform::close()
+{
+    if (!base) return;
+#ifdef _WIN32
+    UnmapViewOfFile(base);
+#else
+    munmap(base, length);
+#endif
+    base = nullptr;
+    length = 0;
+}
+
+bool MappedWaveform::readSamples(size_t first, size_t count, std::complex<double>* out) const
+{
+    if (!base || first > sampleCount() || count > sampleCount() - first) return false;
+    return convertSamples(header().sampleType, static_cast<const char*>(data()) + first * sampleSize(header().sampleType),
+                          count, exponent(), out);
+}
+
+bool exportWaveformText(const std::string& binFile, const std::string& txtFile)
+{
+    MappedWaveform wave;
+    std::vector<std::complex<double>> samples;
+    if (wave.open(binFile)) samples.resize(wave.sampleCount());
+    if (!wave.isOpen() || !wave.readSamples(0, samples.size(), samples.data()))
+	{
+        std::cerr<<"Error reading "<<binFile<<std::endl;
+        return false;
+    }
+    writeWaveform(txtFile, samples);
+    return true;
+}
+
+bool importWaveformText(const std::string& txtFile, const std::string& binFile, uint32_t symbolCount)
+{
+    std::vector<std::complex<double>> samples = readWaveform(txtFile);
+    if (samples.empty())
+	{
+        std::cerr<<"Error reading "<<txtFile<<std::endl;
+        return false;
+    }
+    return writeWaveformFile(binFile, samples.data(), samples.size(), symbolCount, 0);
+}
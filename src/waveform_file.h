@@ -0,0 +1,126 @@
+#pragma once
+
+#include "sample_format.h"
+#include <string>
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <cstddef>
+
+// Binary waveform container: a fixed header followed by raw samples in host
+// (little-endian) byte order. Readers map the file and use the samples in place.
+// Version 2 added the block exponent; version 1 files still read, at exponent 0.
+constexpr uint32_t WAVEFORM_MAGIC = 0x5744464F; // "OFDW"
+constexpr uint16_t WAVEFORM_VERSION = 2;
+
+enum WaveformSampleType
+{
+    SAMPLE_CF64 = 1,    // std::complex<double>
+    SAMPLE_CF32 = 2,    // std::complex<float>
+    SAMPLE_CQ15 = 3     // cq15 at the header's block exponent
+};
+
+// Header sample type of each in-memory sample type
+template<typename T> struct WaveformSample;
+template<> struct WaveformSample<std::complex<double>> { static const uint16_t type = SAMPLE_CF64; };
+template<> struct WaveformSample<std::complex<float>> { static const uint16_t type = SAMPLE_CF32; };
+template<> struct WaveformSample<cq15> { static const uint16_t type = SAMPLE_CQ15; };
+
+struct WaveformHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t sampleType;
+    uint32_t headerSize;    // offset of the first sample
+    uint32_t symbolCount;   // OFDM symbols in the file, sampleCount / symbolCount samples each
+    uint64_t sampleCount;
+    uint64_t sequence;      // writer-assigned sequence number of the first symbol
+    int32_t exponent;       // block exponent of SAMPLE_CQ15 samples (see sample_format.h), else 0
+    uint32_t reserved;
+};
+
+static_assert(sizeof(WaveformHeader) == 40, "waveform header layout changed");
+
+size_t sampleSize(uint16_t sampleType);
+// "cf64", "cf32", "cq15" or "unknown"
+const char* sampleTypeName(uint16_t sampleType);
+uint16_t sampleTypeOf(SampleFormat format);
+
+// Untyped forms of the templates below; samples are sampleCount values of sampleType,
+// and exponent is the block exponent of SAMPLE_CQ15 samples
+bool writeWaveformData(const std::string& filename, uint16_t sampleType, const void* samples, size_t sampleCount,
+                       uint32_t symbolCount, uint64_t sequence, int exponent);
+bool appendWaveformData(const std::string& filename, uint16_t sampleType, const void* samples, size_t sampleCount,
+                        uint64_t sequence, int exponent);
+
+template<typename T>
+bool writeWaveformFile(const std::string& filename, const T* samples, size_t sampleCount,
+                       uint32_t symbolCount, uint64_t sequence)
+{
+    return writeWaveformData(filename, WaveformSample<T>::type, samples, sampleCount, symbolCount, sequence, 0);
+}
+
+// Appends one symbol to an existing container, or starts one if the file is empty
+// or missing; symbols in a file must all have the same sample count and type,
+// and cq15 symbols the same exponent (0 here; appendWaveformData takes others).
+// Appends and drainWaveformData hold an advisory file lock, so concurrent
+// writers and the reader do not lose each other's symbols.
+template<typename T>
+bool appendWaveformFile(const std::string& filename, const T* samples, size_t sampleCount, uint64_t sequence)
+{
+    return appendWaveformData(filename, WaveformSample<T>::type, samples, sampleCount, sequence, 0);
+}
+
+// Moves every symbol out of a container, widened to double, and leaves the file
+// empty; perSymbol is 0 when there was nothing to read, and a missing file is empty
+bool drainWaveformData(const std::string& filename, std::vector<std::complex<double>>& samples, size_t& perSymbol);
+
+// Writes double-precision samples converted to format; CQ15 gets the block
+// exponent that fits their peak
+bool writeWaveformAs(const std::string& filename, SampleFormat format, const std::complex<double>* samples,
+                     size_t sampleCount, uint32_t symbolCount, uint64_t sequence);
+
+// Read-only memory mapping of a waveform file. writeWaveformData replaces files
+// by rename rather than truncating them, so an open mapping stays readable.
+class MappedWaveform
+{
+public:
+    MappedWaveform();
+    ~MappedWaveform();
+
+    // False if the file is missing, empty, truncated or not a waveform container
+    bool open(const std::string& filename);
+    void close();
+
+    bool isOpen() const { return base != nullptr; }
+    const WaveformHeader& header() const { return *static_cast<const WaveformHeader*>(base); }
+    const void* data() const { return static_cast<const char*>(base) + header().headerSize; }
+    size_t sampleCount() const { return header().sampleCount; }
+    uint32_t symbolCount() const { return header().symbolCount; }
+    // Block exponent of SAMPLE_CQ15 samples
+    int exponent() const { return header().version >= 2 ? header().exponent : 0; }
+
+    // Valid only when header().sampleType == SAMPLE_CF64
+    const std::complex<double>* samples() const { return static_cast<const std::complex<double>*>(data()); }
+
+    // The samples as T, or nullptr if the file holds another type
+    template<typename T>
+    const T* samplesAs() const
+    {
+        return header().sampleType == WaveformSample<T>::type ? static_cast<const T*>(data()) : nullptr;
+    }
+
+    // Converts samples [first, first + count) of any type to double; false if out of range
+    bool readSamples(size_t first, size_t count, std::complex<double>* out) const;
+
+private:
+    MappedWaveform(const MappedWaveform&);
+    MappedWaveform& operator=(const MappedWaveform&);
+
+    void* base;
+    size_t length;
+};
+
+// Conversion to and from the text format of writeWaveform/readWaveform
+bool exportWaveformText(const std::string& binFile, const std::string& txtFile);
+bool importWaveformText(const std::string& txtFile, const std::string& binFile, uint32_t symbolCount);
@@ -0,0 +1,66 @@
+#include "signal_processing.h"
+#include "waveform_file.h"
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    if(argc<3)
+	{
+        cerr<<"Usage: waveform_tool info <file.bin>\n"
+            <<"       waveform_tool export <file.bin> <file.txt>\n"
+            <<"       waveform_tool import <file.txt> <file.bin> [symbols]\n"
+            <<"       waveform_tool convert <in.bin> <out.bin> [cf64|cf32|cq15]"<<endl;
+        return 1;
+    }
+    string cmd=argv[1];
+
+    if(cmd=="info")
+	{
+        MappedWaveform wave;
+        if(!wave.open(argv[2]))
+		{
+            cerr<<argv[2]<<" is not a waveform file"<<endl;
+            return 1;
+        }
+        const WaveformHeader& hdr = wave.header();
+        cout<<"version "<<hdr.version<<", sample type "<<sampleTypeName(hdr.sampleType)
+            <<", "<<hdr.sampleCount<<" samples in "<<hdr.symbolCount<<" symbols"
+            <<", sequence "<<hdr.sequence;
+        if(hdr.sampleType==SAMPLE_CQ15)
+            cout<<", exponent "<<wave.exponent();
+        cout<<endl;
+        return 0;
+    }
+    if(cmd=="export" && argc>=4)
+	{
+        return exportWaveformText(argv[2], argv[3]) ? 0 : 1;
+    }
+    if(cmd=="import" && argc>=4)
+	{
+        uint32_t symbols = (argc>=5) ? atoi(argv[4]) : 1;
+        return importWaveformText(argv[2], argv[3], symbols) ? 0 : 1;
+    }
+    if(cmd=="convert" && argc>=4)
+	{
+        // Re-encodes every sample; cq15 gets the block exponent that fits the peak
+        SampleFormat format;
+        string name = (argc>=5) ? argv[4] : DEFAULT_SAMPLE_FORMAT;
+        if(!parseSampleFormat(name, format))
+		{
+            cerr<<"Unknown sample format: "<<name<<endl;
+            return 1;
+        }
+        MappedWaveform wave;
+        vector<complex<double>> samples;
+        if(wave.open(argv[2])) samples.resize(wave.sampleCount());
+        if(!wave.isOpen() || !wave.readSamples(0, samples.size(), samples.data()))
+		{
+            cerr<<argv[2]<<" is not a waveform file"<<endl;
+            return 1;
+        }
+        return writeWaveformAs(argv[3], format, samples.data(), samples.size(), wave.symbolCount(), wave.header().sequence) ? 0 : 1;
+    }
+    cerr<<"Unknown command: "<<cmd<<endl;
+    return 1;
+}
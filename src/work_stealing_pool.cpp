@@ -0,0 +1,108 @@
+#include "work_stealing_pool.h"
+
+static thread_local int workerIndex = -1;
+
+WorkStealingPool::WorkStealingPool(int threads)
+    : queued(0), pending(0), nextWorker(0), stopping(false)
+{
+    if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+    if (threads <= 0) threads = 1;
+    for (int i = 0; i < threads; i++)
+        workers.push_back(std::unique_ptr<Worker>(new Worker()));
+    for (int i = 0; i < threads; i++)
+        threadList.push_back(std::thread(&WorkStealingPool::run, this, i));
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(idleMtx);
+        stopping = true;
+    }
+    idleCv.notify_all();
+    for (size_t i = 0; i < threadList.size(); i++)
+        threadList[i].join();
+}
+
+int WorkStealingPool::currentWorker()
+{
+    return workerIndex;
+}
+
+void WorkStealingPool::submit(Task task)
+{
+    int target = workerIndex;
+    if (target < 0)
+        target = (int)(nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size());
+
+    pending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(workers[target]->mtx);
+        workers[target]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(idleMtx);
+        queued++;
+    }
+    idleCv.notify_one();
+}
+
+bool WorkStealingPool::tryPop(int index, Task& task)
+{
+    // Own deque first, newest task
+    {
+        Worker& own = *workers[index];
+        std::lock_guard<std::mutex> lock(own.mtx);
+        if (!own.tasks.empty())
+		{
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    // Then steal the oldest task of the next non-empty worker
+    int n = (int)workers.size();
+    for (int k = 1; k < n; k++)
+	{
+        Worker& victim = *workers[(index + k) % n];
+        std::lock_guard<std::mutex> lock(victim.mtx);
+        if (!victim.tasks.empty())
+		{
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run(int index)
+{
+    workerIndex = index;
+    for (;;)
+	{
+        {
+            std::unique_lock<std::mutex> lock(idleMtx);
+            idleCv.wait(lock, [this] { return stopping || queued > 0; });
+            if (queued == 0) return;    // stopping with nothing left
+            queued--;                   // claims one task somewhere in the deques
+        }
+
+        Task task;
+        while (!tryPop(index, task))
+            std::this_thread::yield();  // every claim is backed by a queued task, so this only spins on contention
+        task();
+
+        if (pending.fetch_sub(1) == 1)
+		{
+            std::lock_guard<std::mutex> lock(idleMtx);
+            doneCv.notify_all();
+        }
+    }
+}
+
+void WorkStealingPool::wait()
+{
+    std::unique_lock<std::mutex> lock(idleMtx);
+    doneCv.wait(lock, [this] { return pending.load() == 0; });
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own task deque. A worker runs its
+// newest task first and, when its deque is empty, steals the oldest task of
+// another worker. Tasks submitted from inside a task go to the current worker's
+// deque, so follow-up work stays on the thread that has the data in cache.
+class WorkStealingPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    // threads <= 0 uses every hardware thread
+    explicit WorkStealingPool(int threads);
+    ~WorkStealingPool();
+
+    void submit(Task task);
+
+    // Blocks until every submitted task, including ones they submit, has run
+    void wait();
+
+    int threads() const { return (int)workers.size(); }
+
+    // Index of the calling worker, or -1 outside the pool
+    static int currentWorker();
+
+private:
+    struct Worker
+    {
+        std::mutex mtx;
+        std::deque<Task> tasks;
+    };
+
+    void run(int index);
+    bool tryPop(int index, Task& task);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threadList;
+    std::mutex idleMtx;
+    std::condition_variable idleCv;     // tasks queued or stopping
+    std::condition_variable doneCv;     // pending reached 0
+    int queued;                         // tasks sitting in deques, guarded by idleMtx
+    std::atomic<int> pending;           // queued + running
+    std::atomic<unsigned> nextWorker;   // round-robin target for outside submits
+    bool stopping;
+};
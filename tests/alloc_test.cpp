@@ -0,0 +1,135 @@
+#include "signal_processing.h"
+#include "base_station_core.h"
+#include "bs_pipeline.h"
+#include "transport.h"
+#include "user_link.h"
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// Steady-state heap allocations of the user and base-station loops. A base
+// station pipeline and a user terminal run over their own shared-memory
+// transport; once the user holds a grant and has relayed a few messages to
+// itself, further relays must not allocate on either side.
+
+static std::atomic<uint64_t> heapAllocs(0);
+
+void* operator new(size_t size)
+{
+    heapAllocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+#if defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+#if defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+constexpr int USER_ID = 1;
+constexpr int WARMUP_MESSAGES = 20;
+constexpr int MEASURED_MESSAGES = 200;
+constexpr int REPLY_TIMEOUT_MS = 1000;
+
+struct UserSide
+{
+    explicit UserSide(Transport& link)
+        : link(link), terminal(legacyLayout(), USER_ID), rxWave(FFT_SIZE), rxActive(FREQ_BINS),
+          txWave(FFT_SIZE), active(FREQ_BINS), txSymbols(0) {}
+
+    // Decodes downlinks until done() holds; false on a timeout
+    template<typename Done>
+    bool receiveUntil(Done done)
+    {
+        ControlMessage msg;
+        while (!done())
+		{
+            if (!receiveDownlink(link, terminal, rxWave.data(), rxActive.data(), REPLY_TIMEOUT_MS, msg)) return false;
+        }
+        return true;
+    }
+
+    // Sends text to itself through the base station and waits for the relay
+    bool relay(const std::string& text)
+    {
+        if (!terminal.sendData(USER_ID, (const uint8_t*)text.data(), text.size())) return false;
+        while (terminal.dataPending())
+		{
+            terminal.nextDataTx(active.data());
+            sendUplink(link, USER_ID, active.data(), txWave.data(), txSymbols, 0);
+        }
+        return receiveUntil([this]() { return terminal.completedMessage() != nullptr; });
+    }
+
+    Transport& link;
+    UserTerminal terminal;
+    std::vector<std::complex<double>> rxWave, rxActive, txWave, active;
+    uint64_t txSymbols;
+};
+
+int main()
+{
+    // Its own region, so a running base station is left alone, and a fixed
+    // noise seed, so every run sees the same channel
+#ifdef _WIN32
+    _putenv_s("OFDMA_SHM_NAME", "ofdma_alloc_test");
+    _putenv_s("OFDMA_NOISE_SEED", "7");
+#else
+    setenv("OFDMA_SHM_NAME", "ofdma_alloc_test", 1);
+    setenv("OFDMA_NOISE_SEED", "7", 1);
+#endif
+    std::unique_ptr<Transport> bsLink = createTransport(TRANSPORT_SHM, FFT_SIZE, true);
+    std::unique_ptr<Transport> userLink = bsLink ? createTransport(TRANSPORT_SHM, FFT_SIZE, false) : nullptr;
+    if (!userLink)
+	{
+        std::cerr << "alloc_test: no shared-memory transport" << std::endl;
+        return 1;
+    }
+
+    BaseStation bs(legacyLayout());
+    BaseStationPipeline pipeline(bs, *bsLink, 1, 1, 64);
+    pipeline.start();
+    UserSide user(*userLink);
+
+    user.terminal.accessRequest(3, user.active.data());
+    sendUplink(*userLink, USER_ID, user.active.data(), user.txWave.data(), user.txSymbols, 0);
+    bool ok = user.receiveUntil([&user]() { return user.terminal.hasAllocation(); });
+
+    // Reassembly buffers, pools and transforms size themselves on first use
+    const std::string text = "42";
+    for (int i = 0; ok && i < WARMUP_MESSAGES; i++)
+        ok = user.relay(text);
+
+    uint64_t allocs0 = heapAllocs.load();
+    int relayed = 0;
+    for (; ok && relayed < MEASURED_MESSAGES; relayed++)
+        ok = user.relay(text);
+    uint64_t allocs = heapAllocs.load() - allocs0;
+    pipeline.stop();
+
+    if (!ok)
+	{
+        std::cerr << "alloc_test: a relay went unanswered after " << relayed << " messages" << std::endl;
+        return 1;
+    }
+    if (allocs > 0)
+	{
+        std::cerr << "alloc_test: " << allocs << " heap allocations over " << relayed << " relayed messages" << std::endl;
+        return 1;
+    }
+    std::cout << "alloc_test: " << relayed << " relayed messages, no heap allocations" << std::endl;
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include "bin_allocator.h"
+#include <iostream>
+#ifndef _WIN32
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// BinAllocator: first-fit and best-fit pick the runs they promise, released
+// bins merge with their free neighbours whatever the order, allocateAt takes
+// only free bins, and releasing a free bin trips the assert.
+
+constexpr int BINS = 128;
+constexpr int RESERVED = 4;
+
+int main()
+{
+    int failures = 0;
+    int checks = 0;
+    auto check = [&](const char* what, bool ok) {
+        checks++;
+        if (!ok)
+		{
+            std::cerr << "FAIL " << what << std::endl;
+            failures++;
+        }
+    };
+
+    // Reserved bins are never handed out
+    BinAllocator bins(BINS, RESERVED);
+    check("reserved bins", bins.freeBins() == BINS - RESERVED && bins.freeRuns() == 1 && !bins.isFree(RESERVED - 1));
+
+    // Cut the bins into a row of extents, then free every other one
+    std::vector<BinExtent> row;
+    for (int count = 1; bins.freeBins() > 0; count = count % 8 + 1)
+        row.push_back(bins.allocate(count));
+    bool packed = row[0].start == RESERVED;
+    for (size_t i = 1; i < row.size(); i++)
+        packed = packed && row[i].start == row[i - 1].start + row[i - 1].count;
+    check("first fit packs from the lowest bin", packed && bins.freeRuns() == 0);
+    for (size_t i = 0; i < row.size(); i += 2)
+        bins.release(row[i].start, row[i].count);
+    check("released extents stay apart", bins.freeRuns() == (int)(row.size() + 1) / 2);
+
+    // Best fit takes the shortest run that fits; first fit the lowest
+    int shortest = -1, lowest = -1;
+    for (size_t i = 0; i < row.size(); i += 2)
+	{
+        if (row[i].count >= 3 && lowest < 0) lowest = row[i].start;
+        if (row[i].count == 3 && shortest < 0) shortest = row[i].start;
+    }
+    BinAllocator best = bins;
+    best.setPolicy(ALLOC_BEST_FIT);
+    BinExtent b = best.allocate(3);
+    BinExtent f = bins.allocate(3);
+    check("best fit", b.start == shortest && b.count == 3);
+    check("first fit", f.start == lowest && f.count == 3);
+    bins.release(f.start, f.count);
+
+    // Releasing the rest in reverse merges everything back into one run
+    for (size_t i = row.size() - (row.size() % 2 ? 2 : 1); i < row.size(); i -= 2)
+        bins.release(row[i].start, row[i].count);
+    check("coalesced on release", bins.freeRuns() == 1 && bins.largestFree() == BINS - RESERVED &&
+                                  bins.freeBins() == BINS - RESERVED);
+
+    // A request longer than any run gets the longest one
+    BinAllocator split(16, 0);
+    split.allocateAt(5, 1);
+    BinExtent longest = split.allocate(12);
+    check("longest run when none fits", longest.start == 6 && longest.count == 10);
+
+    // allocateAt takes exactly the bins asked for, and only free ones
+    BinAllocator at(16, 0);
+    check("allocateAt", at.allocateAt(4, 4) && !at.isFree(4) && !at.isFree(7) && at.isFree(3) && at.isFree(8) &&
+                        at.freeRuns() == 2);
+    check("allocateAt over used bins", !at.allocateAt(6, 4) && !at.allocateAt(0, 5) && at.freeBins() == 12);
+    at.release(5, 2);
+    check("partial release", at.freeRuns() == 3 && at.freeBins() == 14 && at.allocateAt(5, 2));
+
+#if !defined(_WIN32) && !defined(NDEBUG)
+    // Releasing bins twice must abort rather than corrupt the run index
+    pid_t child = fork();
+    if (child == 0)
+	{
+        BinAllocator twice(16, 0);
+        BinExtent ext = twice.allocate(4);
+        twice.release(ext.start, ext.count);
+        close(2);   // keep the assert's message out of the test output
+        twice.release(ext.start, ext.count);
+        _exit(0);
+    }
+    int status = 0;
+    check("double free asserts", child > 0 && waitpid(child, &status, 0) == child && WIFSIGNALED(status) &&
+                                 WTERMSIG(status) == SIGABRT);
+#endif
+
+    if (failures)
+	{
+        std::cerr << "bin_allocator_test: " << failures << " of " << checks << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "bin_allocator_test: " << checks << " checks passed" << std::endl;
+    return 0;
+}
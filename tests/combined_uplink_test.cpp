@@ -0,0 +1,279 @@
+#include "signal_processing.h"
+#include "base_station_core.h"
+#include "combined_uplink.h"
+#include "user_core.h"
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <set>
+
+// The combined uplink without noise: every allocatable bin owns one scheduled
+// header slot a cycle and shares it with no other bin, two access requests in
+// one TTI collide and neither is granted, a message goes on through a quiet
+// TTI but not through COMBINED_QUIET_TTIS of them, and users sending messages
+// back to back deliver about as many over a combined uplink as over a symbol
+// each.
+
+constexpr int USERS = 20;
+constexpr int GRANT_BINS = 3;
+constexpr int MESSAGE_BYTES = 256;
+constexpr int RELAY_TTIS = 20000;
+// Least share of the per-symbol uplink's messages a combined one must deliver.
+// A 3-bin grant's slots come about a third of the 108-TTI cycle apart, so a
+// message waits about 18 TTIs for one, against about 175 TTIs to send an
+// average message: about 0.91 expected.
+constexpr double MIN_COMBINED_SHARE = 0.85;
+
+// A base station and its users, each downlink delivered as soon as it is made
+class Cell
+{
+public:
+    Cell(const FrameLayout& layout, int users, bool combine)
+        : layout(layout), bs(layout), combine(combine), tti(0), any(false), sum(layout.bins), active(layout.bins),
+          messages(users), segments(users, 0), sent(users, 0), got(users)
+    {
+        bs.setMaxMessage(MESSAGE_BYTES);
+        bs.setUplinkCombine(combine);
+        for (int u = 0; u < users; u++)
+		{
+            terminals.push_back(UserTerminal(layout, u));
+            terminals.back().setUplinkCombine(combine);
+            terminals.back().setReceiveCapacity(MESSAGE_BYTES);
+        }
+    }
+
+    // Grants every user `bins` bins, one access request per TTI
+    bool grantAll(int bins)
+    {
+        bool granted = true;
+        for (size_t u = 0; u < terminals.size(); u++)
+		{
+            while (!turn((int)u, CTRL_ACCESS_REQUEST))
+                endTti();
+            terminals[u].accessRequest(bins, active.data());
+            transmit();
+            endTti();
+            granted = granted && terminals[u].allocCount() == bins;
+        }
+        return granted;
+    }
+
+    // Each user sends messages back to back to the next user for ttis TTIs,
+    // leaving out the TTIs quiet picks
+    void stream(int ttis, const std::function<bool(int)>& quiet = std::function<bool(int)>())
+    {
+        for (int t = 0; t < ttis; t++)
+		{
+            for (size_t u = 0; u < terminals.size(); u++)
+			{
+                UserTerminal& term = terminals[u];
+                if ((quiet && quiet((int)u)) || !turn((int)u, CTRL_DATA_TX)) continue;
+                if (!term.dataPending()) start((int)u);
+                term.nextDataTx(active.data());
+                segments[u]++;
+                transmit();
+            }
+            endTti();
+        }
+    }
+
+    // Ends the TTI: its combined symbol, if anyone sent one, reaches the base station
+    void endTti()
+    {
+        if (combine && any)
+		{
+            bs.handleUplink(sum.data(), out);
+            deliver();
+        }
+        std::fill(sum.begin(), sum.end(), std::complex<double>(0, 0));
+        any = false;
+        tti++;
+    }
+
+    // Whether user u may send a symbol for ctrl in this TTI
+    bool turn(int u, int ctrl)
+    {
+        if (terminals[u].headerTti(ctrl, tti) != tti) return false;
+        terminals[u].setUplinkTti(tti);
+        return true;
+    }
+
+    // The symbol in active goes on the air
+    void transmit()
+    {
+        if (!combine)
+		{
+            bs.handleUplink(active.data(), out);
+            deliver();
+            return;
+        }
+        for (int b = 0; b < layout.bins; b++)
+            sum[b] += active[b];
+        any = true;
+    }
+
+    // Messages that arrived intact, and whether message k from src did
+    int intact() const
+    {
+        int n = 0;
+        for (size_t u = 0; u < got.size(); u++)
+            n += (int)std::count(got[u].begin(), got[u].end(), true);
+        return n;
+    }
+    bool arrived(int src, int k) const { return k < (int)got[src].size() && got[src][k]; }
+    int segmentsOf(int u) const { return segments[u]; }
+
+    FrameLayout layout;
+    BaseStation bs;
+    std::vector<UserTerminal> terminals;
+
+private:
+    // Message k from src: its number, then bytes the receiver can check
+    static size_t lengthOf(int src, int k)
+    {
+        return 4 + (size_t)(src * 37 + k * 101) % (MESSAGE_BYTES - 3);
+    }
+    static uint8_t byteOf(int src, int k, size_t i)
+    {
+        return i < 4 ? (uint8_t)(k >> (8 * i)) : (uint8_t)(src * 31 + k * 7 + i);
+    }
+
+    void start(int u)
+    {
+        int k = sent[u]++;
+        std::vector<uint8_t>& bytes = messages[u];
+        bytes.resize(lengthOf(u, k));
+        for (size_t i = 0; i < bytes.size(); i++)
+            bytes[i] = byteOf(u, k, i);
+        segments[u] = 0;
+        terminals[u].sendData((u + 1) % (int)terminals.size(), bytes.data(), bytes.size());
+    }
+
+    void deliver()
+    {
+        for (size_t i = 0; i < out.size(); i++)
+		{
+            encodeControl(layout, out[i].msg, active.data());
+            UserTerminal& term = terminals[out[i].userId];
+            term.handleDownlink(active.data());
+            const RxMessage* rx = term.completedMessage();
+            if (!rx || rx->length < 4) continue;
+            int k = rx->data[0] | rx->data[1] << 8 | rx->data[2] << 16 | rx->data[3] << 24;
+            bool ok = k >= 0 && k < sent[rx->srcId] && rx->length == lengthOf(rx->srcId, k);
+            for (size_t b = 0; ok && b < rx->length; b++)
+                ok = rx->data[b] == byteOf(rx->srcId, k, b);
+            if (!ok) continue;
+            if ((int)got[rx->srcId].size() <= k) got[rx->srcId].resize(k + 1, false);
+            got[rx->srcId][k] = true;
+        }
+        out.clear();
+    }
+
+    bool combine;
+    uint64_t tti;
+    bool any;
+    std::vector<std::complex<double>> sum, active;
+    std::vector<std::vector<uint8_t>> messages;    // being sent, read in place
+    std::vector<int> segments;                     // of the message being sent
+    std::vector<int> sent;
+    std::vector<std::vector<bool>> got;
+    std::vector<Downlink> out;
+};
+
+// Every allocatable bin owns one (TTI, slot) of the cycle, none shared, off
+// the access slot; a grant's next header TTI is the first in which it owns one
+static bool scheduleHolds(const FrameLayout& layout)
+{
+    const int slots = combinedControlSlots(layout);
+    const int cycle = combinedHeaderCycle(layout);
+    std::set<std::pair<int,int>> owned;
+    bool ok = true;
+    for (int b = combinedControlBins(layout); b < layout.bins; b++)
+	{
+        int turns = 0;
+        for (int t = 0; t < cycle; t++)
+		{
+            int slot = combinedScheduledSlot(layout, b, 1, t);
+            if (slot < 0) continue;
+            turns++;
+            ok = ok && owned.insert(std::make_pair(t, slot)).second && combinedOwnsSlot(layout, b, 1, slot) &&
+                 (slots > 1 ? slot > 0 : !combinedAccessTti(layout, t));
+        }
+        ok = ok && turns == 1;
+    }
+    for (int t = 0; t < cycle; t++)
+	{
+        const int start = combinedControlBins(layout) + t % (layout.bins - combinedControlBins(layout) - 2);
+        uint64_t next = combinedNextHeaderTti(layout, start, 3, t);
+        ok = ok && combinedScheduledSlot(layout, start, 3, next) >= 0;
+        for (uint64_t s = t; ok && s < next; s++)
+            ok = combinedScheduledSlot(layout, start, 3, s) < 0;
+    }
+    return ok;
+}
+
+int main()
+{
+    int failures = 0;
+    int checks = 0;
+    auto check = [&](const char* what, bool ok) {
+        checks++;
+        if (!ok)
+		{
+            std::cerr << "FAIL " << what << std::endl;
+            failures++;
+        }
+    };
+
+    const FrameLayout layout = makeFrameLayout(1024, 128, 6);
+    check("schedule on 64/8", scheduleHolds(legacyLayout()));
+    check("schedule on 256/32", scheduleHolds(makeFrameLayout(256, 32, 6)));
+    check("schedule on 1024/128", scheduleHolds(layout));
+    check("schedule on 2048/1200", scheduleHolds(makeFrameLayout(2048, 1200, 12)));
+
+    // Two access requests in one TTI garble each other
+	{
+        Cell cell(layout, 2, true);
+        std::vector<std::complex<double>> a(layout.bins), b(layout.bins);
+        check("access slot every TTI", cell.turn(0, CTRL_ACCESS_REQUEST) && cell.turn(1, CTRL_ACCESS_REQUEST));
+        cell.terminals[0].accessRequest(GRANT_BINS, a.data());
+        cell.terminals[1].accessRequest(GRANT_BINS, b.data());
+        for (int i = 0; i < layout.bins; i++)
+            a[i] += b[i];
+        std::vector<Downlink> out;
+        cell.bs.handleUplink(a.data(), out);
+        check("colliding access requests", out.empty() && cell.bs.controlCollisions() == 1);
+        check("one at a time", cell.grantAll(GRANT_BINS));
+    }
+
+    // A quiet TTI in the middle of a message, then COMBINED_QUIET_TTIS of them
+    for (int quietTtis = 1; quietTtis <= COMBINED_QUIET_TTIS; quietTtis += COMBINED_QUIET_TTIS - 1)
+	{
+        Cell cell(layout, 2, true);
+        bool granted = cell.grantAll(1);
+        int left = quietTtis;
+        cell.stream(400, [&](int u) { return u == 0 && cell.segmentsOf(0) == 5 && left-- > 0; });
+        if (quietTtis == 1)
+            check("message through a quiet TTI", granted && cell.arrived(0, 0) && cell.arrived(1, 0));
+        else
+            check("message ended by quiet TTIs", granted && !cell.arrived(0, 0) && cell.arrived(1, 0));
+    }
+
+    // Messages back to back from every user, per symbol and combined
+    Cell perSymbol(layout, USERS, false), combined(layout, USERS, true);
+    check("grants", perSymbol.grantAll(GRANT_BINS) && combined.grantAll(GRANT_BINS));
+    perSymbol.stream(RELAY_TTIS);
+    combined.stream(RELAY_TTIS);
+    std::cout << "combined_uplink_test: " << USERS << " users over " << RELAY_TTIS << " TTIs delivered "
+              << combined.intact() << " messages combined, " << perSymbol.intact() << " with a symbol each" << std::endl;
+    check("combined uplink delivers about as many messages",
+          combined.intact() >= MIN_COMBINED_SHARE * perSymbol.intact() && combined.bs.controlCollisions() == 0);
+
+    if (failures)
+	{
+        std::cerr << "combined_uplink_test: " << failures << " of " << checks << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "combined_uplink_test: " << checks << " checks passed" << std::endl;
+    return 0;
+}
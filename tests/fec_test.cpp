@@ -0,0 +1,103 @@
+#include "signal_processing.h"
+#include "base_station_core.h"
+#include "noise.h"
+#include "user_core.h"
+#include <algorithm>
+#include <iostream>
+
+// End-to-end delivery with and without payload coding. A user relays messages
+// to itself through a base station over the channel the processes use, noise
+// on both the uplink and the downlink; every segment carries an uncoded
+// header, so coding must still deliver more messages intact than no coding.
+
+constexpr int USER_ID = 1;
+constexpr int MESSAGES = 200;
+constexpr int MESSAGE_BYTES = 16;
+
+struct Channel
+{
+    Channel() : wave(FFT_SIZE), rx(FREQ_BINS), symbols(0) {}
+
+    // The active bins after the transform, the channel noise and back
+    const std::complex<double>* pass(const std::complex<double>* active, uint32_t link)
+    {
+        muxActiveBins(active, wave.data());
+        addAWGN(wave.data(), FFT_SIZE, NOISE_VARIANCE, noiseKey(link, symbols++));
+        demuxActiveBins(wave.data(), rx.data());
+        return rx.data();
+    }
+
+    std::vector<std::complex<double>> wave, rx;
+    uint64_t symbols;
+};
+
+// Messages of MESSAGES that came back intact
+static int delivered(FecRate fec)
+{
+    BaseStation bs(legacyLayout());
+    bs.setLog(nullptr);
+    bs.setFec(fec);
+    UserTerminal terminal(legacyLayout(), USER_ID);
+    terminal.setFec(fec);
+    Channel up, down;
+    std::vector<std::complex<double>> active(FREQ_BINS);
+    std::vector<Downlink> out;
+
+    int intact = 0;
+    uint8_t message[MESSAGE_BYTES];
+
+    // Delivers the base station's downlinks, counting the message if one completes it
+    auto downlinks = [&]() {
+        for (size_t i = 0; i < out.size(); i++)
+		{
+            encodeControl(legacyLayout(), out[i].msg, active.data());
+            terminal.handleDownlink(down.pass(active.data(), downlinkNoise(USER_ID)));
+            const RxMessage* rx = terminal.completedMessage();
+            if (rx && rx->length == MESSAGE_BYTES && std::equal(message, message + MESSAGE_BYTES, rx->data))
+                intact++;
+        }
+        out.clear();
+    };
+
+    for (int m = 0; m < MESSAGES; m++)
+	{
+        // A header the noise turned into a deallocation costs the grant; ask
+        // again until one gets through
+        for (int tries = 0; tries < 10 && !terminal.hasAllocation(); tries++)
+		{
+            terminal.accessRequest(3, active.data());
+            bs.handleUplink(up.pass(active.data(), uplinkNoise(USER_ID)), out);
+            downlinks();
+        }
+        for (int i = 0; i < MESSAGE_BYTES; i++)
+            message[i] = (uint8_t)(m * 31 + i * 7);
+        terminal.sendData(USER_ID, message, MESSAGE_BYTES);
+        while (terminal.dataPending())
+		{
+            terminal.nextDataTx(active.data());
+            bs.handleUplink(up.pass(active.data(), uplinkNoise(USER_ID)), out);
+            downlinks();
+        }
+    }
+    return intact;
+}
+
+int main()
+{
+    setNoiseSeed(7);
+    int uncoded = delivered(FEC_NONE);
+    int failures = 0;
+    const FecRate rates[] = { FEC_1_2, FEC_3_4 };
+    for (FecRate fec : rates)
+	{
+        int coded = delivered(fec);
+        std::cout << "fec_test: rate " << fecRateName(fec) << " delivered " << coded << " of " << MESSAGES
+                  << " messages, uncoded " << uncoded << std::endl;
+        if (coded <= uncoded)
+		{
+            std::cerr << "FAIL rate " << fecRateName(fec) << ": coding delivered no more than the uncoded link" << std::endl;
+            failures++;
+        }
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,84 @@
+#define _USE_MATH_DEFINES
+#include "signal_processing.h"
+#include "noise.h"
+#include <cmath>
+#include <iostream>
+
+// The radix-2/4 FFT and IFFT against a textbook DFT, for every plan size the
+// numerologies use and a few around them, in place and out of place.
+
+static std::vector<std::complex<double>> referenceDft(const std::vector<std::complex<double>>& x, int sign)
+{
+    const int n = (int)x.size();
+    std::vector<std::complex<double>> y(n);
+    for (int k = 0; k < n; k++)
+	{
+        std::complex<double> acc = 0;
+        for (int i = 0; i < n; i++)
+            acc += x[i] * std::polar(1.0, sign * 2 * M_PI * (double)((long long)k * i % n) / n);
+        y[k] = sign > 0 ? acc / (double)n : acc;
+    }
+    return y;
+}
+
+static double maxError(const std::vector<std::complex<double>>& a, const std::vector<std::complex<double>>& b)
+{
+    double err = 0;
+    for (size_t i = 0; i < a.size(); i++)
+        err = std::max(err, std::abs(a[i] - b[i]));
+    return err;
+}
+
+int main()
+{
+    int failures = 0;
+    int checks = 0;
+    auto check = [&](const char* what, int n, double err) {
+        checks++;
+        // Unit-variance input; rounding grows with log2(n)
+        if (err > 1e-9)
+		{
+            std::cerr << "FAIL " << what << " n=" << n << ": max error " << err << std::endl;
+            failures++;
+        }
+    };
+
+    for (int n = 1; n <= 2048; n *= 2)
+	{
+        std::vector<std::complex<double>> x(n);
+        NoiseStream noise(noiseKey(1, (uint64_t)n));
+        for (int i = 0; i < n; i++)
+            x[i] = std::complex<double>(noise.normal(), noise.normal());
+        std::vector<std::complex<double>> X = referenceDft(x, -1);
+        std::vector<std::complex<double>> xBack = referenceDft(X, 1);
+
+        const FftPlan& plan = fftPlan(n);
+        std::vector<std::complex<double>> out(n);
+        fft(plan, x.data(), out.data());
+        check("fft", n, maxError(out, X));
+        ifft(plan, X.data(), out.data());
+        check("ifft", n, maxError(out, xBack));
+
+        out = x;
+        fftInPlace(plan, out.data());
+        check("fftInPlace", n, maxError(out, X));
+        ifftInPlace(plan, out.data());
+        check("round trip", n, maxError(out, x));
+
+        check("fft(vector)", n, maxError(fft(x), X));
+    }
+
+    // Sizes the plans do not cover fall back to the direct DFT
+    std::vector<std::complex<double>> odd(12);
+    for (size_t i = 0; i < odd.size(); i++)
+        odd[i] = std::complex<double>((double)i, -(double)i / 2);
+    check("fft(vector) non-power-of-two", 12, maxError(fft(odd), referenceDft(odd, -1)));
+
+    if (failures)
+	{
+        std::cerr << "fft_test: " << failures << " of " << checks << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "fft_test: " << checks << " checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include "segment.h"
+#include <algorithm>
+#include <iostream>
+
+// Message segmentation and reassembly: messages of any segment size come back
+// intact, sequence numbers wrap through 1..seqMask across long messages, a
+// missing segment drops its message until the next one starts, a message
+// longer than the buffer is reported without writing past it, and a coded
+// stream decodes through one missing segment but not two.
+
+constexpr int SEQ_BITS = 2;
+constexpr size_t CAPACITY = 64;
+
+struct Segment
+{
+    int seq;
+    int payload;
+};
+
+static std::vector<uint8_t> message(size_t length, int key)
+{
+    std::vector<uint8_t> bytes(length);
+    for (size_t i = 0; i < length; i++)
+        bytes[i] = (uint8_t)(key * 37 + i * 11);
+    return bytes;
+}
+
+static std::vector<Segment> segments(const std::vector<uint8_t>& bytes, int segmentBits, FecRate fec = FEC_NONE)
+{
+    Segmenter tx;
+    std::vector<Segment> out;
+    if (!tx.start(bytes.data(), bytes.size(), segmentBits, SEQ_BITS, fec)) return out;
+    while (!tx.done())
+	{
+        Segment s;
+        tx.next(s.seq, s.payload);
+        out.push_back(s);
+    }
+    return out;
+}
+
+// Feeds segments, skipping the ones in drop; the status of the last one
+static SegmentStatus feed(Reassembler& rx, const std::vector<Segment>& in, int segmentBits,
+                          const std::vector<size_t>& drop = std::vector<size_t>())
+{
+    SegmentStatus status = SEGMENT_PARTIAL;
+    for (size_t i = 0; i < in.size(); i++)
+        if (std::find(drop.begin(), drop.end(), i) == drop.end())
+            status = rx.accept(in[i].seq, in[i].payload, segmentBits);
+    return status;
+}
+
+static bool holds(const Reassembler& rx, const std::vector<uint8_t>& bytes)
+{
+    return rx.length() == bytes.size() && std::equal(bytes.begin(), bytes.end(), rx.data());
+}
+
+int main()
+{
+    int failures = 0;
+    int checks = 0;
+    auto check = [&](const char* what, bool ok) {
+        checks++;
+        if (!ok)
+		{
+            std::cerr << "FAIL " << what << std::endl;
+            failures++;
+        }
+    };
+
+    // Every segment size, including ones that straddle bytes
+    bool intact = true;
+    for (int bits = 1; bits <= SEGMENT_MAX_BITS; bits++)
+	{
+        std::vector<uint8_t> bytes = message(bits + 5, bits);
+        ReassemblyBuffer buf(CAPACITY, SEQ_BITS);
+        std::vector<Segment> in = segments(bytes, bits);
+        intact = intact && in.size() == segmentCount(bytes.size(), bits) && feed(buf.rx, in, bits) == SEGMENT_COMPLETE &&
+                 holds(buf.rx, bytes);
+    }
+    check("round trip at every segment size", intact);
+    ReassemblyBuffer empty(CAPACITY, SEQ_BITS);
+    check("empty message", feed(empty.rx, segments(std::vector<uint8_t>(), 5), 5) == SEGMENT_COMPLETE &&
+                           empty.rx.length() == 0);
+
+    // Sequence numbers: 0 opens, then 1..3 over and over
+    const int seqMask = (1 << SEQ_BITS) - 1;
+    std::vector<uint8_t> longMessage = message(CAPACITY, 1);
+    std::vector<Segment> in = segments(longMessage, 2);
+    bool wraps = in.size() > 100 && in[0].seq == 0;
+    for (size_t i = 1; i < in.size(); i++)
+        wraps = wraps && in[i].seq == 1 + (int)((i - 1) % seqMask);
+    check("sequence numbers wrap through 1..seqMask", wraps);
+    ReassemblyBuffer wrapped(CAPACITY, SEQ_BITS);
+    check("message across many wraps", feed(wrapped.rx, in, 2) == SEGMENT_COMPLETE && holds(wrapped.rx, longMessage));
+
+    // A gap drops the message, and the segments after it, until a new one starts
+	{
+        ReassemblyBuffer buf(CAPACITY, SEQ_BITS);
+        std::vector<uint8_t> first = message(20, 2), second = message(12, 3);
+        std::vector<Segment> a = segments(first, 6), b = segments(second, 6);
+        SegmentStatus status = SEGMENT_PARTIAL;
+        bool lostAfter = true;
+        for (size_t i = 0; i < a.size(); i++)
+		{
+            if (i == 5) continue;
+            status = buf.rx.accept(a[i].seq, a[i].payload, 6);
+            if (i == 6) check("gap detected", status == SEGMENT_LOST);
+            if (i > 6) lostAfter = lostAfter && status == SEGMENT_LOST;
+        }
+        check("rest of the message dropped", lostAfter);
+        check("next message", feed(buf.rx, b, 6) == SEGMENT_COMPLETE && holds(buf.rx, second));
+
+        // A restart in the middle of a message abandons the old one
+        std::vector<Segment> restarted(a.begin(), a.begin() + 4);
+        restarted.insert(restarted.end(), b.begin(), b.end());
+        check("restart mid-message", feed(buf.rx, restarted, 6) == SEGMENT_COMPLETE && holds(buf.rx, second));
+    }
+
+    // A message longer than the buffer is skipped without touching past it
+	{
+        uint8_t buffer[CAPACITY + 8];
+        std::fill(buffer, buffer + sizeof(buffer), 0xa5);
+        Reassembler rx(buffer, CAPACITY, SEQ_BITS);
+        std::vector<uint8_t> big = message(CAPACITY + 40, 4), small = message(CAPACITY, 5);
+        check("too long", feed(rx, segments(big, 8), 8) == SEGMENT_TOO_LONG);
+        check("buffer end respected", std::count(buffer + CAPACITY, buffer + sizeof(buffer), 0xa5) == 8);
+        check("full-size message after", feed(rx, segments(small, 8), 8) == SEGMENT_COMPLETE && holds(rx, small));
+
+        Segmenter tx;
+        std::vector<uint8_t> huge(SEGMENT_MAX_MESSAGE + 1);
+        check("segmenter limits", !tx.start(huge.data(), huge.size(), 8, SEQ_BITS) &&
+                                  !tx.start(small.data(), small.size(), 0, SEQ_BITS) &&
+                                  !tx.start(small.data(), small.size(), SEGMENT_MAX_BITS + 1, SEQ_BITS));
+    }
+
+    // A coded stream fills one missing segment with erasures, not two
+	{
+        const int bits = segmentErasableBits(FEC_1_2);
+        std::vector<uint8_t> bytes = message(24, 6);
+        std::vector<Segment> coded = segments(bytes, bits, FEC_1_2);
+        ReassemblyBuffer one(CAPACITY, SEQ_BITS, FEC_1_2), two(CAPACITY, SEQ_BITS, FEC_1_2);
+        std::vector<size_t> lostOne, lostTwo;
+        lostOne.push_back(coded.size() / 2);
+        lostTwo.push_back(coded.size() / 2);
+        lostTwo.push_back(coded.size() / 2 + 1);
+        check("coded stream decodes through one lost segment", feed(one.rx, coded, bits, lostOne) == SEGMENT_COMPLETE &&
+                                                               holds(one.rx, bytes));
+        check("two lost segments drop it", feed(two.rx, coded, bits, lostTwo) == SEGMENT_LOST);
+    }
+
+    if (failures)
+	{
+        std::cerr << "segment_test: " << failures << " of " << checks << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "segment_test: " << checks << " checks passed" << std::endl;
+    return 0;
+}
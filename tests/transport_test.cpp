@@ -0,0 +1,121 @@
+#include "transport.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// The shared-memory transport: a full ring refuses a symbol and gives back the
+// ones it holds in order, a producer thread and a blocked consumer pass a long
+// stream without losing or reordering any, a receive on an empty ring times
+// out, and OFDMA_SHM_NAME keeps regions apart.
+
+constexpr int SAMPLES = 16;
+constexpr int USER_ID = 3;
+constexpr int STREAM_SYMBOLS = 20000;
+constexpr int RECEIVE_TIMEOUT_MS = 2000;
+
+static void setShmName(const char* name)
+{
+#ifdef _WIN32
+    _putenv_s("OFDMA_SHM_NAME", name);
+#else
+    setenv("OFDMA_SHM_NAME", name, 1);
+#endif
+}
+
+// Symbol i: its number and a pattern the receiver can check
+static void fillSymbol(int i, std::complex<double>* samples)
+{
+    for (int k = 0; k < SAMPLES; k++)
+        samples[k] = std::complex<double>(i, k - i);
+}
+
+static bool isSymbol(int i, const std::complex<double>* samples, int count)
+{
+    if (count != SAMPLES) return false;
+    for (int k = 0; k < SAMPLES; k++)
+        if (samples[k] != std::complex<double>(i, k - i)) return false;
+    return true;
+}
+
+int main()
+{
+    int failures = 0;
+    int checks = 0;
+    auto check = [&](const char* what, bool ok) {
+        checks++;
+        if (!ok)
+		{
+            std::cerr << "FAIL " << what << std::endl;
+            failures++;
+        }
+    };
+
+    // Its own region, so a running base station is left alone
+    setShmName("ofdma_transport_test");
+    std::unique_ptr<Transport> bs = createTransport(TRANSPORT_SHM, SAMPLES, true);
+    std::unique_ptr<Transport> user = bs ? createTransport(TRANSPORT_SHM, SAMPLES, false) : nullptr;
+    if (!user)
+	{
+        std::cerr << "transport_test: no shared-memory transport" << std::endl;
+        return 1;
+    }
+    std::complex<double> tx[SAMPLES], rx[SAMPLES];
+
+    // A full ring refuses the next symbol and keeps the ones it has
+    bool sent = true;
+    for (int i = 0; i < SHM_RING_SLOTS; i++)
+	{
+        fillSymbol(i, tx);
+        sent = sent && user->send(BS_ENDPOINT, tx, SAMPLES);
+    }
+    check("fill the ring", sent);
+    fillSymbol(SHM_RING_SLOTS, tx);
+    check("full ring refuses a symbol", !user->send(BS_ENDPOINT, tx, SAMPLES));
+    bool inOrder = true;
+    for (int i = 0; i < SHM_RING_SLOTS; i++)
+        inOrder = inOrder && isSymbol(i, rx, bs->receive(BS_ENDPOINT, rx, SAMPLES, 0));
+    check("full ring drains in order", inOrder);
+    check("drained ring is empty", bs->receive(BS_ENDPOINT, rx, SAMPLES, 0) == 0);
+
+    // An empty ring waits out the timeout
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    int n = user->receive(USER_ID, rx, SAMPLES, 50);
+    check("receive times out", n == 0 && std::chrono::steady_clock::now() - t0 >= std::chrono::milliseconds(40));
+
+    // A producer thread against a consumer that blocks whenever it catches up;
+    // the pauses make it sleep on the wakeup rather than find the next symbol
+    bool producerOk = true;
+    std::thread producer([&]() {
+        std::complex<double> samples[SAMPLES];
+        for (int i = 0; i < STREAM_SYMBOLS && producerOk; i++)
+		{
+            fillSymbol(i, samples);
+            producerOk = bs->send(USER_ID, samples, SAMPLES);
+            if (i % 2000 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    });
+    int received = 0;
+    while (received < STREAM_SYMBOLS && isSymbol(received, rx, user->receive(USER_ID, rx, SAMPLES, RECEIVE_TIMEOUT_MS)))
+        received++;
+    producer.join();
+    check("producer sends every symbol", producerOk);
+    check("consumer receives every symbol in order", received == STREAM_SYMBOLS);
+
+    // Another name is another region
+    setShmName("ofdma_transport_test2");
+    std::unique_ptr<Transport> other = createTransport(TRANSPORT_SHM, SAMPLES, true);
+    fillSymbol(0, tx);
+    check("second region", other && user->send(BS_ENDPOINT, tx, SAMPLES));
+    check("regions kept apart", other && other->receive(BS_ENDPOINT, rx, SAMPLES, 0) == 0 &&
+                                isSymbol(0, rx, bs->receive(BS_ENDPOINT, rx, SAMPLES, 0)));
+
+    if (failures)
+	{
+        std::cerr << "transport_test: " << failures << " of " << checks << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "transport_test: " << checks << " checks passed, " << STREAM_SYMBOLS << " symbols between threads" << std::endl;
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include "waveform_file.h"
+#include "noise.h"
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+// The binary waveform container: what each sample type writes reads back, the
+// cq15 block exponent survives the header, a replaced file leaves an open
+// mapping of the old one readable, and appended symbols drain in order.
+
+static const char* WAVE_FILE = "waveform_test.bin";
+static const char* APPEND_FILE = "waveform_test_append.bin";
+
+constexpr int SYMBOL_SAMPLES = 64;
+constexpr int SYMBOLS = 3;
+
+static double maxError(const std::vector<std::complex<double>>& a, const std::vector<std::complex<double>>& b)
+{
+    if (a.size() != b.size()) return INFINITY;
+    double err = 0;
+    for (size_t i = 0; i < a.size(); i++)
+        err = std::max(err, std::abs(a[i] - b[i]));
+    return err;
+}
+
+// Unit-variance samples scaled by gain
+static std::vector<std::complex<double>> samples(size_t n, double gain, uint64_t key)
+{
+    std::vector<std::complex<double>> x(n);
+    NoiseStream noise(noiseKey(3, key));
+    for (size_t i = 0; i < n; i++)
+        x[i] = gain * std::complex<double>(noise.normal(), noise.normal());
+    return x;
+}
+
+static std::vector<std::complex<double>> readBack(const MappedWaveform& wave)
+{
+    std::vector<std::complex<double>> out(wave.sampleCount());
+    if (!wave.readSamples(0, out.size(), out.data())) out.clear();
+    return out;
+}
+
+int main()
+{
+    int failures = 0;
+    int checks = 0;
+    auto check = [&](const char* what, bool ok) {
+        checks++;
+        if (!ok)
+		{
+            std::cerr << "FAIL " << what << std::endl;
+            failures++;
+        }
+    };
+
+    // Each format round trips within its precision; 6 puts the peak above 2^4
+    const size_t n = SYMBOL_SAMPLES * SYMBOLS;
+    std::vector<std::complex<double>> x = samples(n, 6, 1);
+    int exponent = blockExponent(x.data(), n);
+    const SampleFormat formats[] = { FORMAT_CF64, FORMAT_CF32, FORMAT_CQ15 };
+    const double tolerance[] = { 0, 1e-5, std::ldexp(1.0, exponent - 15) };
+    for (int f = 0; f < 3; f++)
+	{
+        MappedWaveform wave;
+        bool ok = writeWaveformAs(WAVE_FILE, formats[f], x.data(), n, SYMBOLS, 42) && wave.open(WAVE_FILE);
+        check(sampleFormatName(formats[f]), ok);
+        if (!ok) continue;
+        const WaveformHeader& hdr = wave.header();
+        check("header fields", hdr.version == WAVEFORM_VERSION && hdr.sampleType == sampleTypeOf(formats[f]) &&
+                               wave.sampleCount() == n && wave.symbolCount() == SYMBOLS && hdr.sequence == 42);
+        check("block exponent", wave.exponent() == (formats[f] == FORMAT_CQ15 ? exponent : 0));
+        check("samples", maxError(readBack(wave), x) <= tolerance[f]);
+    }
+    check("cq15 exponent above 0", exponent > 0);
+
+    // Replacing the file renames a new one over it; the old mapping keeps its samples
+	{
+        MappedWaveform before;
+        bool ok = writeWaveformFile(WAVE_FILE, x.data(), n, SYMBOLS, 1) && before.open(WAVE_FILE);
+        std::vector<std::complex<double>> y = samples(SYMBOL_SAMPLES, 1, 2);
+        ok = ok && writeWaveformFile(WAVE_FILE, y.data(), y.size(), 1, 2);
+        check("replace", ok);
+        MappedWaveform after;
+        check("old mapping intact", ok && before.header().sequence == 1 && maxError(readBack(before), x) == 0);
+        check("new file", ok && after.open(WAVE_FILE) && after.header().sequence == 2 && maxError(readBack(after), y) == 0);
+    }
+
+    // Truncated containers are refused
+	{
+        MappedWaveform wave;
+        std::vector<std::complex<double>> y = samples(SYMBOL_SAMPLES, 1, 3);
+        bool ok = writeWaveformFile(WAVE_FILE, y.data(), y.size(), 1, 0);
+        if (FILE* f = std::fopen(WAVE_FILE, "r+b"))
+		{
+            WaveformHeader hdr;
+            ok = ok && std::fread(&hdr, sizeof(hdr), 1, f) == 1;
+            hdr.sampleCount += 1;
+            ok = ok && std::fseek(f, 0, SEEK_SET) == 0 && std::fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+            std::fclose(f);
+        }
+        check("truncated file refused", ok && !wave.open(WAVE_FILE));
+    }
+
+    // Appended cq15 symbols drain in order at their exponent, and leave the file empty
+	{
+        std::remove(APPEND_FILE);
+        std::vector<std::complex<double>> sent;
+        bool ok = true;
+        for (int s = 0; s < SYMBOLS; s++)
+		{
+            std::vector<std::complex<double>> y = samples(SYMBOL_SAMPLES, 0.25, 10 + s);
+            std::vector<cq15> q(SYMBOL_SAMPLES);
+            toQ15(y.data(), SYMBOL_SAMPLES, -1, q.data());
+            ok = ok && appendWaveformData(APPEND_FILE, SAMPLE_CQ15, q.data(), SYMBOL_SAMPLES, s, -1);
+            fromQ15(q.data(), SYMBOL_SAMPLES, -1, y.data());
+            sent.insert(sent.end(), y.begin(), y.end());
+        }
+        check("append", ok);
+        std::vector<cq15> other(SYMBOL_SAMPLES);
+        check("append at another exponent refused", !appendWaveformData(APPEND_FILE, SAMPLE_CQ15, other.data(), SYMBOL_SAMPLES, 9, 0));
+
+        std::vector<std::complex<double>> drained;
+        size_t perSymbol = 0;
+        check("drain", drainWaveformData(APPEND_FILE, drained, perSymbol) && perSymbol == SYMBOL_SAMPLES &&
+                       maxError(drained, sent) == 0);
+        check("drained file empty", drainWaveformData(APPEND_FILE, drained, perSymbol) && perSymbol == 0 && drained.empty());
+    }
+
+    std::remove(WAVE_FILE);
+    std::remove(APPEND_FILE);
+    if (failures)
+	{
+        std::cerr << "waveform_test: " << failures << " of " << checks << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "waveform_test: " << checks << " checks passed" << std::endl;
+    return 0;
+}